@@ -36,8 +36,9 @@ Examples:
 }
 
 int main(int argc, char* argv[]) {
-    kbgdb::KnowledgeBase kb;
-    kbgdb::QueryEngine engine(std::make_shared<kbgdb::KnowledgeBase>(kb));
+    auto shared = std::make_shared<kbgdb::KnowledgeBase>();
+    kbgdb::KnowledgeBase& kb = *shared;
+    kbgdb::QueryEngine engine(shared);
     kbgdb::QueryParser parser;
     
     // Load initial file if provided
@@ -152,19 +153,18 @@ int main(int argc, char* argv[]) {
             } else if (line.substr(0, 3) == "?- ") {
                 std::string queryStr = line.substr(3);
                 
-                auto results = kb.query(queryStr);
-                
-                if (results.empty()) {
-                    std::cout << "false." << std::endl;
-                } else {
-                    for (const auto& binding : results) {
-                        if (binding.bindings.empty()) {
-                            std::cout << "true." << std::endl;
-                        } else {
-                            std::cout << binding.toString() << std::endl;
-                        }
+                // Print solutions as they are found
+                auto solutions = kb.cursor(queryStr);
+                while (auto binding = solutions.next()) {
+                    if (binding->bindings.empty()) {
+                        std::cout << "true." << std::endl;
+                    } else {
+                        std::cout << binding->toString() << std::endl;
                     }
                 }
+                if (solutions.count() == 0) {
+                    std::cout << "false." << std::endl;
+                }
             } else {
                 std::cerr << "Unknown command. Type 'help' for available commands." << std::endl;
             }
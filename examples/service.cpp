@@ -5,11 +5,15 @@
 #include "storage/rocksdb_provider.h"
 #include <folly/init/Init.h>
 #include <gflags/gflags.h>
+#include <chrono>
 #include <iostream>
 
 DEFINE_int32(port, 8080, "Server port");
 DEFINE_string(rules_file, "rules.txt", "Path to rules file");
 DEFINE_string(rocksdb_path, "", "Path to RocksDB database (optional)");
+DEFINE_int64(query_timeout_ms, 0, "Longest a query may run, in milliseconds (0 for no limit)");
+DEFINE_int64(query_max_steps, 0, "Most inference steps a query may take (0 for no limit)");
+DEFINE_int64(query_max_memory, 0, "Most bytes a query may use while evaluated (0 for no limit)");
 
 int main(int argc, char* argv[]) {
     // Initialize folly using RAII
@@ -26,8 +30,12 @@ int main(int argc, char* argv[]) {
             );
         }
         
-        // Create and start server
-        kbgdb::Server server(FLAGS_port, kb);
+        // Create and start server; requests may tighten these limits
+        kbgdb::QueryLimits limits;
+        limits.timeout = std::chrono::milliseconds(FLAGS_query_timeout_ms);
+        limits.maxSteps = FLAGS_query_max_steps;
+        limits.maxMemory = FLAGS_query_max_memory;
+        kbgdb::Server server(FLAGS_port, kb, limits);
         
         std::cout << "Starting KBGDB server on port " << FLAGS_port << std::endl;
         server.start();
@@ -0,0 +1,225 @@
+#include "common/cell.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+namespace kbgdb {
+
+// ============================================================================
+// CellArena
+// ============================================================================
+
+CellArena::CellArena(size_t chunkCells)
+    : chunkCells_(std::max<size_t>(chunkCells, 16)) {
+}
+
+Cell* CellArena::allocate(size_t n) {
+    // Find a chunk with room, reusing chunks kept after a release()
+    while (current_ < chunks_.size()) {
+        Chunk& chunk = chunks_[current_];
+        if (chunk.capacity - chunk.used >= n) {
+            Cell* result = chunk.cells.get() + chunk.used;
+            chunk.used += n;
+            return result;
+        }
+        if (current_ + 1 < chunks_.size()) {
+            chunks_[current_ + 1].used = 0;
+        }
+        ++current_;
+    }
+
+    size_t capacity = std::max(n, chunkCells_);
+    chunks_.push_back(Chunk{std::make_unique<Cell[]>(capacity), capacity, n});
+    current_ = chunks_.size() - 1;
+    return chunks_.back().cells.get();
+}
+
+CellArena::Mark CellArena::mark() const {
+    if (chunks_.empty()) {
+        return Mark{};
+    }
+    return Mark{current_, chunks_[current_].used};
+}
+
+void CellArena::release(const Mark& mark) {
+    if (chunks_.empty()) {
+        return;
+    }
+    current_ = mark.chunk;
+    chunks_[current_].used = mark.used;
+}
+
+size_t CellArena::bytesUsed() const {
+    size_t total = 0;
+    for (size_t i = 0; i <= current_ && i < chunks_.size(); ++i) {
+        total += chunks_[i].used * sizeof(Cell);
+    }
+    return total;
+}
+
+// ============================================================================
+// Term <-> Cell conversion
+// ============================================================================
+
+/**
+ * Parse a NUMBER as a small integer if its text is canonical ("42", "-7"),
+ * so that decoding gives back exactly the same text.
+ */
+static bool parseSmallInt(const std::string& text, int64_t& value) {
+    if (text.empty() || text.size() > 19) return false;
+    size_t digits = text[0] == '-' ? 1 : 0;
+    if (digits == text.size()) return false;
+    if (text[digits] == '0' && text.size() > digits + 1) return false;  // "007"
+    if (text == "-0") return false;
+    for (size_t i = digits; i < text.size(); ++i) {
+        if (!std::isdigit(static_cast<unsigned char>(text[i]))) return false;
+    }
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || ptr != text.data() + text.size()) return false;
+    return value >= Cell::MIN_INT && value <= Cell::MAX_INT;
+}
+
+bool encodeAtomic(const Term& term, Cell& out) {
+    switch (term.type) {
+        case TermType::CONSTANT:
+            out = Cell::atom(term.value);
+            return true;
+
+        case TermType::NUMBER: {
+            int64_t value;
+            if (parseSmallInt(term.value.str(), value)) {
+                out = Cell::integer(value);
+            } else {
+                out = Cell::number(term.value);
+            }
+            return true;
+        }
+
+        case TermType::LIST:
+            if (term.isEmptyList()) {
+                out = Cell::nil();
+                return true;
+            }
+            return false;
+
+        case TermType::VARIABLE:
+        case TermType::COMPOUND:
+            return false;
+    }
+    return false;
+}
+
+Cell encodeTerm(const Term& term, CellArena& arena, std::vector<Symbol>& vars) {
+    Cell atomic;
+    if (encodeAtomic(term, atomic)) {
+        return atomic;
+    }
+
+    switch (term.type) {
+        case TermType::VARIABLE: {
+            auto it = std::find(vars.begin(), vars.end(), term.value);
+            uint32_t slot = static_cast<uint32_t>(it - vars.begin());
+            if (it == vars.end()) {
+                vars.push_back(term.value);
+            }
+            return Cell::ref(slot, term.value);
+        }
+
+        case TermType::COMPOUND: {
+            uint32_t arity = static_cast<uint32_t>(term.args.size());
+            Cell* block = arena.allocate(arity + 1);
+            block[0] = Cell::functor(term.functor, arity);
+            for (uint32_t i = 0; i < arity; ++i) {
+                block[i + 1] = encodeTerm(term.args[i], arena, vars);
+            }
+            return Cell::structure(block);
+        }
+
+        case TermType::LIST: {
+            // Iterate along the spine so long lists don't recurse deeply
+            Cell result;
+            Cell* hole = &result;
+            const Term* current = &term;
+            while (current->isConsList()) {
+                Cell* block = arena.allocate(2);
+                block[0] = encodeTerm(current->head(), arena, vars);
+                *hole = Cell::list(block);
+                hole = &block[1];
+                current = &current->tail();
+            }
+            *hole = encodeTerm(*current, arena, vars);
+            return result;
+        }
+
+        default:
+            break;
+    }
+    return Cell::nil();
+}
+
+Term decodeCell(Cell cell) {
+    switch (cell.tag()) {
+        case Cell::Tag::REF:
+            return Term::variable(cell.varName());
+
+        case Cell::Tag::ATOM:
+            return Term::constant(cell.symbol());
+
+        case Cell::Tag::INT:
+            return Term::number(std::to_string(cell.intValue()));
+
+        case Cell::Tag::NUM:
+            return Term::number(cell.symbol());
+
+        case Cell::Tag::STR: {
+            std::vector<Term> args;
+            args.reserve(cell.arity());
+            for (uint32_t i = 0; i < cell.arity(); ++i) {
+                args.push_back(decodeCell(cell.args()[i]));
+            }
+            return Term::compound(cell.functorName(), std::move(args));
+        }
+
+        case Cell::Tag::LIST: {
+            std::vector<Term> elements;
+            Cell current = cell;
+            while (current.isList()) {
+                elements.push_back(decodeCell(current.args()[0]));
+                current = current.args()[1];
+            }
+            if (current.isNil()) {
+                return Term::list(std::move(elements));
+            }
+            Term result = decodeCell(current);
+            for (auto it = elements.rbegin(); it != elements.rend(); ++it) {
+                result = Term::cons(std::move(*it), std::move(result));
+            }
+            return result;
+        }
+
+        case Cell::Tag::NIL:
+            return Term::emptyList();
+
+        case Cell::Tag::FUNCTOR:
+            break;
+    }
+    return Term::constant("?unknown?");
+}
+
+bool indexKey(Cell cell, uint64_t& key) {
+    switch (cell.tag()) {
+        case Cell::Tag::REF:
+            return false;
+        case Cell::Tag::STR:
+            key = cell.block()[0].bits();  // Functor and arity
+            return true;
+        case Cell::Tag::LIST:
+            key = static_cast<uint64_t>(Cell::Tag::LIST);
+            return true;
+        default:
+            key = cell.bits();
+            return true;
+    }
+}
+
+} // namespace kbgdb
@@ -0,0 +1,200 @@
+#pragma once
+#include "common/fact.h"
+#include "common/symbol.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * Cell is the packed 64-bit representation of a term.
+ *
+ * The low 3 bits hold a tag, the remaining 61 bits the payload:
+ *
+ * REF:     Variable: slot index (29 bits) and name Symbol (32 bits)
+ * ATOM:    Constant: Symbol id
+ * INT:     Small integer NUMBER (61-bit signed)
+ * NUM:     Any other NUMBER (e.g. 3.14): Symbol id of its text
+ * STR:     Pointer to a compound block [FUNCTOR][arg0]...[argN-1]
+ * LIST:    Pointer to a cons block [head][tail]
+ * NIL:     Empty list []
+ * FUNCTOR: Header of a compound block: functor Symbol and arity
+ *
+ * Blocks live in a CellArena, so a Cell never owns memory and copying
+ * one is a single word copy. Atomic cells compare equal iff their bits do.
+ */
+class Cell {
+public:
+    enum class Tag : uint8_t {
+        REF = 0,
+        ATOM = 1,
+        INT = 2,
+        NUM = 3,
+        STR = 4,
+        LIST = 5,
+        NIL = 6,
+        FUNCTOR = 7
+    };
+
+    static constexpr int TAG_BITS = 3;
+    static constexpr uint64_t TAG_MASK = (1u << TAG_BITS) - 1;
+    static constexpr int SLOT_BITS = 29;
+    static constexpr uint32_t MAX_SLOT = (1u << SLOT_BITS) - 1;
+    static constexpr int64_t MIN_INT = -(int64_t(1) << 60);
+    static constexpr int64_t MAX_INT = (int64_t(1) << 60) - 1;
+
+    Cell() : bits_(static_cast<uint64_t>(Tag::NIL)) {}
+
+    // Factory methods
+    static Cell ref(uint32_t slot, Symbol name = Symbol()) {
+        return Cell(pack(Tag::REF,
+            (uint64_t(name.id()) << SLOT_BITS) | (slot & MAX_SLOT)));
+    }
+    static Cell atom(Symbol name) { return Cell(pack(Tag::ATOM, name.id())); }
+    static Cell integer(int64_t value) {
+        return Cell((static_cast<uint64_t>(value) << TAG_BITS) |
+                    static_cast<uint64_t>(Tag::INT));
+    }
+    static Cell number(Symbol text) { return Cell(pack(Tag::NUM, text.id())); }
+    static Cell structure(const Cell* block) { return pointer(Tag::STR, block); }
+    static Cell list(const Cell* block) { return pointer(Tag::LIST, block); }
+    static Cell nil() { return Cell(); }
+    static Cell functor(Symbol name, uint32_t arity) {
+        return Cell(pack(Tag::FUNCTOR,
+            (uint64_t(name.id()) << SLOT_BITS) | (arity & MAX_SLOT)));
+    }
+
+    Tag tag() const { return static_cast<Tag>(bits_ & TAG_MASK); }
+    uint64_t bits() const { return bits_; }
+
+    // Type checks
+    bool isRef() const { return tag() == Tag::REF; }
+    bool isAtom() const { return tag() == Tag::ATOM; }
+    bool isInt() const { return tag() == Tag::INT; }
+    bool isNum() const { return tag() == Tag::NUM; }
+    bool isStructure() const { return tag() == Tag::STR; }
+    bool isList() const { return tag() == Tag::LIST; }
+    bool isNil() const { return tag() == Tag::NIL; }
+
+    /** ATOM, INT, NUM and NIL cells: equal terms have equal bits. */
+    bool isAtomic() const {
+        Tag t = tag();
+        return t == Tag::ATOM || t == Tag::INT || t == Tag::NUM || t == Tag::NIL;
+    }
+
+    // REF accessors
+    uint32_t slot() const { return static_cast<uint32_t>(payload() & MAX_SLOT); }
+    Symbol varName() const {
+        return Symbol::fromId(static_cast<uint32_t>(payload() >> SLOT_BITS));
+    }
+
+    // ATOM / NUM accessors
+    Symbol symbol() const { return Symbol::fromId(static_cast<uint32_t>(payload())); }
+
+    // INT accessor (arithmetic shift restores the sign)
+    int64_t intValue() const { return static_cast<int64_t>(bits_) >> TAG_BITS; }
+
+    // STR / LIST accessors
+    const Cell* block() const {
+        return reinterpret_cast<const Cell*>(bits_ & ~TAG_MASK);
+    }
+    Symbol functorName() const { return block()[0].varName(); }
+    uint32_t arity() const { return isList() ? 2 : block()[0].slot(); }
+    const Cell* args() const { return isList() ? block() : block() + 1; }
+
+    bool operator==(const Cell& other) const { return bits_ == other.bits_; }
+    bool operator!=(const Cell& other) const { return bits_ != other.bits_; }
+
+private:
+    explicit Cell(uint64_t bits) : bits_(bits) {}
+
+    static uint64_t pack(Tag tag, uint64_t payload) {
+        return (payload << TAG_BITS) | static_cast<uint64_t>(tag);
+    }
+    static Cell pointer(Tag tag, const Cell* block) {
+        return Cell(reinterpret_cast<uint64_t>(block) | static_cast<uint64_t>(tag));
+    }
+    uint64_t payload() const { return bits_ >> TAG_BITS; }
+
+    uint64_t bits_;
+};
+
+static_assert(sizeof(Cell) == 8, "Cell must be a single machine word");
+
+/**
+ * CellArena is a chunked bump allocator for compound and cons blocks.
+ *
+ * Blocks never move once allocated, so Cells can point into them.
+ * Memory is released all at once, or back to a mark (for backtracking).
+ */
+class CellArena {
+public:
+    explicit CellArena(size_t chunkCells = 4096);
+
+    CellArena(const CellArena&) = delete;
+    CellArena& operator=(const CellArena&) = delete;
+    CellArena(CellArena&&) = default;
+    CellArena& operator=(CellArena&&) = default;
+
+    Cell* allocate(size_t n);
+
+    struct Mark {
+        size_t chunk = 0;
+        size_t used = 0;
+    };
+    Mark mark() const;
+    void release(const Mark& mark);
+    void clear() { release(Mark{}); }
+
+    size_t bytesUsed() const;
+
+private:
+    struct Chunk {
+        std::unique_ptr<Cell[]> cells;
+        size_t capacity;
+        size_t used;
+    };
+
+    size_t chunkCells_;
+    std::vector<Chunk> chunks_;
+    size_t current_ = 0;
+};
+
+/**
+ * Encode a Term into cells, allocating compound/cons blocks in arena.
+ * Variables are numbered by first occurrence; vars maps slot -> name and
+ * is extended as new variables are seen.
+ */
+Cell encodeTerm(const Term& term, CellArena& arena, std::vector<Symbol>& vars);
+
+/**
+ * Encode a term that needs no arena (constant, number, empty list).
+ * Returns false for variables, compounds and non-empty lists.
+ */
+bool encodeAtomic(const Term& term, Cell& out);
+
+/**
+ * Decode cells back to a Term. Variables keep their original names.
+ */
+Term decodeCell(Cell cell);
+
+/**
+ * Hash index key for a cell's outermost symbol: the atom or number
+ * itself, functor/arity for compounds, or "a list" for cons cells.
+ * Returns false for variables, which match any key.
+ */
+bool indexKey(Cell cell, uint64_t& key);
+
+/**
+ * Combine value into hash with splitmix64's finalizer, so that every
+ * input bit affects every output bit.
+ */
+inline uint64_t mixHash(uint64_t hash, uint64_t value) {
+    uint64_t x = hash + value + 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+} // namespace kbgdb
@@ -6,11 +6,11 @@ namespace kbgdb {
 std::string Term::toString() const {
     switch (type) {
         case TermType::VARIABLE:
-            return "?" + value;
+            return "?" + value.str();
             
         case TermType::CONSTANT:
         case TermType::NUMBER:
-            return value;
+            return value.str();
             
         case TermType::COMPOUND: {
             std::ostringstream oss;
@@ -82,8 +82,8 @@ bool Term::operator==(const Term& other) const {
     return false;
 }
 
-Fact::Fact(std::string predicate, std::vector<Term> terms)
-    : predicate_(std::move(predicate))
+Fact::Fact(Symbol predicate, std::vector<Term> terms)
+    : predicate_(predicate)
     , terms_(std::move(terms)) {
 }
 
@@ -1,4 +1,5 @@
 #pragma once
+#include "common/symbol.h"
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -24,15 +25,19 @@ enum class TermType {
     LIST
 };
 
+/**
+ * Names (atoms, numbers-as-text, variable names, functors) are interned
+ * Symbols, so comparing two terms of the same shape is an integer compare.
+ */
 struct Term {
     TermType type;
-    std::string value;              // For VARIABLE, CONSTANT, NUMBER
-    std::string functor;            // For COMPOUND terms (e.g., "f" in f(X,Y))
+    Symbol value;                   // For VARIABLE, CONSTANT, NUMBER
+    Symbol functor;                 // For COMPOUND terms (e.g., "f" in f(X,Y))
     std::vector<Term> args;         // For COMPOUND and LIST (cons cell: [head, tail])
     
     // Constructors
     Term() : type(TermType::CONSTANT) {}
-    Term(TermType t, std::string v) : type(t), value(std::move(v)) {}
+    Term(TermType t, Symbol v) : type(t), value(v) {}
     
     // Type checks
     bool isVariable() const { return type == TermType::VARIABLE; }
@@ -49,19 +54,19 @@ struct Term {
     const Term& tail() const { return args[1]; }  // For cons list [H|T]
     
     // Factory methods for cleaner construction
-    static Term variable(const std::string& name) {
+    static Term variable(Symbol name) {
         return Term{TermType::VARIABLE, name};
     }
     
-    static Term constant(const std::string& name) {
+    static Term constant(Symbol name) {
         return Term{TermType::CONSTANT, name};
     }
     
-    static Term number(const std::string& val) {
+    static Term number(Symbol val) {
         return Term{TermType::NUMBER, val};
     }
     
-    static Term compound(const std::string& functor, std::vector<Term> args) {
+    static Term compound(Symbol functor, std::vector<Term> args) {
         Term t;
         t.type = TermType::COMPOUND;
         t.functor = functor;
@@ -105,9 +110,9 @@ struct Term {
 class Fact {
 public:
     Fact() = default;
-    Fact(std::string predicate, std::vector<Term> terms);
+    Fact(Symbol predicate, std::vector<Term> terms);
     
-    const std::string& predicate() const { return predicate_; }
+    const Symbol& predicate() const { return predicate_; }
     const std::vector<Term>& terms() const { return terms_; }
     size_t arity() const { return terms_.size(); }
     
@@ -117,27 +122,28 @@ public:
         return predicate_ == other.predicate_ && terms_ == other.terms_;
     }
 
-    std::string predicate_;
+    Symbol predicate_;
     std::vector<Term> terms_;
 };
 
 /**
  * BindingSet holds variable bindings during unification and evaluation.
  * Now supports binding to full Term objects, not just strings.
+ * Variables are keyed by their interned name.
  */
 struct BindingSet {
-    std::unordered_map<std::string, Term> bindings;
+    std::unordered_map<Symbol, Term> bindings;
     
-    void add(const std::string& var, const Term& value) {
+    void add(Symbol var, const Term& value) {
         bindings[var] = value;
     }
     
     // Legacy string-based add (for simple constants)
-    void add(const std::string& var, const std::string& value) {
+    void add(Symbol var, const std::string& value) {
         bindings[var] = Term::constant(value);
     }
     
-    std::optional<Term> getTerm(const std::string& var) const {
+    std::optional<Term> getTerm(Symbol var) const {
         auto it = bindings.find(var);
         if (it != bindings.end()) {
             return it->second;
@@ -146,18 +152,18 @@ struct BindingSet {
     }
     
     // Legacy string-based get (returns empty if not found or not a simple value)
-    std::string get(const std::string& var) const {
+    std::string get(Symbol var) const {
         auto it = bindings.find(var);
         if (it != bindings.end()) {
             const Term& t = it->second;
             if (t.isConstant() || t.isNumber() || t.isVariable()) {
-                return t.value;
+                return t.value.str();
             }
         }
         return "";
     }
     
-    bool has(const std::string& var) const {
+    bool has(Symbol var) const {
         return bindings.find(var) != bindings.end();
     }
     
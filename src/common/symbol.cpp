@@ -0,0 +1,61 @@
+#include "common/symbol.h"
+#include <mutex>
+#include <stdexcept>
+
+namespace kbgdb {
+
+SymbolTable& SymbolTable::global() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolTable::SymbolTable() {
+    // Reserve ID 0 for the empty string so default Symbols are ""
+    names_.emplace_back();
+    ids_.emplace(std::string_view(names_.back()), 0);
+}
+
+uint32_t SymbolTable::intern(std::string_view name) {
+    {
+        std::shared_lock lock(mutex_);
+        auto it = ids_.find(name);
+        if (it != ids_.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock lock(mutex_);
+    auto it = ids_.find(name);
+    if (it != ids_.end()) {
+        return it->second;  // Interned by another thread meanwhile
+    }
+    uint32_t id = static_cast<uint32_t>(names_.size());
+    names_.emplace_back(name);
+    ids_.emplace(std::string_view(names_.back()), id);
+    return id;
+}
+
+bool SymbolTable::lookup(std::string_view name, uint32_t& id) const {
+    std::shared_lock lock(mutex_);
+    auto it = ids_.find(name);
+    if (it == ids_.end()) {
+        return false;
+    }
+    id = it->second;
+    return true;
+}
+
+const std::string& SymbolTable::name(uint32_t id) const {
+    std::shared_lock lock(mutex_);
+    if (id >= names_.size()) {
+        throw std::out_of_range("Unknown symbol id: " + std::to_string(id));
+    }
+    return names_[id];
+}
+
+size_t SymbolTable::size() const {
+    std::shared_lock lock(mutex_);
+    return names_.size();
+}
+
+} // namespace kbgdb
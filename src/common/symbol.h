@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace kbgdb {
+
+/**
+ * SymbolTable interns strings (atoms, functors, numbers-as-text, predicate
+ * and variable names) into compact integer IDs.
+ *
+ * There is a single process-wide table, returned by global(). IDs are
+ * never reused or freed, so a Symbol stays valid for the life of the
+ * process. ID 0 is reserved for the empty string.
+ */
+class SymbolTable {
+public:
+    static SymbolTable& global();
+
+    /**
+     * Return the ID for name, adding it to the table if it is new.
+     */
+    uint32_t intern(std::string_view name);
+
+    /**
+     * Return the ID for name if it has been interned, without adding it.
+     */
+    bool lookup(std::string_view name, uint32_t& id) const;
+
+    /**
+     * Resolve an ID back to its string. The reference stays valid forever.
+     */
+    const std::string& name(uint32_t id) const;
+
+    size_t size() const;
+
+private:
+    SymbolTable();
+
+    mutable std::shared_mutex mutex_;
+    std::deque<std::string> names_;                        // id -> name (stable refs)
+    std::unordered_map<std::string_view, uint32_t> ids_;   // name -> id (views into names_)
+};
+
+/**
+ * Symbol is an interned string: a 32-bit handle into the global
+ * SymbolTable. Comparing and hashing Symbols is an integer operation.
+ *
+ * Symbols convert implicitly from and to strings so that code written
+ * against the old std::string fields keeps working.
+ */
+class Symbol {
+public:
+    Symbol() = default;
+    Symbol(std::string_view name) : id_(SymbolTable::global().intern(name)) {}
+    Symbol(const std::string& name) : Symbol(std::string_view(name)) {}
+    Symbol(const char* name) : Symbol(std::string_view(name)) {}
+
+    static Symbol fromId(uint32_t id) {
+        Symbol s;
+        s.id_ = id;
+        return s;
+    }
+
+    uint32_t id() const { return id_; }
+    const std::string& str() const { return SymbolTable::global().name(id_); }
+    operator const std::string&() const { return str(); }
+
+    bool empty() const { return id_ == 0; }
+
+    bool operator==(const Symbol& other) const { return id_ == other.id_; }
+    bool operator!=(const Symbol& other) const { return id_ != other.id_; }
+    bool operator<(const Symbol& other) const { return id_ < other.id_; }
+
+    // Compare against plain strings without interning them
+    bool operator==(const char* other) const { return str() == other; }
+    bool operator==(const std::string& other) const { return str() == other; }
+    bool operator!=(const char* other) const { return str() != other; }
+    bool operator!=(const std::string& other) const { return str() != other; }
+
+private:
+    uint32_t id_ = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Symbol& symbol) {
+    return os << symbol.str();
+}
+
+} // namespace kbgdb
+
+template <>
+struct std::hash<kbgdb::Symbol> {
+    size_t operator()(const kbgdb::Symbol& s) const noexcept {
+        return std::hash<uint32_t>{}(s.id());
+    }
+};
@@ -0,0 +1,196 @@
+#include "core/aggregate.h"
+#include <charconv>
+#include <stdexcept>
+#include <string>
+
+namespace kbgdb {
+
+namespace {
+
+const Symbol COUNT("count");
+const Symbol SUM("sum");
+const Symbol MIN("min");
+const Symbol MAX("max");
+const Symbol GROUP_BY("group_by");
+
+std::optional<AggregateOp> opNamed(Symbol name) {
+    if (name == COUNT) return AggregateOp::COUNT;
+    if (name == SUM) return AggregateOp::SUM;
+    if (name == MIN) return AggregateOp::MIN;
+    if (name == MAX) return AggregateOp::MAX;
+    return std::nullopt;
+}
+
+// Append the goals term stands for: one goal, or a list of them
+bool toGoals(const Term& term, std::vector<Fact>& goals) {
+    switch (term.type) {
+        case TermType::CONSTANT:
+            goals.emplace_back(term.value, std::vector<Term>{});
+            return true;
+        case TermType::COMPOUND:
+            goals.emplace_back(term.functor, term.args);
+            return true;
+        case TermType::LIST: {
+            const Term* list = &term;
+            while (list->isConsList()) {
+                if (!toGoals(list->head(), goals)) return false;
+                list = &list->tail();
+            }
+            return list->isEmptyList() && !goals.empty();
+        }
+        default:
+            return false;
+    }
+}
+
+// The aggregate of op over goal (with value, for all but count)
+std::optional<AggregateCall> takeApart(AggregateOp op, const Term* value, const Term& goal) {
+    AggregateCall call{op, {}, value ? *value : Term(), std::nullopt};
+    if (!toGoals(goal, call.goals)) {
+        return std::nullopt;
+    }
+    return call;
+}
+
+bool parseInteger(const std::string& text, int64_t& value) {
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && ptr == text.data() + text.size();
+}
+
+std::optional<double> parseReal(const std::string& text) {
+    double value;
+    auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || ptr != text.data() + text.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+Term numberTerm(double value) {
+    char text[32];
+    auto [end, ec] = std::to_chars(text, text + sizeof(text), value);
+    return Term::number(Symbol(std::string(text, end)));
+}
+
+} // namespace
+
+bool isAggregate(Symbol predicate, uint32_t arity) {
+    if (predicate == COUNT) return arity == 2;
+    if (predicate == GROUP_BY) return arity == 3;
+    return arity == 3 && opNamed(predicate).has_value();
+}
+
+std::optional<AggregateCall> parseAggregate(const Fact& goal) {
+    if (!isAggregate(goal.predicate(), static_cast<uint32_t>(goal.arity()))) {
+        return std::nullopt;
+    }
+    const auto& args = goal.terms();
+    if (goal.predicate() == COUNT) {
+        return takeApart(AggregateOp::COUNT, nullptr, args[0]);
+    }
+    if (goal.predicate() != GROUP_BY) {
+        return takeApart(*opNamed(goal.predicate()), &args[0], args[1]);
+    }
+
+    // group_by(Key, count(Goal) or sum/min/max(V, Goal), Result)
+    const Term& inner = args[1];
+    std::optional<AggregateOp> op = inner.isCompound() ? opNamed(inner.functor) : std::nullopt;
+    std::optional<AggregateCall> call;
+    if (op == AggregateOp::COUNT && inner.args.size() == 1) {
+        call = takeApart(*op, nullptr, inner.args[0]);
+    } else if (op && *op != AggregateOp::COUNT && inner.args.size() == 2) {
+        call = takeApart(*op, &inner.args[0], inner.args[1]);
+    }
+    if (call) {
+        call->key = args[0];
+    }
+    return call;
+}
+
+void Accumulator::add(const Term& value) {
+    std::optional<double> number;
+    if (value.isNumber()) {
+        int64_t integer;
+        if (op_ == AggregateOp::SUM && parseInteger(value.value.str(), integer)) {
+            add(integer);
+            return;
+        }
+        number = parseReal(value.value.str());
+    }
+
+    ++count_;
+    if (op_ == AggregateOp::SUM) {
+        if (!number) {
+            throw std::invalid_argument("sum of a term that is not a number: " + value.toString());
+        }
+        addReal(*number);
+    } else if (op_ != AggregateOp::COUNT) {
+        offer(value, number);
+    }
+}
+
+void Accumulator::add(int64_t value) {
+    ++count_;
+    if (op_ == AggregateOp::SUM) {
+        int64_t sum;
+        if (integral_ && !__builtin_add_overflow(intSum_, value, &sum)) {
+            intSum_ = sum;
+        } else {
+            addReal(static_cast<double>(value));
+        }
+    } else if (op_ != AggregateOp::COUNT) {
+        // The term is only made for a new least or greatest value
+        double number = static_cast<double>(value);
+        if (improves(number, nullptr)) {
+            best_ = Term::number(Symbol(std::to_string(value)));
+            bestNumber_ = number;
+        }
+    }
+}
+
+void Accumulator::addReal(double value) {
+    if (integral_) {
+        integral_ = false;
+        realSum_ = static_cast<double>(intSum_);
+    }
+    realSum_ += value;
+}
+
+void Accumulator::offer(const Term& value, std::optional<double> number) {
+    if (improves(number, &value)) {
+        best_ = value;
+        bestNumber_ = number;
+        bestText_ = number ? std::string() : value.toString();
+    }
+}
+
+// Numbers come before other terms, which are ordered by their text;
+// value is only read if number is unset
+bool Accumulator::improves(std::optional<double> number, const Term* value) const {
+    int order;
+    if (!best_) {
+        return true;
+    } else if (number && bestNumber_) {
+        order = *number < *bestNumber_ ? -1 : *number > *bestNumber_ ? 1 : 0;
+    } else if (number || bestNumber_) {
+        order = number ? -1 : 1;
+    } else {
+        order = value->toString().compare(bestText_);
+    }
+    return op_ == AggregateOp::MIN ? order < 0 : order > 0;
+}
+
+std::optional<Term> Accumulator::result() const {
+    switch (op_) {
+        case AggregateOp::COUNT:
+            return Term::number(Symbol(std::to_string(count_)));
+        case AggregateOp::SUM:
+            return integral_ ? Term::number(Symbol(std::to_string(intSum_))) : numberTerm(realSum_);
+        case AggregateOp::MIN:
+        case AggregateOp::MAX:
+            break;
+    }
+    return best_;
+}
+
+} // namespace kbgdb
@@ -0,0 +1,96 @@
+#pragma once
+#include "common/fact.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * Built-in aggregate predicates, computed by the solver as it finds the
+ * solutions of a goal, without collecting them:
+ *
+ *   count(Goal, N)          N is the number of solutions of Goal
+ *   sum(V, Goal, S)         S is the sum of V over them (0 if none)
+ *   min(V, Goal, M)         M is the least V; fails if there are none
+ *   max(V, Goal, M)         M is the greatest V; fails if there are none
+ *   group_by(K, Agg, R)     one solution per distinct value of K over the
+ *                           solutions of Agg's goal, with R its aggregate;
+ *                           Agg is count(Goal), sum(V, Goal), min(V, Goal)
+ *                           or max(V, Goal)
+ *
+ * Goal is a goal or a list of goals (a conjunction). Its variables that
+ * are unbound when the aggregate is called are local to it, except that
+ * group_by binds those of K. Sums are of numbers; min and max compare
+ * numbers by value, before any other term, and other terms by text.
+ *
+ * The names are only built in while the knowledge base has no facts or
+ * rules of its own for them.
+ */
+enum class AggregateOp {
+    COUNT,
+    SUM,
+    MIN,
+    MAX
+};
+
+/** Whether predicate/arity names a built-in aggregate. */
+bool isAggregate(Symbol predicate, uint32_t arity);
+
+/** An aggregate goal taken apart. */
+struct AggregateCall {
+    AggregateOp op;
+    std::vector<Fact> goals;        // The conjunction aggregated over
+    Term value;                     // Summed or compared (not for count)
+    std::optional<Term> key;        // Grouped by, for group_by
+};
+
+/**
+ * Take an aggregate goal apart, or nullopt if its goal or inner
+ * aggregate is not one (a variable, say).
+ */
+std::optional<AggregateCall> parseAggregate(const Fact& goal);
+
+/**
+ * The running result of one aggregate (or of one group), in constant
+ * space: a count, a sum or the least or greatest value so far.
+ */
+class Accumulator {
+public:
+    explicit Accumulator(AggregateOp op) : op_(op) {}
+
+    /** Count one solution. */
+    void add() { ++count_; }
+
+    /** Count one solution with value, which sum requires to be a number. */
+    void add(const Term& value);
+
+    /** Count one solution with an integer value (a fast path for add()). */
+    void add(int64_t value);
+
+    uint64_t count() const { return count_; }
+
+    /** The aggregate, or nullopt for the min or max of no solutions. */
+    std::optional<Term> result() const;
+
+private:
+    void addReal(double value);
+    void offer(const Term& value, std::optional<double> number);
+    bool improves(std::optional<double> number, const Term* value) const;
+
+    AggregateOp op_;
+    uint64_t count_ = 0;
+
+    // Sums stay exact integers until a real number (or an overflow)
+    bool integral_ = true;
+    int64_t intSum_ = 0;
+    double realSum_ = 0;
+
+    // The least or greatest value so far, and its number if it is one
+    std::optional<Term> best_;
+    std::optional<double> bestNumber_;
+    std::string bestText_;
+};
+
+} // namespace kbgdb
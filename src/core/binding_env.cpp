@@ -0,0 +1,349 @@
+#include "core/binding_env.h"
+#include <algorithm>
+
+namespace kbgdb {
+
+uint32_t BindingEnv::newVar() {
+    uint32_t slot = static_cast<uint32_t>(slots_.size());
+    slots_.push_back(Cell::ref(slot));
+    return slot;
+}
+
+uint32_t BindingEnv::newVars(uint32_t count) {
+    uint32_t base = static_cast<uint32_t>(slots_.size());
+    for (uint32_t i = 0; i < count; ++i) {
+        slots_.push_back(Cell::ref(base + i));
+    }
+    return base;
+}
+
+bool BindingEnv::isBound(uint32_t slot) const {
+    Cell value = slots_[slot];
+    return !(value.isRef() && value.slot() == slot);
+}
+
+Cell BindingEnv::deref(Cell cell) const {
+    while (cell.isRef()) {
+        Cell value = slots_[cell.slot()];
+        if (value.isRef() && value.slot() == cell.slot()) {
+            return cell;  // Unbound: keep the referencing cell (and its name)
+        }
+        cell = value;
+    }
+    return cell;
+}
+
+void BindingEnv::bind(uint32_t slot, Cell value) {
+    slots_[slot] = value;
+    trail_.push_back(slot);
+}
+
+bool BindingEnv::occurs(uint32_t slot, Cell cell) const {
+    cell = deref(cell);
+    switch (cell.tag()) {
+        case Cell::Tag::REF:
+            return cell.slot() == slot;
+
+        case Cell::Tag::STR:
+            for (uint32_t i = 0; i < cell.arity(); ++i) {
+                if (occurs(slot, cell.args()[i])) return true;
+            }
+            return false;
+
+        case Cell::Tag::LIST:
+            while (cell.isList()) {
+                if (occurs(slot, cell.args()[0])) return true;
+                cell = deref(cell.args()[1]);
+            }
+            return cell.isRef() && cell.slot() == slot;
+
+        default:
+            return false;
+    }
+}
+
+bool BindingEnv::unify(Cell a, Cell b) {
+    while (true) {
+        a = deref(a);
+        b = deref(b);
+
+        if (a.isRef() && b.isRef()) {
+            if (a.slot() == b.slot()) return true;
+            // Bind the younger variable to the older one
+            if (a.slot() > b.slot()) {
+                bind(a.slot(), b);
+            } else {
+                bind(b.slot(), a);
+            }
+            return true;
+        }
+
+        if (a.isRef()) {
+            if (!b.isAtomic() && occurs(a.slot(), b)) return false;
+            bind(a.slot(), b);
+            return true;
+        }
+
+        if (b.isRef()) {
+            if (!a.isAtomic() && occurs(b.slot(), a)) return false;
+            bind(b.slot(), a);
+            return true;
+        }
+
+        if (a.isAtomic() || b.isAtomic()) {
+            return a == b;
+        }
+
+        if (a.tag() != b.tag()) return false;
+
+        if (a.isStructure()) {
+            if (a.block()[0] != b.block()[0]) return false;  // Functor and arity
+            if (a.block() == b.block()) return true;
+            uint32_t n = a.arity();
+            for (uint32_t i = 0; i + 1 < n; ++i) {
+                if (!unify(a.args()[i], b.args()[i])) return false;
+            }
+            if (n == 0) return true;
+            // Last argument by iteration
+            Cell nextA = a.args()[n - 1];
+            b = b.args()[n - 1];
+            a = nextA;
+            continue;
+        }
+
+        // Cons cells: unify heads, then iterate along the tails
+        if (a.block() == b.block()) return true;
+        if (!unify(a.args()[0], b.args()[0])) return false;
+        Cell nextA = a.args()[1];
+        b = b.args()[1];
+        a = nextA;
+    }
+}
+
+BindingEnv::Mark BindingEnv::mark() const {
+    return Mark{trail_.size(), slots_.size(), heap_.mark()};
+}
+
+void BindingEnv::undo(const Mark& mark) {
+    while (trail_.size() > mark.trail) {
+        uint32_t slot = trail_.back();
+        trail_.pop_back();
+        if (slot < mark.vars) {
+            slots_[slot] = Cell::ref(slot);
+        }
+    }
+    slots_.resize(mark.vars);
+    heap_.release(mark.heap);
+}
+
+Cell BindingEnv::encode(const Term& term, std::unordered_map<Symbol, uint32_t>& vars) {
+    Cell atomic;
+    if (encodeAtomic(term, atomic)) {
+        return atomic;
+    }
+
+    switch (term.type) {
+        case TermType::VARIABLE: {
+            auto it = vars.find(term.value);
+            if (it == vars.end()) {
+                it = vars.emplace(term.value, newVar()).first;
+            }
+            return Cell::ref(it->second, term.value);
+        }
+
+        case TermType::COMPOUND: {
+            uint32_t arity = static_cast<uint32_t>(term.args.size());
+            Cell* block = allocate(arity + 1);
+            block[0] = Cell::functor(term.functor, arity);
+            for (uint32_t i = 0; i < arity; ++i) {
+                block[i + 1] = encode(term.args[i], vars);
+            }
+            return Cell::structure(block);
+        }
+
+        case TermType::LIST: {
+            Cell* block = allocate(2);
+            block[0] = encode(term.head(), vars);
+            block[1] = encode(term.tail(), vars);
+            return Cell::list(block);
+        }
+
+        default:
+            break;
+    }
+    return Cell::nil();
+}
+
+Cell BindingEnv::instantiate(Cell cell, uint32_t base) {
+    switch (cell.tag()) {
+        case Cell::Tag::REF:
+            return Cell::ref(base + cell.slot(), cell.varName());
+
+        case Cell::Tag::STR: {
+            uint32_t arity = cell.arity();
+            Cell* block = allocate(arity + 1);
+            block[0] = cell.block()[0];
+            for (uint32_t i = 0; i < arity; ++i) {
+                block[i + 1] = instantiate(cell.args()[i], base);
+            }
+            return Cell::structure(block);
+        }
+
+        case Cell::Tag::LIST: {
+            Cell* block = allocate(2);
+            block[0] = instantiate(cell.args()[0], base);
+            block[1] = instantiate(cell.args()[1], base);
+            return Cell::list(block);
+        }
+
+        default:
+            return cell;
+    }
+}
+
+Goal BindingEnv::instantiate(const Goal& goal, uint32_t base) {
+    Cell* args = allocate(goal.arity);
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        args[i] = instantiate(goal.args[i], base);
+    }
+    return Goal{goal.predicate, goal.arity, args};
+}
+
+bool BindingEnv::unifyTemplate(Cell pattern, uint32_t base, Cell value) {
+    while (true) {
+        if (pattern.isRef()) {
+            return unify(Cell::ref(base + pattern.slot(), pattern.varName()), value);
+        }
+        
+        value = deref(value);
+        if (value.isRef()) {
+            if (pattern.isAtomic()) {
+                bind(value.slot(), pattern);
+                return true;
+            }
+            // The copy may mention variables already bound to value
+            return unify(value, instantiate(pattern, base));
+        }
+        
+        if (pattern.isAtomic() || value.isAtomic()) {
+            return pattern == value;
+        }
+        if (pattern.tag() != value.tag()) {
+            return false;
+        }
+        
+        if (pattern.isStructure()) {
+            if (pattern.block()[0] != value.block()[0]) return false;
+            uint32_t n = pattern.arity();
+            if (n == 0) return true;
+            for (uint32_t i = 0; i + 1 < n; ++i) {
+                if (!unifyTemplate(pattern.args()[i], base, value.args()[i])) return false;
+            }
+            Cell nextPattern = pattern.args()[n - 1];
+            value = value.args()[n - 1];
+            pattern = nextPattern;
+            continue;
+        }
+        
+        // Cons cells: heads, then iterate along the tails
+        if (!unifyTemplate(pattern.args()[0], base, value.args()[0])) return false;
+        Cell nextPattern = pattern.args()[1];
+        value = value.args()[1];
+        pattern = nextPattern;
+    }
+}
+
+Term BindingEnv::resolve(Cell cell, bool uniqueNames) const {
+    cell = deref(cell);
+    switch (cell.tag()) {
+        case Cell::Tag::REF:
+            if (uniqueNames || cell.varName().empty()) {
+                return Term::variable("_G" + std::to_string(cell.slot()));
+            }
+            return Term::variable(cell.varName());
+
+        case Cell::Tag::STR: {
+            std::vector<Term> args;
+            args.reserve(cell.arity());
+            for (uint32_t i = 0; i < cell.arity(); ++i) {
+                args.push_back(resolve(cell.args()[i], uniqueNames));
+            }
+            return Term::compound(cell.functorName(), std::move(args));
+        }
+
+        case Cell::Tag::LIST: {
+            std::vector<Term> elements;
+            while (cell.isList()) {
+                elements.push_back(resolve(cell.args()[0], uniqueNames));
+                cell = deref(cell.args()[1]);
+            }
+            Term result = cell.isNil() ? Term::emptyList() : resolve(cell, uniqueNames);
+            for (auto it = elements.rbegin(); it != elements.rend(); ++it) {
+                result = Term::cons(std::move(*it), std::move(result));
+            }
+            return result;
+        }
+
+        default:
+            return decodeCell(cell);
+    }
+}
+
+Fact BindingEnv::resolve(const Goal& goal, bool uniqueNames) const {
+    std::vector<Term> terms;
+    terms.reserve(goal.arity);
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        terms.push_back(resolve(goal.args[i], uniqueNames));
+    }
+    return Fact(goal.predicate, std::move(terms));
+}
+
+uint64_t BindingEnv::variantHash(Cell cell, uint64_t hash) const {
+    while (true) {
+        cell = deref(cell);
+        switch (cell.tag()) {
+            case Cell::Tag::REF: {
+                auto it = std::find(seen_.begin(), seen_.end(), cell.slot());
+                if (it == seen_.end()) {
+                    seen_.push_back(cell.slot());
+                    it = seen_.end() - 1;
+                }
+                // The tag keeps variable i apart from the integer i
+                return mixHash(hash, (static_cast<uint64_t>(it - seen_.begin()) << 3) |
+                                     static_cast<uint64_t>(Cell::Tag::REF));
+            }
+
+            case Cell::Tag::STR: {
+                hash = mixHash(hash, cell.block()[0].bits());
+                uint32_t n = cell.arity();
+                if (n == 0) return hash;
+                for (uint32_t i = 0; i + 1 < n; ++i) {
+                    hash = variantHash(cell.args()[i], hash);
+                }
+                cell = cell.args()[n - 1];
+                continue;
+            }
+
+            case Cell::Tag::LIST:
+                // Iterate along the tail so long lists use no stack
+                hash = mixHash(hash, static_cast<uint64_t>(Cell::Tag::LIST));
+                hash = variantHash(cell.args()[0], hash);
+                cell = cell.args()[1];
+                continue;
+
+            default:
+                return mixHash(hash, cell.bits());
+        }
+    }
+}
+
+uint64_t BindingEnv::variantHash(const Goal& goal) const {
+    seen_.clear();
+    uint64_t hash = mixHash(goal.predicate.id(), goal.arity);
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        hash = variantHash(goal.args[i], hash);
+    }
+    return hash;
+}
+
+} // namespace kbgdb
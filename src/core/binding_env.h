@@ -0,0 +1,128 @@
+#pragma once
+#include "common/cell.h"
+#include "common/fact.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * Goal is a predicate applied to argument cells.
+ * The cells live in a BindingEnv heap or in a FactTable and are never owned.
+ */
+struct Goal {
+    Symbol predicate;
+    uint32_t arity = 0;
+    const Cell* args = nullptr;
+};
+
+/**
+ * BindingEnv is the mutable binding store used during evaluation.
+ *
+ * Variables are integer slots. Binding a variable writes its slot in place
+ * and records it on the trail; undo(mark) restores every slot bound since
+ * the mark, drops variables created since, and releases heap cells built
+ * since. Backtracking therefore costs nothing per binding beyond the
+ * trail entry, and a successful unification allocates nothing.
+ */
+class BindingEnv {
+public:
+    BindingEnv() = default;
+
+    BindingEnv(const BindingEnv&) = delete;
+    BindingEnv& operator=(const BindingEnv&) = delete;
+
+    // Variables
+    uint32_t newVar();
+    uint32_t newVars(uint32_t count);    // Returns the first of count fresh slots
+    size_t numVars() const { return slots_.size(); }
+    bool isBound(uint32_t slot) const;
+    
+    /** Bytes held by slots, trail and heap. */
+    size_t bytesUsed() const {
+        return slots_.capacity() * sizeof(Cell) + trail_.capacity() * sizeof(uint32_t) +
+               heap_.bytesUsed();
+    }
+
+    /**
+     * Follow variable bindings until reaching an unbound variable
+     * or a non-variable cell.
+     */
+    Cell deref(Cell cell) const;
+
+    /**
+     * Unify two cells, binding variables in place.
+     * On failure some bindings may remain; callers undo to a mark.
+     */
+    bool unify(Cell a, Cell b);
+
+    // Backtracking
+    struct Mark {
+        size_t trail = 0;
+        size_t vars = 0;
+        CellArena::Mark heap;
+    };
+    Mark mark() const;
+    void undo(const Mark& mark);
+
+    // Building terms on the heap
+    Cell* allocate(size_t n) { return heap_.allocate(n); }
+
+    /**
+     * Encode a Term on the heap. Variables are looked up in vars by name
+     * and given fresh slots the first time they are seen.
+     */
+    Cell encode(const Term& term, std::unordered_map<Symbol, uint32_t>& vars);
+
+    /**
+     * Copy a cell whose variables are numbered from 0 (as in FactTable
+     * rows) onto the heap, renaming variable i to slot base + i.
+     */
+    Cell instantiate(Cell cell, uint32_t base);
+    
+    /**
+     * Instantiate a goal template's arguments on the heap (see above).
+     */
+    Goal instantiate(const Goal& goal, uint32_t base);
+    
+    /**
+     * Unify a template cell (variables numbered from 0, renamed to
+     * base + i) with a live cell without copying the template first.
+     * Only a template structure bound to an unbound variable is copied.
+     */
+    bool unifyTemplate(Cell pattern, uint32_t base, Cell value);
+
+    // Reading terms back
+
+    /**
+     * Fully resolve a cell to a Term. Unbound variables keep the name they
+     * were created with, or are named _G<slot> if uniqueNames is set.
+     */
+    Term resolve(Cell cell, bool uniqueNames = false) const;
+
+    /**
+     * Resolve a goal to a Fact (see resolve()).
+     */
+    Fact resolve(const Goal& goal, bool uniqueNames = false) const;
+
+    /**
+     * Hash a goal's current value up to variable renaming: variables are
+     * hashed by the order of their first occurrence, so variants (goals
+     * equal but for the names of their variables) hash equal.
+     */
+    uint64_t variantHash(const Goal& goal) const;
+
+private:
+    void bind(uint32_t slot, Cell value);
+    bool occurs(uint32_t slot, Cell cell) const;
+    uint64_t variantHash(Cell cell, uint64_t hash) const;
+
+    std::vector<Cell> slots_;       // Unbound slots hold a REF to themselves
+    std::vector<uint32_t> trail_;   // Slots bound, in binding order
+    CellArena heap_;
+    mutable std::vector<uint32_t> seen_;   // Scratch for variantHash
+};
+
+} // namespace kbgdb
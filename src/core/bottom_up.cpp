@@ -0,0 +1,560 @@
+#include "core/bottom_up.h"
+#include "core/aggregate.h"
+#include <algorithm>
+#include <functional>
+
+namespace kbgdb {
+
+static PredicateKey keyOf(const Goal& goal) {
+    return PredicateKey{goal.predicate, goal.arity};
+}
+
+BottomUpEvaluator::BottomUpEvaluator(const Clauses& clauses, const Relations& facts)
+    : BottomUpEvaluator(clauses, [&facts](const PredicateKey& key) -> const FactTable* {
+          auto it = facts.find(key);
+          return it != facts.end() ? &it->second : nullptr;
+      }) {
+}
+
+BottomUpEvaluator::BottomUpEvaluator(const Clauses& clauses, Lookup stored)
+    : clauses_(clauses)
+    , stored_(std::move(stored)) {
+    for (uint32_t id = 0; id < clauses_.size(); ++id) {
+        rulesFor_[keyOf(clauses_[id]->head())].push_back(id);
+    }
+    stratify();
+}
+
+bool BottomUpEvaluator::isDatalog(const CompiledClause& clause) const {
+    // Aggregates are only solved top-down
+    for (const auto& goal : clause.body()) {
+        if (isAggregate(goal.predicate, goal.arity)) {
+            return false;
+        }
+    }
+
+    std::vector<bool> inBody(clause.numVars(), false);
+    std::function<void(Cell)> mark = [&](Cell cell) {
+        if (cell.isRef()) {
+            inBody[cell.slot()] = true;
+        } else if (cell.isStructure() || cell.isList()) {
+            for (uint32_t i = 0; i < cell.arity(); ++i) {
+                mark(cell.args()[i]);
+            }
+        }
+    };
+    for (const auto& goal : clause.body()) {
+        for (uint32_t i = 0; i < goal.arity; ++i) {
+            mark(goal.args[i]);
+        }
+    }
+
+    std::function<bool(Cell)> ground = [&](Cell cell) {
+        if (cell.isRef()) return false;
+        if (cell.isStructure() || cell.isList()) {
+            for (uint32_t i = 0; i < cell.arity(); ++i) {
+                if (!ground(cell.args()[i])) return false;
+            }
+        }
+        return true;
+    };
+
+    // Heads may only copy body values or name ground terms, so nothing
+    // new (and nothing unbound) is ever built
+    const Goal& head = clause.head();
+    for (uint32_t i = 0; i < head.arity; ++i) {
+        Cell arg = head.args[i];
+        if (arg.isRef() ? !inBody[arg.slot()] : !ground(arg)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void BottomUpEvaluator::stratify() {
+    // Tarjan's algorithm over the rule-defined predicates. Components come
+    // out after every component they depend on: exactly evaluation order.
+    std::unordered_map<PredicateKey, size_t> indexOf;
+    std::unordered_map<PredicateKey, size_t> lowLink;
+    std::vector<PredicateKey> stack;
+    std::unordered_set<PredicateKey> onStack;
+
+    std::function<void(const PredicateKey&)> visit = [&](const PredicateKey& p) {
+        size_t index = indexOf.size();
+        indexOf[p] = index;
+        lowLink[p] = index;
+        stack.push_back(p);
+        onStack.insert(p);
+
+        for (uint32_t id : rulesFor_.at(p)) {
+            for (const auto& goal : clauses_[id]->body()) {
+                PredicateKey q = keyOf(goal);
+                if (!rulesFor_.count(q)) continue;
+                if (!indexOf.count(q)) {
+                    visit(q);
+                    lowLink[p] = std::min(lowLink[p], lowLink[q]);
+                } else if (onStack.count(q)) {
+                    lowLink[p] = std::min(lowLink[p], indexOf[q]);
+                }
+            }
+        }
+
+        if (lowLink[p] == indexOf[p]) {
+            std::vector<PredicateKey> component;
+            PredicateKey q;
+            do {
+                q = stack.back();
+                stack.pop_back();
+                onStack.erase(q);
+                stratumOf_[q] = strata_.size();
+                component.push_back(q);
+            } while (!(q == p));
+            strata_.push_back(std::move(component));
+        }
+    };
+
+    // Visit in rule order so strata are deterministic
+    for (const auto& clause : clauses_) {
+        PredicateKey p = keyOf(clause->head());
+        if (!indexOf.count(p)) {
+            visit(p);
+        }
+    }
+
+    for (const auto& stratum : strata_) {
+        bool ok = true;
+        for (const auto& p : stratum) {
+            const FactTable* stored = stored_(p);
+            ok = ok && (!stored || !stored->hasVariables());
+            for (uint32_t id : rulesFor_.at(p)) {
+                const CompiledClause& clause = *clauses_[id];
+                ok = ok && isDatalog(clause);
+                for (const auto& goal : clause.body()) {
+                    PredicateKey q = keyOf(goal);
+                    if (rulesFor_.count(q)) {
+                        // Same stratum, or an earlier one that must be materialized
+                        ok = ok && (stratumOf_.at(q) == stratumOf_.at(p) ||
+                                    materializable_.count(q));
+                    } else {
+                        const FactTable* facts = stored_(q);
+                        ok = ok && (!facts || !facts->hasVariables());
+                    }
+                }
+            }
+        }
+        if (ok) {
+            materializable_.insert(stratum.begin(), stratum.end());
+        }
+    }
+}
+
+BottomUpEvaluator::Relations BottomUpEvaluator::run() {
+    return derive(nullptr);
+}
+
+BottomUpEvaluator::Relations BottomUpEvaluator::run(const std::vector<PredicateKey>& goals) {
+    std::unordered_set<PredicateKey> needed;
+    std::vector<PredicateKey> pending(goals);
+    while (!pending.empty()) {
+        PredicateKey p = pending.back();
+        pending.pop_back();
+        auto it = rulesFor_.find(p);
+        if (it == rulesFor_.end() || !needed.insert(p).second) continue;
+        for (uint32_t id : it->second) {
+            for (const auto& goal : clauses_[id]->body()) {
+                pending.push_back(keyOf(goal));
+            }
+        }
+    }
+    return derive(&needed);
+}
+
+BottomUpEvaluator::Relations BottomUpEvaluator::derive(
+    const std::unordered_set<PredicateKey>* needed) {
+    Relations derived;
+
+    for (const auto& stratum : strata_) {
+        if (budget_ && budget_->stopped()) break;
+        if (!canMaterialize(stratum.front())) continue;
+        if (needed && !needed->count(stratum.front())) continue;
+
+        // Each relation starts as its stored facts. Rows [0, old) are known
+        // to the previous round, [old, end) are its delta.
+        std::unordered_map<PredicateKey, size_t> old;
+        std::unordered_map<PredicateKey, size_t> end;
+        for (const auto& p : stratum) {
+            const FactTable* stored = stored_(p);
+            FactTable& table = derived.emplace(p, stored
+                ? *stored : FactTable(p.name, p.arity)).first->second;
+            old[p] = 0;
+            end[p] = table.size();
+        }
+
+        for (bool first = true; ; first = false) {
+            for (const auto& p : stratum) {
+                FactTable& target = derived.at(p);
+                Emit emit = [&](const Fact& fact) {
+                    if (find(target, fact) == SIZE_MAX) {
+                        target.add(fact);
+                    }
+                };
+                for (uint32_t id : rulesFor_.at(p)) {
+                    const CompiledClause& clause = *clauses_[id];
+                    const auto& body = clause.body();
+
+                    std::vector<size_t> recursive;
+                    for (size_t i = 0; i < body.size(); ++i) {
+                        if (stratumOf_.count(keyOf(body[i])) &&
+                            stratumOf_.at(keyOf(body[i])) == stratumOf_.at(p)) {
+                            recursive.push_back(i);
+                        }
+                    }
+
+                    // Goals outside the stratum read whole, finished relations
+                    std::vector<Range> ranges(body.size());
+                    for (size_t i = 0; i < body.size(); ++i) {
+                        PredicateKey q = keyOf(body[i]);
+                        auto it = derived.find(q);
+                        const FactTable* table = nullptr;
+                        if (it != derived.end()) {
+                            table = &it->second;
+                        } else {
+                            table = stored_(q);
+                        }
+                        ranges[i] = Range{table, 0, table ? table->size() : 0};
+                    }
+
+                    if (recursive.empty()) {
+                        // Reads nothing that changes: one round is enough
+                        if (first) {
+                            evaluate(clause, ranges, emit);
+                        }
+                        continue;
+                    }
+
+                    // One join per recursive goal: that goal reads the delta,
+                    // earlier ones the older rows, later ones everything, so
+                    // no combination of rows is joined twice
+                    for (size_t d : recursive) {
+                        for (size_t i : recursive) {
+                            PredicateKey q = keyOf(body[i]);
+                            if (i < d) {
+                                ranges[i].begin = 0;
+                                ranges[i].end = old[q];
+                            } else if (i == d) {
+                                ranges[i].begin = old[q];
+                                ranges[i].end = end[q];
+                            } else {
+                                ranges[i].begin = 0;
+                                ranges[i].end = end[q];
+                            }
+                        }
+                        if (ranges[d].begin < ranges[d].end) {
+                            evaluate(clause, ranges, emit);
+                        }
+                    }
+                }
+            }
+
+            bool changed = false;
+            for (const auto& p : stratum) {
+                size_t size = derived.at(p).size();
+                changed = changed || size > end[p];
+                old[p] = end[p];
+                end[p] = size;
+            }
+            if (!changed || (budget_ && budget_->stopped())) break;
+        }
+    }
+    return derived;
+}
+
+void BottomUpEvaluator::evaluate(
+    const CompiledClause& clause, const std::vector<Range>& ranges,
+    const Emit& emit, const Cell* head, size_t first) {
+    std::vector<size_t> order(clause.body().size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i == 0 ? first : (i <= first ? i - 1 : i);
+    }
+    auto mark = env_.mark();
+    uint32_t base = env_.newVars(clause.numVars());
+    bool matched = true;
+    for (uint32_t i = 0; head && i < clause.head().arity && matched; ++i) {
+        matched = env_.unifyTemplate(clause.head().args[i], base, head[i]);
+    }
+    if (matched) {
+        join(clause, ranges, order, 0, base, emit);
+    }
+    env_.undo(mark);
+}
+
+void BottomUpEvaluator::join(
+    const CompiledClause& clause, const std::vector<Range>& ranges,
+    const std::vector<size_t>& order, size_t index, uint32_t base,
+    const Emit& emit) {
+
+    if (index == clause.body().size()) {
+        auto mark = env_.mark();
+        Fact fact = env_.resolve(env_.instantiate(clause.head(), base));
+        env_.undo(mark);
+        emit(fact);
+        return;
+    }
+
+    const Goal& goal = clause.body()[order[index]];
+    const Range& range = ranges[order[index]];
+    if (!range.table || range.begin >= range.end) {
+        return;
+    }
+
+    // Look up by whatever the goal's arguments are bound to so far
+    auto outer = env_.mark();
+    Cell* args = env_.allocate(goal.arity);
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        Cell arg = goal.args[i];
+        args[i] = arg.isRef() ? env_.deref(Cell::ref(base + arg.slot())) : arg;
+    }
+
+    RowSet rows = range.table->candidates(args);
+    RowSet::Position pos;
+    if (rows.isAll()) {
+        rows.advance(pos, range.begin);     // Straight to a delta's rows
+    }
+    size_t r;
+    while (rows.next(pos, r) && step()) {
+        if (r < range.begin) continue;
+        if (r >= range.end) break;      // Rows come in insertion order
+        if (!range.table->live(r)) continue;
+
+        const Cell* row = range.table->row(r);
+        auto mark = env_.mark();
+        bool matched = true;
+        for (uint32_t i = 0; i < goal.arity && matched; ++i) {
+            matched = env_.unifyTemplate(goal.args[i], base, row[i]);
+        }
+        if (matched) {
+            join(clause, ranges, order, index + 1, base, emit);
+        }
+        env_.undo(mark);
+    }
+    env_.undo(outer);
+}
+
+void BottomUpEvaluator::update(Relations& derived, const Changes& added,
+                               const Changes& removed, Lookup before) {
+    // A goal reads the derived relation if there is one, else stored facts
+    auto relation = [&](const PredicateKey& q, bool old) -> const FactTable* {
+        auto it = derived.find(q);
+        if (it != derived.end()) {
+            return &it->second;
+        }
+        return old ? before(q) : stored_(q);
+    };
+    auto whole = [](const FactTable* table) {
+        return Range{table, 0, table ? table->size() : 0};
+    };
+    auto tableOf = [](Relations& relations, const PredicateKey& p) -> FactTable& {
+        return relations.try_emplace(p, p.name, p.arity).first->second;
+    };
+
+    // Delete: every derived fact with a derivation through a removed one.
+    // Derived relations are left as they were meanwhile, so the other
+    // goals of a join read the facts as they were.
+    Relations gone;
+    for (const auto& [q, facts] : removed) {
+        FactTable& table = tableOf(gone, q);
+        for (const auto& fact : facts) {
+            table.add(fact);
+        }
+    }
+    for (const auto& stratum : strata_) {
+        if (!derived.count(stratum.front())) continue;
+
+        std::unordered_map<PredicateKey, size_t> done;
+        for (bool changed = true; changed; ) {
+            std::unordered_map<PredicateKey, size_t> end;
+            for (const auto& [q, table] : gone) {
+                end[q] = table.size();
+            }
+            for (const auto& p : stratum) {
+                const FactTable& current = derived.at(p);
+                Emit emit = [&](const Fact& fact) {
+                    FactTable& deleted = tableOf(gone, p);
+                    if (find(current, fact) != SIZE_MAX && find(deleted, fact) == SIZE_MAX) {
+                        deleted.add(fact);
+                    }
+                };
+                for (uint32_t id : rulesFor_.at(p)) {
+                    const CompiledClause& clause = *clauses_[id];
+                    const auto& body = clause.body();
+                    for (size_t d = 0; d < body.size(); ++d) {
+                        PredicateKey q = keyOf(body[d]);
+                        auto delta = gone.find(q);
+                        if (delta == gone.end() || done[q] >= end[q]) continue;
+
+                        std::vector<Range> ranges(body.size());
+                        for (size_t i = 0; i < body.size(); ++i) {
+                            ranges[i] = i == d ? Range{&delta->second, done[q], end[q]}
+                                               : whole(relation(keyOf(body[i]), true));
+                        }
+                        evaluate(clause, ranges, emit, nullptr, d);
+                    }
+                }
+            }
+            changed = false;
+            for (const auto& [q, table] : gone) {
+                changed = changed || table.size() > end[q];
+                done[q] = end[q];
+            }
+        }
+    }
+    for (const auto& [p, deleted] : gone) {
+        auto it = derived.find(p);
+        if (it == derived.end()) continue;
+        for (size_t r = 0; r < deleted.size(); ++r) {
+            size_t row = find(it->second, deleted.fact(r));
+            if (row != SIZE_MAX) {
+                it->second.remove(row);
+            }
+        }
+    }
+
+    // Rows from here on are new to every join below
+    std::unordered_map<PredicateKey, size_t> start;
+    for (const auto& [p, table] : derived) {
+        start[p] = table.size();
+    }
+
+    // Restore deleted facts that are still stored, or derivable through
+    // facts that are left
+    for (const auto& stratum : strata_) {
+        for (const auto& p : stratum) {
+            auto deleted = gone.find(p);
+            if (!derived.count(p) || deleted == gone.end()) continue;
+            FactTable& target = derived.at(p);
+            for (size_t r = 0; r < deleted->second.size(); ++r) {
+                Fact fact = deleted->second.fact(r);
+                const FactTable* stored = stored_(p);
+                bool derivable = stored && find(*stored, fact) != SIZE_MAX;
+                
+                auto mark = env_.mark();
+                std::unordered_map<Symbol, uint32_t> vars;
+                Cell* head = env_.allocate(p.arity);
+                for (uint32_t i = 0; i < p.arity; ++i) {
+                    head[i] = env_.encode(fact.terms()[i], vars);
+                }
+                Emit emit = [&](const Fact&) { derivable = true; };
+                for (uint32_t id : rulesFor_.at(p)) {
+                    if (derivable) break;
+                    const CompiledClause& clause = *clauses_[id];
+                    std::vector<Range> ranges(clause.body().size());
+                    for (size_t i = 0; i < ranges.size(); ++i) {
+                        ranges[i] = whole(relation(keyOf(clause.body()[i]), false));
+                    }
+                    evaluate(clause, ranges, emit, head);
+                }
+                env_.undo(mark);
+                
+                if (derivable && find(target, fact) == SIZE_MAX) {
+                    target.add(fact);
+                }
+            }
+        }
+    }
+
+    // Insert: every fact derivable through a restored or added one. Added
+    // facts of derived relations are new rows of them; those of stored
+    // relations are joined from a table of their own.
+    Relations fresh;
+    for (const auto& [q, facts] : added) {
+        auto it = derived.find(q);
+        FactTable& table = it != derived.end() ? it->second : tableOf(fresh, q);
+        for (const auto& fact : facts) {
+            if (it == derived.end() || find(table, fact) == SIZE_MAX) {
+                table.add(fact);
+            }
+        }
+    }
+    for (const auto& stratum : strata_) {
+        if (!derived.count(stratum.front())) continue;
+
+        // Earlier strata are final: their new rows are one delta, read
+        // in the first round. This stratum's grow by round.
+        std::unordered_map<PredicateKey, size_t> old(start);
+        for (bool first = true; ; first = false) {
+            std::unordered_map<PredicateKey, size_t> end;
+            for (const auto& [q, table] : derived) {
+                end[q] = table.size();
+            }
+            for (const auto& p : stratum) {
+                FactTable& target = derived.at(p);
+                Emit emit = [&](const Fact& fact) {
+                    if (find(target, fact) == SIZE_MAX) {
+                        target.add(fact);
+                    }
+                };
+                for (uint32_t id : rulesFor_.at(p)) {
+                    const CompiledClause& clause = *clauses_[id];
+                    const auto& body = clause.body();
+                    for (size_t d = 0; d < body.size(); ++d) {
+                        PredicateKey q = keyOf(body[d]);
+                        Range delta;
+                        if (derived.count(q)) {
+                            delta = Range{&derived.at(q), old[q], end[q]};
+                        } else if (first && fresh.count(q)) {
+                            delta = whole(&fresh.at(q));
+                        }
+                        if (delta.begin >= delta.end) continue;
+
+                        std::vector<Range> ranges(body.size());
+                        for (size_t i = 0; i < body.size(); ++i) {
+                            ranges[i] = i == d ? delta : whole(relation(keyOf(body[i]), false));
+                        }
+                        evaluate(clause, ranges, emit, nullptr, d);
+                    }
+                }
+            }
+
+            bool changed = false;
+            for (const auto& [q, size] : end) {
+                old[q] = size;
+            }
+            for (const auto& p : stratum) {
+                changed = changed || derived.at(p).size() > end.at(p);
+            }
+            if (!changed) break;
+        }
+    }
+}
+
+size_t BottomUpEvaluator::find(const FactTable& table, const Fact& fact) {
+    auto mark = env_.mark();
+    std::unordered_map<Symbol, uint32_t> vars;
+    Cell* args = env_.allocate(table.arity());
+    for (uint32_t i = 0; i < table.arity(); ++i) {
+        args[i] = env_.encode(fact.terms()[i], vars);
+    }
+    
+    // Both are ground, so they unify only if equal
+    size_t found = SIZE_MAX;
+    RowSet rows = table.candidates(args);
+    RowSet::Position pos;
+    size_t r;
+    while (found == SIZE_MAX && rows.next(pos, r)) {
+        if (!table.live(r)) continue;
+        const Cell* row = table.row(r);
+        auto inner = env_.mark();
+        bool matched = true;
+        for (uint32_t i = 0; i < table.arity() && matched; ++i) {
+            matched = env_.unify(args[i], row[i]);
+        }
+        env_.undo(inner);
+        if (matched) {
+            found = r;
+        }
+    }
+    env_.undo(mark);
+    return found;
+}
+
+} // namespace kbgdb
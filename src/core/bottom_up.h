@@ -0,0 +1,135 @@
+#pragma once
+#include "core/binding_env.h"
+#include "core/clause.h"
+#include "core/fact_table.h"
+#include "core/query_budget.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * BottomUpEvaluator materializes the predicates defined by rules, Datalog
+ * style: instead of proving goals on demand it derives every fact the
+ * rules imply, once, into FactTables that queries then read by index.
+ *
+ * Predicates are grouped into strata, the strongly connected components
+ * of the rule dependency graph, and evaluated dependencies first. Within
+ * a stratum evaluation is semi-naive: each round only joins through the
+ * facts derived in the previous round (the delta), until a round derives
+ * nothing new.
+ *
+ * A predicate is materialized only if the result is guaranteed finite and
+ * ground: every rule for it has ground or variable head arguments, every
+ * head variable occurs in the body, the facts it reads are ground, and
+ * every predicate it depends on is materialized too, and none of its
+ * rules calls an aggregate. Other predicates are left to top-down
+ * evaluation.
+ *
+ * Derived relations can be kept up to date as stored facts change with
+ * update(), which rederives only what the changed facts reach.
+ */
+class BottomUpEvaluator {
+public:
+    using Clauses = std::vector<std::shared_ptr<const CompiledClause>>;
+    using Relations = std::unordered_map<PredicateKey, FactTable>;
+    using Lookup = std::function<const FactTable*(const PredicateKey&)>;
+    using Changes = std::unordered_map<PredicateKey, std::vector<Fact>>;
+
+    BottomUpEvaluator(const Clauses& clauses, const Relations& facts);
+
+    /** Read the stored facts of a predicate from stored(key), or none if null. */
+    BottomUpEvaluator(const Clauses& clauses, Lookup stored);
+
+    /**
+     * The predicates defined by rules, one stratum per entry, in
+     * evaluation order (every stratum after those it depends on).
+     */
+    const std::vector<std::vector<PredicateKey>>& strata() const { return strata_; }
+
+    bool canMaterialize(const PredicateKey& key) const {
+        return materializable_.count(key) > 0;
+    }
+
+    /**
+     * Derive every materializable predicate. The tables include the
+     * predicate's stored facts as well as the derived ones.
+     */
+    Relations run();
+    
+    /** Derive the predicates of goals, and those they depend on, only. */
+    Relations run(const std::vector<PredicateKey>& goals);
+    
+    /**
+     * Charge run()'s join steps to budget, and stop deriving once it is
+     * exceeded: the relations are then those derived so far. Null (the
+     * default) for no limits.
+     */
+    void setBudget(QueryBudget* budget) { budget_ = budget; }
+    
+    /**
+     * Bring relations run() derived up to date with changes to the stored
+     * facts, which the lookup this evaluator was made with now reads:
+     * added and removed are the facts added and removed, and before
+     * reads the stored facts as they were. Derived facts are changed in
+     * place, DRed style: every fact derivable through a removed one is
+     * deleted, those still derivable otherwise are restored, and the
+     * facts derivable through restored and added ones are added, each
+     * step semi-naively.
+     */
+    void update(Relations& derived, const Changes& added, const Changes& removed,
+                Lookup before);
+
+private:
+    // The rows of a relation one body goal may read: [begin, end)
+    struct Range {
+        const FactTable* table = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    // Receives each head a join derives
+    using Emit = std::function<void(const Fact&)>;
+
+    void stratify();
+    bool isDatalog(const CompiledClause& clause) const;
+    Relations derive(const std::unordered_set<PredicateKey>* needed);
+
+    // Join the body of clause over ranges, starting with goal first (the
+    // one reading a delta, say) and then in order; if head is given,
+    // only for the head instance with those arguments
+    void evaluate(const CompiledClause& clause, const std::vector<Range>& ranges,
+                  const Emit& emit, const Cell* head = nullptr, size_t first = 0);
+    void join(const CompiledClause& clause, const std::vector<Range>& ranges,
+              const std::vector<size_t>& order, size_t index, uint32_t base,
+              const Emit& emit);
+
+    // Row of a live fact equal to fact in table, or SIZE_MAX
+    size_t find(const FactTable& table, const Fact& fact);
+
+    const Clauses& clauses_;
+    Lookup stored_;
+
+    std::unordered_map<PredicateKey, std::vector<uint32_t>> rulesFor_;
+    std::vector<std::vector<PredicateKey>> strata_;
+    std::unordered_map<PredicateKey, size_t> stratumOf_;
+    std::unordered_set<PredicateKey> materializable_;
+
+    BindingEnv env_;
+    
+    QueryBudget* budget_ = nullptr;
+    uint64_t steps_ = 0;
+    
+    // Count a join step against budget_, if any; false once it is exceeded
+    bool step() {
+        if (!budget_) return true;
+        if (++steps_ % QueryBudget::CHECK_STEPS != 0) return !budget_->stopped();
+        return budget_->charge(QueryBudget::CHECK_STEPS);
+    }
+};
+
+} // namespace kbgdb
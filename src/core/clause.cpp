@@ -0,0 +1,98 @@
+#include "core/clause.h"
+#include "core/leapfrog_join.h"
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
+namespace kbgdb {
+
+namespace {
+
+void collectVars(const Goal& goal, std::vector<uint32_t>& vars) {
+    std::vector<Cell> pending(goal.args, goal.args + goal.arity);
+    while (!pending.empty()) {
+        Cell cell = pending.back();
+        pending.pop_back();
+        if (cell.isRef()) {
+            vars.push_back(cell.slot());
+        } else if (cell.isStructure() || cell.isList()) {
+            pending.insert(pending.end(), cell.args(), cell.args() + cell.arity());
+        }
+    }
+}
+
+// Whether the goals split into groups linked only by head variables
+bool hasIndependentGoals(const Goal& head, const std::vector<Goal>& body) {
+    if (body.size() < 2) {
+        return false;
+    }
+    std::vector<uint32_t> headVars;
+    collectVars(head, headVars);
+
+    std::vector<size_t> parent(body.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&](size_t i) {
+        while (parent[i] != i) i = parent[i] = parent[parent[i]];
+        return i;
+    };
+    std::unordered_map<uint32_t, size_t> firstUse;
+    for (size_t i = 0; i < body.size(); ++i) {
+        std::vector<uint32_t> vars;
+        collectVars(body[i], vars);
+        for (uint32_t v : vars) {
+            if (std::find(headVars.begin(), headVars.end(), v) != headVars.end()) continue;
+            auto [it, inserted] = firstUse.emplace(v, i);
+            if (!inserted) parent[find(i)] = find(it->second);
+        }
+    }
+    for (size_t i = 1; i < body.size(); ++i) {
+        if (find(i) != find(0)) return true;
+    }
+    return false;
+}
+
+void collectVars(const Term& term, std::vector<Term>& vars) {
+    if (term.isVariable()) {
+        bool seen = std::any_of(vars.begin(), vars.end(),
+                                [&](const Term& v) { return v.value == term.value; });
+        if (!seen) vars.push_back(term);
+    }
+    for (const auto& arg : term.args) {
+        collectVars(arg, vars);
+    }
+}
+
+} // namespace
+
+CompiledClause CompiledClause::compile(const Rule& rule) {
+    CompiledClause clause;
+    clause.head_ = clause.compileGoal(rule.head());
+    clause.body_.reserve(rule.body().size());
+    for (const auto& goal : rule.body()) {
+        clause.body_.push_back(clause.compileGoal(goal));
+    }
+    clause.cyclicBody_ = LeapfrogJoin::isCyclic(clause.body_);
+    clause.independentBody_ = hasIndependentGoals(clause.head_, clause.body_);
+    return clause;
+}
+
+Goal CompiledClause::compileGoal(const Fact& fact) {
+    uint32_t arity = static_cast<uint32_t>(fact.arity());
+    Cell* args = arena_.allocate(arity);
+    for (uint32_t i = 0; i < arity; ++i) {
+        args[i] = encodeTerm(fact.terms()[i], arena_, varNames_);
+    }
+    return Goal{fact.predicate(), arity, args};
+}
+
+Fact conjunctionHead(const std::vector<Fact>& goals) {
+    std::vector<Term> vars;
+    for (const auto& goal : goals) {
+        for (const auto& term : goal.terms()) {
+            collectVars(term, vars);
+        }
+    }
+    return Fact("$query", std::move(vars));
+}
+
+} // namespace kbgdb
@@ -0,0 +1,63 @@
+#pragma once
+#include "common/cell.h"
+#include "core/binding_env.h"
+#include "core/rule.h"
+#include <cstdint>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * CompiledClause is a rule compiled once, at addRule time, into cell
+ * templates. Variables are numbered 0..numVars()-1 in order of first
+ * occurrence (head first, then body).
+ *
+ * Trying the clause reserves a frame of numVars() fresh slots in the
+ * BindingEnv and unifies the head template against the goal in place
+ * (BindingEnv::unifyTemplate), so a failing head costs no copying. Body
+ * goals are instantiated one at a time as evaluation reaches them.
+ */
+class CompiledClause {
+public:
+    static CompiledClause compile(const Rule& rule);
+    
+    CompiledClause(const CompiledClause&) = delete;
+    CompiledClause& operator=(const CompiledClause&) = delete;
+    CompiledClause(CompiledClause&&) = default;
+    CompiledClause& operator=(CompiledClause&&) = default;
+    
+    const Goal& head() const { return head_; }
+    const std::vector<Goal>& body() const { return body_; }
+    uint32_t numVars() const { return static_cast<uint32_t>(varNames_.size()); }
+    const std::vector<Symbol>& varNames() const { return varNames_; }
+    
+    /** Whether the body is a cyclic join (see LeapfrogJoin::isCyclic). */
+    bool cyclicBody() const { return cyclicBody_; }
+    
+    /**
+     * Whether the body falls into groups of goals that share no variable
+     * except through the head: independent subgoals once the head's
+     * variables are bound by the call.
+     */
+    bool independentBody() const { return independentBody_; }
+
+private:
+    CompiledClause() = default;
+    
+    Goal compileGoal(const Fact& fact);
+    
+    Goal head_;
+    std::vector<Goal> body_;
+    std::vector<Symbol> varNames_;
+    bool cyclicBody_ = false;
+    bool independentBody_ = false;
+    CellArena arena_{64};
+};
+
+/**
+ * The head of the clause a conjunctive query is solved as: the goal
+ * $query over each of goals' variables once, in order of first occurrence.
+ */
+Fact conjunctionHead(const std::vector<Fact>& goals);
+
+} // namespace kbgdb
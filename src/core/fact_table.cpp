@@ -0,0 +1,586 @@
+#include "core/fact_table.h"
+#include <stdexcept>
+
+namespace kbgdb {
+
+// ============================================================================
+// RowList
+// ============================================================================
+
+RowList& RowList::operator=(const RowList& other) {
+    if (this != &other) {
+        size_t n = other.size();
+        const uint32_t* rows = other.rows_.load(std::memory_order_acquire);
+        owned_.reset(n ? new uint32_t[n] : nullptr);
+        std::copy(rows, rows + n, owned_.get());
+        capacity_ = static_cast<uint32_t>(n);
+        rows_.store(owned_.get(), std::memory_order_release);
+        size_.store(static_cast<uint32_t>(n), std::memory_order_release);
+    }
+    return *this;
+}
+
+size_t RowList::countBelow(size_t limit) const {
+    // The size first: the array loaded after it holds at least that many
+    size_t n = size();
+    if (n == 0) {
+        return 0;
+    }
+    const uint32_t* rows = rows_.load(std::memory_order_acquire);
+    if (rows[n - 1] < limit) {
+        return n;
+    }
+    return static_cast<size_t>(std::lower_bound(rows, rows + n, limit) - rows);
+}
+
+std::unique_ptr<uint32_t[]> RowList::push_back(uint32_t row) {
+    std::unique_ptr<uint32_t[]> old;
+    uint32_t n = size_.load(std::memory_order_relaxed);
+    if (n == capacity_) {
+        capacity_ = std::max<uint32_t>(2, capacity_ * 2);
+        std::unique_ptr<uint32_t[]> grown(new uint32_t[capacity_]);
+        std::copy(owned_.get(), owned_.get() + n, grown.get());
+        old = std::move(owned_);
+        owned_ = std::move(grown);
+        rows_.store(owned_.get(), std::memory_order_release);
+    }
+    owned_[n] = row;
+    size_.store(n + 1, std::memory_order_release);
+    return old;
+}
+
+// ============================================================================
+// FactTable storage
+// ============================================================================
+
+// Arrays grown out of, which readers of older versions may still hold
+using Superseded = std::vector<std::shared_ptr<void>>;
+
+/**
+ * The index of one argument position: rows by key, in an open addressing
+ * table that lookups probe without locking while add() inserts into it.
+ */
+struct FactTable::ArgIndex {
+    struct Slot {
+        uint64_t key = 0;                       // Set before rows is
+        std::atomic<RowList*> rows{nullptr};    // Null while free
+    };
+
+    struct Slots {
+        explicit Slots(unsigned bits)
+            : shift(64 - bits), slots(new Slot[size_t{1} << bits]) {}
+
+        size_t capacity() const { return size_t{1} << (64 - shift); }
+        size_t home(uint64_t key) const { return (key * 0x9E3779B97F4A7C15ull) >> shift; }
+
+        // The slot holding key, or the free one where it belongs
+        Slot& probe(uint64_t key) const {
+            size_t mask = capacity() - 1;
+            for (size_t i = home(key); ; i = (i + 1) & mask) {
+                Slot& slot = slots[i];
+                RowList* rows = slot.rows.load(std::memory_order_acquire);
+                if (!rows || slot.key == key) {
+                    return slot;
+                }
+            }
+        }
+
+        unsigned shift;
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    ArgIndex() : owned(std::make_unique<Slots>(3)), current(owned.get()) {}
+
+    const RowList* find(uint64_t key) const {
+        return current.load(std::memory_order_acquire)->probe(key)
+            .rows.load(std::memory_order_acquire);
+    }
+
+    void add(Cell cell, uint32_t row, Superseded& superseded) {
+        uint64_t key;
+        RowList& rows = indexKey(cell, key) ? bucket(key, superseded) : wildcards;
+        if (auto old = rows.push_back(row)) {
+            superseded.emplace_back(std::move(old));
+        }
+    }
+
+    RowList& bucket(uint64_t key, Superseded& superseded) {
+        Slot* slot = &owned->probe(key);
+        if (RowList* rows = slot->rows.load(std::memory_order_relaxed)) {
+            return *rows;
+        }
+        if ((buckets.size() + 1) * 2 > owned->capacity()) {
+            // Rehash into twice the slots, kept under half full
+            auto grown = std::make_unique<Slots>(65 - owned->shift);
+            for (size_t i = 0; i < owned->capacity(); ++i) {
+                const Slot& from = owned->slots[i];
+                if (RowList* rows = from.rows.load(std::memory_order_relaxed)) {
+                    Slot& to = grown->probe(from.key);
+                    to.key = from.key;
+                    to.rows.store(rows, std::memory_order_relaxed);
+                }
+            }
+            current.store(grown.get(), std::memory_order_release);
+            superseded.emplace_back(std::move(owned));
+            owned = std::move(grown);
+            slot = &owned->probe(key);
+        }
+        buckets.push_back(std::make_unique<RowList>());
+        slot->key = key;
+        slot->rows.store(buckets.back().get(), std::memory_order_release);
+        return *buckets.back();
+    }
+
+    std::unique_ptr<Slots> owned;
+    std::atomic<const Slots*> current;
+    std::vector<std::unique_ptr<RowList>> buckets;
+    RowList wildcards;      // Rows with a variable here
+};
+
+/**
+ * Rows and indexes, shared by a table and its forks. Only the version
+ * that has seen every change makes more; the arrays it grows out of are
+ * kept while some version of the epoch they were grown out of, or an
+ * older one, is left to read them.
+ */
+struct FactTable::Storage {
+    explicit Storage(uint32_t arity)
+        : indexes(arity)
+        , built(new std::atomic<const ArgIndex*>[arity]()) {
+        if (arity > 0) {
+            indexes[0] = std::make_unique<ArgIndex>();
+            built[0].store(indexes[0].get(), std::memory_order_release);
+        }
+    }
+
+    void pin(size_t epoch) { ++versions[epoch]; }
+
+    void unpin(size_t epoch) {
+        auto it = versions.find(epoch);
+        if (--it->second == 0) {
+            versions.erase(it);
+        }
+    }
+
+    // A version moving on, as add() does after each row
+    void advance(size_t from, size_t to) {
+        auto it = versions.find(from);
+        if (it->second == 1) {
+            auto node = versions.extract(it);
+            node.key() = to;
+            auto result = versions.insert(std::move(node));
+            if (!result.inserted) {
+                ++result.position->second;
+            }
+        } else {
+            --it->second;
+            pin(to);
+        }
+    }
+
+    void retire(size_t epoch, Superseded& superseded) {
+        for (auto& array : superseded) {
+            retired.emplace_back(epoch, std::move(array));
+        }
+        superseded.clear();
+    }
+
+    // Free what no version left is old enough to read
+    void reclaim() {
+        size_t oldest = versions.empty() ? NO_ROW : versions.begin()->first;
+        retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                     [&](const auto& r) { return r.first < oldest; }),
+                      retired.end());
+    }
+
+    std::mutex mutex;           // Appending, publishing an index, versions
+    std::mutex buildMutex;      // One index build at a time
+
+    size_t epoch = 0;           // Changes made
+    size_t size = 0;
+    size_t removed = 0;
+    std::unique_ptr<Cell[]> cells;
+    size_t capacity = 0;        // In rows
+    std::unique_ptr<uint32_t[]> varCounts;
+    size_t varCapacity = 0;
+    size_t firstVariable = NO_ROW;
+    std::unique_ptr<std::atomic<size_t>[]> deleted;     // Null until a row is removed
+    size_t deletedCapacity = 0;
+    CellArena arena;
+
+    // Per argument position; null until built. Lookups read an index
+    // through built without locking.
+    std::vector<std::unique_ptr<ArgIndex>> indexes;
+    std::unique_ptr<std::atomic<const ArgIndex*>[]> built;
+
+    std::map<size_t, size_t> versions;      // Live versions by epoch
+    std::vector<std::pair<size_t, std::shared_ptr<void>>> retired;  // By epoch grown out of
+};
+
+// Grow array to hold at least n items of width cells, copying the first
+// used; the old array is superseded
+template <typename T>
+static void grow(std::unique_ptr<T[]>& array, size_t& capacity, size_t n, size_t width,
+                 size_t used, Superseded& superseded) {
+    if (n <= capacity) {
+        return;
+    }
+    capacity = std::max<size_t>(8, capacity * 2);
+    std::unique_ptr<T[]> grown(new T[capacity * width]);
+    std::copy(array.get(), array.get() + used * width, grown.get());
+    if (array) {
+        superseded.emplace_back(std::move(array));
+    }
+    array = std::move(grown);
+}
+
+// Grow the removal epochs of rows likewise; new rows are never removed
+static void grow(std::unique_ptr<std::atomic<size_t>[]>& array, size_t& capacity, size_t n,
+                 Superseded& superseded) {
+    if (n <= capacity) {
+        return;
+    }
+    size_t used = capacity;
+    capacity = std::max<size_t>(8, std::max(n, capacity * 2));
+    std::unique_ptr<std::atomic<size_t>[]> grown(new std::atomic<size_t>[capacity]);
+    for (size_t i = 0; i < capacity; ++i) {
+        size_t epoch = i < used ? array[i].load(std::memory_order_relaxed) : SIZE_MAX;
+        grown[i].store(epoch, std::memory_order_relaxed);
+    }
+    if (array) {
+        superseded.emplace_back(std::move(array));
+    }
+    array = std::move(grown);
+}
+
+// ============================================================================
+// FactTable
+// ============================================================================
+
+FactTable::FactTable(Symbol predicate, uint32_t arity)
+    : FactTable(predicate, arity, std::make_shared<Storage>(arity)) {
+    storage_->pin(0);
+}
+
+FactTable::FactTable(Symbol predicate, uint32_t arity, std::shared_ptr<Storage> storage)
+    : predicate_(predicate)
+    , arity_(arity)
+    , storage_(std::move(storage))
+    , trieMutex_(std::make_unique<std::mutex>()) {
+}
+
+FactTable::~FactTable() {
+    release();
+}
+
+FactTable::FactTable(const FactTable& other)
+    : FactTable(other.predicate_, other.arity_) {
+    for (size_t i = 0; i < other.size(); ++i) {
+        add(other.fact(i));
+    }
+    for (size_t i = 0; other.removed() > removed(); ++i) {
+        if (!other.live(i)) {
+            remove(i);
+        }
+    }
+}
+
+FactTable& FactTable::operator=(const FactTable& other) {
+    if (this != &other) {
+        FactTable copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+FactTable::FactTable(FactTable&& other) noexcept
+    : predicate_(other.predicate_)
+    , arity_(other.arity_)
+    , storage_(std::move(other.storage_))
+    , epoch_(other.epoch_)
+    , size_(other.size_)
+    , removed_(other.removed_)
+    , cells_(other.cells_)
+    , varCounts_(other.varCounts_)
+    , firstVariable_(other.firstVariable_)
+    , deleted_(other.deleted_)
+    , tries_(std::move(other.tries_))
+    , trieMutex_(std::move(other.trieMutex_)) {
+}
+
+FactTable& FactTable::operator=(FactTable&& other) noexcept {
+    if (this != &other) {
+        release();
+        predicate_ = other.predicate_;
+        arity_ = other.arity_;
+        storage_ = std::move(other.storage_);
+        epoch_ = other.epoch_;
+        size_ = other.size_;
+        removed_ = other.removed_;
+        cells_ = other.cells_;
+        varCounts_ = other.varCounts_;
+        firstVariable_ = other.firstVariable_;
+        deleted_ = other.deleted_;
+        tries_ = std::move(other.tries_);
+        trieMutex_ = std::move(other.trieMutex_);
+    }
+    return *this;
+}
+
+void FactTable::release() {
+    if (storage_) {
+        std::lock_guard<std::mutex> lock(storage_->mutex);
+        storage_->unpin(epoch_);
+        storage_->reclaim();
+    }
+}
+
+FactTable FactTable::fork() const {
+    FactTable version(predicate_, arity_, storage_);
+    version.epoch_ = epoch_;
+    version.size_ = size_;
+    version.removed_ = removed_;
+    version.cells_ = cells_;
+    version.varCounts_ = varCounts_;
+    version.firstVariable_ = firstVariable_;
+    version.deleted_ = deleted_;
+    std::lock_guard<std::mutex> lock(storage_->mutex);
+    storage_->pin(epoch_);
+    return version;
+}
+
+void FactTable::own(std::unique_lock<std::mutex>& lock) {
+    if (epoch_ != storage_->epoch) {
+        // Another version has changed the storage since this one
+        lock.unlock();
+        *this = FactTable(*this);
+        lock = std::unique_lock<std::mutex>(storage_->mutex);
+    }
+}
+
+void FactTable::update() {
+    const Storage& s = *storage_;
+    epoch_ = s.epoch;
+    size_ = s.size;
+    removed_ = s.removed;
+    cells_ = s.cells.get();
+    varCounts_ = s.varCounts.get();
+    firstVariable_ = s.firstVariable;
+    deleted_ = s.deleted.get();
+    tries_.clear();
+}
+
+void FactTable::add(const Fact& fact) {
+    if (fact.arity() != arity_) {
+        throw std::invalid_argument("Fact " + fact.toString() +
+            " does not match arity of " + PredicateKey{predicate_, arity_}.toString());
+    }
+
+    std::unique_lock<std::mutex> lock(storage_->mutex);
+    own(lock);
+    Storage& s = *storage_;
+    size_t row = s.size;
+    Superseded superseded;
+
+    grow(s.cells, s.capacity, row + 1, arity_, row, superseded);
+    if (s.deleted) {
+        grow(s.deleted, s.deletedCapacity, row + 1, superseded);
+    }
+    Cell* cells = s.cells.get() + row * arity_;
+    std::vector<Symbol> vars;
+    for (uint32_t i = 0; i < arity_; ++i) {
+        cells[i] = encodeTerm(fact.terms()[i], s.arena, vars);
+    }
+
+    if (!vars.empty() && s.firstVariable == NO_ROW) {
+        s.firstVariable = row;
+    }
+    if (s.firstVariable != NO_ROW) {
+        size_t i = row - s.firstVariable;
+        grow(s.varCounts, s.varCapacity, i + 1, 1, i, superseded);
+        s.varCounts[i] = static_cast<uint32_t>(vars.size());
+    }
+
+    for (uint32_t pos = 0; pos < arity_; ++pos) {
+        if (s.indexes[pos]) {
+            s.indexes[pos]->add(cells[pos], static_cast<uint32_t>(row), superseded);
+        }
+    }
+
+    s.size = row + 1;
+    size_t epoch = s.epoch++;
+    s.advance(epoch, s.epoch);
+    s.retire(epoch, superseded);
+    s.reclaim();
+    update();
+}
+
+void FactTable::remove(size_t i) {
+    std::unique_lock<std::mutex> lock(storage_->mutex);
+    own(lock);
+    Storage& s = *storage_;
+    Superseded superseded;
+    grow(s.deleted, s.deletedCapacity, s.size, superseded);
+
+    // Versions up to this epoch still see the row
+    size_t epoch = s.epoch++;
+    s.deleted[i].store(s.epoch, std::memory_order_relaxed);
+    ++s.removed;
+    s.advance(epoch, s.epoch);
+    s.retire(epoch, superseded);
+    s.reclaim();
+    update();
+}
+
+void FactTable::compact() {
+    FactTable compacted(predicate_, arity_);
+    for (size_t i = 0; i < size_; ++i) {
+        if (live(i)) {
+            compacted.add(fact(i));
+        }
+    }
+    *this = std::move(compacted);
+}
+
+Fact FactTable::fact(size_t i) const {
+    std::vector<Term> terms;
+    terms.reserve(arity_);
+    const Cell* cells = row(i);
+    for (uint32_t j = 0; j < arity_; ++j) {
+        terms.push_back(decodeCell(cells[j]));
+    }
+    return Fact(predicate_, std::move(terms));
+}
+
+bool FactTable::hasIndex(uint32_t position) const {
+    return position < arity_ &&
+           storage_->built[position].load(std::memory_order_acquire) != nullptr;
+}
+
+void FactTable::ensureIndex(uint32_t position) const {
+    if (position >= arity_ || hasIndex(position)) {
+        return;
+    }
+    Storage& s = *storage_;
+    std::lock_guard<std::mutex> building(s.buildMutex);
+    if (hasIndex(position)) {
+        return;     // Built by another thread meanwhile
+    }
+
+    // Index the rows there are now without holding up add(), then
+    // catch up with the ones added meanwhile. This version keeps the
+    // array read from being reclaimed.
+    size_t rows;
+    const Cell* cells;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        rows = s.size;
+        cells = s.cells.get();
+    }
+    auto index = std::make_unique<ArgIndex>();
+    Superseded superseded;
+    for (size_t r = 0; r < rows; ++r) {
+        index->add(cells[r * arity_ + position], static_cast<uint32_t>(r), superseded);
+        superseded.clear();     // Never shared yet
+    }
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for (size_t r = rows; r < s.size; ++r) {
+        index->add(s.cells[r * arity_ + position], static_cast<uint32_t>(r), superseded);
+        superseded.clear();
+    }
+    s.indexes[position] = std::move(index);
+    s.built[position].store(s.indexes[position].get(), std::memory_order_release);
+}
+
+RowSet FactTable::candidates(const Cell* args) const {
+    const ArgIndex* best = nullptr;
+    const RowList* bestBucket = nullptr;
+    size_t bestMatches = 0;
+    size_t bestWildcards = 0;
+    size_t bestSize = size_;
+    int firstUnindexed = -1;
+
+    // Counts are of this version's rows only, so that every reader of it
+    // makes the same choice
+    for (uint32_t pos = 0; pos < arity_; ++pos) {
+        uint64_t key;
+        if (!indexKey(args[pos], key)) continue;
+
+        const ArgIndex* index = storage_->built[pos].load(std::memory_order_acquire);
+        if (!index) {
+            if (firstUnindexed < 0) firstUnindexed = static_cast<int>(pos);
+            continue;
+        }
+        const RowList* bucket = index->find(key);
+        size_t matches = bucket ? bucket->countBelow(size_) : 0;
+        size_t wildcards = index->wildcards.countBelow(size_);
+        if (!best || matches + wildcards < bestSize) {
+            best = index;
+            bestBucket = bucket;
+            bestMatches = matches;
+            bestWildcards = wildcards;
+            bestSize = matches + wildcards;
+        }
+    }
+
+    // No index narrows this lookup enough: index the first bound
+    // position that doesn't have one yet and try again
+    if (firstUnindexed >= 0 && bestSize > MIN_INDEX_ROWS) {
+        ensureIndex(static_cast<uint32_t>(firstUnindexed));
+        return candidates(args);
+    }
+
+    if (!best) {
+        return RowSet::all(size_);
+    }
+    return RowSet::bucket(bestBucket, bestMatches, &best->wildcards, bestWildcards);
+}
+
+const TrieIndex* FactTable::trie(const std::vector<uint32_t>& order) const {
+    std::lock_guard<std::mutex> lock(*trieMutex_);
+    auto it = tries_.find(order);
+    if (it == tries_.end()) {
+        std::unique_ptr<TrieIndex> trie;
+        if (!hasVariables() && removed_ == 0) {
+            trie = TrieIndex::build(cells_, size_, arity_, order);
+        } else if (!hasVariables()) {
+            std::vector<Cell> rows;
+            rows.reserve((size_ - removed_) * arity_);
+            for (size_t i = 0; i < size_; ++i) {
+                if (live(i)) {
+                    rows.insert(rows.end(), row(i), row(i) + arity_);
+                }
+            }
+            trie = TrieIndex::build(rows.data(), size_ - removed_, arity_, order);
+        }
+        it = tries_.emplace(order, std::move(trie)).first;
+    }
+    return it->second.get();
+}
+
+size_t FactTable::bytesUsed() const {
+    const Storage& s = *storage_;
+    std::lock_guard<std::mutex> lock(storage_->mutex);
+    size_t total = s.capacity * arity_ * sizeof(Cell) +
+                   s.varCapacity * sizeof(uint32_t) +
+                   s.deletedCapacity * sizeof(size_t) +
+                   s.arena.bytesUsed();
+    for (const auto& index : s.indexes) {
+        if (!index) continue;
+        total += index->owned->capacity() * sizeof(ArgIndex::Slot) +
+                 index->wildcards.size() * sizeof(uint32_t);
+        for (const auto& rows : index->buckets) {
+            total += sizeof(RowList) + rows->size() * sizeof(uint32_t);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> tries(*trieMutex_);
+        for (const auto& [order, trie] : tries_) {
+            total += trie ? trie->size() * trie->depth() * sizeof(Cell) : 0;
+        }
+    }
+    return total;
+}
+
+} // namespace kbgdb
@@ -0,0 +1,326 @@
+#pragma once
+#include "common/cell.h"
+#include "common/fact.h"
+#include "core/trie_index.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * PredicateKey identifies a relation by name and arity (e.g. parent/2).
+ */
+struct PredicateKey {
+    Symbol name;
+    uint32_t arity = 0;
+    
+    bool operator==(const PredicateKey& other) const {
+        return name == other.name && arity == other.arity;
+    }
+    
+    std::string toString() const {
+        return name.str() + "/" + std::to_string(arity);
+    }
+};
+
+} // namespace kbgdb
+
+template <>
+struct std::hash<kbgdb::PredicateKey> {
+    size_t operator()(const kbgdb::PredicateKey& k) const noexcept {
+        return (static_cast<size_t>(k.name.id()) << 8) ^ k.arity;
+    }
+};
+
+namespace kbgdb {
+
+/**
+ * RowList is an ascending list of row ids that can be read from other
+ * threads while it is appended to: a reader sees every row appended
+ * before it started, and possibly some more. Growing moves the rows to
+ * a new array, which whoever appends decides when to free (see
+ * push_back()), so a list never moves under a reader that could still
+ * be using it.
+ */
+class RowList {
+public:
+    RowList() = default;
+    RowList(const RowList& other) { *this = other; }
+    RowList& operator=(const RowList& other);
+    
+    size_t size() const { return size_.load(std::memory_order_acquire); }
+    uint32_t operator[](size_t i) const { return rows_.load(std::memory_order_acquire)[i]; }
+    
+    /** Number of rows below limit. */
+    size_t countBelow(size_t limit) const;
+    
+    /**
+     * Append row, which must be above every row so far. Returns the
+     * array it replaced if it had to grow; readers may still be reading
+     * it until they finish.
+     */
+    std::unique_ptr<uint32_t[]> push_back(uint32_t row);
+
+private:
+    std::unique_ptr<uint32_t[]> owned_;
+    std::atomic<const uint32_t*> rows_{nullptr};
+    std::atomic<uint32_t> size_{0};
+    uint32_t capacity_ = 0;
+};
+
+/**
+ * RowSet is the set of FactTable rows a lookup has to examine: either
+ * every row, or the first rows of one index bucket merged with those of
+ * the list of rows that hold a variable at the indexed position. Rows
+ * are visited in insertion order.
+ */
+class RowSet {
+public:
+    static RowSet all(size_t size) {
+        RowSet rows;
+        rows.size_ = static_cast<uint32_t>(size);
+        return rows;
+    }
+    
+    static RowSet bucket(const RowList* matches, size_t matchCount,
+                         const RowList* wildcards, size_t wildcardCount) {
+        RowSet rows;
+        rows.all_ = false;
+        rows.matches_ = matches;
+        rows.size_ = matches ? static_cast<uint32_t>(matchCount) : 0;
+        rows.wildcards_ = wildcards;
+        rows.wildcardCount_ = wildcards ? static_cast<uint32_t>(wildcardCount) : 0;
+        return rows;
+    }
+    
+    bool isAll() const { return all_; }
+    
+    /** Upper bound on the number of rows visited. */
+    size_t size() const { return size_t{size_} + wildcardCount_; }
+    
+    /**
+     * Resumable iteration: next() stores the next row in row and advances
+     * pos, or returns false when every row has been visited.
+     */
+    struct Position {
+        size_t i = 0;
+        size_t j = 0;
+    };
+    
+    bool next(Position& pos, size_t& row) const {
+        if (all_) {
+            if (pos.i == size_) return false;
+            row = pos.i++;
+            return true;
+        }
+        size_t a = size_;
+        size_t b = wildcardCount_;
+        if (pos.i == a && pos.j == b) return false;
+        if (pos.j == b || (pos.i < a && (*matches_)[pos.i] < (*wildcards_)[pos.j])) {
+            row = (*matches_)[pos.i++];
+        } else {
+            row = (*wildcards_)[pos.j++];
+        }
+        return true;
+    }
+    
+    bool atEnd(const Position& pos) const {
+        return pos.i == size_ && pos.j == wildcardCount_;
+    }
+    
+    /** Skip the next n rows (or as many as are left). */
+    void advance(Position& pos, size_t n) const {
+        size_t a = size_;
+        size_t b = wildcardCount_;
+        if (all_ || b == 0) {
+            pos.i = std::min(a, pos.i + n);
+        } else if (a == 0) {
+            pos.j = std::min(b, pos.j + n);
+        } else {
+            size_t row;
+            while (n-- > 0 && next(pos, row)) {}
+        }
+    }
+    
+    /**
+     * Call f(row) for each row until it returns false.
+     * Returns false if f stopped the iteration.
+     */
+    template <typename F>
+    bool forEach(F&& f) const {
+        Position pos;
+        size_t r;
+        while (next(pos, r)) {
+            if (!f(r)) return false;
+        }
+        return true;
+    }
+
+private:
+    const RowList* matches_ = nullptr;
+    const RowList* wildcards_ = nullptr;
+    uint32_t size_ = 0;             // Every row, or the matches visited
+    uint32_t wildcardCount_ = 0;
+    bool all_ = true;
+};
+
+/**
+ * FactTable stores the facts of one predicate/arity as packed rows of cells.
+ * 
+ * Each row is arity() consecutive Cells, so a ground atom or small integer
+ * argument costs one word and a scan walks contiguous memory. Compound
+ * and list arguments point into the table's own arena.
+ * 
+ * Argument positions can be hash indexed on their outermost symbol (atom,
+ * number, functor/arity, or list). The first argument is indexed as facts
+ * are added; other positions are indexed the first time a lookup binds
+ * them. Every index is kept up to date by add().
+ * 
+ * Facts are removed by tombstone: a removed row stays in place, and in
+ * the indexes, but lookups skip it (see live()) until compact() drops
+ * it. Neither add() nor remove() moves the other rows.
+ * 
+ * Rows and indexes are append-only storage that fork() shares: a fork is
+ * a version of the table, which sees the rows and removals made before
+ * it (its epoch, counted in changes) while add() and remove() change the
+ * storage behind it, so taking one costs no copy. Arrays that appending
+ * grows out of are reclaimed once no version old enough to still read
+ * them is left.
+ * 
+ * Const members may be called from several threads at once (indexes
+ * and tries built on demand are then built once), and so may add() or
+ * remove() on one version while others are read. Changes may not run
+ * concurrently with anything else on the same version.
+ */
+class FactTable {
+public:
+    FactTable(Symbol predicate, uint32_t arity);
+    ~FactTable();
+    
+    // Copies re-encode every row so compound cells point into the new arena
+    FactTable(const FactTable& other);
+    FactTable& operator=(const FactTable& other);
+    FactTable(FactTable&& other) noexcept;
+    FactTable& operator=(FactTable&& other) noexcept;
+    
+    /**
+     * A version of this table sharing its storage, without copying: the
+     * fork sees the rows this table has now. Adding to either one keeps
+     * the other as it was; the first to add after the other copies the
+     * storage first.
+     */
+    FactTable fork() const;
+    
+    void add(const Fact& fact);
+    
+    /**
+     * Remove fact i, which must be live. Row numbers stay as they were.
+     */
+    void remove(size_t i);
+    
+    /**
+     * Copy the live facts to fresh storage, numbering the rows afresh
+     * and dropping the removed ones.
+     */
+    void compact();
+    
+    Symbol predicate() const { return predicate_; }
+    uint32_t arity() const { return arity_; }
+    
+    /** Number of rows, removed ones included. */
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    
+    /** Number of removed rows. */
+    size_t removed() const { return removed_; }
+    
+    /** False if fact i has been removed; lookups still return its row. */
+    bool live(size_t i) const {
+        return !deleted_ || deleted_[i].load(std::memory_order_relaxed) > epoch_;
+    }
+    
+    /**
+     * The arity() cells of fact i.
+     */
+    const Cell* row(size_t i) const { return cells_ + i * arity_; }
+    
+    /**
+     * Number of distinct variables in fact i (0 for ground facts).
+     */
+    uint32_t numVars(size_t i) const {
+        return i < firstVariable_ ? 0 : varCounts_[i - firstVariable_];
+    }
+    
+    /** True if some fact has a variable argument. */
+    bool hasVariables() const { return firstVariable_ < size_; }
+    
+    /**
+     * Decode fact i back to a Fact.
+     */
+    Fact fact(size_t i) const;
+    
+    /**
+     * Rows that may unify with a goal whose dereferenced argument cells
+     * are args. Uses the smallest index bucket among the bound positions,
+     * building an index for a bound position on first use.
+     */
+    RowSet candidates(const Cell* args) const;
+    
+    bool hasIndex(uint32_t position) const;
+    void ensureIndex(uint32_t position) const;
+    
+    /**
+     * The rows as a trie with columns in the given order (see TrieIndex),
+     * built on first use and dropped by add(). Null unless every fact is
+     * ground and atomic.
+     */
+    const TrieIndex* trie(const std::vector<uint32_t>& order) const;
+    
+    // Below this size a scan is as cheap as an on-demand index
+    static constexpr size_t MIN_INDEX_ROWS = 8;
+    
+    size_t bytesUsed() const;
+
+private:
+    struct ArgIndex;
+    struct Storage;
+    
+    static constexpr size_t NO_ROW = SIZE_MAX;
+    
+    // A version of storage that does not see any of it yet
+    FactTable(Symbol predicate, uint32_t arity, std::shared_ptr<Storage> storage);
+    void release();
+    
+    // With the storage locked: copy it first if another version has
+    // changed it since this one, and after a change, catch up with it
+    void own(std::unique_lock<std::mutex>& lock);
+    void update();
+    
+
+    Symbol predicate_;
+    uint32_t arity_;
+    std::shared_ptr<Storage> storage_;  // Shared with forks; null once moved from
+    
+    // This version: the storage after its first epoch_ changes, read
+    // through the arrays that held it then
+    size_t epoch_ = 0;
+    size_t size_ = 0;
+    size_t removed_ = 0;
+    const Cell* cells_ = nullptr;
+    const uint32_t* varCounts_ = nullptr;   // Of rows from firstVariable_ on
+    size_t firstVariable_ = NO_ROW;
+    const std::atomic<size_t>* deleted_ = nullptr;  // Epoch each row is removed at; null while none is
+    
+    // Built lazily from const lookups, hence mutable
+    mutable std::map<std::vector<uint32_t>, std::unique_ptr<TrieIndex>> tries_;
+    mutable std::unique_ptr<std::mutex> trieMutex_;
+};
+
+} // namespace kbgdb
@@ -0,0 +1,362 @@
+#include "core/hash_join.h"
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+namespace kbgdb {
+
+namespace {
+
+uint64_t hashColumns(const Cell* row, const std::vector<int>& columns) {
+    uint64_t hash = 0;
+    for (int c : columns) {
+        hash = mixHash(hash, row[c].bits());
+    }
+    return hash;
+}
+
+// Count a step; false once the caller wants the join stopped
+bool more(const LeapfrogJoin::Step& step) {
+    return !step || step();
+}
+
+bool equalColumns(const Cell* a, const std::vector<int>& columnsA,
+                  const Cell* b, const std::vector<int>& columnsB) {
+    for (size_t i = 0; i < columnsA.size(); ++i) {
+        if (a[columnsA[i]] != b[columnsB[i]]) return false;
+    }
+    return true;
+}
+
+// Rows of a batch hashed on some of its columns: a chain of rows per
+// bucket, threaded through flat arrays
+class HashTable {
+public:
+    HashTable(const BindingBatch& batch, std::vector<int> columns)
+        : batch_(batch), columns_(std::move(columns)) {
+        size_t buckets = 16;
+        while (buckets < batch.size() * 2) buckets <<= 1;
+        mask_ = buckets - 1;
+        heads_.assign(buckets, NONE);
+        next_.resize(batch.size());
+        hashes_.resize(batch.size());
+        // Insert backwards so chains list rows in batch order
+        for (size_t r = batch.size(); r-- > 0;) {
+            uint64_t hash = hashColumns(batch.row(r), columns_);
+            hashes_[r] = hash;
+            next_[r] = heads_[hash & mask_];
+            heads_[hash & mask_] = static_cast<uint32_t>(r);
+        }
+    }
+
+    // Call f(row) for each row equal to probe on probeColumns, until
+    // it returns false; false if it did
+    template <typename F>
+    bool forEachMatch(const Cell* probe, const std::vector<int>& probeColumns, F&& f) const {
+        uint64_t hash = hashColumns(probe, probeColumns);
+        for (uint32_t r = heads_[hash & mask_]; r != NONE; r = next_[r]) {
+            if (hashes_[r] == hash &&
+                equalColumns(batch_.row(r), columns_, probe, probeColumns) &&
+                !f(batch_.row(r))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool anyMatch(const Cell* probe, const std::vector<int>& probeColumns) const {
+        uint64_t hash = hashColumns(probe, probeColumns);
+        for (uint32_t r = heads_[hash & mask_]; r != NONE; r = next_[r]) {
+            if (hashes_[r] == hash &&
+                equalColumns(batch_.row(r), columns_, probe, probeColumns)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    const BindingBatch& batch_;
+    std::vector<int> columns_;
+    size_t mask_;
+    std::vector<uint32_t> heads_;
+    std::vector<uint32_t> next_;
+    std::vector<uint64_t> hashes_;
+};
+
+// Columns of the variables a and b share, in a and in b
+void sharedColumns(const BindingBatch& a, const BindingBatch& b,
+                   std::vector<int>& inA, std::vector<int>& inB) {
+    for (size_t i = 0; i < a.width(); ++i) {
+        int j = b.column(a.variables()[i]);
+        if (j >= 0) {
+            inA.push_back(static_cast<int>(i));
+            inB.push_back(j);
+        }
+    }
+}
+
+bool shares(const BindingBatch& a, const BindingBatch& b) {
+    for (uint32_t var : a.variables()) {
+        if (b.column(var) >= 0) return true;
+    }
+    return false;
+}
+
+} // namespace
+
+void BindingBatch::reserve(size_t rows) {
+    cells_.reserve(rows * width());
+}
+
+void BindingBatch::add(const Cell* values) {
+    cells_.insert(cells_.end(), values, values + width());
+    ++rows_;
+}
+
+int BindingBatch::column(uint32_t var) const {
+    auto it = std::find(vars_.begin(), vars_.end(), var);
+    return it != vars_.end() ? static_cast<int>(it - vars_.begin()) : -1;
+}
+
+std::optional<BindingBatch> scan(const LeapfrogJoin::Atom& atom,
+                                 const LeapfrogJoin::Step& step) {
+    // Each variable's first position gives its column; later ones must
+    // hold the same value
+    std::vector<uint32_t> vars;
+    std::vector<int> columnOf(atom.args.size(), -1);
+    for (size_t i = 0; i < atom.args.size(); ++i) {
+        Cell arg = atom.args[i];
+        if (!arg.isRef()) {
+            if (!arg.isAtomic()) return std::nullopt;
+            continue;
+        }
+        auto it = std::find(vars.begin(), vars.end(), arg.slot());
+        columnOf[i] = static_cast<int>(it - vars.begin());
+        if (it == vars.end()) {
+            vars.push_back(arg.slot());
+        }
+    }
+
+    BindingBatch batch(vars);
+    if (!atom.table) {
+        return batch;
+    }
+    if (atom.table->hasVariables()) {
+        return std::nullopt;
+    }
+
+    std::vector<Cell> values(vars.size());
+    RowSet rows = atom.table->candidates(atom.args.data());
+    RowSet::Position pos;
+    size_t r;
+    while (rows.next(pos, r) && more(step)) {
+        if (!atom.table->live(r)) continue;
+        const Cell* row = atom.table->row(r);
+        bool matched = true;
+        std::fill(values.begin(), values.end(), Cell::ref(0));
+        for (size_t i = 0; i < atom.args.size() && matched; ++i) {
+            if (columnOf[i] < 0) {
+                matched = row[i] == atom.args[i];
+            } else if (values[columnOf[i]].isRef()) {
+                values[columnOf[i]] = row[i];
+            } else {
+                if (!row[i].isAtomic()) return std::nullopt;
+                matched = values[columnOf[i]] == row[i];
+            }
+        }
+        if (matched) {
+            batch.add(values.data());
+        }
+    }
+    return batch;
+}
+
+BindingBatch hashJoin(const BindingBatch& left, const BindingBatch& right,
+                      const LeapfrogJoin::Step& step) {
+    std::vector<uint32_t> vars = left.variables();
+    std::vector<int> extra;         // Right columns not already in left
+    for (size_t j = 0; j < right.width(); ++j) {
+        if (left.column(right.variables()[j]) < 0) {
+            vars.push_back(right.variables()[j]);
+            extra.push_back(static_cast<int>(j));
+        }
+    }
+    BindingBatch result(vars);
+    result.reserve(std::max(left.size(), right.size()));
+
+    std::vector<int> inLeft;
+    std::vector<int> inRight;
+    sharedColumns(left, right, inLeft, inRight);
+
+    std::vector<Cell> out(vars.size());
+    auto emit = [&](const Cell* l, const Cell* r) {
+        std::copy(l, l + left.width(), out.begin());
+        for (size_t k = 0; k < extra.size(); ++k) {
+            out[left.width() + k] = r[extra[k]];
+        }
+        result.add(out.data());
+        return more(step);
+    };
+
+    if (left.size() <= right.size()) {
+        HashTable table(left, inLeft);
+        for (size_t r = 0; r < right.size() && more(step); ++r) {
+            if (!table.forEachMatch(right.row(r), inRight,
+                                    [&](const Cell* l) { return emit(l, right.row(r)); })) {
+                break;
+            }
+        }
+    } else {
+        HashTable table(right, inRight);
+        for (size_t l = 0; l < left.size() && more(step); ++l) {
+            if (!table.forEachMatch(left.row(l), inLeft,
+                                    [&](const Cell* r) { return emit(left.row(l), r); })) {
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+BindingBatch semiJoin(const BindingBatch& left, const BindingBatch& right,
+                      const LeapfrogJoin::Step& step) {
+    std::vector<int> inLeft;
+    std::vector<int> inRight;
+    sharedColumns(left, right, inLeft, inRight);
+
+    BindingBatch result(left.variables());
+    if (right.empty()) {
+        return result;
+    }
+    HashTable table(right, inRight);
+    for (size_t l = 0; l < left.size() && more(step); ++l) {
+        if (table.anyMatch(left.row(l), inLeft)) {
+            result.add(left.row(l));
+        }
+    }
+    return result;
+}
+
+BindingBatch project(const BindingBatch& batch, const std::vector<uint32_t>& vars) {
+    std::vector<int> columns;
+    for (uint32_t var : vars) {
+        columns.push_back(batch.column(var));
+    }
+    BindingBatch result(vars);
+    result.reserve(batch.size());
+    std::vector<Cell> out(vars.size());
+    for (size_t r = 0; r < batch.size(); ++r) {
+        const Cell* row = batch.row(r);
+        for (size_t i = 0; i < columns.size(); ++i) {
+            out[i] = row[columns[i]];
+        }
+        result.add(out.data());
+    }
+    return result;
+}
+
+std::optional<BindingBatch> joinBatches(const std::vector<LeapfrogJoin::Atom>& atoms,
+                                        const std::vector<uint32_t>& output,
+                                        const LeapfrogJoin::Step& step) {
+    // Stopped once step says so: every later operator then gives up at once
+    bool stopped = false;
+    LeapfrogJoin::Step counted;
+    if (step) {
+        counted = [&] {
+            stopped = stopped || !step();
+            return !stopped;
+        };
+    }
+
+    std::vector<BindingBatch> batches;
+    for (const auto& atom : atoms) {
+        auto batch = scan(atom, counted);
+        if (!batch) {
+            return std::nullopt;
+        }
+        batches.push_back(std::move(*batch));
+    }
+
+    // Join keys must be atomic to be compared by bits
+    std::unordered_map<uint32_t, size_t> occurrences;
+    for (const auto& batch : batches) {
+        for (uint32_t var : batch.variables()) ++occurrences[var];
+    }
+    for (const auto& batch : batches) {
+        for (size_t c = 0; c < batch.width(); ++c) {
+            if (occurrences[batch.variables()[c]] < 2) continue;
+            for (size_t r = 0; r < batch.size(); ++r) {
+                if (!batch.row(r)[c].isAtomic()) return std::nullopt;
+            }
+        }
+    }
+
+    std::vector<uint32_t> bound;
+    for (uint32_t var : output) {
+        if (occurrences.count(var)) bound.push_back(var);
+    }
+    if (stopped) {
+        return BindingBatch(bound);
+    }
+
+    // Drop rows that cannot join, both ways along the atoms
+    for (size_t i = 0; i < batches.size(); ++i) {
+        for (size_t j = 0; j < batches.size(); ++j) {
+            if (i != j && shares(batches[i], batches[j])) {
+                batches[i] = semiJoin(batches[i], batches[j], counted);
+            }
+        }
+        if (batches[i].empty() || stopped) {
+            return BindingBatch(bound);
+        }
+    }
+
+    // Join smallest first, preferring batches connected to the result
+    auto smallest = [&](bool connected, const BindingBatch* result) {
+        size_t best = batches.size();
+        for (size_t i = 0; i < batches.size(); ++i) {
+            if (connected && !shares(*result, batches[i])) continue;
+            if (best == batches.size() || batches[i].size() < batches[best].size()) {
+                best = i;
+            }
+        }
+        return best;
+    };
+
+    size_t first = smallest(false, nullptr);
+    BindingBatch result = std::move(batches[first]);
+    batches.erase(batches.begin() + static_cast<std::ptrdiff_t>(first));
+    while (!batches.empty()) {
+        size_t next = smallest(true, &result);
+        if (next == batches.size()) {
+            next = smallest(false, nullptr);
+        }
+        result = hashJoin(result, batches[next], counted);
+        batches.erase(batches.begin() + static_cast<std::ptrdiff_t>(next));
+        if (stopped) {
+            return BindingBatch(bound);
+        }
+        if (result.empty()) {
+            break;
+        }
+
+        // Keep only what later joins or the caller need
+        std::vector<uint32_t> needed;
+        for (uint32_t var : result.variables()) {
+            bool later = std::find(output.begin(), output.end(), var) != output.end();
+            for (size_t i = 0; i < batches.size() && !later; ++i) {
+                later = batches[i].column(var) >= 0;
+            }
+            if (later) needed.push_back(var);
+        }
+        if (needed.size() < result.width()) {
+            result = project(result, needed);
+        }
+    }
+    return project(result, bound);
+}
+
+} // namespace kbgdb
@@ -0,0 +1,95 @@
+#pragma once
+#include "common/cell.h"
+#include "core/fact_table.h"
+#include "core/leapfrog_join.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * BindingBatch is a set of bindings for the same variables, stored as
+ * rows of cells: the unit that set-at-a-time operators consume and
+ * produce. Variables are identified by slot.
+ */
+class BindingBatch {
+public:
+    explicit BindingBatch(std::vector<uint32_t> vars) : vars_(std::move(vars)) {}
+
+    const std::vector<uint32_t>& variables() const { return vars_; }
+    size_t width() const { return vars_.size(); }
+    size_t size() const { return width() ? cells_.size() / width() : rows_; }
+    bool empty() const { return size() == 0; }
+
+    const Cell* row(size_t i) const { return cells_.data() + i * width(); }
+    void add(const Cell* values);
+    void reserve(size_t rows);
+
+    /** The column holding var, or -1. */
+    int column(uint32_t var) const;
+
+    size_t bytesUsed() const { return cells_.capacity() * sizeof(Cell); }
+
+private:
+    std::vector<uint32_t> vars_;
+    std::vector<Cell> cells_;
+    size_t rows_ = 0;       // Counts rows while there are no columns
+};
+
+/**
+ * The bindings for an atom's variables from the rows of its relation
+ * that match its constants, or nullopt if the atom cannot be read this
+ * way (see joinBatches()). step is called per row read; once it
+ * returns false the rest are skipped.
+ */
+std::optional<BindingBatch> scan(const LeapfrogJoin::Atom& atom,
+                                 const LeapfrogJoin::Step& step = nullptr);
+
+/**
+ * Every combination of a left and a right row that agree on the
+ * variables both bind; a cross product if they share none. The smaller
+ * side is hashed on the shared variables and the other probes it.
+ * step is called per row probed and per row produced; once it returns
+ * false the join stops, leaving the result incomplete.
+ */
+BindingBatch hashJoin(const BindingBatch& left, const BindingBatch& right,
+                      const LeapfrogJoin::Step& step = nullptr);
+
+/**
+ * The left rows that agree with some right row on the shared variables;
+ * step is as for hashJoin().
+ */
+BindingBatch semiJoin(const BindingBatch& left, const BindingBatch& right,
+                      const LeapfrogJoin::Step& step = nullptr);
+
+/**
+ * The rows of batch restricted to vars (which it must bind). Rows are
+ * kept with their multiplicity, as a goal-at-a-time search would
+ * produce them.
+ */
+BindingBatch project(const BindingBatch& batch, const std::vector<uint32_t>& vars);
+
+/**
+ * Solve a conjunction of atoms set-at-a-time and return the bindings
+ * of output (the variables the caller still needs), one row for each
+ * solution the conjunction has when solved goal by goal.
+ *
+ * Every atom is scanned once, filtered by its constants. Semi-joins
+ * then remove rows without a partner in the other atoms, and the
+ * batches are hash joined smallest first, projected after each join to
+ * the variables that later joins or output still need. Total work is
+ * linear in the inputs plus the intermediate results.
+ *
+ * Nullopt if some atom has a compound argument, a relation with variables,
+ * or compound values where it joins (cells are compared by their bits,
+ * which identify atomic values only).
+ *
+ * step is called for every row scanned, probed or produced; if it
+ * returns false the join stops and its result is empty.
+ */
+std::optional<BindingBatch> joinBatches(const std::vector<LeapfrogJoin::Atom>& atoms,
+                                        const std::vector<uint32_t>& output,
+                                        const LeapfrogJoin::Step& step = nullptr);
+
+} // namespace kbgdb
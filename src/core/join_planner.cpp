@@ -0,0 +1,189 @@
+#include "core/join_planner.h"
+#include "core/aggregate.h"
+#include <limits>
+#include <mutex>
+
+namespace kbgdb {
+
+namespace {
+
+PredicateKey keyOf(const Goal& goal) {
+    return PredicateKey{goal.predicate, goal.arity};
+}
+
+// Mark every variable of a template cell (slots numbered from 0) bound
+void bindVariables(Cell cell, std::vector<bool>& bound) {
+    if (cell.isRef()) {
+        bound[cell.slot()] = true;
+    } else if (cell.isStructure() || cell.isList()) {
+        for (uint32_t i = 0; i < cell.arity(); ++i) {
+            bindVariables(cell.args()[i], bound);
+        }
+    }
+}
+
+} // namespace
+
+void PredicateStats::remove() {
+    if (cardinality_ > 0) {
+        --cardinality_;
+    }
+}
+
+void PredicateStats::add(const Cell* row) {
+    ++cardinality_;
+    for (uint32_t i = 0; i < values_.size(); ++i) {
+        uint64_t key;
+        if (indexKey(row[i], key)) {
+            values_[i].insert(key);
+        }
+    }
+}
+
+bool JoinPlanner::addFact(const PredicateKey& key, const Cell* row) {
+    std::unique_lock<std::shared_mutex> lock(statsMutex_);
+    auto it = stats_.find(key);
+    if (it == stats_.end()) {
+        it = stats_.emplace(key, PredicateStats(key.arity)).first;
+    }
+    it->second.add(row);
+
+    // Replan once the estimates a plan was made with are off by 2x
+    size_t n = it->second.cardinality();
+    return (n & (n - 1)) == 0;
+}
+
+bool JoinPlanner::removeFact(const PredicateKey& key) {
+    std::unique_lock<std::shared_mutex> lock(statsMutex_);
+    auto it = stats_.find(key);
+    if (it == stats_.end()) {
+        return false;
+    }
+    it->second.remove();
+
+    // Likewise once the predicate has halved
+    size_t n = it->second.cardinality();
+    return (n & (n - 1)) == 0;
+}
+
+const PredicateStats* JoinPlanner::stats(const PredicateKey& key) const {
+    auto it = stats_.find(key);
+    return it != stats_.end() ? &it->second : nullptr;
+}
+
+uint64_t JoinPlanner::bindingPattern(const Goal& goal) {
+    uint64_t pattern = 0;
+    for (uint32_t i = 0; i < goal.arity && i < 64; ++i) {
+        if (!goal.args[i].isRef()) {
+            pattern |= uint64_t(1) << i;
+        }
+    }
+    return pattern;
+}
+
+const std::vector<Goal>& PlanCache::plan(uint32_t id, const CompiledClause& clause,
+                                         uint64_t pattern, const RuleIndex& rules,
+                                         const JoinPlanner& planner) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto forRule = plans_.find(id);
+        if (forRule != plans_.end()) {
+            auto it = forRule->second.find(pattern);
+            if (it != forRule->second.end()) {
+                return it->second;
+            }
+        }
+    }
+
+    // Variables in bound head arguments are bound when the body starts
+    std::vector<bool> bound(clause.numVars(), false);
+    const Goal& head = clause.head();
+    for (uint32_t i = 0; i < head.arity && i < 64; ++i) {
+        if (pattern & (uint64_t(1) << i)) {
+            bindVariables(head.args[i], bound);
+        }
+    }
+
+    std::vector<Goal> body;
+    for (size_t i : planner.order(clause.body(), bound, rules)) {
+        body.push_back(clause.body()[i]);
+    }
+    // Another thread may have planned the same call meanwhile; either
+    // plan is the same
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    return plans_[id].emplace(pattern, std::move(body)).first->second;
+}
+
+std::vector<size_t> JoinPlanner::order(const std::vector<Goal>& goals,
+                                       std::vector<bool>& bound,
+                                       const RuleIndex& rules) const {
+    std::vector<size_t> result;
+    result.reserve(goals.size());
+    std::shared_lock<std::shared_mutex> lock(statsMutex_);
+
+    // Goals on stored facts between two rule-defined goals are ordered
+    // among themselves; rule-defined goals stay where they are, as do
+    // aggregates, whose result depends on what is bound before them
+    size_t start = 0;
+    while (start < goals.size()) {
+        size_t end = start;
+        while (end < goals.size() && !rules.rulesFor(keyOf(goals[end])) &&
+               !isAggregate(goals[end].predicate, goals[end].arity)) {
+            ++end;
+        }
+
+        std::vector<bool> placed(end - start, false);
+        for (size_t n = start; n < end; ++n) {
+            size_t best = 0;
+            double bestRows = std::numeric_limits<double>::infinity();
+            for (size_t i = start; i < end; ++i) {
+                if (placed[i - start]) continue;
+                double rows = estimate(stats(keyOf(goals[i])), goals[i], bound);
+                if (rows < bestRows) {
+                    best = i;
+                    bestRows = rows;
+                }
+            }
+            placed[best - start] = true;
+            result.push_back(best);
+            for (uint32_t a = 0; a < goals[best].arity; ++a) {
+                bindVariables(goals[best].args[a], bound);
+            }
+        }
+
+        if (end < goals.size()) {
+            result.push_back(end);
+            for (uint32_t a = 0; a < goals[end].arity; ++a) {
+                bindVariables(goals[end].args[a], bound);
+            }
+            ++end;
+        }
+        start = end;
+    }
+    return result;
+}
+
+double JoinPlanner::estimate(const Goal& goal, const std::vector<bool>& bound) const {
+    std::shared_lock<std::shared_mutex> lock(statsMutex_);
+    return estimate(stats(keyOf(goal)), goal, bound);
+}
+
+double JoinPlanner::estimate(const PredicateStats* s, const Goal& goal,
+                             const std::vector<bool>& bound) const {
+    if (!s) {
+        return 0;   // No facts: fails at once
+    }
+
+    // Arguments are assumed independent, each bound one keeping
+    // 1 / distinct of the rows
+    double rows = static_cast<double>(s->cardinality());
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        Cell arg = goal.args[i];
+        if ((!arg.isRef() || bound[arg.slot()]) && s->distinct(i) > 0) {
+            rows /= static_cast<double>(s->distinct(i));
+        }
+    }
+    return rows;
+}
+
+} // namespace kbgdb
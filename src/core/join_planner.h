@@ -0,0 +1,112 @@
+#pragma once
+#include "core/binding_env.h"
+#include "core/clause.h"
+#include "core/fact_table.h"
+#include "core/rule_index.h"
+#include <cstdint>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * PredicateStats summarizes a predicate's stored facts for planning: how
+ * many there are, and how many distinct values (outermost symbols, as
+ * indexed by FactTable) each argument position holds.
+ */
+class PredicateStats {
+public:
+    explicit PredicateStats(uint32_t arity) : values_(arity) {}
+
+    void add(const Cell* row);
+    
+    /** Uncount a row. Distinct values are kept: they are an upper bound. */
+    void remove();
+
+    size_t cardinality() const { return cardinality_; }
+    size_t distinct(uint32_t position) const { return values_[position].size(); }
+
+private:
+    size_t cardinality_ = 0;
+    std::vector<std::unordered_set<uint64_t>> values_;
+};
+
+/**
+ * JoinPlanner chooses the order in which a rule body's goals are solved.
+ *
+ * Goals on stored facts are ordered greedily: next comes the goal
+ * expected to produce the fewest rows given the variables bound so far,
+ * estimating cardinality / distinct(position) for each bound argument.
+ * Goals on rule-defined predicates keep their place, and goals from
+ * before them stay before them, so a recursive call is never made with
+ * fewer arguments bound than written (which could stop it terminating).
+ * So do aggregates (see aggregate.h).
+ *
+ * Statistics are updated by every added and removed fact, and may be
+ * read by queries while facts are added. Plans are cached in a PlanCache.
+ */
+class JoinPlanner {
+public:
+    /**
+     * Count a stored fact. True if plans made before it should be made
+     * again: its predicate's size has doubled since they were.
+     */
+    bool addFact(const PredicateKey& key, const Cell* row);
+    
+    /** Uncount a removed fact. True if plans should be made again. */
+    bool removeFact(const PredicateKey& key);
+
+    /** Statistics for key; not to be read while facts are being added. */
+    const PredicateStats* stats(const PredicateKey& key) const;
+
+    /**
+     * Bit i is set if the goal's (dereferenced) argument i is bound.
+     * Arguments past the 64th count as free.
+     */
+    static uint64_t bindingPattern(const Goal& goal);
+
+    /**
+     * Order goals whose variables (numbered from 0) are bound as in
+     * bound, which is updated to include every goal's variables.
+     * Returns the goals' positions in solving order.
+     */
+    std::vector<size_t> order(const std::vector<Goal>& goals, std::vector<bool>& bound,
+                              const RuleIndex& rules) const;
+
+    /** Expected number of rows matching goal, given the bound variables. */
+    double estimate(const Goal& goal, const std::vector<bool>& bound) const;
+
+private:
+    double estimate(const PredicateStats* stats, const Goal& goal,
+                    const std::vector<bool>& bound) const;
+
+    std::unordered_map<PredicateKey, PredicateStats> stats_;
+    mutable std::shared_mutex statsMutex_;
+};
+
+/**
+ * PlanCache keeps the body orders a JoinPlanner chose for one set of
+ * rules, per rule and binding pattern (which head arguments the call
+ * binds). Plans are made again by starting a new cache; queries keep
+ * the cache they started with. Safe to use from several threads.
+ */
+class PlanCache {
+public:
+    /**
+     * The body of rule id (compiled as clause), ordered by planner for a
+     * call with the given binding pattern. rules tells which predicates
+     * are rule-defined. The result lives as long as the cache.
+     */
+    const std::vector<Goal>& plan(uint32_t id, const CompiledClause& clause, uint64_t pattern,
+                                  const RuleIndex& rules, const JoinPlanner& planner);
+
+private:
+    // Per rule id: binding pattern -> ordered body. Node-based, so plans
+    // handed out stay put as others are added.
+    std::unordered_map<uint32_t, std::unordered_map<uint64_t, std::vector<Goal>>> plans_;
+    std::shared_mutex mutex_;
+};
+
+} // namespace kbgdb
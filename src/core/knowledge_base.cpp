@@ -4,9 +4,12 @@
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <set>
 #include <functional>
+#include <iterator>
+#include <stdexcept>
 
 namespace kbgdb {
 
@@ -16,12 +19,10 @@ namespace kbgdb {
 // ============================================================================
 
 // Forward declarations
-static std::optional<BindingSet> unifyImpl(
-    const Term& x, const Term& y, BindingSet bindings);
-static std::optional<BindingSet> unifyVariable(
-    const Term& var, const Term& x, BindingSet bindings);
+static bool unifyImpl(const Term& x, const Term& y, BindingSet& bindings);
+static bool unifyVariable(const Term& var, const Term& x, BindingSet& bindings);
 static bool occursCheck(
-    const std::string& var, const Term& x, const BindingSet& bindings);
+    Symbol var, const Term& x, const BindingSet& bindings);
 static Term resolveTerm(const Term& term, const BindingSet& bindings);
 
 /**
@@ -77,7 +78,7 @@ static Term resolveTerm(const Term& term, const BindingSet& bindings) {
  * Prevents infinite structures like X = f(X)
  */
 static bool occursCheck(
-    const std::string& var, const Term& x, const BindingSet& bindings) {
+    Symbol var, const Term& x, const BindingSet& bindings) {
     
     switch (x.type) {
         case TermType::VARIABLE: {
@@ -110,10 +111,10 @@ static bool occursCheck(
 
 /**
  * Unify a variable with a term x.
- * Following Norvig's unify-variable from PAIP.
+ * Following Norvig's unify-variable from PAIP, but extending bindings
+ * in place; callers discard the set on failure.
  */
-static std::optional<BindingSet> unifyVariable(
-    const Term& var, const Term& x, BindingSet bindings) {
+static bool unifyVariable(const Term& var, const Term& x, BindingSet& bindings) {
     
     // If var is already bound, unify its value with x
     auto varBinding = bindings.getTerm(var.value);
@@ -131,31 +132,30 @@ static std::optional<BindingSet> unifyVariable(
     
     // Occurs check: prevent X = f(X) style infinite structures
     if (occursCheck(var.value, x, bindings)) {
-        return std::nullopt;
+        return false;
     }
     
     // Extend bindings: bind var to x
     bindings.add(var.value, x);
-    return bindings;
+    return true;
 }
 
 /**
  * Core unification: See if x and y match with given bindings.
- * Following Norvig's unify from PAIP.
+ * Following Norvig's unify from PAIP, extending bindings in place.
  */
-static std::optional<BindingSet> unifyImpl(
-    const Term& x, const Term& y, BindingSet bindings) {
+static bool unifyImpl(const Term& x, const Term& y, BindingSet& bindings) {
     
     // If x and y are identical atoms/numbers/empty lists
     if (x.type == y.type) {
         if ((x.isConstant() || x.isNumber()) && x.value == y.value) {
-            return bindings;
+            return true;
         }
         if (x.isVariable() && x.value == y.value) {
-            return bindings;
+            return true;
         }
         if (x.isEmptyList() && y.isEmptyList()) {
-            return bindings;
+            return true;
         }
     }
     
@@ -172,14 +172,12 @@ static std::optional<BindingSet> unifyImpl(
     // Both are compound terms
     if (x.isCompound() && y.isCompound()) {
         if (x.functor != y.functor || x.args.size() != y.args.size()) {
-            return std::nullopt;
+            return false;
         }
         for (size_t i = 0; i < x.args.size(); ++i) {
-            auto result = unifyImpl(x.args[i], y.args[i], bindings);
-            if (!result) return std::nullopt;
-            bindings = *result;
+            if (!unifyImpl(x.args[i], y.args[i], bindings)) return false;
         }
-        return bindings;
+        return true;
     }
     
     // Both are lists (cons cells)
@@ -187,16 +185,15 @@ static std::optional<BindingSet> unifyImpl(
         // Both empty - already handled above
         if (x.isEmptyList() || y.isEmptyList()) {
             // One empty, one not - fail
-            return std::nullopt;
+            return false;
         }
         // Both are cons cells - unify head and tail
-        auto headResult = unifyImpl(x.head(), y.head(), bindings);
-        if (!headResult) return std::nullopt;
-        return unifyImpl(x.tail(), y.tail(), *headResult);
+        return unifyImpl(x.head(), y.head(), bindings) &&
+               unifyImpl(x.tail(), y.tail(), bindings);
     }
     
     // Type mismatch - fail
-    return std::nullopt;
+    return false;
 }
 
 // ============================================================================
@@ -206,10 +203,10 @@ static std::optional<BindingSet> unifyImpl(
 std::string Unifier::resolve(const Term& term, const BindingSet& bindings) {
     Term resolved = resolveTerm(term, bindings);
     if (resolved.isConstant() || resolved.isNumber()) {
-        return resolved.value;
+        return resolved.value.str();
     }
     if (resolved.isVariable()) {
-        return resolved.value;
+        return resolved.value.str();
     }
     // For compound/list, return toString representation
     return resolved.toString();
@@ -220,10 +217,10 @@ std::pair<std::string, bool> Unifier::resolveWithType(
     
     Term resolved = resolveTerm(term, bindings);
     if (resolved.isVariable()) {
-        return {resolved.value, true};
+        return {resolved.value.str(), true};
     }
     if (resolved.isConstant() || resolved.isNumber()) {
-        return {resolved.value, false};
+        return {resolved.value.str(), false};
     }
     // Compound/list - return toString, not a variable
     return {resolved.toString(), false};
@@ -242,10 +239,9 @@ std::optional<BindingSet> Unifier::unifyTerms(
         return std::nullopt;
     }
 
+    // bindings is our own copy, so it can be extended in place
     for (size_t i = 0; i < terms1.size(); ++i) {
-        auto result = unifyImpl(terms1[i], terms2[i], bindings);
-        if (!result) return std::nullopt;
-        bindings = *result;
+        if (!unifyImpl(terms1[i], terms2[i], bindings)) return std::nullopt;
     }
     
     return bindings;
@@ -290,17 +286,216 @@ void KnowledgeBase::addFact(const Fact& fact) {
         std::cerr << "Warning: Attempting to add fact with empty predicate" << std::endl;
         return;
     }
-    facts_[fact.predicate()].push_back(fact);
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    add(fact);
+}
+
+void KnowledgeBase::add(const Fact& fact) {
+    PredicateKey key{fact.predicate(), static_cast<uint32_t>(fact.arity())};
+    FactTable& table = writableTable(key);
+    table.add(fact);
+    changed(key);
+    if (planner_.addFact(key, table.row(table.size() - 1))) {
+        // Replan once the estimates plans were made with are off by 2x
+        state_->plans_ = std::make_shared<PlanCache>();
+    }
+    invalidateMaterialized();
+    
+    const ViewSet* views = state_->views_.get();
+    if (views && views->current && views->inputs.count(key)) {
+        if (table.numVars(table.size() - 1) > 0) {
+            deriveViews();      // No longer materializable
+        } else {
+            updateViews(key, {fact}, {}, nullptr);
+        }
+    }
+}
+
+bool KnowledgeBase::retractFact(const Fact& pattern) {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return retract(pattern, 1) > 0;
+}
+
+size_t KnowledgeBase::retractAll(const Fact& pattern) {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return retract(pattern, SIZE_MAX);
+}
+
+size_t KnowledgeBase::upsertFact(const Fact& pattern, const Fact& fact) {
+    if (fact.predicate_.empty()) {
+        throw std::invalid_argument("upsertFact: fact has an empty predicate");
+    }
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    // Both changes are made before the lock is released, and so before
+    // any query can pin the snapshot between them
+    size_t removed = retract(pattern, SIZE_MAX);
+    add(fact);
+    return removed;
+}
+
+size_t KnowledgeBase::retract(const Fact& pattern, size_t limit) {
+    PredicateKey key{pattern.predicate(), static_cast<uint32_t>(pattern.arity())};
+    const FactTable* table = state_->facts(key.name, key.arity);
+    if (!table) {
+        return 0;
+    }
+
+    // Match the pattern against the rows as a goal is
+    BindingEnv env;
+    std::unordered_map<Symbol, uint32_t> vars;
+    std::vector<Cell> args;
+    for (const auto& term : pattern.terms()) {
+        args.push_back(env.encode(term, vars));
+    }
+    std::vector<size_t> matches;
+    RowSet rows = table->candidates(args.data());
+    RowSet::Position pos;
+    size_t r;
+    while (matches.size() < limit && rows.next(pos, r)) {
+        if (!table->live(r)) continue;
+        const Cell* row = table->row(r);
+        auto mark = env.mark();
+        uint32_t numVars = table->numVars(r);
+        uint32_t base = numVars > 0 ? env.newVars(numVars) : 0;
+        bool matched = true;
+        for (uint32_t i = 0; i < key.arity && matched; ++i) {
+            matched = numVars > 0 ? env.unifyTemplate(row[i], base, args[i])
+                                  : env.unify(args[i], row[i]);
+        }
+        if (matched) {
+            matches.push_back(r);
+        }
+        env.undo(mark);
+    }
+    if (matches.empty()) {
+        return 0;
+    }
+
+    // Views are updated from the facts as they were
+    const ViewSet* views = state_->views_.get();
+    bool viewed = views && views->current && views->inputs.count(key);
+    std::optional<FactTable> before;
+    std::vector<Fact> removed;
+    if (viewed) {
+        before = table->fork();
+        for (size_t row : matches) {
+            removed.push_back(table->fact(row));
+        }
+    }
+
+    FactTable& writable = writableTable(key);
+    bool replan = false;
+    for (size_t row : matches) {
+        writable.remove(row);
+        changed(key);
+        replan = planner_.removeFact(key) || replan;
+    }
+    if (writable.removed() * 2 > writable.size()) {
+        // Mostly tombstones: lookups would skip more rows than they use
+        writable.compact();
+    }
+    if (replan) {
+        state_->plans_ = std::make_shared<PlanCache>();
+    }
+    invalidateMaterialized();
+    if (viewed) {
+        updateViews(key, {}, removed, &*before);
+    }
+    return matches.size();
 }
 
-void KnowledgeBase::addFact(const std::string& predicate, std::vector<Term> terms) {
+void KnowledgeBase::addFact(Symbol predicate, std::vector<Term> terms) {
     addFact(Fact(predicate, std::move(terms)));
 }
 
-const std::vector<Fact>& KnowledgeBase::getFacts(const std::string& predicate) const {
-    static const std::vector<Fact> empty;
-    auto it = facts_.find(predicate);
-    return it != facts_.end() ? it->second : empty;
+std::vector<Fact> KnowledgeBase::getFacts(Symbol predicate) const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    std::vector<Fact> result;
+    for (const auto& [key, table] : state_->facts_) {
+        if (key.name != predicate) continue;
+        for (size_t i = 0; i < table->size(); ++i) {
+            if (!table->live(i)) continue;
+            result.push_back(table->fact(i));
+        }
+    }
+    return result;
+}
+
+const FactTable* KnowledgeBase::getFactTable(Symbol predicate, uint32_t arity) const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return state_->facts(predicate, arity);
+}
+
+const std::vector<Rule>& KnowledgeBase::getRules() const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return state_->rules().rules;
+}
+
+std::shared_ptr<const KnowledgeSnapshot> KnowledgeBase::snapshot() const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return state_;
+}
+
+KnowledgeSnapshot& KnowledgeBase::writable() {
+    // Only snapshot() adds owners, with stateMutex_ held too
+    if (state_.use_count() > 1) {
+        // Shares everything with the pinned snapshot until it changes it
+        auto copy = std::make_shared<KnowledgeSnapshot>(*state_);
+        copy->ownRules_ = false;
+        copy->ownViews_ = false;
+        copy->ownTables_.clear();
+        state_ = std::move(copy);
+    } else {
+        // The reads of the queries that have let it go come first
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return *state_;
+}
+
+FactTable& KnowledgeBase::writableTable(const PredicateKey& key) {
+    KnowledgeSnapshot& state = writable();
+    auto& table = state.facts_[key];
+    if (!table) {
+        table = std::make_shared<FactTable>(key.name, key.arity);
+        state.ownTables_.insert(key);
+    } else if (state.ownTables_.insert(key).second) {
+        table = std::make_shared<FactTable>(table->fork());
+    }
+    return *table;
+}
+
+void KnowledgeBase::changed(const PredicateKey& key) {
+    KnowledgeSnapshot& state = writable();
+    state.changedAt_[key] = ++state.epoch_;
+}
+
+ViewSet& KnowledgeBase::writableViews() {
+    KnowledgeSnapshot& state = writable();
+    if (!state.views_) {
+        state.views_ = std::make_shared<ViewSet>();
+        state.ownViews_ = true;
+    } else if (!state.ownViews_) {
+        // Fork the derived tables rather than copying them
+        auto copy = std::make_shared<ViewSet>();
+        copy->declared = state.views_->declared;
+        copy->inputs = state.views_->inputs;
+        copy->current = state.views_->current;
+        for (const auto& [key, table] : state.views_->derived) {
+            copy->derived.emplace(key, table.fork());
+        }
+        state.views_ = std::move(copy);
+        state.ownViews_ = true;
+    }
+    return *state.views_;
+}
+
+RuleSet& KnowledgeBase::writableRules() {
+    KnowledgeSnapshot& state = writable();
+    if (!state.ownRules_) {
+        state.rules_ = std::make_shared<RuleSet>(*state.rules_);
+        state.ownRules_ = true;
+    }
+    return *state.rules_;
 }
 
 void KnowledgeBase::addRule(const Rule& rule) {
@@ -308,13 +503,183 @@ void KnowledgeBase::addRule(const Rule& rule) {
         std::cerr << "Warning: Attempting to add invalid rule" << std::endl;
         return;
     }
-    rules_.push_back(rule);
+    auto clause = std::make_shared<const CompiledClause>(CompiledClause::compile(rule));
+    
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    RuleSet& rules = writableRules();
+    rules.index.add(rule, static_cast<uint32_t>(rules.rules.size()));
+    rules.rules.push_back(rule);
+    rules.clauses.push_back(std::move(clause));
+    changed(PredicateKey{rule.head().predicate(), static_cast<uint32_t>(rule.head().arity())});
+    state_->plans_ = std::make_shared<PlanCache>();
+    invalidateMaterialized();
+    if (state_->views_ && state_->views_->current) {
+        writableViews().current = false;
+    }
 }
 
 void KnowledgeBase::addRule(const Fact& head, const std::vector<Fact>& body) {
     addRule(Rule(head, body));
 }
 
+void KnowledgeBase::setEvaluationMode(EvaluationMode mode) {
+    mode_ = mode;
+    if (mode_ == EvaluationMode::BOTTOM_UP) {
+        materialize();
+    } else {
+        std::lock_guard<std::mutex> lock(stateMutex_);
+        invalidateMaterialized();
+    }
+}
+
+void KnowledgeBase::setParallelism(size_t threads) {
+    if (threads == 0) {
+        throw std::invalid_argument("Parallelism must be at least 1");
+    }
+    // The thread calling query() works too
+    pool_ = threads > 1 ? std::make_unique<WorkPool>(threads - 1) : nullptr;
+}
+
+void KnowledgeBase::materialize() {
+    auto pinned = snapshot();
+    if (pinned->isMaterialized()) {
+        return;
+    }
+    std::lock_guard<std::mutex> busy(materializeMutex_);
+    pinned = snapshot();
+    if (pinned->isMaterialized()) {
+        return;     // Done by another thread meanwhile
+    }
+    // Writers go on meanwhile
+    BottomUpEvaluator evaluator(pinned->rules().clauses, [&](const PredicateKey& key) {
+        return pinned->facts(key.name, key.arity);
+    });
+    auto relations = std::make_shared<const BottomUpEvaluator::Relations>(evaluator.run());
+    
+    // Unless something was added since, it is the current state's
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    if (state_ == pinned) {
+        pinned.reset();     // Not to copy the state for this
+        writable().materialized_ = std::move(relations);
+    }
+}
+
+void KnowledgeBase::invalidateMaterialized() {
+    if (state_->materialized_) {
+        writable().materialized_ = nullptr;
+    }
+}
+
+const FactTable* KnowledgeBase::getMaterializedTable(Symbol predicate, uint32_t arity) const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return state_->materialized(predicate, arity);
+}
+
+void KnowledgeBase::tablePredicate(Symbol predicate, uint32_t arity) {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    if (!state_->isTabled(predicate, arity)) {
+        writable().tabled_.insert(PredicateKey{predicate, arity});
+        changed(PredicateKey{predicate, arity});    // Answers are no longer repeated
+    }
+}
+
+bool KnowledgeBase::isTabled(Symbol predicate, uint32_t arity) const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    return state_->isTabled(predicate, arity);
+}
+
+void KnowledgeBase::materializePredicate(Symbol predicate, uint32_t arity) {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    const ViewSet* views = state_->views_.get();
+    if (!views || !views->declared.count(PredicateKey{predicate, arity})) {
+        writableViews().declared.insert(PredicateKey{predicate, arity});
+        deriveViews();
+        changed(PredicateKey{predicate, arity});
+    }
+}
+
+bool KnowledgeBase::isMaterialized(Symbol predicate, uint32_t arity) const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    const ViewSet* views = state_->views_.get();
+    return views && views->declared.count(PredicateKey{predicate, arity});
+}
+
+void KnowledgeBase::deriveViews() {
+    ViewSet& views = writableViews();
+    const RuleSet& rules = state_->rules();
+    BottomUpEvaluator evaluator(rules.clauses, [this](const PredicateKey& key) {
+        return state_->facts(key.name, key.arity);
+    });
+    views.derived = evaluator.run(std::vector<PredicateKey>(views.declared.begin(),
+                                                            views.declared.end()));
+    views.inputs.clear();
+    for (const auto& clause : rules.clauses) {
+        PredicateKey head{clause->head().predicate, clause->head().arity};
+        if (!views.derived.count(head)) continue;
+        views.inputs.insert(head);
+        for (const auto& goal : clause->body()) {
+            views.inputs.insert(PredicateKey{goal.predicate, goal.arity});
+        }
+    }
+    views.current = true;
+}
+
+void KnowledgeBase::updateViews(const PredicateKey& key, const std::vector<Fact>& added,
+                                const std::vector<Fact>& removed, const FactTable* before) {
+    ViewSet& views = writableViews();
+    BottomUpEvaluator evaluator(state_->rules().clauses, [this](const PredicateKey& q) {
+        return state_->facts(q.name, q.arity);
+    });
+    BottomUpEvaluator::Changes additions;
+    BottomUpEvaluator::Changes removals;
+    if (!added.empty()) additions[key] = added;
+    if (!removed.empty()) removals[key] = removed;
+    evaluator.update(views.derived, additions, removals, [&](const PredicateKey& q) {
+        return q == key ? before : state_->facts(q.name, q.arity);
+    });
+}
+
+void KnowledgeBase::refreshViews() {
+    std::lock_guard<std::mutex> lock(stateMutex_);
+    if (state_->views_ && !state_->views_->current) {
+        deriveViews();
+    }
+}
+
+void KnowledgeBase::applyDirective(const std::string& directive) {
+    std::istringstream in(directive);
+    std::string name;
+    in >> name;
+    if (name != "table" && name != "materialize") {
+        throw std::runtime_error("Unknown directive: " + name);
+    }
+    
+    // table name/arity, name/arity, ... (or materialize)
+    std::string spec;
+    size_t count = 0;
+    while (std::getline(in >> std::ws, spec, ',')) {
+        size_t slash = spec.find('/');
+        size_t end = spec.find_last_not_of(" \t");
+        if (slash == std::string::npos || slash == 0 || end == slash) {
+            throw std::runtime_error("Expected name/arity in " + name + " directive: " + spec);
+        }
+        std::string arity = spec.substr(slash + 1, end - slash);
+        if (arity.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::runtime_error("Expected name/arity in " + name + " directive: " + spec);
+        }
+        Symbol predicate = spec.substr(0, slash);
+        if (name == "table") {
+            tablePredicate(predicate, static_cast<uint32_t>(std::stoul(arity)));
+        } else {
+            materializePredicate(predicate, static_cast<uint32_t>(std::stoul(arity)));
+        }
+        ++count;
+    }
+    if (count == 0) {
+        throw std::runtime_error("Expected name/arity in " + name + " directive");
+    }
+}
+
 void KnowledgeBase::loadFromFile(const std::string& filename) {
     std::ifstream file(filename);
     if (!file) {
@@ -345,7 +710,10 @@ void KnowledgeBase::loadFromFile(const std::string& filename) {
         }
         
         try {
-            if (line.find(":-") != std::string::npos) {
+            if (line.compare(0, 2, ":-") == 0) {
+                applyDirective(line.substr(2));
+                
+            } else if (line.find(":-") != std::string::npos) {
                 // This is a rule
                 parser.setRuleMode(true);
                 
@@ -420,238 +788,188 @@ void KnowledgeBase::loadFromFile(const std::string& filename) {
             throw;
         }
     }
+    
+    // The precompute step for bottom-up evaluation happens at load time
+    prepareQuery();
+}
+
+void KnowledgeBase::prepareQuery() {
+    refreshViews();
+    if (mode_ == EvaluationMode::BOTTOM_UP) {
+        materialize();
+    }
 }
 
 std::vector<BindingSet> KnowledgeBase::query(const std::string& queryStr) {
     QueryParser parser;
     parser.setRuleMode(false);  // Query mode: ?X variables
-    Fact goal = parser.parse(queryStr);
-    return query(goal);
+    return query(parser.parseConjunction(queryStr));
 }
 
 std::vector<BindingSet> KnowledgeBase::query(const Fact& goal) {
-    std::set<std::string> visited;
-    auto results = evaluateGoal(goal, BindingSet{}, visited);
-    
-    // Collect all query variables (including those inside compound terms/lists)
-    std::vector<std::string> queryVars;
-    std::function<void(const Term&)> collectVars;
-    collectVars = [&](const Term& term) {
-        switch (term.type) {
-            case TermType::VARIABLE:
-                queryVars.push_back(term.value);
-                break;
-            case TermType::COMPOUND:
-            case TermType::LIST:
-                for (const auto& arg : term.args) {
-                    collectVars(arg);
-                }
-                break;
-            default:
-                break;
-        }
-    };
-    
-    for (const auto& term : goal.terms()) {
-        collectVars(term);
+    return query(std::vector<Fact>{goal});
+}
+
+std::vector<BindingSet> KnowledgeBase::query(const std::vector<Fact>& goals,
+                                             std::shared_ptr<QueryBudget> budget) {
+    prepareQuery();
+    if (pool_) {
+        return queryParallel(goals, budget);
     }
-    
-    // Resolve each result to get final values
+    return drain(cursor(goals, budget), budget.get());
+}
+
+std::vector<BindingSet> KnowledgeBase::drain(SolutionCursor solutions,
+                                             QueryBudget* budget) const {
+    size_t limit = budget ? budget->limits().maxResults : 0;
+    solutions.setLimit(limit);
     std::vector<BindingSet> resolved;
-    for (const auto& binding : results) {
-        BindingSet finalBinding;
-        for (const auto& var : queryVars) {
-            // Use the new resolveFull to get the complete resolved term
-            Term varTerm = Term::variable(var);
-            Term resolvedTerm = Unifier::resolveFull(varTerm, binding);
-            
-            // Only add if we found a non-variable value
-            if (!resolvedTerm.isVariable()) {
-                finalBinding.add(var, resolvedTerm);
-            } else if (resolvedTerm.value != var) {
-                // Bound to another variable
-                finalBinding.add(var, resolvedTerm);
-            }
-        }
-        if (!finalBinding.bindings.empty() || queryVars.empty()) {
-            resolved.push_back(finalBinding);
-        }
+    while (auto solution = solutions.next()) {
+        resolved.push_back(std::move(*solution));
+    }
+    if (limit > 0 && resolved.size() == limit) {
+        budget->stop(QueryStop::RESULTS);
     }
-    
     return resolved;
 }
 
-Rule KnowledgeBase::renameVariables(const Rule& rule, int& counter) const {
-    std::unordered_map<std::string, std::string> renaming;
-    
-    auto renameVar = [&](const std::string& var) -> std::string {
-        auto it = renaming.find(var);
-        if (it != renaming.end()) {
-            return it->second;
-        }
-        std::string newName = var + "_" + std::to_string(counter++);
-        renaming[var] = newName;
-        return newName;
-    };
-    
-    // Forward declaration for recursion
-    std::function<Term(const Term&)> renameTerm;
-    
-    renameTerm = [&](const Term& term) -> Term {
-        switch (term.type) {
-            case TermType::VARIABLE:
-                return Term::variable(renameVar(term.value));
-                
-            case TermType::CONSTANT:
-            case TermType::NUMBER:
-                return term;
-                
-            case TermType::COMPOUND: {
-                std::vector<Term> newArgs;
-                for (const auto& arg : term.args) {
-                    newArgs.push_back(renameTerm(arg));
-                }
-                return Term::compound(term.functor, std::move(newArgs));
-            }
-            
-            case TermType::LIST: {
-                if (term.isEmptyList()) {
-                    return term;
-                }
-                return Term::cons(
-                    renameTerm(term.head()),
-                    renameTerm(term.tail())
-                );
-            }
-        }
-        return term;
-    };
-    
-    auto renameFact = [&](const Fact& f) -> Fact {
-        std::vector<Term> newTerms;
-        for (const auto& term : f.terms()) {
-            newTerms.push_back(renameTerm(term));
-        }
-        return Fact(f.predicate(), newTerms);
-    };
-    
-    Fact newHead = renameFact(rule.head());
-    std::vector<Fact> newBody;
-    for (const auto& goal : rule.body()) {
-        newBody.push_back(renameFact(goal));
-    }
-    
-    return Rule(newHead, newBody);
+SolutionCursor KnowledgeBase::cursor(const std::string& queryStr) const {
+    QueryParser parser;
+    parser.setRuleMode(false);  // Query mode: ?X variables
+    return cursor(parser.parseConjunction(queryStr));
 }
 
-std::vector<BindingSet> KnowledgeBase::evaluateGoal(
-    const Fact& goal,
-    const BindingSet& bindings,
-    std::set<std::string>& visited) const {
-    
-    // Create a key to detect infinite recursion
-    Fact substituted = Unifier::substitute(goal, bindings);
-    std::string goalKey = substituted.toString();
-    
-    // Check for infinite recursion (with same bindings)
-    if (visited.count(goalKey)) {
-        return {};
+SolutionCursor KnowledgeBase::cursor(const Fact& goal, std::shared_ptr<QueryBudget> budget) const {
+    auto pinned = snapshot();
+    std::shared_ptr<const BottomUpEvaluator::Relations> answers;
+    if (mode_ == EvaluationMode::MAGIC_SETS) {
+        answers = evaluateMagic(*pinned, goal, budget.get());
     }
-    visited.insert(goalKey);
-    
-    std::vector<BindingSet> results;
-    
-    // Try to match against facts
-    const auto& facts = getFacts(goal.predicate());
-    for (const auto& fact : facts) {
-        auto unified = Unifier::unify(goal, fact, bindings);
-        if (unified) {
-            results.push_back(*unified);
-        }
+    SolutionCursor solutions(*this, std::move(pinned), {goal}, std::move(answers));
+    solutions.setBudget(std::move(budget));
+    return solutions;
+}
+
+SolutionCursor KnowledgeBase::cursor(const std::vector<Fact>& goals,
+                                     std::shared_ptr<QueryBudget> budget) const {
+    if (goals.empty()) {
+        throw std::invalid_argument("Empty conjunction");
     }
-    
-    // Try to match against rules
-    static int varCounter = 0;
-    for (const auto& rule : rules_) {
-        if (rule.head().predicate() == goal.predicate()) {
-            // Rename variables in the rule to avoid capture
-            Rule renamedRule = renameVariables(rule, varCounter);
-            
-            // Try to unify goal with rule head
-            auto headBindings = Unifier::unify(goal, renamedRule.head(), bindings);
-            if (headBindings) {
-                // Evaluate the rule body
-                auto bodyResults = evaluateConjunction(
-                    renamedRule.body(), *headBindings, visited);
-                
-                results.insert(results.end(), 
-                              bodyResults.begin(), bodyResults.end());
-            }
-        }
+    if (goals.size() == 1) {
+        return cursor(goals[0], std::move(budget));
     }
-    
-    visited.erase(goalKey);
-    return results;
+    SolutionCursor solutions(*this, goals);
+    solutions.setBudget(std::move(budget));
+    return solutions;
 }
 
-std::vector<BindingSet> KnowledgeBase::evaluateRule(
-    const Rule& rule,
-    const Fact& goal,
-    const BindingSet& bindings,
-    std::set<std::string>& visited) const {
-    
-    // First unify goal with rule head
-    auto headBindings = Unifier::unify(goal, rule.head(), bindings);
-    if (!headBindings) {
-        return {};
-    }
-    
-    // Then evaluate body goals
-    return evaluateConjunction(rule.body(), *headBindings, visited);
+SolutionCursor KnowledgeBase::openQuery(const std::vector<Fact>& goals,
+                                        std::shared_ptr<QueryBudget> budget) {
+    prepareQuery();
+    return cursor(goals, std::move(budget));
 }
 
-std::vector<BindingSet> KnowledgeBase::evaluateConjunction(
-    const std::vector<Fact>& goals,
-    const BindingSet& bindings,
-    std::set<std::string>& visited) const {
-    
+PreparedQuery KnowledgeBase::prepare(const std::string& queryStr) {
+    QueryParser parser;
+    parser.setRuleMode(false);  // Query mode: ?X variables, $X parameters
+    return PreparedQuery(*this, parser.parseConjunction(queryStr), nextPreparedId_++);
+}
+
+std::vector<BindingSet> KnowledgeBase::queryParallel(const std::vector<Fact>& goals,
+                                                     std::shared_ptr<QueryBudget> budget) const {
     if (goals.empty()) {
-        return {bindings};
+        throw std::invalid_argument("Empty conjunction");
+    }
+    // Every part reads the same snapshot
+    auto pinned = snapshot();
+    std::shared_ptr<const BottomUpEvaluator::Relations> answers;
+    if (mode_ == EvaluationMode::MAGIC_SETS && goals.size() == 1) {
+        answers = evaluateMagic(*pinned, goals[0], budget.get());
+    }
+    return queryParallel([&] {
+        SolutionCursor solutions(*this, pinned, goals, answers);
+        solutions.setBudget(budget);
+        return solutions;
+    }, budget.get());
+}
+
+std::vector<BindingSet> KnowledgeBase::queryParallel(
+    const std::function<SolutionCursor()>& open, QueryBudget* budget) const {
+    
+    // More parts than threads, so that workers done early can steal
+    // the parts others have not started. Each part stops at the result
+    // limit, which the first parts may reach alone.
+    size_t limit = budget ? budget->limits().maxResults : 0;
+    size_t parts = parallelism() * 4;
+    std::vector<std::vector<BindingSet>> found(parts);
+    std::vector<std::function<void()>> tasks;
+    for (size_t part = 0; part < parts; ++part) {
+        tasks.push_back([&, part] {
+            SolutionCursor solutions = open();
+            solutions.setPartition(part, parts);
+            solutions.setLimit(limit);
+            while (auto solution = solutions.next()) {
+                found[part].push_back(std::move(*solution));
+            }
+        });
     }
+    pool_->run(std::move(tasks));
     
-    // Evaluate first goal
-    const Fact& firstGoal = goals[0];
-    auto firstResults = evaluateGoal(firstGoal, bindings, visited);
-    
-    if (goals.size() == 1) {
-        return firstResults;
+    std::vector<BindingSet> resolved;
+    for (auto& solutions : found) {
+        std::move(solutions.begin(), solutions.end(), std::back_inserter(resolved));
+    }
+    if (limit > 0 && resolved.size() >= limit) {
+        resolved.resize(limit);
+        budget->stop(QueryStop::RESULTS);
     }
+    return resolved;
+}
+
+std::shared_ptr<const BottomUpEvaluator::Relations> KnowledgeBase::evaluateMagic(
+    const KnowledgeSnapshot& snapshot, const Fact& goal, QueryBudget* budget) const {
     
-    // For each result from first goal, evaluate remaining goals
-    std::vector<Fact> remainingGoals(goals.begin() + 1, goals.end());
-    std::vector<BindingSet> finalResults;
+    auto program = rewriteMagicSets(snapshot.rules().rules, goal);
+    if (!program) {
+        return nullptr;
+    }
     
-    for (const auto& result : firstResults) {
-        auto restResults = evaluateConjunction(remainingGoals, result, visited);
-        finalResults.insert(finalResults.end(), 
-                           restResults.begin(), restResults.end());
+    BottomUpEvaluator::Clauses clauses;
+    clauses.reserve(program->rules.size());
+    for (const auto& rule : program->rules) {
+        clauses.push_back(std::make_shared<const CompiledClause>(CompiledClause::compile(rule)));
+    }
+    BottomUpEvaluator evaluator(clauses, [&](const PredicateKey& key) {
+        return snapshot.facts(key.name, key.arity);
+    });
+    if (!evaluator.canMaterialize(program->answer)) {
+        return nullptr;
     }
+    evaluator.setBudget(budget);
     
-    return finalResults;
+    // The adorned relation answers goal in place of goal's predicate
+    auto derived = evaluator.run();
+    auto answers = std::make_shared<BottomUpEvaluator::Relations>();
+    answers->emplace(PredicateKey{goal.predicate(), static_cast<uint32_t>(goal.arity())},
+                     std::move(derived.at(program->answer)));
+    return answers;
 }
 
 void KnowledgeBase::printFacts() const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
     std::cout << "Facts:" << std::endl;
-    for (const auto& [pred, factList] : facts_) {
-        for (const auto& fact : factList) {
-            std::cout << "  " << fact.toString() << std::endl;
+    for (const auto& [key, table] : state_->facts_) {
+        for (size_t i = 0; i < table->size(); ++i) {
+            if (!table->live(i)) continue;
+            std::cout << "  " << table->fact(i).toString() << std::endl;
         }
     }
 }
 
 void KnowledgeBase::printRules() const {
+    std::lock_guard<std::mutex> lock(stateMutex_);
     std::cout << "Rules:" << std::endl;
-    for (const auto& rule : rules_) {
+    for (const auto& rule : state_->rules().rules) {
         std::cout << "  " << rule.toString() << std::endl;
     }
 }
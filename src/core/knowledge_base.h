@@ -1,9 +1,25 @@
 #pragma once
 #include "common/fact.h"
+#include "core/binding_env.h"
+#include "core/bottom_up.h"
+#include "core/clause.h"
+#include "core/fact_table.h"
+#include "core/join_planner.h"
+#include "core/knowledge_snapshot.h"
+#include "core/magic_sets.h"
+#include "core/prepared_query.h"
+#include "core/query_budget.h"
 #include "core/rule.h"
+#include "core/rule_index.h"
+#include "core/solution_cursor.h"
+#include "core/work_pool.h"
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <optional>
 #include <set>
@@ -65,11 +81,36 @@ public:
         BindingSet bindings);
 };
 
+/**
+ * How rule-defined predicates are answered.
+ *
+ * TOP_DOWN proves each goal from the rules when it is called.
+ * BOTTOM_UP derives every fact of the Datalog predicates once (see
+ * BottomUpEvaluator) and answers goals on them by lookup; predicates
+ * that cannot be materialized are still evaluated top-down.
+ * MAGIC_SETS rewrites the rules for each query (see rewriteMagicSets)
+ * and evaluates them bottom-up, deriving only facts the query can use;
+ * queries whose rules are not Datalog are evaluated top-down.
+ */
+enum class EvaluationMode {
+    TOP_DOWN,
+    BOTTOM_UP,
+    MAGIC_SETS
+};
+
 /**
  * KnowledgeBase stores facts and rules, and provides synchronous query evaluation.
  * 
  * This is a clean synchronous implementation suitable for in-memory facts and rules.
  * For external data sources, use AsyncKnowledgeBase which wraps this class.
+ *
+ * Queries and cursors may run on several threads at once, while other
+ * threads add facts and rules: each query reads the snapshot that was
+ * current when it started (see KnowledgeSnapshot), and sees no later
+ * change, facts retracted meanwhile included. Writers are serialized,
+ * but never wait for queries nor copy the facts they read. The settings
+ * (evaluation mode, join options, parallelism) are not to be changed
+ * while queries run.
  */
 class KnowledgeBase {
 public:
@@ -78,13 +119,129 @@ public:
     
     // Fact management
     void addFact(const Fact& fact);
-    void addFact(const std::string& predicate, std::vector<Term> terms);
-    const std::vector<Fact>& getFacts(const std::string& predicate) const;
+    void addFact(Symbol predicate, std::vector<Term> terms);
+    
+    /**
+     * Remove the first stored fact (in the order added) that unifies
+     * with pattern, as Prolog's retract/1. False if none does.
+     */
+    bool retractFact(const Fact& pattern);
+    
+    /** Remove every stored fact that unifies with pattern; returns how many. */
+    size_t retractAll(const Fact& pattern);
+    
+    /**
+     * Replace the facts that unify with pattern by fact, as one change:
+     * no query sees the facts removed without fact added. Returns how
+     * many were removed. For example, upsertFact(age(bob, _), age(bob, 43)).
+     */
+    size_t upsertFact(const Fact& pattern, const Fact& fact);
+    
+    /**
+     * Decode the stored facts for a predicate (all arities).
+     * Facts are stored packed; this materializes a copy.
+     */
+    std::vector<Fact> getFacts(Symbol predicate) const;
+    
+    /** The current table of predicate/arity; not to be read while facts are added. */
+    const FactTable* getFactTable(Symbol predicate, uint32_t arity) const;
     
     // Rule management
     void addRule(const Rule& rule);
     void addRule(const Fact& head, const std::vector<Fact>& body);
-    const std::vector<Rule>& getRules() const { return rules_; }
+    
+    /** The current rules; not to be read while rules are added. */
+    const std::vector<Rule>& getRules() const;
+    
+    /**
+     * Pin the current state for reading: the snapshot stays as it is,
+     * whatever is added afterwards, for as long as it is held.
+     */
+    std::shared_ptr<const KnowledgeSnapshot> snapshot() const;
+    
+    /**
+     * Evaluate predicate/arity with tabling: each call variant's answers
+     * are computed once, to a fixpoint, and later variant calls read them.
+     * Left-recursive and cyclic definitions then terminate with every
+     * answer. Set from a file with ":- table name/arity."
+     */
+    void tablePredicate(Symbol predicate, uint32_t arity);
+    bool isTabled(Symbol predicate, uint32_t arity) const;
+    
+    /**
+     * Keep predicate/arity materialized as a view: its derived facts are
+     * stored in an indexed table, which goals on it read in any evaluation
+     * mode, and updated incrementally as facts are added and retracted
+     * (see BottomUpEvaluator::update()). Adding a rule derives every view
+     * again, by the next query(). Predicates that cannot be materialized
+     * (see BottomUpEvaluator) are evaluated as usual. Set from a file
+     * with ":- materialize name/arity."
+     */
+    void materializePredicate(Symbol predicate, uint32_t arity);
+    bool isMaterialized(Symbol predicate, uint32_t arity) const;
+    
+    /**
+     * Reorder rule bodies by estimated cost before solving them (see
+     * JoinPlanner). On by default; solutions may then come out in a
+     * different order than the rules are written.
+     */
+    void setJoinPlanning(bool enabled) { planJoins_ = enabled; }
+    bool joinPlanning() const { return planJoins_; }
+    const JoinPlanner& planner() const { return planner_; }
+    
+    /**
+     * Solve rule bodies that are cyclic joins over stored facts (such as
+     * triangles) with one multiway join (see LeapfrogJoin). On by default.
+     */
+    void setMultiwayJoins(bool enabled) { multiwayJoins_ = enabled; }
+    bool multiwayJoins() const { return multiwayJoins_; }
+    
+    /**
+     * Solve other rule bodies over stored facts set-at-a-time with hash
+     * joins (see joinBatches()) when every goal matches at least
+     * BATCH_JOIN_MIN_ROWS rows. On by default.
+     */
+    void setBatchJoins(bool enabled) { batchJoins_ = enabled; }
+    bool batchJoins() const { return batchJoins_; }
+    static constexpr size_t BATCH_JOIN_MIN_ROWS = 64;
+    
+    /**
+     * Solve the groups of a rule body that share no unbound variable
+     * (as in report(X, Y) :- heavyA(X), heavyB(Y)) once each, rather
+     * than a later group once per solution of the earlier ones, and
+     * combine their solutions by cross product. Groups are solved
+     * concurrently when parallelism() > 1. Used when a later group calls
+     * rules; the solutions are the same as sequentially, though not
+     * always in the same order. On by default.
+     */
+    void setIndependentGoals(bool enabled) { independentGoals_ = enabled; }
+    bool independentGoals() const { return independentGoals_; }
+    
+    /**
+     * Evaluate query() (and QueryEngine's queries) on up to threads
+     * threads (1, the default, runs queries on the calling thread
+     * alone). The alternatives of the query's first branching goal (fact
+     * rows, rules, join results) are shared out as tasks over a
+     * work-stealing pool, each solved by its own machine (see
+     * SolutionCursor::setPartition()); the solutions and their order are
+     * the same as sequentially. Tables of tabled predicates are filled
+     * per task. Cursors always run sequentially.
+     */
+    void setParallelism(size_t threads);
+    size_t parallelism() const { return pool_ ? pool_->size() + 1 : 1; }
+    
+    /**
+     * Select the evaluation mode. Switching to BOTTOM_UP materializes
+     * right away; later changes are materialized again by the next query()
+     * (or by loadFromFile, or an explicit materialize()). Cursors opened
+     * while the materialization is out of date evaluate top-down.
+     */
+    void setEvaluationMode(EvaluationMode mode);
+    EvaluationMode evaluationMode() const { return mode_; }
+    void materialize();
+    
+    /** Derived facts of a materialized predicate, or null. */
+    const FactTable* getMaterializedTable(Symbol predicate, uint32_t arity) const;
     
     // Loading from file
     void loadFromFile(const std::string& filename);
@@ -93,33 +250,121 @@ public:
     std::vector<BindingSet> query(const std::string& queryStr);
     std::vector<BindingSet> query(const Fact& goal);
     
+    /**
+     * Solve a conjunction of goals, such as the query string
+     * "parent(?X, ?Y), age(?Y, ?A)". The goals are joined like a rule
+     * body: reordered by the join planner and, where they qualify, solved
+     * as a multiway or batch join. Conjunctions are evaluated top-down in
+     * MAGIC_SETS mode, which rewrites the rules for single goals only.
+     * Goals may be aggregates, such as count(parent(?X, ?Y), ?N), which
+     * give one solution rather than one per match (see aggregate.h).
+     *
+     * With a budget, evaluation (magic-sets derivation included) stops
+     * once one of its limits is exceeded, and the solutions found until
+     * then are returned, up to its maxResults; budget->reason() tells
+     * whether and why the query stopped early.
+     */
+    std::vector<BindingSet> query(const std::vector<Fact>& goals,
+                                  std::shared_ptr<QueryBudget> budget = nullptr);
+    
+    /**
+     * Open a cursor that computes solutions on demand (see SolutionCursor),
+     * within budget's limits if given. query() is the same as draining one.
+     */
+    SolutionCursor cursor(const std::string& queryStr) const;
+    SolutionCursor cursor(const Fact& goal, std::shared_ptr<QueryBudget> budget = nullptr) const;
+    SolutionCursor cursor(const std::vector<Fact>& goals,
+                          std::shared_ptr<QueryBudget> budget = nullptr) const;
+    
+    /**
+     * Open a cursor on goals as query() would evaluate them: views are
+     * brought up to date and, in BOTTOM_UP mode, rules materialized
+     * first, which cursor() leaves to the caller.
+     */
+    SolutionCursor openQuery(const std::vector<Fact>& goals,
+                             std::shared_ptr<QueryBudget> budget = nullptr);
+    
+    /**
+     * Parse and compile a query once, to run it many times with values
+     * for its $-named parameters, as in prepare("parent($who, ?X)")
+     * (see PreparedQuery).
+     */
+    PreparedQuery prepare(const std::string& queryStr);
+    
     // Debug/info
     void printFacts() const;
     void printRules() const;
 
 private:
-    std::vector<Rule> rules_;
-    std::unordered_map<std::string, std::vector<Fact>> facts_;
+    // The current snapshot. Readers pin it and writers change it under
+    // stateMutex_, which is held for no longer than one change.
+    std::shared_ptr<KnowledgeSnapshot> state_ = std::make_shared<KnowledgeSnapshot>();
+    mutable std::mutex stateMutex_;
+    std::mutex materializeMutex_;   // One materialization at a time
     
-    // Core evaluation - synchronous
-    std::vector<BindingSet> evaluateGoal(
-        const Fact& goal,
-        const BindingSet& bindings,
-        std::set<std::string>& visited) const;
+    JoinPlanner planner_;       // Fact statistics
+    bool planJoins_ = true;
+    bool multiwayJoins_ = true;
+    bool batchJoins_ = true;
+    bool independentGoals_ = true;
+    std::unique_ptr<WorkPool> pool_;    // Null while queries are sequential
     
-    std::vector<BindingSet> evaluateRule(
-        const Rule& rule,
-        const Fact& goal,
-        const BindingSet& bindings,
-        std::set<std::string>& visited) const;
+    EvaluationMode mode_ = EvaluationMode::TOP_DOWN;
+    
+    // Apply a ":- directive" line from a rules file
+    void applyDirective(const std::string& directive);
+    
+    // The current snapshot (or a table or the rules of it), to change:
+    // copied first while a query holds it. With stateMutex_ held.
+    KnowledgeSnapshot& writable();
+    FactTable& writableTable(const PredicateKey& key);
+    RuleSet& writableRules();
+    ViewSet& writableViews();
+    
+    // Count a change to key's facts, rules or settings
+    void changed(const PredicateKey& key);
+    
+    void invalidateMaterialized();
+    
+    // Fact changes, with stateMutex_ held. retract() removes up to limit
+    // facts matching pattern
+    void add(const Fact& fact);
+    size_t retract(const Fact& pattern, size_t limit);
+    
+    // Views, with stateMutex_ held: derive them from scratch, or update
+    // them for facts of key changed, given key's table before the change
+    void deriveViews();
+    void updateViews(const PredicateKey& key, const std::vector<Fact>& added,
+                     const std::vector<Fact>& removed, const FactTable* before);
+    
+    // Derive views again if rules changed since they were, before a query
+    void refreshViews();
+    
+    // Everything a query needs done first: refreshViews(), and
+    // materialize() in BOTTOM_UP mode
+    void prepareQuery();
+    
+    // Answer relation for goal by magic-sets evaluation (within budget, if
+    // any), or null if the rewritten program cannot be evaluated bottom-up
+    std::shared_ptr<const BottomUpEvaluator::Relations> evaluateMagic(
+        const KnowledgeSnapshot& snapshot, const Fact& goal, QueryBudget* budget = nullptr) const;
+    
+    // Every solution of a cursor, up to budget's result limit
+    std::vector<BindingSet> drain(SolutionCursor solutions, QueryBudget* budget) const;
+    
+    std::vector<BindingSet> queryParallel(const std::vector<Fact>& goals,
+                                          std::shared_ptr<QueryBudget> budget) const;
+    
+    // Every solution, in order, of the cursors open() makes, each solving
+    // its own part of them on the pool, up to budget's result limit
+    std::vector<BindingSet> queryParallel(const std::function<SolutionCursor()>& open,
+                                          QueryBudget* budget) const;
     
-    std::vector<BindingSet> evaluateConjunction(
-        const std::vector<Fact>& goals,
-        const BindingSet& bindings,
-        std::set<std::string>& visited) const;
+    // Plan ids of prepared queries, past those of rules
+    std::atomic<uint32_t> nextPreparedId_{uint32_t(1) << 31};
     
-    // Rename variables in a rule to avoid capture
-    Rule renameVariables(const Rule& rule, int& counter) const;
+    friend class PreparedQuery;
+    friend class SolutionCursor;
 };
 
 } // namespace kbgdb
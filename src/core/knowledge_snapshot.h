@@ -0,0 +1,116 @@
+#pragma once
+#include "core/bottom_up.h"
+#include "core/clause.h"
+#include "core/fact_table.h"
+#include "core/join_planner.h"
+#include "core/rule.h"
+#include "core/rule_index.h"
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * RuleSet holds the rules of a KnowledgeBase, compiled, and their index.
+ * A rule's id is its position.
+ */
+struct RuleSet {
+    std::vector<Rule> rules;
+    std::vector<std::shared_ptr<const CompiledClause>> clauses;
+    RuleIndex index;
+};
+
+/**
+ * ViewSet holds the predicates a KnowledgeBase keeps materialized (see
+ * KnowledgeBase::materializePredicate()) and their derived facts, with
+ * those of the predicates they depend on, as BottomUpEvaluator derives
+ * them. Predicates that cannot be materialized have none.
+ */
+struct ViewSet {
+    std::unordered_set<PredicateKey> declared;
+    BottomUpEvaluator::Relations derived;
+    std::unordered_set<PredicateKey> inputs;    // Read by derived's rules, or derived
+    bool current = false;                       // False once rules change, until derived again
+};
+
+/**
+ * KnowledgeSnapshot is the state of a KnowledgeBase that queries read:
+ * its stored facts, rules, tabled predicates, views and materialized
+ * relations, and the plans made for its rules.
+ *
+ * A query pins the current snapshot when it starts (see
+ * KnowledgeBase::snapshot()) and reads only that one, without locking,
+ * for as long as it runs. A pinned snapshot never changes: writers
+ * change the current snapshot in place while no query holds it, and a
+ * copy of it otherwise. The copy shares the rules and every fact table
+ * with the pinned snapshot. Rules are copied before their first change;
+ * a fact table is forked (see FactTable::fork()), so facts added to the
+ * copy are appended to storage the pinned snapshot shares but does not
+ * see, and adding facts costs the same whether queries run or not. Facts
+ * removed from the copy stay in that storage, marked as removed at an
+ * epoch the pinned snapshot is older than. The tables of views are
+ * forked likewise before their first change.
+ */
+class KnowledgeSnapshot {
+public:
+    const FactTable* facts(Symbol predicate, uint32_t arity) const {
+        auto it = facts_.find(PredicateKey{predicate, arity});
+        return it != facts_.end() ? it->second.get() : nullptr;
+    }
+
+    /** Derived facts of a materialized predicate or view, or null. */
+    const FactTable* materialized(Symbol predicate, uint32_t arity) const {
+        if (views_ && views_->current) {
+            auto it = views_->derived.find(PredicateKey{predicate, arity});
+            if (it != views_->derived.end()) {
+                return &it->second;
+            }
+        }
+        if (!materialized_ || materialized_->empty()) {
+            return nullptr;
+        }
+        auto it = materialized_->find(PredicateKey{predicate, arity});
+        return it != materialized_->end() ? &it->second : nullptr;
+    }
+    bool isMaterialized() const { return materialized_ != nullptr; }
+
+    bool isTabled(Symbol predicate, uint32_t arity) const {
+        return !tabled_.empty() && tabled_.count(PredicateKey{predicate, arity});
+    }
+
+    const RuleSet& rules() const { return *rules_; }
+    PlanCache& plans() const { return *plans_; }
+    
+    /**
+     * Number of changes before this snapshot: facts and rules added,
+     * facts removed, predicates tabled or materialized.
+     */
+    uint64_t epoch() const { return epoch_; }
+    
+    /** The epoch of the last change to predicate/arity, or 0 if none. */
+    uint64_t changedAt(Symbol predicate, uint32_t arity) const {
+        auto it = changedAt_.find(PredicateKey{predicate, arity});
+        return it != changedAt_.end() ? it->second : 0;
+    }
+
+private:
+    friend class KnowledgeBase;
+
+    std::unordered_map<PredicateKey, std::shared_ptr<FactTable>> facts_;
+    std::shared_ptr<RuleSet> rules_ = std::make_shared<RuleSet>();
+    std::unordered_set<PredicateKey> tabled_;
+    std::shared_ptr<const BottomUpEvaluator::Relations> materialized_;  // Null while out of date
+    std::shared_ptr<ViewSet> views_;    // Null until a view is declared
+    std::shared_ptr<PlanCache> plans_ = std::make_shared<PlanCache>();
+    uint64_t epoch_ = 0;
+    std::unordered_map<PredicateKey, uint64_t> changedAt_;
+
+    // Writers' bookkeeping, under the knowledge base's lock
+    bool ownRules_ = true;                          // Not shared with a pinned snapshot
+    bool ownViews_ = true;                          // Likewise
+    std::unordered_set<PredicateKey> ownTables_;    // Likewise
+};
+
+} // namespace kbgdb
@@ -0,0 +1,262 @@
+#include "core/leapfrog_join.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace kbgdb {
+
+std::unique_ptr<LeapfrogJoin> LeapfrogJoin::create(const std::vector<Atom>& atoms, Step step) {
+    std::unique_ptr<LeapfrogJoin> join(new LeapfrogJoin());
+    join->step_ = std::move(step);
+
+    // Variables shared by the most goals first: they prune the most
+    std::unordered_map<uint32_t, size_t> occurrences;
+    std::vector<uint32_t> firstSeen;
+    for (const auto& atom : atoms) {
+        for (size_t i = 0; i < atom.args.size(); ++i) {
+            Cell arg = atom.args[i];
+            if (!arg.isRef()) {
+                if (!arg.isAtomic()) return nullptr;
+                continue;
+            }
+            for (size_t j = 0; j < i; ++j) {
+                if (atom.args[j] == arg) return nullptr;
+            }
+            if (occurrences[arg.slot()]++ == 0) {
+                firstSeen.push_back(arg.slot());
+            }
+        }
+    }
+    join->vars_ = firstSeen;
+    std::stable_sort(join->vars_.begin(), join->vars_.end(), [&](uint32_t a, uint32_t b) {
+        return occurrences[a] > occurrences[b];
+    });
+    std::unordered_map<uint32_t, size_t> rank;
+    for (size_t i = 0; i < join->vars_.size(); ++i) {
+        rank[join->vars_[i]] = i;
+    }
+    join->participants_.resize(join->vars_.size());
+    join->at_.resize(join->vars_.size());
+
+    for (const auto& atom : atoms) {
+        if (!atom.table || atom.table->empty()) {
+            join->exhausted_ = true;
+            continue;
+        }
+        if (atom.args.empty()) {
+            // A stored proposition: true, once per copy
+            size_t copies = atom.table->size() - atom.table->removed();
+            join->exhausted_ = join->exhausted_ || copies == 0;
+            join->factor_ *= copies;
+            continue;
+        }
+
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> vars;
+        for (uint32_t i = 0; i < atom.args.size(); ++i) {
+            (atom.args[i].isRef() ? vars : order).push_back(i);
+        }
+        std::sort(vars.begin(), vars.end(), [&](uint32_t a, uint32_t b) {
+            return rank[atom.args[a].slot()] < rank[atom.args[b].slot()];
+        });
+        size_t constants = order.size();
+        order.insert(order.end(), vars.begin(), vars.end());
+
+        const TrieIndex* trie = atom.table->trie(order);
+        if (!trie) {
+            return nullptr;
+        }
+        size_t id = join->iterators_.size();
+        join->iterators_.emplace_back(*trie);
+        for (uint32_t position : vars) {
+            join->participants_[rank[atom.args[position].slot()]].push_back(id);
+        }
+
+        // Descend through the constants once; the variables' levels
+        // are opened below them
+        TrieIndex::Iterator& it = join->iterators_.back();
+        for (size_t level = 0; level < constants && !join->exhausted_; ++level) {
+            Cell value = atom.args[order[level]];
+            it.open();
+            it.seek(value);
+            join->exhausted_ = it.atEnd() || it.key() != value;
+        }
+    }
+    return join;
+}
+
+bool LeapfrogJoin::next(std::vector<Cell>& values) {
+    // Each solution produced is a step, and so is each move of the search
+    if (step_ && (repeats_ > 0 || !exhausted_) && !step_()) {
+        exhausted_ = true;
+        repeats_ = 0;
+        return false;
+    }
+    if (repeats_ > 0) {
+        --repeats_;
+        values = values_;
+        return true;
+    }
+    if (exhausted_) {
+        return false;
+    }
+    values_.resize(vars_.size());
+
+    // Each solution is repeated for the duplicates of the rows it matches;
+    // the iterators of every goal are then at a row of their last level
+    auto found = [&]() {
+        uint64_t copies = factor_;
+        for (const auto& it : iterators_) {
+            copies *= it.count();
+        }
+        repeats_ = copies - 1;
+        values = values_;
+        return true;
+    };
+
+    size_t depth = 0;
+    bool matched;
+    if (!started_) {
+        started_ = true;
+        if (vars_.empty()) {
+            exhausted_ = true;  // Every goal is ground and holds
+            return found();
+        }
+        matched = enter(0);
+    } else {
+        depth = vars_.size() - 1;
+        matched = advance(depth);
+    }
+
+    while (true) {
+        if (step_ && !step_()) {
+            exhausted_ = true;
+            return false;
+        }
+        if (matched) {
+            values_[depth] = iterators_[participants_[depth][0]].key();
+            if (depth + 1 == vars_.size()) {
+                return found();
+            }
+            ++depth;
+            matched = enter(depth);
+        } else {
+            leave(depth);
+            if (depth == 0) {
+                exhausted_ = true;
+                return false;
+            }
+            --depth;
+            matched = advance(depth);
+        }
+    }
+}
+
+bool LeapfrogJoin::enter(size_t depth) {
+    std::vector<size_t>& ids = participants_[depth];
+    bool empty = false;
+    for (size_t id : ids) {
+        iterators_[id].open();
+        empty = empty || iterators_[id].atEnd();
+    }
+    if (empty) {
+        return false;
+    }
+    std::sort(ids.begin(), ids.end(), [&](size_t a, size_t b) {
+        return iterators_[a].key().bits() < iterators_[b].key().bits();
+    });
+    at_[depth] = 0;
+    return search(depth);
+}
+
+bool LeapfrogJoin::advance(size_t depth) {
+    const std::vector<size_t>& ids = participants_[depth];
+    TrieIndex::Iterator& it = iterators_[ids[at_[depth]]];
+    it.next();
+    if (it.atEnd()) {
+        return false;
+    }
+    at_[depth] = (at_[depth] + 1) % ids.size();
+    return search(depth);
+}
+
+void LeapfrogJoin::leave(size_t depth) {
+    for (size_t id : participants_[depth]) {
+        iterators_[id].up();
+    }
+}
+
+bool LeapfrogJoin::search(size_t depth) {
+    // Iterators are in key order from at_ on, cyclically; the one before
+    // at_ holds the largest key
+    const std::vector<size_t>& ids = participants_[depth];
+    size_t k = ids.size();
+    size_t& at = at_[depth];
+    Cell max = iterators_[ids[(at + k - 1) % k]].key();
+    while (true) {
+        TrieIndex::Iterator& it = iterators_[ids[at]];
+        if (it.key() == max) {
+            return true;
+        }
+        it.seek(max);
+        if (it.atEnd()) {
+            return false;
+        }
+        max = it.key();
+        at = (at + 1) % k;
+    }
+}
+
+bool LeapfrogJoin::isCyclic(const std::vector<Goal>& goals) {
+    std::vector<std::vector<uint32_t>> edges;
+    for (const auto& goal : goals) {
+        std::vector<uint32_t> edge;
+        std::vector<Cell> pending(goal.args, goal.args + goal.arity);
+        while (!pending.empty()) {
+            Cell cell = pending.back();
+            pending.pop_back();
+            if (cell.isRef()) {
+                edge.push_back(cell.slot());
+            } else if (cell.isStructure() || cell.isList()) {
+                pending.insert(pending.end(), cell.args(), cell.args() + cell.arity());
+            }
+        }
+        std::sort(edge.begin(), edge.end());
+        edge.erase(std::unique(edge.begin(), edge.end()), edge.end());
+        edges.push_back(std::move(edge));
+    }
+
+    // GYO: drop variables found in a single edge, and edges contained
+    // in another, until nothing changes. Only cyclic graphs leave edges.
+    bool changed = true;
+    while (changed && !edges.empty()) {
+        changed = false;
+
+        std::unordered_map<uint32_t, size_t> count;
+        for (const auto& edge : edges) {
+            for (uint32_t v : edge) ++count[v];
+        }
+        for (auto& edge : edges) {
+            size_t before = edge.size();
+            edge.erase(std::remove_if(edge.begin(), edge.end(),
+                                      [&](uint32_t v) { return count[v] == 1; }),
+                       edge.end());
+            changed = changed || edge.size() != before;
+        }
+
+        for (size_t i = 0; i < edges.size(); ++i) {
+            bool contained = edges[i].empty();
+            for (size_t j = 0; j < edges.size() && !contained; ++j) {
+                contained = j != i && std::includes(edges[j].begin(), edges[j].end(),
+                                                    edges[i].begin(), edges[i].end());
+            }
+            if (contained) {
+                edges.erase(edges.begin() + static_cast<std::ptrdiff_t>(i));
+                changed = true;
+                break;
+            }
+        }
+    }
+    return !edges.empty();
+}
+
+} // namespace kbgdb
@@ -0,0 +1,95 @@
+#pragma once
+#include "common/cell.h"
+#include "core/binding_env.h"
+#include "core/fact_table.h"
+#include "core/trie_index.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * LeapfrogJoin evaluates a conjunction of goals on stored facts as one
+ * multiway join (Leapfrog Triejoin), instead of a goal at a time.
+ *
+ * Variables are bound one at a time in a global order. For each, the
+ * goals that mention it intersect their candidate values by leapfrogging:
+ * each trie iterator in turn seeks to the largest key another one is at,
+ * until they all agree. No intermediate result is ever built, and the
+ * work is bounded by the worst-case output size of the join, which for
+ * cyclic patterns (triangles, cliques) is far below what any sequence
+ * of pairwise joins may produce on the way.
+ *
+ * Each goal is read through a TrieIndex of its relation whose columns
+ * are its constant arguments first, then its variables in the global
+ * order. Solutions come out one at a time, each as many times as a
+ * goal-at-a-time search would find it: once per combination of the
+ * (possibly duplicate) rows it matches.
+ */
+class LeapfrogJoin {
+public:
+    /**
+     * One goal: its relation (null if it has no facts) and its arguments,
+     * each an unbound variable (a REF cell, identified by slot) or an
+     * atomic constant.
+     */
+    struct Atom {
+        const FactTable* table;
+        std::vector<Cell> args;
+    };
+
+    /**
+     * Called once per unit of join work (a key sought, a row probed or
+     * produced), so that a query's budget covers joins too; returning
+     * false stops the join as if it had no more solutions.
+     */
+    using Step = std::function<bool()>;
+
+    /**
+     * A join over atoms, or null if they cannot be joined this way: an
+     * argument is compound, a variable repeats within a goal, or a
+     * relation has facts that are not ground and atomic.
+     */
+    static std::unique_ptr<LeapfrogJoin> create(const std::vector<Atom>& atoms,
+                                                Step step = nullptr);
+
+    /** Variable slots, in the order values are bound. */
+    const std::vector<uint32_t>& variables() const { return vars_; }
+
+    /**
+     * The next solution: values[i] is the value of variables()[i].
+     * Returns false once every solution has been produced.
+     */
+    bool next(std::vector<Cell>& values);
+
+    /**
+     * Whether a conjunction's variable hypergraph (a node per variable,
+     * an edge per goal) is cyclic, by GYO reduction. Acyclic joins are
+     * handled well by pairwise joins in a good order; cyclic ones are
+     * where a multiway join pays off.
+     */
+    static bool isCyclic(const std::vector<Goal>& goals);
+
+private:
+    LeapfrogJoin() = default;
+
+    bool enter(size_t depth);       // Open the iterators of depth, find a first key
+    bool advance(size_t depth);     // Next key common to the iterators of depth
+    void leave(size_t depth);
+    bool search(size_t depth);
+
+    Step step_;
+    std::vector<uint32_t> vars_;
+    std::vector<TrieIndex::Iterator> iterators_;        // One per atom
+    std::vector<std::vector<size_t>> participants_;     // Per depth: iterator ids
+    std::vector<size_t> at_;                            // Per depth: leapfrog position
+    std::vector<Cell> values_;                          // The last solution
+    uint64_t factor_ = 1;       // Copies of every solution due to stored propositions
+    uint64_t repeats_ = 0;      // Copies of the last solution still to produce
+    bool started_ = false;
+    bool exhausted_ = false;
+};
+
+} // namespace kbgdb
@@ -0,0 +1,132 @@
+#include "core/magic_sets.h"
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace kbgdb {
+
+namespace {
+
+using Bound = std::unordered_set<Symbol>;
+
+void collectVariables(const Term& term, Bound& vars) {
+    if (term.isVariable()) {
+        vars.insert(term.value);
+        return;
+    }
+    for (const auto& arg : term.args) {
+        collectVariables(arg, vars);
+    }
+}
+
+bool isBound(const Term& term, const Bound& bound) {
+    if (term.isVariable()) {
+        return bound.count(term.value) > 0;
+    }
+    for (const auto& arg : term.args) {
+        if (!isBound(arg, bound)) return false;
+    }
+    return true;
+}
+
+// "bf" for a goal whose first argument is bound and second free
+std::string adornment(const Fact& goal, const Bound& bound) {
+    std::string result;
+    for (const auto& term : goal.terms()) {
+        result += isBound(term, bound) ? 'b' : 'f';
+    }
+    return result;
+}
+
+Symbol adorned(Symbol predicate, const std::string& adornment) {
+    return predicate.str() + "^" + adornment;
+}
+
+Fact magicGoal(const Fact& goal, const std::string& adornment) {
+    std::vector<Term> bound;
+    for (size_t i = 0; i < adornment.size(); ++i) {
+        if (adornment[i] == 'b') {
+            bound.push_back(goal.terms()[i]);
+        }
+    }
+    return Fact("magic^" + adorned(goal.predicate(), adornment).str(), std::move(bound));
+}
+
+} // namespace
+
+std::optional<MagicProgram> rewriteMagicSets(const std::vector<Rule>& rules,
+                                             const Fact& query) {
+    std::unordered_map<PredicateKey, std::vector<const Rule*>> rulesFor;
+    for (const auto& rule : rules) {
+        const Fact& head = rule.head();
+        rulesFor[PredicateKey{head.predicate(), static_cast<uint32_t>(head.arity())}]
+            .push_back(&rule);
+    }
+
+    auto keyOf = [](const Fact& goal) {
+        return PredicateKey{goal.predicate(), static_cast<uint32_t>(goal.arity())};
+    };
+    if (!rulesFor.count(keyOf(query))) {
+        return std::nullopt;
+    }
+
+    MagicProgram program;
+    std::string queryAdornment = adornment(query, Bound{});
+    program.answer = PredicateKey{adorned(query.predicate(), queryAdornment),
+                                  static_cast<uint32_t>(query.arity())};
+
+    // The seed: the query's own bound arguments
+    program.rules.emplace_back(magicGoal(query, queryAdornment), std::vector<Fact>{});
+
+    std::deque<std::pair<PredicateKey, std::string>> pending{{keyOf(query), queryAdornment}};
+    std::unordered_set<std::string> done;
+
+    while (!pending.empty()) {
+        auto [key, adorn] = pending.front();
+        pending.pop_front();
+        if (!done.insert(key.toString() + "^" + adorn).second) continue;
+
+        // Stored facts of the predicate, restricted to its magic set
+        std::vector<Term> vars;
+        for (uint32_t i = 0; i < key.arity; ++i) {
+            vars.push_back(Term::variable("_A" + std::to_string(i)));
+        }
+        Fact general(key.name, vars);
+        program.rules.emplace_back(
+            Fact(adorned(key.name, adorn), vars),
+            std::vector<Fact>{magicGoal(general, adorn), general});
+
+        for (const Rule* rule : rulesFor.at(key)) {
+            const Fact& head = rule->head();
+            Fact magic = magicGoal(head, adorn);
+
+            // Variables bound when the rule is called, then by each goal
+            Bound bound;
+            for (const auto& term : magic.terms()) {
+                collectVariables(term, bound);
+            }
+
+            std::vector<Fact> body{magic};
+            for (const Fact& goal : rule->body()) {
+                if (!rulesFor.count(keyOf(goal))) {
+                    body.push_back(goal);
+                } else {
+                    // The goal is called with the arguments bound so far:
+                    // they join its magic set
+                    std::string goalAdornment = adornment(goal, bound);
+                    program.rules.emplace_back(magicGoal(goal, goalAdornment), body);
+                    pending.emplace_back(keyOf(goal), goalAdornment);
+                    body.emplace_back(adorned(goal.predicate(), goalAdornment), goal.terms());
+                }
+                for (const auto& term : goal.terms()) {
+                    collectVariables(term, bound);
+                }
+            }
+            program.rules.emplace_back(Fact(adorned(head.predicate(), adorn), head.terms()),
+                                       std::move(body));
+        }
+    }
+    return program;
+}
+
+} // namespace kbgdb
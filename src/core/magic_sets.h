@@ -0,0 +1,36 @@
+#pragma once
+#include "core/fact_table.h"
+#include "core/rule.h"
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * A program rewritten for one query by magic sets (see rewriteMagicSets).
+ */
+struct MagicProgram {
+    std::vector<Rule> rules;    // Rewritten rules, magic rules and the seed
+    PredicateKey answer;        // Holds the query's answers once evaluated
+};
+
+/**
+ * Rewrite rules so that bottom-up evaluation only derives facts relevant
+ * to query.
+ *
+ * Each predicate reachable from the query is specialized for the
+ * argument positions that are bound when it is called (its adornment,
+ * e.g. ancestor^bf for ancestor(john, X)), passing bindings left to
+ * right through rule bodies. A magic predicate per adorned predicate
+ * (magic^ancestor^bf) collects the bound arguments it is called with,
+ * starting from the query's constants (the seed, a rule with no body),
+ * and every rewritten rule only fires for arguments in its magic set.
+ *
+ * Predicates with stored facts as well as rules get a rule copying those
+ * facts in. Returns nullopt if no rule defines the query's predicate.
+ */
+std::optional<MagicProgram> rewriteMagicSets(const std::vector<Rule>& rules,
+                                             const Fact& query);
+
+} // namespace kbgdb
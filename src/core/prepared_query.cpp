@@ -0,0 +1,109 @@
+#include "core/prepared_query.h"
+#include "core/clause.h"
+#include "core/knowledge_base.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace kbgdb {
+
+namespace {
+
+bool isParameter(const Term& term) {
+    return term.isVariable() && term.value.str()[0] == '$';
+}
+
+void collectParameters(const Term& term, std::vector<Symbol>& parameters) {
+    if (isParameter(term) &&
+        std::find(parameters.begin(), parameters.end(), term.value) == parameters.end()) {
+        parameters.push_back(term.value);
+    }
+    for (const auto& arg : term.args) {
+        collectParameters(arg, parameters);
+    }
+}
+
+} // namespace
+
+PreparedQuery::PreparedQuery(KnowledgeBase& kb, std::vector<Fact> goals, uint32_t id)
+    : kb_(&kb), goals_(std::move(goals)), id_(id) {
+    if (goals_.empty()) {
+        throw std::invalid_argument("Empty conjunction");
+    }
+    for (const auto& goal : goals_) {
+        for (const auto& term : goal.terms()) {
+            collectParameters(term, parameters_);
+        }
+    }
+
+    if (goals_.size() == 1) {
+        head_ = goals_[0];
+        return;
+    }
+    head_ = conjunctionHead(goals_);
+    clause_ = std::make_shared<const CompiledClause>(CompiledClause::compile(Rule(head_, goals_)));
+    for (size_t i = 0; i < head_.arity() && i < 64; ++i) {
+        if (isParameter(head_.terms()[i])) {
+            pattern_ |= uint64_t(1) << i;
+        }
+    }
+}
+
+std::vector<std::string> PreparedQuery::parameters() const {
+    std::vector<std::string> names;
+    for (const auto& parameter : parameters_) {
+        names.push_back(parameter.str().substr(1));
+    }
+    return names;
+}
+
+void PreparedQuery::checkValues(const std::vector<Term>& values) const {
+    if (values.size() != parameters_.size()) {
+        throw std::invalid_argument("Expected " + std::to_string(parameters_.size()) +
+                                    " parameter values, got " + std::to_string(values.size()));
+    }
+}
+
+std::vector<Fact> PreparedQuery::substitute(const std::vector<Term>& values) const {
+    BindingSet bindings;
+    for (size_t i = 0; i < parameters_.size(); ++i) {
+        bindings.add(parameters_[i], values[i]);
+    }
+    std::vector<Fact> goals;
+    for (const auto& goal : goals_) {
+        goals.push_back(Unifier::substitute(goal, bindings));
+    }
+    return goals;
+}
+
+SolutionCursor PreparedQuery::cursor(const std::vector<Term>& values,
+                                     std::shared_ptr<QueryBudget> budget) const {
+    checkValues(values);
+    // Magic sets rewrite the rules for the goal's constants
+    if (kb_->evaluationMode() == EvaluationMode::MAGIC_SETS && goals_.size() == 1) {
+        return kb_->cursor(substitute(values)[0], std::move(budget));
+    }
+    SolutionCursor solutions(*this, kb_->snapshot(), values);
+    solutions.setBudget(std::move(budget));
+    return solutions;
+}
+
+std::vector<BindingSet> PreparedQuery::execute(const std::vector<Term>& values,
+                                               std::shared_ptr<QueryBudget> budget) const {
+    checkValues(values);
+    KnowledgeBase& kb = *kb_;
+    if (kb.evaluationMode() == EvaluationMode::MAGIC_SETS && goals_.size() == 1) {
+        return kb.query(substitute(values), std::move(budget));
+    }
+    kb.prepareQuery();
+    if (kb.pool_) {
+        auto pinned = kb.snapshot();
+        return kb.queryParallel([&] {
+            SolutionCursor solutions(*this, pinned, values);
+            solutions.setBudget(budget);
+            return solutions;
+        }, budget.get());
+    }
+    return kb.drain(cursor(values, budget), budget.get());
+}
+
+} // namespace kbgdb
@@ -0,0 +1,72 @@
+#pragma once
+#include "common/fact.h"
+#include "core/solution_cursor.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+
+class CompiledClause;
+class KnowledgeBase;
+class QueryBudget;
+
+/**
+ * PreparedQuery is a query parsed and compiled once, to be run many
+ * times with different values for its parameters: the $-named terms of
+ * the query string, as in kb.prepare("parent($who, ?X)").
+ *
+ * Preparing resolves the query's symbols and, for a conjunction,
+ * compiles it into a clause whose join order is planned once per
+ * binding of the parameters (and again only when the join planner's
+ * statistics change, as for rules; see PlanCache). Executing binds the
+ * parameters in the cursor's machine, with no parsing or compiling.
+ * Parameters are not reported in the solutions' bindings.
+ *
+ * Copies share their compiled form. The KnowledgeBase must outlive them.
+ */
+class PreparedQuery {
+public:
+    /** The parameters' names, without '$', in order of first occurrence. */
+    std::vector<std::string> parameters() const;
+
+    const std::vector<Fact>& goals() const { return goals_; }
+
+    /**
+     * Every solution with the parameters bound to values, in order, as
+     * KnowledgeBase::query(), within budget if given. Throws
+     * std::invalid_argument unless there is one value per parameter.
+     */
+    std::vector<BindingSet> execute(const std::vector<Term>& values,
+                                    std::shared_ptr<QueryBudget> budget = nullptr) const;
+
+    /** A cursor over the solutions for values (see KnowledgeBase::cursor()). */
+    SolutionCursor cursor(const std::vector<Term>& values,
+                          std::shared_ptr<QueryBudget> budget = nullptr) const;
+
+private:
+    friend class KnowledgeBase;
+    friend class SolutionCursor;
+
+    PreparedQuery(KnowledgeBase& kb, std::vector<Fact> goals, uint32_t id);
+
+    void checkValues(const std::vector<Term>& values) const;
+
+    // The goals with the parameters replaced by values
+    std::vector<Fact> substitute(const std::vector<Term>& values) const;
+
+    KnowledgeBase* kb_;
+    std::vector<Fact> goals_;
+    std::vector<Symbol> parameters_;    // With their '$'
+
+    // The goal solved: goals_[0], or the head of the conjunction's
+    // clause, which is planned as rule id_ called with the parameters'
+    // arguments (pattern_) bound
+    Fact head_;
+    std::shared_ptr<const CompiledClause> clause_;
+    uint32_t id_;
+    uint64_t pattern_ = 0;
+};
+
+} // namespace kbgdb
@@ -0,0 +1,62 @@
+#include "core/query_budget.h"
+
+namespace kbgdb {
+
+const char* toString(QueryStop stop) {
+    switch (stop) {
+        case QueryStop::NONE: return "none";
+        case QueryStop::RESULTS: return "results";
+        case QueryStop::DEADLINE: return "deadline";
+        case QueryStop::STEPS: return "steps";
+        case QueryStop::MEMORY: return "memory";
+        case QueryStop::CANCELLED: return "cancelled";
+    }
+    return "none";
+}
+
+QueryBudget::QueryBudget(const QueryLimits& limits)
+    : limits_(limits)
+    , deadline_(std::chrono::steady_clock::now() + limits.timeout) {
+}
+
+bool QueryBudget::charge(uint64_t steps, int64_t memory) {
+    uint64_t total = steps_.fetch_add(steps, std::memory_order_relaxed) + steps;
+    int64_t used = memory_.fetch_add(memory, std::memory_order_relaxed) + memory;
+    if (limits_.maxSteps > 0 && total > limits_.maxSteps) {
+        stop(QueryStop::STEPS);
+    } else if (limits_.maxMemory > 0 && used > static_cast<int64_t>(limits_.maxMemory)) {
+        stop(QueryStop::MEMORY);
+    } else if (limits_.timeout.count() > 0 && std::chrono::steady_clock::now() >= deadline_) {
+        stop(QueryStop::DEADLINE);
+    }
+    return !stopped();
+}
+
+void QueryBudget::stop(QueryStop reason) {
+    QueryStop none = QueryStop::NONE;
+    reason_.compare_exchange_strong(none, reason, std::memory_order_acq_rel);
+    stopped_.store(true, std::memory_order_release);
+}
+
+std::string QueryBudget::message() const {
+    switch (reason()) {
+        case QueryStop::RESULTS:
+            return "Query reached its limit of " + std::to_string(limits_.maxResults) + " results";
+        case QueryStop::DEADLINE:
+            return "Query exceeded its deadline of " + std::to_string(limits_.timeout.count()) +
+                   " ms";
+        case QueryStop::STEPS:
+            return "Query exceeded its limit of " + std::to_string(limits_.maxSteps) +
+                   " inference steps";
+        case QueryStop::MEMORY:
+            return "Query exceeded its memory limit of " + std::to_string(limits_.maxMemory) +
+                   " bytes";
+        case QueryStop::CANCELLED:
+            return "Query cancelled";
+        case QueryStop::NONE:
+            break;
+    }
+    return "";
+}
+
+} // namespace kbgdb
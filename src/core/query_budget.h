@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace kbgdb {
+
+/**
+ * Limits on the work one query may do; zero means no limit.
+ *
+ * Steps are inferences: goals called and alternatives (fact rows,
+ * clauses) tried, and facts derived bottom-up for the query. Memory is
+ * that of the evaluation state, approximately: bindings, the search
+ * stacks, tabled answers and the rows of joins and aggregates computed
+ * up front, not the solutions already returned.
+ */
+struct QueryLimits {
+    std::chrono::milliseconds timeout{0};   // From the start of the query
+    uint64_t maxSteps = 0;
+    size_t maxResults = 0;
+    size_t maxMemory = 0;                   // Bytes
+
+    // When a limit other than maxResults stops the query, return the
+    // solutions found so far rather than an error
+    bool partialResults = true;
+};
+
+/** Why a query stopped before finding every solution. */
+enum class QueryStop {
+    NONE,
+    RESULTS,
+    DEADLINE,
+    STEPS,
+    MEMORY,
+    CANCELLED
+};
+
+/** "deadline", "steps" and so on, as reported by the HTTP API. */
+const char* toString(QueryStop stop);
+
+/**
+ * QueryBudget tracks one query's use of its limits, and stops it once
+ * one is exceeded or it is cancelled.
+ *
+ * Evaluation checks it cooperatively: machines charge their steps and
+ * memory every CHECK_STEPS steps (see charge()), and stop at the next
+ * check of stopped(), which they make at every step. The deadline runs
+ * from the budget's construction. Every machine of a query (parallel
+ * parts, groups, tabling rounds) charges the same budget, so the limits
+ * are on the query as a whole. Safe to use from several threads.
+ */
+class QueryBudget {
+public:
+    static constexpr uint64_t CHECK_STEPS = 1024;
+
+    explicit QueryBudget(const QueryLimits& limits = {});
+
+    QueryBudget(const QueryBudget&) = delete;
+    QueryBudget& operator=(const QueryBudget&) = delete;
+
+    const QueryLimits& limits() const { return limits_; }
+
+    /**
+     * Add steps and a change in memory (in bytes; negative when memory
+     * is released) and check every limit, the deadline included. False
+     * once the query is to stop.
+     */
+    bool charge(uint64_t steps, int64_t memory = 0);
+
+    /** Give back memory charged, with no check (as a machine ends). */
+    void release(size_t memory) {
+        memory_.fetch_sub(static_cast<int64_t>(memory), std::memory_order_relaxed);
+    }
+
+    /** Stop the query for reason; only the first reason is kept. */
+    void stop(QueryStop reason);
+    void cancel() { stop(QueryStop::CANCELLED); }
+
+    bool stopped() const { return stopped_.load(std::memory_order_relaxed); }
+    QueryStop reason() const { return reason_.load(std::memory_order_acquire); }
+
+    /** Set once the query is to stop, for loops that poll a flag. */
+    const std::atomic<bool>& flag() const { return stopped_; }
+
+    uint64_t steps() const { return steps_.load(std::memory_order_relaxed); }
+    size_t memory() const { return static_cast<size_t>(memory_.load(std::memory_order_relaxed)); }
+
+    /** A message for reason, such as "Query exceeded its deadline of 100 ms". */
+    std::string message() const;
+
+private:
+    QueryLimits limits_;
+    std::chrono::steady_clock::time_point deadline_;
+    std::atomic<uint64_t> steps_{0};
+    std::atomic<int64_t> memory_{0};
+    std::atomic<bool> stopped_{false};
+    std::atomic<QueryStop> reason_{QueryStop::NONE};
+};
+
+} // namespace kbgdb
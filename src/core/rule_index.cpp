@@ -0,0 +1,48 @@
+#include "core/rule_index.h"
+
+namespace kbgdb {
+
+void RuleIndex::add(const Rule& rule, uint32_t id) {
+    const Fact& head = rule.head();
+    Entry& entry = entries_[PredicateKey{head.predicate(),
+                                         static_cast<uint32_t>(head.arity())}];
+    entry.all.push_back(id);
+    
+    if (head.arity() == 0) {
+        return;
+    }
+    
+    CellArena scratch(16);
+    std::vector<Symbol> vars;
+    uint64_t key;
+    if (indexKey(encodeTerm(head.terms()[0], scratch, vars), key)) {
+        entry.byFirstArg[key].push_back(id);
+    } else {
+        entry.wildcards.push_back(id);
+    }
+}
+
+RowSet RuleIndex::candidates(Symbol predicate, uint32_t arity, Cell firstArg) const {
+    auto it = entries_.find(PredicateKey{predicate, arity});
+    if (it == entries_.end()) {
+        return RowSet::bucket(nullptr, 0, nullptr, 0);
+    }
+    const Entry& entry = it->second;
+    
+    uint64_t key;
+    if (arity == 0 || !indexKey(firstArg, key)) {
+        return RowSet::bucket(&entry.all, entry.all.size(), nullptr, 0);
+    }
+    
+    auto bucket = entry.byFirstArg.find(key);
+    const RowList* matches = bucket != entry.byFirstArg.end() ? &bucket->second : nullptr;
+    return RowSet::bucket(matches, matches ? matches->size() : 0,
+                          &entry.wildcards, entry.wildcards.size());
+}
+
+const RowList* RuleIndex::rulesFor(const PredicateKey& key) const {
+    auto it = entries_.find(key);
+    return it != entries_.end() ? &it->second.all : nullptr;
+}
+
+} // namespace kbgdb
@@ -0,0 +1,41 @@
+#pragma once
+#include "core/fact_table.h"
+#include "core/rule.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * RuleIndex maps a predicate/arity to the ids (positions in the rule list)
+ * of the rules whose head defines it, further split by the outermost
+ * symbol of the head's first argument, like FactTable's first-argument
+ * index. A goal only visits the rules that could match its head.
+ */
+class RuleIndex {
+public:
+    void add(const Rule& rule, uint32_t id);
+    void clear() { entries_.clear(); }
+    
+    /**
+     * Rule ids that may match a goal, in the order the rules were added.
+     * firstArg is the goal's dereferenced first argument (ignored for
+     * arity 0); an unbound first argument selects every rule.
+     */
+    RowSet candidates(Symbol predicate, uint32_t arity, Cell firstArg) const;
+    
+    /** Ids of every rule for predicate/arity, in order. */
+    const RowList* rulesFor(const PredicateKey& key) const;
+
+private:
+    struct Entry {
+        RowList all;
+        std::unordered_map<uint64_t, RowList> byFirstArg;
+        RowList wildcards;  // Variable first argument
+    };
+    
+    std::unordered_map<PredicateKey, Entry> entries_;
+};
+
+} // namespace kbgdb
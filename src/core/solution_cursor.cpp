@@ -0,0 +1,1384 @@
+#include "core/solution_cursor.h"
+#include "core/aggregate.h"
+#include "core/binding_env.h"
+#include "core/clause.h"
+#include "core/hash_join.h"
+#include "core/knowledge_base.h"
+#include "core/knowledge_snapshot.h"
+#include "core/leapfrog_join.h"
+#include "core/prepared_query.h"
+#include "core/query_budget.h"
+#include "core/variant_set.h"
+#include "core/work_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace kbgdb {
+
+namespace {
+
+/**
+ * A clause body being solved, and the continuation to resume once all
+ * of its goals have succeeded. Frame 0 is the query itself.
+ */
+struct Frame {
+    const std::vector<Goal>* goals;
+    uint32_t base;          // First slot of the clause's variables
+    uint32_t parent;        // Continue with goal parentIndex of frame parent
+    uint32_t parentIndex;
+    uint64_t key;           // Guard key of the goal this body solves
+};
+
+/**
+ * The solutions of a rule body whose goals fall into independent groups
+ * (sharing no unbound variable): the rows each group binds its
+ * variables to, and every combination of one row per group, numbered
+ * with the first group varying slowest, as in a nested loop.
+ */
+struct CrossProduct {
+    std::vector<std::unique_ptr<FactTable>> groups;
+    std::vector<std::vector<uint32_t>> vars;    // Slot of each column, per group
+    size_t size = 1;
+};
+
+/**
+ * The groups a group_by call found, in order of first solution: each
+ * key with its aggregate, to bind to the call's arguments in turn.
+ */
+struct AggregateGroups {
+    std::vector<std::pair<Term, Term>> rows;
+};
+
+/**
+ * A goal call with alternatives left to try: fact rows first, then rules,
+ * each in insertion order (the same order as the old recursive solver).
+ */
+struct ChoicePoint {
+    Goal goal;              // Arguments dereferenced at call time
+    uint32_t frame;         // Continuation after the goal succeeds
+    uint32_t index;
+    uint64_t key;
+    bool guarded = true;    // key was added to the recursion guard
+
+    // State to restore before each alternative
+    BindingEnv::Mark mark;
+    size_t frames;
+    size_t guardLog;
+
+    const FactTable* table;
+    RowSet rows;
+    RowSet::Position rowPos;
+    RowSet rules;
+    RowSet::Position rulePos;
+    const CompiledClause* local = nullptr;  // Tried after the rules, if set
+
+    // Solutions of a rule body solved as one join, in place of rows and
+    // rules: a multiway join run lazily, a batch computed up front, or a
+    // cross product of independent groups. Or the groups of a group_by.
+    std::shared_ptr<LeapfrogJoin> join;
+    std::shared_ptr<const BindingBatch> batch;
+    std::shared_ptr<const CrossProduct> product;
+    std::shared_ptr<const AggregateGroups> groups;
+    size_t batchPos = 0;    // Next batch row, product combination or group
+
+    // Alternatives this machine may still try: all of them, except at
+    // the choice point a partitioned machine splits (see partition())
+    size_t budget = SIZE_MAX;
+};
+
+/**
+ * Append the text of cell to out with variables numbered by first
+ * occurrence, so variant terms (equal up to renaming) get equal text.
+ */
+void appendVariant(const BindingEnv& env, Cell cell,
+                   std::vector<uint32_t>& seen, std::string& out) {
+    cell = env.deref(cell);
+    switch (cell.tag()) {
+        case Cell::Tag::REF: {
+            auto it = std::find(seen.begin(), seen.end(), cell.slot());
+            out += '?';
+            out += std::to_string(it - seen.begin());
+            if (it == seen.end()) {
+                seen.push_back(cell.slot());
+            }
+            break;
+        }
+
+        case Cell::Tag::STR:
+            out += cell.functorName().str();
+            out += '(';
+            for (uint32_t i = 0; i < cell.arity(); ++i) {
+                if (i > 0) out += ',';
+                appendVariant(env, cell.args()[i], seen, out);
+            }
+            out += ')';
+            break;
+
+        case Cell::Tag::LIST:
+            out += '[';
+            appendVariant(env, cell.args()[0], seen, out);
+            out += '|';
+            appendVariant(env, cell.args()[1], seen, out);
+            out += ']';
+            break;
+
+        default:
+            out += decodeCell(cell).toString();
+            break;
+    }
+}
+
+std::string variantKey(const BindingEnv& env, const Goal& goal) {
+    std::vector<uint32_t> seen;
+    std::string key = goal.predicate.str();
+    key += '(';
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        if (i > 0) key += ',';
+        appendVariant(env, goal.args[i], seen, key);
+    }
+    key += ')';
+    return key;
+}
+
+/**
+ * The answers to one call variant of a tabled predicate.
+ *
+ * A table is filled by re-running the call's clauses until a round adds
+ * no answer anywhere (linear tabling). Calls to a variant that is still
+ * being filled read the answers found so far, which ties the tables
+ * between them into one strongly connected component: only the oldest
+ * (its leader) may decide they are complete, when a whole round of its
+ * own evaluation adds nothing.
+ */
+struct AnswerTable {
+    enum class State { EVALUATING, INCOMPLETE, COMPLETE };
+
+    explicit AnswerTable(const Goal& goal) : answers(goal.predicate, goal.arity) {}
+
+    FactTable answers;
+    std::unordered_set<std::string> variants;
+    State state = State::INCOMPLETE;
+    size_t depth = 0;       // Position on the evaluation stack
+    size_t lowLink = 0;     // Lowest position whose answers it has read
+};
+
+/**
+ * The tables of one query, shared by the machines that fill them.
+ */
+struct TableSpace {
+    std::unordered_map<std::string, std::unique_ptr<AnswerTable>> tables;
+    std::vector<AnswerTable*> evaluating;   // Stack of tables being filled
+    std::vector<AnswerTable*> pending;      // Filled, waiting for their leader
+    size_t answers = 0;                     // Answers added to any table
+    size_t bytes = 0;                       // Roughly, of the answers and their keys
+};
+
+} // namespace
+
+struct SolutionCursor::Machine {
+    const KnowledgeBase& kb;
+    std::shared_ptr<const KnowledgeSnapshot> snapshot;  // All the machine reads
+    BindingEnv env;
+
+    std::vector<Goal> query;
+    std::vector<Symbol> queryVars;
+    std::unordered_map<Symbol, uint32_t> varSlots;
+
+    // A conjunctive query is solved as the body of a clause of its own,
+    // whose head (over the query's variables) is the query goal
+    static constexpr uint32_t QUERY_CLAUSE = UINT32_MAX;
+    std::shared_ptr<const CompiledClause> queryClause;
+    std::vector<Goal> queryPlan;
+
+    std::vector<Frame> frames;
+    std::vector<ChoicePoint> choices;
+    uint32_t frame = 0;     // Next goal to solve
+    uint32_t index = 0;
+
+    // Recursion guard: the goals being derived (ancestors of the current
+    // goal), by variant hash. Changes are logged so backtracking can
+    // restore the set a choice point saw.
+    struct GuardOp {
+        bool inserted;
+        uint64_t key;
+    };
+    VariantSet ancestors;
+    std::vector<GuardOp> guardLog;
+
+    // Tabling: the query's answer tables, and whether this machine is
+    // filling one (then its query goal is solved by clauses, not by
+    // reading the table)
+    std::shared_ptr<TableSpace> tables;
+    bool filling = false;
+
+    // Relations computed for this query that take the place of rules
+    std::shared_ptr<const Relations> relations;
+    std::vector<Cell> joinValues;
+
+    // OR-parallel evaluation: part of parts machines, each trying its own
+    // range of the alternatives of the first choice point with several
+    // (the split). Until the split, every part makes the same moves.
+    size_t part = 0;
+    size_t parts = 1;
+    bool split = false;
+
+    bool started = false;
+    bool exhausted = false;
+    size_t limit = 0;
+    size_t count = 0;
+    std::atomic<bool> cancelled{false};
+    const std::atomic<bool>* interrupt = &cancelled;
+
+    // The query's limits, if it has any (then interrupt is its flag):
+    // steps are counted here, and charged with the machine's memory
+    // every QueryBudget::CHECK_STEPS
+    std::shared_ptr<QueryBudget> queryBudget;
+    uint64_t steps = 0;
+    size_t memoryCharged = 0;
+    bool ownTables = false;     // Made tables, so counts their memory
+
+    Machine(const KnowledgeBase& kb, std::shared_ptr<const KnowledgeSnapshot> snapshot,
+            const Fact& goal);
+    Machine(const KnowledgeBase& kb, std::shared_ptr<const KnowledgeSnapshot> snapshot,
+            const std::vector<Fact>& goals);
+    Machine(const KnowledgeBase& kb, std::shared_ptr<const KnowledgeSnapshot> snapshot,
+            const PreparedQuery& prepared, const std::vector<Term>& values);
+    ~Machine();
+
+    void setBudget(std::shared_ptr<QueryBudget> budget);
+    bool step() { return ++steps < QueryBudget::CHECK_STEPS || charge(); }
+    // The steps of a join run for this machine: counted as its own, and
+    // stopping the join once the query is to stop
+    LeapfrogJoin::Step joinStep() {
+        return [this] { return step() && !interrupt->load(std::memory_order_relaxed); };
+    }
+    bool charge();
+    size_t memoryUsed() const;
+
+    bool solve();
+    bool call(const Goal& goal);
+    bool callTabled(const Goal& goal);
+    bool callAggregate(const Goal& goal);
+    void fill(AnswerTable& table, const Goal& goal);
+    void pushChoicePoint(const Goal& goal, uint64_t key,
+                         const FactTable* table, RowSet rows, RowSet rules);
+    bool joinAtoms(const CompiledClause& clause, uint32_t base,
+                   std::vector<LeapfrogJoin::Atom>& atoms);
+    std::shared_ptr<LeapfrogJoin> multiwayJoin(const CompiledClause& clause, uint32_t base);
+    std::shared_ptr<const BindingBatch> batchJoin(const CompiledClause& clause, uint32_t base);
+    std::shared_ptr<const CrossProduct> crossProduct(const CompiledClause& clause, uint32_t base);
+    void unboundVariables(const Goal& goal, uint32_t base, std::vector<uint32_t>& vars) const;
+    bool resume();
+    bool isLast(const ChoicePoint& cp) const;
+    void partition(ChoicePoint& cp);
+    std::optional<bool> tryClause(const CompiledClause& clause, uint32_t id);
+    bool resumeJoin();
+    bool resumeBatch();
+    bool resumeProduct();
+    bool resumeGroups();
+    bool backtrack();
+    void guard(bool insert, uint64_t key);
+    void undoGuard(size_t size);
+    bool finished() const;
+};
+
+SolutionCursor::Machine::Machine(const KnowledgeBase& kb,
+                                 std::shared_ptr<const KnowledgeSnapshot> pinned,
+                                 const Fact& goal)
+    : kb(kb), snapshot(std::move(pinned)) {
+    uint32_t arity = static_cast<uint32_t>(goal.arity());
+    Cell* args = env.allocate(arity);
+    for (uint32_t i = 0; i < arity; ++i) {
+        args[i] = env.encode(goal.terms()[i], varSlots);
+    }
+    query.push_back(Goal{goal.predicate(), arity, args});
+
+    // Collect all query variables (including those inside compound terms/lists)
+    std::function<void(const Term&)> collectVars;
+    collectVars = [&](const Term& term) {
+        switch (term.type) {
+            case TermType::VARIABLE:
+                queryVars.push_back(term.value);
+                break;
+            case TermType::COMPOUND:
+            case TermType::LIST:
+                for (const auto& arg : term.args) {
+                    collectVars(arg);
+                }
+                break;
+            default:
+                break;
+        }
+    };
+    for (const auto& term : goal.terms()) {
+        collectVars(term);
+    }
+
+    // The query's variables already have their slots, so base 0 renames
+    // each of them to itself
+    frames.push_back(Frame{&query, 0, 0, 0, 0});
+}
+
+SolutionCursor::Machine::Machine(const KnowledgeBase& kb,
+                                 std::shared_ptr<const KnowledgeSnapshot> pinned,
+                                 const std::vector<Fact>& goals)
+    : Machine(kb, std::move(pinned), goals.size() == 1 ? goals[0] : conjunctionHead(goals)) {
+    if (goals.size() == 1) {
+        return;
+    }
+    queryClause = std::make_shared<const CompiledClause>(
+        CompiledClause::compile(Rule(conjunctionHead(goals), goals)));
+
+    // The query's variables are all free, so it has one plan
+    const auto& body = queryClause->body();
+    std::vector<size_t> order(body.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    if (kb.planJoins_) {
+        std::vector<bool> bound(queryClause->numVars(), false);
+        order = kb.planner_.order(body, bound, snapshot->rules().index);
+    }
+    for (size_t i : order) {
+        queryPlan.push_back(body[i]);
+    }
+}
+
+SolutionCursor::Machine::Machine(const KnowledgeBase& kb,
+                                 std::shared_ptr<const KnowledgeSnapshot> pinned,
+                                 const PreparedQuery& prepared, const std::vector<Term>& values)
+    : Machine(kb, std::move(pinned), prepared.head_) {
+    // The parameters are bound before the search starts, and not reported
+    std::unordered_map<Symbol, uint32_t> valueVars;
+    for (size_t i = 0; i < values.size(); ++i) {
+        Symbol parameter = prepared.parameters_[i];
+        env.unify(Cell::ref(varSlots.at(parameter)), env.encode(values[i], valueVars));
+        queryVars.erase(std::remove(queryVars.begin(), queryVars.end(), parameter),
+                        queryVars.end());
+    }
+    if (!prepared.clause_) {
+        return;
+    }
+
+    // Planned once per binding of the parameters, as a rule is
+    queryClause = prepared.clause_;
+    if (kb.planJoins_) {
+        queryPlan = snapshot->plans().plan(prepared.id_, *queryClause, prepared.pattern_,
+                                           snapshot->rules().index, kb.planner_);
+    } else {
+        queryPlan = queryClause->body();
+    }
+}
+
+SolutionCursor::Machine::~Machine() {
+    if (queryBudget) {
+        queryBudget->release(memoryCharged);
+    }
+}
+
+void SolutionCursor::Machine::setBudget(std::shared_ptr<QueryBudget> budget) {
+    queryBudget = std::move(budget);
+    interrupt = queryBudget ? &queryBudget->flag() : &cancelled;
+}
+
+// Charge the steps counted since the last charge, and the change in
+// memory; false once the query is to stop
+bool SolutionCursor::Machine::charge() {
+    uint64_t counted = steps;
+    steps = 0;
+    if (!queryBudget) {
+        return true;
+    }
+    size_t used = memoryUsed();
+    int64_t change = static_cast<int64_t>(used) - static_cast<int64_t>(memoryCharged);
+    memoryCharged = used;
+    return queryBudget->charge(counted, change);
+}
+
+size_t SolutionCursor::Machine::memoryUsed() const {
+    size_t bytes = env.bytesUsed() + frames.capacity() * sizeof(Frame) +
+                   choices.capacity() * sizeof(ChoicePoint) +
+                   guardLog.capacity() * sizeof(GuardOp);
+    if (ownTables) {
+        bytes += tables->bytes;
+    }
+
+    // The solutions joins and aggregates computed up front, often the
+    // largest part of all
+    for (const auto& cp : choices) {
+        if (cp.batch) {
+            bytes += cp.batch->bytesUsed();
+        }
+        if (cp.product) {
+            for (const auto& rows : cp.product->groups) {
+                bytes += rows->bytesUsed();
+            }
+        }
+        if (cp.groups) {
+            bytes += cp.groups->rows.capacity() * sizeof(cp.groups->rows[0]);
+        }
+    }
+    return bytes;
+}
+
+bool SolutionCursor::Machine::finished() const {
+    return exhausted || interrupt->load(std::memory_order_relaxed) ||
+           (limit > 0 && count >= limit);
+}
+
+bool SolutionCursor::Machine::solve() {
+    if (!started) {
+        started = true;
+    } else if (!backtrack()) {
+        return false;
+    }
+
+    while (!interrupt->load(std::memory_order_relaxed)) {
+        // Leave every clause body whose goals have all succeeded
+        while (index == frames[frame].goals->size()) {
+            if (frame == 0) {
+                return true;
+            }
+            const Frame& done = frames[frame];
+            guard(false, done.key);
+            index = done.parentIndex;
+            frame = done.parent;
+        }
+
+        // Instantiate the next goal only now; the copy lives until
+        // backtracking past it
+        const Frame& current = frames[frame];
+        Goal goal = env.instantiate((*current.goals)[index], current.base);
+        if (!call(goal) && !backtrack()) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool SolutionCursor::Machine::call(const Goal& goal) {
+    if (!step()) {
+        return false;
+    }
+
+    // Materialized predicates are answered by lookup alone
+    const FactTable* derived = nullptr;
+    if (relations) {
+        auto it = relations->find(PredicateKey{goal.predicate, goal.arity});
+        derived = it != relations->end() ? &it->second : nullptr;
+    }
+    if (!derived) {
+        derived = snapshot->materialized(goal.predicate, goal.arity);
+    }
+    
+    // Built-in aggregates, unless the knowledge base defines the name
+    if (!derived && isAggregate(goal.predicate, goal.arity) &&
+        !snapshot->facts(goal.predicate, goal.arity) &&
+        !snapshot->rules().index.rulesFor(PredicateKey{goal.predicate, goal.arity})) {
+        return callAggregate(goal);
+    }
+
+    // A tabled goal is answered from its table, except by the machine
+    // filling that table
+    if (!derived && snapshot->isTabled(goal.predicate, goal.arity) && !(filling && frame == 0)) {
+        return callTabled(goal);
+    }
+
+    // A variant of a goal still being derived would only recurse forever
+    uint64_t key = env.variantHash(goal);
+    if (ancestors.contains(key)) {
+        return false;
+    }
+    guard(true, key);
+
+    Cell* args = env.allocate(goal.arity);
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        args[i] = env.deref(goal.args[i]);
+    }
+
+    // Only rows from the most selective argument index are visited,
+    // and only the rules indexed for this predicate
+    const FactTable* table = derived ? derived : snapshot->facts(goal.predicate, goal.arity);
+    RowSet rows = table ? table->candidates(args) : RowSet::all(0);
+    Cell firstArg = goal.arity > 0 ? args[0] : Cell::nil();
+    RowSet rules = derived ? RowSet::all(0)
+                           : snapshot->rules().index.candidates(goal.predicate, goal.arity, firstArg);
+
+    pushChoicePoint(Goal{goal.predicate, goal.arity, args}, key, table, rows, rules);
+    return resume();
+}
+
+bool SolutionCursor::Machine::callTabled(const Goal& goal) {
+    if (!tables) {
+        tables = std::make_shared<TableSpace>();
+        ownTables = true;
+    }
+    std::string variant = variantKey(env, goal);
+    auto& slot = tables->tables[variant];
+    if (!slot) {
+        slot = std::make_unique<AnswerTable>(goal);
+    }
+    AnswerTable& table = *slot;
+
+    if (table.state == AnswerTable::State::EVALUATING) {
+        // A recursive variant call: read the answers found so far, which
+        // puts every table filled since this one in its component
+        for (size_t i = table.depth; i < tables->evaluating.size(); ++i) {
+            AnswerTable* t = tables->evaluating[i];
+            t->lowLink = std::min(t->lowLink, table.depth);
+        }
+    } else if (table.state == AnswerTable::State::INCOMPLETE) {
+        fill(table, goal);
+        if (interrupt->load(std::memory_order_relaxed)) {
+            return false;
+        }
+    }
+
+    // The answers are matched like fact rows. Reading a table derives
+    // nothing, so the goal is kept out of the recursion guard: the
+    // machine filling the table may hold the same variant there.
+    Cell* args = env.allocate(goal.arity);
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        args[i] = env.deref(goal.args[i]);
+    }
+    pushChoicePoint(Goal{goal.predicate, goal.arity, args}, 0, &table.answers,
+                    table.answers.candidates(args), RowSet::all(0));
+    choices.back().guarded = false;
+    return resume();
+}
+
+// Solve the aggregate's goal in a machine of its own, folding each
+// solution into an accumulator (one per group for group_by) as it is
+// found; only the results are kept
+bool SolutionCursor::Machine::callAggregate(const Goal& goal) {
+    // The goal's variables still unbound are local to it, or the key's
+    Fact called = env.resolve(goal, true);
+    std::optional<AggregateCall> aggregate = parseAggregate(called);
+    if (!aggregate) {
+        throw std::invalid_argument("Not an aggregate of a goal: " + called.toString());
+    }
+
+    if (!tables) {
+        tables = std::make_shared<TableSpace>();
+        ownTables = true;
+    }
+    Machine sub(kb, snapshot, aggregate->goals);
+    sub.ancestors = ancestors;
+    sub.relations = relations;
+    sub.tables = tables;
+    sub.setBudget(queryBudget);
+    sub.interrupt = interrupt;
+    AggregateOp op = aggregate->op;
+    Cell value = op == AggregateOp::COUNT ? Cell::nil()
+                                          : sub.env.encode(aggregate->value, sub.varSlots);
+    auto add = [&](Accumulator& accumulator) {
+        if (op == AggregateOp::COUNT) {
+            accumulator.add();
+            return;
+        }
+        Cell v = sub.env.deref(value);
+        if (v.isInt()) {
+            accumulator.add(v.intValue());
+        } else {
+            accumulator.add(sub.env.resolve(v));
+        }
+    };
+
+    std::unordered_map<Symbol, uint32_t> vars;
+    if (!aggregate->key) {
+        Accumulator accumulator(op);
+        while (sub.solve()) {
+            add(accumulator);
+        }
+        std::optional<Term> result = accumulator.result();
+        if (interrupt->load(std::memory_order_relaxed) || !result ||
+            !env.unify(goal.args[goal.arity - 1], env.encode(*result, vars))) {
+            return false;
+        }
+        ++index;
+        return true;
+    }
+
+    // Groups are told apart by the key's text, variables numbered
+    Cell key = sub.env.encode(*aggregate->key, sub.varSlots);
+    std::unordered_map<std::string, size_t> groupOf;
+    std::vector<std::pair<Term, Accumulator>> groups;
+    std::vector<uint32_t> seen;
+    std::string text;
+    while (sub.solve()) {
+        seen.clear();
+        text.clear();
+        appendVariant(sub.env, key, seen, text);
+        auto [it, added] = groupOf.emplace(text, groups.size());
+        if (added) {
+            groups.emplace_back(sub.env.resolve(key), Accumulator(op));
+        }
+        add(groups[it->second].second);
+    }
+    if (interrupt->load(std::memory_order_relaxed)) {
+        return false;
+    }
+    auto rows = std::make_shared<AggregateGroups>();
+    for (const auto& [keyValue, accumulator] : groups) {
+        if (auto result = accumulator.result()) {
+            rows->rows.emplace_back(keyValue, std::move(*result));
+        }
+    }
+    if (rows->rows.empty()) {
+        return false;
+    }
+
+    // The groups are matched like fact rows, out of the recursion guard
+    // as a table's answers are
+    Cell* args = env.allocate(goal.arity);
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        args[i] = env.deref(goal.args[i]);
+    }
+    pushChoicePoint(Goal{goal.predicate, goal.arity, args}, 0, nullptr,
+                    RowSet::all(0), RowSet::all(0));
+    choices.back().guarded = false;
+    choices.back().groups = std::move(rows);
+    return resume();
+}
+
+void SolutionCursor::Machine::fill(AnswerTable& table, const Goal& goal) {
+    TableSpace& space = *tables;
+    table.state = AnswerTable::State::EVALUATING;
+    table.depth = space.evaluating.size();
+    table.lowLink = table.depth;
+    space.evaluating.push_back(&table);
+    size_t pendingMark = space.pending.size();
+
+    Fact call = env.resolve(goal, true);
+    size_t before;
+    do {
+        before = space.answers;
+
+        // One round: every solution of the call's clauses, reading the
+        // answers other tables (and this one) have so far
+        Machine round(kb, snapshot, call);
+        round.tables = tables;
+        round.relations = relations;
+        round.filling = true;
+        round.setBudget(queryBudget);
+        round.interrupt = interrupt;
+        while (round.solve()) {
+            const Goal& answer = round.query[0];
+            auto [key, added] = table.variants.insert(variantKey(round.env, answer));
+            if (added) {
+                table.answers.add(round.env.resolve(answer));
+                ++space.answers;
+                space.bytes += key->size() + answer.arity * sizeof(Cell);
+            }
+        }
+    } while (space.answers != before && !interrupt->load(std::memory_order_relaxed));
+
+    space.evaluating.pop_back();
+    if (table.lowLink == table.depth) {
+        // A leader: a round added nothing to any table of its component
+        table.state = AnswerTable::State::COMPLETE;
+        for (size_t i = pendingMark; i < space.pending.size(); ++i) {
+            space.pending[i]->state = AnswerTable::State::COMPLETE;
+        }
+        space.pending.resize(pendingMark);
+    } else {
+        // Depends on a table still being filled; its leader's rounds
+        // will fill this one again
+        table.state = AnswerTable::State::INCOMPLETE;
+        space.pending.push_back(&table);
+        if (!space.evaluating.empty()) {
+            AnswerTable* parent = space.evaluating.back();
+            parent->lowLink = std::min(parent->lowLink, table.lowLink);
+        }
+    }
+}
+
+void SolutionCursor::Machine::pushChoicePoint(
+    const Goal& goal, uint64_t key, const FactTable* table, RowSet rows, RowSet rules) {
+    ChoicePoint cp;
+    cp.goal = goal;
+    cp.frame = frame;
+    cp.index = index + 1;
+    cp.key = key;
+    cp.table = table;
+    cp.rows = rows;
+    cp.rules = rules;
+    cp.mark = env.mark();
+    cp.frames = frames.size();
+    cp.guardLog = guardLog.size();
+    if (queryClause && frame == 0) {
+        cp.local = queryClause.get();
+    }
+    choices.push_back(cp);
+    if (parts > 1 && !split) {
+        partition(choices.back());
+    }
+}
+
+void SolutionCursor::Machine::partition(ChoicePoint& cp) {
+    if (cp.join) {
+        // Its solutions have to be counted to be shared out
+        std::vector<uint32_t> vars = cp.join->variables();
+        auto batch = std::make_shared<BindingBatch>(vars);
+        while (cp.join->next(joinValues)) {
+            batch->add(joinValues.data());
+        }
+        cp.join.reset();
+        cp.batch = std::move(batch);
+    }
+
+    size_t total;
+    if (cp.batch) {
+        total = cp.batch->size();
+    } else if (cp.product) {
+        total = cp.product->size;
+    } else if (cp.groups) {
+        total = cp.groups->rows.size();
+    } else {
+        total = (cp.table ? cp.rows.size() : 0) + cp.rules.size() + (cp.local ? 1 : 0);
+    }
+    if (total < 2) {
+        return;
+    }
+
+    // Contiguous ranges, so the parts' solutions in part order are the
+    // solutions in sequential order
+    split = true;
+    size_t first = total * part / parts;
+    size_t last = total * (part + 1) / parts;
+    cp.budget = last - first;
+    if (cp.batch || cp.product || cp.groups) {
+        cp.batchPos = first;
+        return;
+    }
+    size_t skip = first;
+    size_t rows = cp.table ? cp.rows.size() : 0;
+    if (rows > 0) {
+        cp.rows.advance(cp.rowPos, std::min(skip, rows));
+        skip -= std::min(skip, rows);
+    }
+    cp.rules.advance(cp.rulePos, skip);
+    skip -= std::min(skip, cp.rules.size());
+    if (skip > 0) {
+        cp.local = nullptr;
+    }
+}
+
+bool SolutionCursor::Machine::resume() {
+    ChoicePoint& cp = choices.back();
+    if (cp.join) {
+        return resumeJoin();
+    }
+    if (cp.batch) {
+        return resumeBatch();
+    }
+    if (cp.product) {
+        return resumeProduct();
+    }
+    if (cp.groups) {
+        return resumeGroups();
+    }
+    const Cell* args = cp.goal.args;
+    size_t r;
+
+    while (cp.budget > 0 && cp.table && cp.rows.next(cp.rowPos, r)) {
+        --cp.budget;
+        if (!step()) return false;
+        if (!cp.table->live(r)) continue;
+
+        // Bound atomic arguments are compared against the packed row as
+        // raw words before any unification is attempted
+        const Cell* row = cp.table->row(r);
+        bool matched = true;
+        for (uint32_t i = 0; i < cp.goal.arity && matched; ++i) {
+            matched = !(args[i].isAtomic() && row[i] != args[i] && !row[i].isRef());
+        }
+        if (!matched) continue;
+
+        uint32_t numVars = cp.table->numVars(r);
+        uint32_t base = numVars > 0 ? env.newVars(numVars) : 0;
+        for (uint32_t i = 0; i < cp.goal.arity && matched; ++i) {
+            // Ground rows are used in place; rows with variables get
+            // fresh slots for this use of the fact
+            matched = numVars > 0 ? env.unifyTemplate(row[i], base, args[i])
+                                  : env.unify(args[i], row[i]);
+        }
+        if (matched) {
+            // A fact finishes the goal: continue after it
+            frame = cp.frame;
+            index = cp.index;
+            if (cp.guarded) guard(false, cp.key);
+            if (isLast(cp)) choices.pop_back();
+            return true;
+        }
+        env.undo(cp.mark);
+    }
+
+    while (cp.budget > 0 && cp.rules.next(cp.rulePos, r)) {
+        --cp.budget;
+        if (!step()) return false;
+        if (auto resumed = tryClause(*snapshot->rules().clauses[r], static_cast<uint32_t>(r))) {
+            return *resumed;
+        }
+    }
+    if (const CompiledClause* clause = cp.budget > 0 ? cp.local : nullptr) {
+        cp.local = nullptr;
+        if (auto resumed = tryClause(*clause, QUERY_CLAUSE)) {
+            return *resumed;
+        }
+    }
+
+    choices.pop_back();
+    return false;
+}
+
+bool SolutionCursor::Machine::isLast(const ChoicePoint& cp) const {
+    return cp.budget == 0 ||
+           ((!cp.table || cp.rows.atEnd(cp.rowPos)) && cp.rules.atEnd(cp.rulePos) && !cp.local);
+}
+
+// Nullopt if the clause's head does not match the goal of the current
+// choice point; otherwise the result of resuming with the clause (as for
+// resume()), which may have taken the choice point off the stack
+std::optional<bool> SolutionCursor::Machine::tryClause(const CompiledClause& clause,
+                                                       uint32_t id) {
+    ChoicePoint& cp = choices.back();
+
+    // A frame of fresh slots stands in for renaming the clause's variables
+    uint32_t base = env.newVars(clause.numVars());
+    bool matched = true;
+    for (uint32_t i = 0; i < cp.goal.arity && matched; ++i) {
+        matched = env.unifyTemplate(clause.head().args[i], base, cp.goal.args[i]);
+    }
+    if (!matched) {
+        env.undo(cp.mark);
+        return std::nullopt;
+    }
+
+    if (kb.multiwayJoins_ && clause.cyclicBody()) {
+        if (auto join = multiwayJoin(clause, base)) {
+            // Its solutions are alternatives of their own, tried
+            // with the head unified
+            ChoicePoint solutions = cp;
+            solutions.join = std::move(join);
+            solutions.mark = env.mark();
+            solutions.budget = SIZE_MAX;
+            if (isLast(cp)) choices.pop_back();
+            choices.push_back(std::move(solutions));
+            if (parts > 1 && !split) {
+                partition(choices.back());
+            }
+            return choices.back().join ? resumeJoin() : resumeBatch();
+        }
+    }
+    if (kb.batchJoins_ && !clause.cyclicBody() && clause.body().size() > 1) {
+        if (auto batch = batchJoin(clause, base)) {
+            ChoicePoint solutions = cp;
+            solutions.batch = std::move(batch);
+            solutions.mark = env.mark();
+            solutions.budget = SIZE_MAX;
+            if (isLast(cp)) choices.pop_back();
+            choices.push_back(std::move(solutions));
+            if (parts > 1 && !split) {
+                partition(choices.back());
+            }
+            return resumeBatch();
+        }
+    }
+    // Not while tables are being filled: their rounds have to see every
+    // call the body makes
+    bool fillingTables = tables && !tables->evaluating.empty();
+    if (kb.independentGoals_ && clause.independentBody() && !fillingTables) {
+        if (auto product = crossProduct(clause, base)) {
+            ChoicePoint solutions = cp;
+            solutions.product = std::move(product);
+            solutions.mark = env.mark();
+            solutions.budget = SIZE_MAX;
+            if (isLast(cp)) choices.pop_back();
+            choices.push_back(std::move(solutions));
+            if (parts > 1 && !split) {
+                partition(choices.back());
+            }
+            return resumeProduct();
+        }
+    }
+
+    // Then solve the body, in planned order, continuing after the goal
+    // when it is done
+    const std::vector<Goal>* body = &clause.body();
+    if (id == QUERY_CLAUSE) {
+        body = &queryPlan;
+    } else if (kb.planJoins_ && body->size() > 1) {
+        body = &snapshot->plans().plan(id, clause, JoinPlanner::bindingPattern(cp.goal),
+                                       snapshot->rules().index, kb.planner_);
+    }
+    frames.push_back(Frame{body, base, cp.frame, cp.index, cp.key});
+    frame = static_cast<uint32_t>(frames.size() - 1);
+    index = 0;
+    if (isLast(cp)) choices.pop_back();
+    return true;
+}
+
+bool SolutionCursor::Machine::resumeJoin() {
+    ChoicePoint& cp = choices.back();
+    // The join counts its steps itself (see joinStep())
+    if (!cp.join->next(joinValues)) {
+        choices.pop_back();
+        return false;
+    }
+    const auto& vars = cp.join->variables();
+    for (size_t i = 0; i < vars.size(); ++i) {
+        env.unify(Cell::ref(vars[i]), joinValues[i]);
+    }
+    frame = cp.frame;
+    index = cp.index;
+    guard(false, cp.key);
+    return true;
+}
+
+bool SolutionCursor::Machine::resumeBatch() {
+    ChoicePoint& cp = choices.back();
+    const BindingBatch& batch = *cp.batch;
+    if (cp.batchPos == batch.size() || cp.budget == 0) {
+        choices.pop_back();
+        return false;
+    }
+    --cp.budget;
+    if (!step()) return false;
+    const Cell* row = batch.row(cp.batchPos++);
+    for (size_t i = 0; i < batch.width(); ++i) {
+        env.unify(Cell::ref(batch.variables()[i]), row[i]);
+    }
+    frame = cp.frame;
+    index = cp.index;
+    guard(false, cp.key);
+    if (cp.batchPos == batch.size() || cp.budget == 0) choices.pop_back();
+    return true;
+}
+
+bool SolutionCursor::Machine::resumeProduct() {
+    ChoicePoint& cp = choices.back();
+    const CrossProduct& product = *cp.product;
+    if (cp.batchPos == product.size || cp.budget == 0) {
+        choices.pop_back();
+        return false;
+    }
+    --cp.budget;
+    if (!step()) return false;
+
+    // The combination's row of each group, the last group varying fastest
+    size_t pos = cp.batchPos++;
+    for (size_t g = product.groups.size(); g-- > 0;) {
+        const FactTable& rows = *product.groups[g];
+        const Cell* row = rows.row(pos % rows.size());
+        pos /= rows.size();
+        for (size_t i = 0; i < product.vars[g].size(); ++i) {
+            env.unify(Cell::ref(product.vars[g][i]), row[i]);
+        }
+    }
+    frame = cp.frame;
+    index = cp.index;
+    guard(false, cp.key);
+    if (cp.batchPos == product.size || cp.budget == 0) choices.pop_back();
+    return true;
+}
+
+bool SolutionCursor::Machine::resumeGroups() {
+    ChoicePoint& cp = choices.back();
+    const auto& rows = cp.groups->rows;
+    std::unordered_map<Symbol, uint32_t> vars;
+    while (cp.batchPos < rows.size() && cp.budget > 0) {
+        --cp.budget;
+        if (!step()) return false;
+
+        // Copied to the heap, so the bindings outlive the choice point
+        const auto& [key, result] = rows[cp.batchPos++];
+        vars.clear();
+        if (env.unify(cp.goal.args[0], env.encode(key, vars)) &&
+            env.unify(cp.goal.args[2], env.encode(result, vars))) {
+            frame = cp.frame;
+            index = cp.index;
+            if (cp.guarded) guard(false, cp.key);
+            if (cp.batchPos == rows.size() || cp.budget == 0) choices.pop_back();
+            return true;
+        }
+        env.undo(cp.mark);
+    }
+    choices.pop_back();
+    return false;
+}
+
+std::shared_ptr<LeapfrogJoin> SolutionCursor::Machine::multiwayJoin(
+    const CompiledClause& clause, uint32_t base) {
+    std::vector<LeapfrogJoin::Atom> atoms;
+    if (!joinAtoms(clause, base, atoms)) {
+        return nullptr;
+    }
+    return LeapfrogJoin::create(atoms, joinStep());
+}
+
+std::shared_ptr<const BindingBatch> SolutionCursor::Machine::batchJoin(
+    const CompiledClause& clause, uint32_t base) {
+    std::vector<LeapfrogJoin::Atom> atoms;
+    if (!joinAtoms(clause, base, atoms)) {
+        return nullptr;
+    }
+
+    // Calls that only touch a few rows stream better a tuple at a time
+    size_t smallest = SIZE_MAX;
+    for (const auto& atom : atoms) {
+        size_t rows = atom.table ? atom.table->candidates(atom.args.data()).size() : 0;
+        smallest = std::min(smallest, rows);
+    }
+    if (smallest < KnowledgeBase::BATCH_JOIN_MIN_ROWS) {
+        return nullptr;
+    }
+
+    // Only the variables the caller can see through the head are needed
+    std::vector<uint32_t> output;
+    unboundVariables(clause.head(), base, output);
+    auto batch = joinBatches(atoms, output, joinStep());
+    if (!batch) {
+        return nullptr;
+    }
+    return std::make_shared<const BindingBatch>(std::move(*batch));
+}
+
+std::shared_ptr<const CrossProduct> SolutionCursor::Machine::crossProduct(
+    const CompiledClause& clause, uint32_t base) {
+    // Goals sharing an unbound variable fall in the same group
+    const auto& body = clause.body();
+    std::vector<size_t> parent(body.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto find = [&](size_t i) {
+        while (parent[i] != i) i = parent[i] = parent[parent[i]];
+        return i;
+    };
+    std::vector<std::vector<uint32_t>> goalVars(body.size());
+    std::unordered_map<uint32_t, size_t> firstUse;
+    for (size_t i = 0; i < body.size(); ++i) {
+        unboundVariables(body[i], base, goalVars[i]);
+        for (uint32_t slot : goalVars[i]) {
+            auto [it, inserted] = firstUse.emplace(slot, i);
+            if (!inserted) parent[find(i)] = find(it->second);
+        }
+    }
+    std::vector<std::vector<size_t>> groups;
+    std::unordered_map<size_t, size_t> groupOf;     // Root goal to group
+    for (size_t i = 0; i < body.size(); ++i) {
+        auto [it, inserted] = groupOf.emplace(find(i), groups.size());
+        if (inserted) groups.emplace_back();
+        groups[it->second].push_back(i);
+    }
+    if (groups.size() < 2) {
+        return nullptr;
+    }
+
+    // Only worth it when a later group calls rules: solved in place, it
+    // would be derived again for every solution of the earlier groups
+    bool derived = false;
+    for (size_t g = 1; g < groups.size() && !derived; ++g) {
+        for (size_t i : groups[g]) {
+            PredicateKey key{body[i].predicate, body[i].arity};
+            if ((relations && relations->count(key)) ||
+                snapshot->materialized(key.name, key.arity)) {
+                continue;
+            }
+            derived = derived || snapshot->isTabled(key.name, key.arity) ||
+                      snapshot->rules().index.rulesFor(key) || isAggregate(key.name, key.arity);
+        }
+    }
+    if (!derived) {
+        return nullptr;
+    }
+
+    // Each group is a query of its own, over its goals as called here;
+    // its columns are the variables of the group the caller can see
+    std::vector<uint32_t> visible;
+    unboundVariables(clause.head(), base, visible);
+    std::vector<std::vector<Fact>> queries(groups.size());
+    std::vector<std::vector<Symbol>> names(groups.size());
+    auto product = std::make_shared<CrossProduct>();
+    for (size_t g = 0; g < groups.size(); ++g) {
+        std::vector<uint32_t> vars;
+        for (size_t i : groups[g]) {
+            queries[g].push_back(env.resolve(env.instantiate(body[i], base), true));
+            for (uint32_t slot : goalVars[i]) {
+                bool seen = std::find(vars.begin(), vars.end(), slot) != vars.end();
+                if (!seen && std::find(visible.begin(), visible.end(), slot) != visible.end()) {
+                    vars.push_back(slot);
+                    names[g].push_back(env.resolve(Cell::ref(slot), true).value);
+                }
+            }
+        }
+        product->groups.push_back(std::make_unique<FactTable>(
+            Symbol("$group"), static_cast<uint32_t>(vars.size())));
+        product->vars.push_back(std::move(vars));
+    }
+
+    // Tables are shared when the groups are solved one after another
+    bool concurrent = kb.pool_ != nullptr;
+    if (!concurrent && !tables) {
+        tables = std::make_shared<TableSpace>();
+        ownTables = true;
+    }
+    // A group without solutions empties the product: the others stop
+    std::atomic<bool> empty{false};
+    auto solveGroup = [&](size_t g) {
+        if (empty.load(std::memory_order_relaxed)) {
+            return;
+        }
+        Machine sub(kb, snapshot, queries[g]);
+        sub.ancestors = ancestors;
+        sub.relations = relations;
+        sub.setBudget(queryBudget);
+        sub.interrupt = interrupt;
+        if (!concurrent) {
+            sub.tables = tables;
+        }
+        FactTable& rows = *product->groups[g];
+        std::vector<Term> values(names[g].size());
+        while (!rows.hasVariables() && !empty.load(std::memory_order_relaxed) && sub.solve()) {
+            for (size_t i = 0; i < values.size(); ++i) {
+                Cell value = sub.env.deref(Cell::ref(sub.varSlots.at(names[g][i])));
+                values[i] = sub.env.resolve(value);
+            }
+            rows.add(Fact(rows.predicate(), values));
+        }
+        if (rows.empty()) {
+            empty.store(true, std::memory_order_relaxed);
+        }
+    };
+    if (concurrent) {
+        std::vector<std::function<void()>> tasks;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            tasks.push_back([&solveGroup, g] { solveGroup(g); });
+        }
+        kb.pool_->run(std::move(tasks));
+    } else {
+        for (size_t g = 0; g < groups.size() && !empty; ++g) {
+            solveGroup(g);
+        }
+    }
+
+    // Rows left with variables could not be shared between groups
+    product->size = 1;
+    for (const auto& rows : product->groups) {
+        if (rows->hasVariables()) {
+            return nullptr;
+        }
+        product->size *= rows->size();
+    }
+    return product;
+}
+
+// Add the slots of the unbound variables a goal template of a clause
+// with its frame at base reaches to vars (cells of the template, whose
+// variables are numbered from 0, lead to cells on the heap once they
+// reach a variable's value)
+void SolutionCursor::Machine::unboundVariables(const Goal& goal, uint32_t base,
+                                               std::vector<uint32_t>& vars) const {
+    std::vector<std::pair<Cell, bool>> pending;     // Cell, is template
+    for (uint32_t i = 0; i < goal.arity; ++i) {
+        pending.emplace_back(goal.args[i], true);
+    }
+    while (!pending.empty()) {
+        auto [cell, isTemplate] = pending.back();
+        pending.pop_back();
+        if (isTemplate && cell.isRef()) {
+            cell = Cell::ref(base + cell.slot());
+            isTemplate = false;
+        }
+        if (!isTemplate) {
+            cell = env.deref(cell);
+        }
+        if (cell.isRef()) {
+            if (std::find(vars.begin(), vars.end(), cell.slot()) == vars.end()) {
+                vars.push_back(cell.slot());
+            }
+        } else if (cell.isStructure() || cell.isList()) {
+            for (uint32_t i = 0; i < cell.arity(); ++i) {
+                pending.emplace_back(cell.args()[i], isTemplate);
+            }
+        }
+    }
+}
+
+bool SolutionCursor::Machine::joinAtoms(const CompiledClause& clause, uint32_t base,
+                                        std::vector<LeapfrogJoin::Atom>& atoms) {
+    for (const Goal& goal : clause.body()) {
+        // Only goals answered by a relation alone: stored or derived facts
+        PredicateKey key{goal.predicate, goal.arity};
+        const FactTable* table = nullptr;
+        if (relations) {
+            auto it = relations->find(key);
+            table = it != relations->end() ? &it->second : nullptr;
+        }
+        if (!table) {
+            table = snapshot->materialized(goal.predicate, goal.arity);
+        }
+        if (!table) {
+            if (snapshot->isTabled(goal.predicate, goal.arity) || snapshot->rules().index.rulesFor(key) ||
+                isAggregate(goal.predicate, goal.arity)) {
+                return false;
+            }
+            table = snapshot->facts(goal.predicate, goal.arity);
+        }
+
+        LeapfrogJoin::Atom atom{table, {}};
+        for (uint32_t i = 0; i < goal.arity; ++i) {
+            Cell arg = goal.args[i];
+            atom.args.push_back(arg.isRef() ? env.deref(Cell::ref(base + arg.slot())) : arg);
+        }
+        atoms.push_back(std::move(atom));
+    }
+    return true;
+}
+
+bool SolutionCursor::Machine::backtrack() {
+    while (!choices.empty() && !interrupt->load(std::memory_order_relaxed)) {
+        const ChoicePoint& cp = choices.back();
+        env.undo(cp.mark);
+        undoGuard(cp.guardLog);
+        frames.resize(cp.frames);
+        if (resume()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SolutionCursor::Machine::guard(bool insert, uint64_t key) {
+    if (insert) {
+        ancestors.insert(key);
+    } else {
+        ancestors.erase(key);
+    }
+    guardLog.push_back(GuardOp{insert, key});
+}
+
+void SolutionCursor::Machine::undoGuard(size_t size) {
+    while (guardLog.size() > size) {
+        GuardOp op = guardLog.back();
+        guardLog.pop_back();
+        if (op.inserted) {
+            ancestors.erase(op.key);
+        } else {
+            ancestors.insert(op.key);
+        }
+    }
+}
+
+// ============================================================================
+// SolutionCursor
+// ============================================================================
+
+SolutionCursor::SolutionCursor(const KnowledgeBase& kb, const Fact& goal)
+    : SolutionCursor(kb, kb.snapshot(), {goal}) {
+}
+
+SolutionCursor::SolutionCursor(const KnowledgeBase& kb, const Fact& goal,
+                               std::shared_ptr<const Relations> relations)
+    : SolutionCursor(kb, kb.snapshot(), {goal}, std::move(relations)) {
+}
+
+SolutionCursor::SolutionCursor(const KnowledgeBase& kb, const std::vector<Fact>& goals)
+    : SolutionCursor(kb, kb.snapshot(), goals) {
+}
+
+SolutionCursor::SolutionCursor(const KnowledgeBase& kb,
+                               std::shared_ptr<const KnowledgeSnapshot> snapshot,
+                               const std::vector<Fact>& goals,
+                               std::shared_ptr<const Relations> relations)
+    : machine_(std::make_unique<Machine>(kb, std::move(snapshot), goals)) {
+    machine_->relations = std::move(relations);
+}
+
+SolutionCursor::SolutionCursor(const PreparedQuery& query,
+                               std::shared_ptr<const KnowledgeSnapshot> snapshot,
+                               const std::vector<Term>& values) {
+    query.checkValues(values);
+    machine_ = std::make_unique<Machine>(*query.kb_, std::move(snapshot), query, values);
+}
+
+SolutionCursor::~SolutionCursor() = default;
+SolutionCursor::SolutionCursor(SolutionCursor&&) noexcept = default;
+SolutionCursor& SolutionCursor::operator=(SolutionCursor&&) noexcept = default;
+
+std::optional<BindingSet> SolutionCursor::next() {
+    Machine& m = *machine_;
+    while (!m.finished()) {
+        if (!m.solve()) {
+            m.exhausted = true;
+            break;
+        }
+        if (!m.split && m.part > 0) {
+            continue;   // Reached by every part; part 0 returns it
+        }
+
+        // Convert the solution to a BindingSet while its bindings are live
+        BindingSet solution;
+        for (const auto& var : m.queryVars) {
+            uint32_t slot = m.varSlots.at(var);
+            Cell value = m.env.deref(Cell::ref(slot, var));
+
+            // Only add if we found a non-variable value, or another variable
+            if (!value.isRef() || value.slot() != slot) {
+                solution.add(var, m.env.resolve(value));
+            }
+        }
+        if (!solution.bindings.empty() || m.queryVars.empty()) {
+            ++m.count;
+            return solution;
+        }
+    }
+    return std::nullopt;
+}
+
+void SolutionCursor::setPartition(size_t part, size_t parts) {
+    if (parts == 0 || part >= parts) {
+        throw std::invalid_argument("Invalid partition " + std::to_string(part) +
+                                    " of " + std::to_string(parts));
+    }
+    if (machine_->started) {
+        throw std::runtime_error("Cursor already started");
+    }
+    machine_->part = part;
+    machine_->parts = parts;
+}
+
+void SolutionCursor::setLimit(size_t n) {
+    machine_->limit = n;
+}
+
+void SolutionCursor::setBudget(std::shared_ptr<QueryBudget> budget) {
+    if (machine_->started) {
+        throw std::runtime_error("Cursor already started");
+    }
+    machine_->setBudget(std::move(budget));
+}
+
+void SolutionCursor::cancel() {
+    if (machine_->queryBudget) {
+        machine_->queryBudget->cancel();
+    } else {
+        machine_->cancelled.store(true, std::memory_order_relaxed);
+    }
+}
+
+bool SolutionCursor::done() const {
+    return machine_->finished();
+}
+
+size_t SolutionCursor::count() const {
+    return machine_->count;
+}
+
+} // namespace kbgdb
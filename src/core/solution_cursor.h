@@ -0,0 +1,111 @@
+#pragma once
+#include "common/fact.h"
+#include "core/fact_table.h"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace kbgdb {
+
+class KnowledgeBase;
+class KnowledgeSnapshot;
+class PreparedQuery;
+class QueryBudget;
+
+/**
+ * SolutionCursor produces the solutions of a query one at a time.
+ *
+ * Evaluation is a backtracking machine with an explicit choice-point
+ * stack: next() runs it until the next solution and stops there, so
+ * nothing is computed ahead of the caller and memory is bounded by the
+ * current derivation, not by the number of solutions. Solutions come
+ * out in the same order query() returns them.
+ *
+ * A cursor reads the snapshot of the KnowledgeBase pinned when it was
+ * opened (see KnowledgeBase::snapshot()): facts and rules added later
+ * are not seen. The KnowledgeBase must outlive it.
+ */
+class SolutionCursor {
+public:
+    using Relations = std::unordered_map<PredicateKey, FactTable>;
+    
+    SolutionCursor(const KnowledgeBase& kb, const Fact& goal);
+    
+    /**
+     * Answer goals on the predicates in relations from those tables
+     * alone (as for materialized predicates).
+     */
+    SolutionCursor(const KnowledgeBase& kb, const Fact& goal,
+                   std::shared_ptr<const Relations> relations);
+    
+    /**
+     * Solve a conjunction of goals, optimized like a rule body: the goals
+     * are reordered by the join planner, and may be joined as a whole
+     * (see LeapfrogJoin, joinBatches()).
+     */
+    SolutionCursor(const KnowledgeBase& kb, const std::vector<Fact>& goals);
+    
+    /**
+     * Solve goals on a snapshot pinned earlier, so that several cursors
+     * read the same state. relations is as above, for a single goal.
+     */
+    SolutionCursor(const KnowledgeBase& kb, std::shared_ptr<const KnowledgeSnapshot> snapshot,
+                   const std::vector<Fact>& goals,
+                   std::shared_ptr<const Relations> relations = nullptr);
+    
+    /**
+     * Solve a prepared query, on a snapshot pinned earlier, with its
+     * parameters bound to values (see PreparedQuery).
+     */
+    SolutionCursor(const PreparedQuery& query, std::shared_ptr<const KnowledgeSnapshot> snapshot,
+                   const std::vector<Term>& values);
+    ~SolutionCursor();
+
+    SolutionCursor(SolutionCursor&&) noexcept;
+    SolutionCursor& operator=(SolutionCursor&&) noexcept;
+
+    /**
+     * The next solution's bindings for the query variables, or nullopt
+     * once the query is exhausted, the limit is reached or it was cancelled.
+     */
+    std::optional<BindingSet> next();
+
+    /**
+     * Produce only part (0-based) of parts disjoint shares of the
+     * solutions, to run the parts in parallel. The first choice point
+     * with several alternatives (fact rows, rules, or join results) is
+     * split into parts contiguous ranges, and each part explores one;
+     * appending the parts' solutions in order gives this query's
+     * solutions in order. Must be set before the first next().
+     */
+    void setPartition(size_t part, size_t parts);
+    
+    /** Return at most n solutions in total (0 means no limit). */
+    void setLimit(size_t n);
+    
+    /**
+     * Stop the search once budget's limits are exceeded (see QueryBudget):
+     * next() then returns nullopt, and budget->reason() tells why. Cursors
+     * may share a budget, to limit them as a whole. Must be set before
+     * the first next().
+     */
+    void setBudget(std::shared_ptr<QueryBudget> budget);
+
+    /**
+     * Stop the search (and, if it has a budget, every cursor sharing it).
+     * Safe to call from another thread while next() is running; that call
+     * returns nullopt.
+     */
+    void cancel();
+
+    bool done() const;
+    size_t count() const;   // Solutions returned so far
+
+private:
+    struct Machine;
+    std::unique_ptr<Machine> machine_;
+};
+
+} // namespace kbgdb
@@ -0,0 +1,101 @@
+#include "core/trie_index.h"
+#include <algorithm>
+#include <numeric>
+
+namespace kbgdb {
+
+std::unique_ptr<TrieIndex> TrieIndex::build(const Cell* rows, size_t count, uint32_t arity,
+                                            const std::vector<uint32_t>& order) {
+    for (size_t i = 0; i < count * arity; ++i) {
+        if (!rows[i].isAtomic()) {
+            return nullptr;
+        }
+    }
+
+    std::vector<uint32_t> sorted(count);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    auto less = [&](uint32_t a, uint32_t b) {
+        for (uint32_t column : order) {
+            uint64_t x = rows[a * arity + column].bits();
+            uint64_t y = rows[b * arity + column].bits();
+            if (x != y) return x < y;
+        }
+        return false;
+    };
+    std::sort(sorted.begin(), sorted.end(), less);
+
+    std::unique_ptr<TrieIndex> trie(new TrieIndex());
+    trie->depth_ = static_cast<uint32_t>(order.size());
+    trie->cells_.reserve(count * order.size());
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        if (i > 0 && !less(sorted[i - 1], sorted[i])) {
+            ++trie->counts_.back();     // Same as the previous row
+            continue;
+        }
+        for (uint32_t column : order) {
+            trie->cells_.push_back(rows[sorted[i] * arity + column]);
+        }
+        trie->counts_.push_back(1);
+    }
+    return trie;
+}
+
+void TrieIndex::Iterator::open() {
+    if (levels_.empty()) {
+        levels_.push_back(Level{0, trie_->size()});
+        return;
+    }
+    // The children of a node are the rows sharing its key, which start
+    // at the node's own row
+    const Level& parent = levels_.back();
+    size_t end = gallop(parent.pos, parent.end, key().bits(), true);
+    levels_.push_back(Level{parent.pos, end});
+}
+
+void TrieIndex::Iterator::up() {
+    levels_.pop_back();
+}
+
+void TrieIndex::Iterator::next() {
+    Level& current = levels_.back();
+    current.pos = gallop(current.pos, current.end, key().bits(), true);
+}
+
+void TrieIndex::Iterator::seek(Cell key) {
+    Level& current = levels_.back();
+    current.pos = gallop(current.pos, current.end, key.bits(), false);
+}
+
+size_t TrieIndex::Iterator::gallop(size_t from, size_t to, uint64_t key, bool strict) const {
+    uint32_t lvl = level();
+    auto before = [&](size_t row) {
+        uint64_t bits = trie_->cell(row, lvl).bits();
+        return strict ? bits <= key : bits < key;
+    };
+
+    // Double the step until past the target, then binary search the
+    // last step
+    size_t lo = from;
+    size_t step = 1;
+    while (lo < to && before(lo)) {
+        size_t probe = lo + step;
+        if (probe >= to || !before(probe)) {
+            to = std::min(probe, to);
+            ++lo;
+            break;
+        }
+        lo = probe + 1;
+        step *= 2;
+    }
+    while (lo < to) {
+        size_t mid = lo + (to - lo) / 2;
+        if (before(mid)) {
+            lo = mid + 1;
+        } else {
+            to = mid;
+        }
+    }
+    return lo;
+}
+
+} // namespace kbgdb
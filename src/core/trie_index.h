@@ -0,0 +1,83 @@
+#pragma once
+#include "common/cell.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * TrieIndex holds a relation's rows sorted lexicographically, with the
+ * columns permuted into a chosen order, so that it can be walked as a
+ * trie: level i holds the distinct values of column order[i] below a
+ * given prefix. Duplicate rows are stored once, with their count.
+ *
+ * Only relations of atomic values can be indexed, since cells are
+ * ordered and compared by their raw bits (an arbitrary but consistent
+ * total order in which equal atomic terms are equal).
+ */
+class TrieIndex {
+public:
+    /**
+     * Index count rows of arity cells each, columns in the given order.
+     * Returns null if some cell is not atomic.
+     */
+    static std::unique_ptr<TrieIndex> build(const Cell* rows, size_t count, uint32_t arity,
+                                            const std::vector<uint32_t>& order);
+
+    uint32_t depth() const { return depth_; }
+    size_t size() const { return depth_ ? cells_.size() / depth_ : 0; }
+    Cell cell(size_t row, uint32_t level) const { return cells_[row * depth_ + level]; }
+    /** How many times row occurs in the relation. */
+    uint32_t count(size_t row) const { return counts_[row]; }
+
+    /**
+     * Iterator is a position in the trie: a node at some level, among the
+     * siblings below one prefix. Seeks gallop forward, so a sequence of
+     * increasing seeks costs about the log of the distance covered.
+     */
+    class Iterator {
+    public:
+        explicit Iterator(const TrieIndex& trie) : trie_(&trie) {}
+
+        /** Move to the first child of the current node (the first root initially). */
+        void open();
+        /** Back to the parent node. */
+        void up();
+
+        bool atEnd() const { return levels_.back().pos == levels_.back().end; }
+        Cell key() const { return trie_->cell(levels_.back().pos, level()); }
+        /** At the last level: how many times the current row occurs. */
+        uint32_t count() const { return trie_->count(levels_.back().pos); }
+
+        /** Next sibling. */
+        void next();
+        /** First sibling, from here on, whose key is at least key. */
+        void seek(Cell key);
+
+    private:
+        struct Level {
+            size_t pos;
+            size_t end;     // Siblings are the rows [pos, end) at this level
+        };
+
+        uint32_t level() const { return static_cast<uint32_t>(levels_.size() - 1); }
+
+        // First row in [from, to) whose key at level is not below key,
+        // or above it if strict
+        size_t gallop(size_t from, size_t to, uint64_t key, bool strict) const;
+
+        const TrieIndex* trie_;
+        std::vector<Level> levels_;
+    };
+
+private:
+    TrieIndex() = default;
+
+    uint32_t depth_ = 0;
+    std::vector<Cell> cells_;
+    std::vector<uint32_t> counts_;  // Per row
+};
+
+} // namespace kbgdb
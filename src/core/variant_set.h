@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * VariantSet is a set of 64-bit goal variant hashes (see
+ * BindingEnv::variantHash), used as the recursion guard.
+ *
+ * Open addressing with linear probing in one flat array; erase shifts
+ * the following entries back instead of leaving tombstones, so a set
+ * that sees many insert/erase pairs (one per goal call) never degrades.
+ */
+class VariantSet {
+public:
+    explicit VariantSet(size_t capacity = 64) {
+        size_t n = 16;
+        while (n < capacity * 2) n <<= 1;
+        slots_.assign(n, EMPTY);
+    }
+
+    bool contains(uint64_t hash) const {
+        if (hash == EMPTY) return hasEmpty_;
+        for (size_t i = home(hash); ; i = next(i)) {
+            if (slots_[i] == hash) return true;
+            if (slots_[i] == EMPTY) return false;
+        }
+    }
+
+    /** Returns false if hash was already present. */
+    bool insert(uint64_t hash) {
+        if (hash == EMPTY) {
+            if (hasEmpty_) return false;
+            hasEmpty_ = true;
+            ++size_;
+            return true;
+        }
+        if ((size_ + 1) * 2 > slots_.size()) {
+            grow();
+        }
+        size_t i = home(hash);
+        for (; slots_[i] != EMPTY; i = next(i)) {
+            if (slots_[i] == hash) return false;
+        }
+        slots_[i] = hash;
+        ++size_;
+        return true;
+    }
+
+    /** Returns false if hash was not present. */
+    bool erase(uint64_t hash) {
+        if (hash == EMPTY) {
+            if (!hasEmpty_) return false;
+            hasEmpty_ = false;
+            --size_;
+            return true;
+        }
+        size_t i = home(hash);
+        for (; slots_[i] != hash; i = next(i)) {
+            if (slots_[i] == EMPTY) return false;
+        }
+
+        // Move later entries of the probe run back into the hole when
+        // their home position does not lie between the hole and them
+        size_t hole = i;
+        for (size_t j = next(i); slots_[j] != EMPTY; j = next(j)) {
+            size_t h = home(slots_[j]);
+            bool reachable = hole <= j ? (hole < h && h <= j) : (hole < h || h <= j);
+            if (!reachable) {
+                slots_[hole] = slots_[j];
+                hole = j;
+            }
+        }
+        slots_[hole] = EMPTY;
+        --size_;
+        return true;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    static constexpr uint64_t EMPTY = 0;
+
+    size_t home(uint64_t hash) const { return static_cast<size_t>(hash) & (slots_.size() - 1); }
+    size_t next(size_t i) const { return (i + 1) & (slots_.size() - 1); }
+
+    void grow() {
+        std::vector<uint64_t> old;
+        old.swap(slots_);
+        slots_.assign(old.size() * 2, EMPTY);
+        size_ = hasEmpty_ ? 1 : 0;
+        for (uint64_t hash : old) {
+            if (hash != EMPTY) insert(hash);
+        }
+    }
+
+    std::vector<uint64_t> slots_;
+    size_t size_ = 0;
+    bool hasEmpty_ = false;     // The one hash that cannot be stored in a slot
+};
+
+} // namespace kbgdb
@@ -0,0 +1,126 @@
+#include "core/work_pool.h"
+
+namespace kbgdb {
+
+WorkPool::WorkPool(size_t threads) {
+    for (size_t i = 0; i < threads; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back([this, i] { work(i); });
+    }
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void WorkPool::run(std::vector<std::function<void()>> tasks) {
+    if (tasks.empty()) {
+        return;
+    }
+    Batch batch;
+    batch.remaining = tasks.size();
+
+    if (queues_.empty()) {
+        for (auto& task : tasks) {
+            Job job{std::move(task), &batch};
+            execute(job);
+        }
+    } else {
+        // Counted before they are queued, so a worker never sees a job
+        // it has not been told about
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            pending_ += tasks.size();
+        }
+        for (auto& task : tasks) {
+            Queue& queue = *queues_[nextQueue_++ % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(Job{std::move(task), &batch});
+        }
+        wake_.notify_all();
+
+        // Help until the queues run dry, then wait for the workers
+        Job job;
+        while (take(queues_.size(), job)) {
+            execute(job);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.done.wait(lock, [&] { return batch.remaining == 0; });
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+void WorkPool::work(size_t self) {
+    Job job;
+    while (true) {
+        if (take(self, job)) {
+            execute(job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        wake_.wait(lock, [&] { return stopping_ || pending_ > 0; });
+        if (stopping_ && pending_ == 0) {
+            return;
+        }
+    }
+}
+
+bool WorkPool::take(size_t self, Job& job) {
+    // The worker's own queue from the back, then the others' from the front
+    if (self < queues_.size()) {
+        Queue& own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+    for (size_t i = 1; i <= queues_.size(); ++i) {
+        Queue& victim = *queues_[(self + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkPool::execute(Job& job) {
+    std::exception_ptr error;
+    try {
+        job.task();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    job.task = nullptr;
+
+    // The batch lives on the stack of run(), which may return as soon as
+    // the count reaches zero: finish with it under its lock
+    Batch& batch = *job.batch;
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    if (error && !batch.error) {
+        batch.error = error;
+    }
+    if (--batch.remaining == 0) {
+        batch.done.notify_all();
+    }
+}
+
+} // namespace kbgdb
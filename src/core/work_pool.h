@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * WorkPool runs batches of independent tasks on a fixed set of threads.
+ *
+ * Each worker has its own queue: it takes tasks from the back of it and,
+ * once it is empty, steals from the front of the others, so a worker
+ * left with long tasks has the rest of its queue picked up by idle ones.
+ * The thread calling run() works on the tasks too until they are done.
+ */
+class WorkPool {
+public:
+    explicit WorkPool(size_t threads);
+    ~WorkPool();
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    /** Worker threads, not counting the callers of run(). */
+    size_t size() const { return threads_.size(); }
+
+    /**
+     * Run every task and return once all are done. If tasks throw, the
+     * first exception is rethrown after the others have finished. Safe
+     * to call from several threads at once.
+     */
+    void run(std::vector<std::function<void()>> tasks);
+
+private:
+    struct Batch {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining;
+        std::exception_ptr error;
+    };
+
+    struct Job {
+        std::function<void()> task;
+        Batch* batch = nullptr;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void work(size_t self);
+    bool take(size_t self, Job& job);
+    void execute(Job& job);
+
+    std::vector<std::unique_ptr<Queue>> queues_;    // One per worker
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> nextQueue_{0};
+
+    // Workers sleep while no job is queued anywhere
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> pending_{0};
+    bool stopping_ = false;
+};
+
+} // namespace kbgdb
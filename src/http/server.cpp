@@ -5,16 +5,42 @@
 #include <folly/json.h>
 #include <folly/executors/GlobalExecutor.h>
 #include <fmt/format.h>
+#include <algorithm>
 #include <iostream>
 
 namespace kbgdb {
 
+namespace {
+
+// The tighter of two limits, where 0 is none
+template <typename T>
+T tighter(T limit, T requested) {
+    if (limit == T(0)) return requested;
+    if (requested == T(0)) return limit;
+    return std::min(limit, requested);
+}
+
+const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "Error";
+    }
+}
+
+} // namespace
+
 class Server::ConnectionHandler : public folly::AsyncTransportWrapper::ReadCallback,
                                 public folly::AsyncTransportWrapper::WriteCallback {
 public:
     ConnectionHandler(folly::AsyncTransportWrapper::UniquePtr sock,
-                      std::shared_ptr<KnowledgeBase> kb)
-        : socket_(dynamic_cast<folly::AsyncSocket*>(sock.release())), kb_(kb) {
+                      std::shared_ptr<QueryEngine> engine, const QueryLimits& limits)
+        : socket_(dynamic_cast<folly::AsyncSocket*>(sock.release()))
+        , engine_(std::move(engine))
+        , limits_(limits) {
         if (!socket_) {
             throw std::invalid_argument("Socket is not of type AsyncSocket");
         }
@@ -72,7 +98,8 @@ public:
 
 private:
     folly::AsyncSocket* socket_; 
-    std::shared_ptr<KnowledgeBase> kb_;
+    std::shared_ptr<QueryEngine> engine_;
+    QueryLimits limits_;
     folly::IOBufQueue readBuffer_{folly::IOBufQueue::cacheChainLength()};
 
     void handleQuery(const std::string& body) {
@@ -84,20 +111,58 @@ private:
             }
 
             std::string queryStr = json["query"].getString();
-            kb_->query(queryStr)
-                .via(folly::getGlobalCPUExecutor())
-                .thenValue([this](std::vector<BindingSet> results) {
+
+            for (const char* field : {"timeout_ms", "max_steps", "max_results", "max_memory"}) {
+                if (json.getDefault(field, 0).asInt() < 0) {
+                    sendErrorResponse(400, fmt::format("'{}' must not be negative", field));
+                    return;
+                }
+            }
+
+            // The request may only tighten the server's limits
+            QueryLimits limits = limits_;
+            limits.timeout = tighter(limits.timeout, std::chrono::milliseconds(
+                json.getDefault("timeout_ms", 0).asInt()));
+            limits.maxSteps = tighter<uint64_t>(limits.maxSteps,
+                                                json.getDefault("max_steps", 0).asInt());
+            limits.maxResults = tighter<size_t>(limits.maxResults,
+                                                json.getDefault("max_results", 0).asInt());
+            limits.maxMemory = tighter<size_t>(limits.maxMemory,
+                                               json.getDefault("max_memory", 0).asInt());
+            limits.partialResults = json.getDefault("partial", limits.partialResults).asBool();
+
+            folly::via(folly::getGlobalCPUExecutor(),
+                       [engine = engine_, queryStr, limits] {
+                           return engine->execute(queryStr, limits);
+                       })
+                .via(folly::getKeepAliveToken(socket_->getEventBase()))
+                .thenValue([this](QueryResult result) {
+                    if (!result.success) {
+                        int status = 400;
+                        if (result.stopped == QueryStop::DEADLINE) {
+                            status = 504;
+                        } else if (result.stopped != QueryStop::NONE) {
+                            status = 503;
+                        }
+                        sendErrorResponse(status, result.error, result.stopped);
+                        return;
+                    }
+
                     // Convert results to JSON
                     folly::dynamic resultJson = folly::dynamic::array;
-                    for (const auto& binding : results) {
+                    for (const auto& binding : result.bindings) {
                         folly::dynamic bindingJson = folly::dynamic::object;
                         for (const auto& [var, value] : binding.bindings) {
-                            bindingJson[var] = value;
+                            bindingJson[var.str()] = value.toString();
                         }
                         resultJson.push_back(std::move(bindingJson));
                     }
 
-                    sendJsonResponse(200, folly::toJson(resultJson));
+                    std::string headers;
+                    if (result.stopped != QueryStop::NONE) {
+                        headers = fmt::format("X-Query-Stopped: {}\r\n", toString(result.stopped));
+                    }
+                    sendJsonResponse(200, folly::toJson(resultJson), headers);
                 })
                 .thenError<std::exception>([this](const std::exception& e) {
                     sendErrorResponse(500, e.what());
@@ -108,28 +173,35 @@ private:
         }
     }
 
-    void sendJsonResponse(int status, const std::string& json) {
+    void sendJsonResponse(int status, const std::string& json, const std::string& headers = "") {
         std::string response = fmt::format(
-            "HTTP/1.1 {} OK\r\n"
+            "HTTP/1.1 {} {}\r\n"
             "Content-Type: application/json\r\n"
             "Content-Length: {}\r\n"
+            "{}"
             "\r\n"
-            "{}", status, json.length(), json);
+            "{}", status, statusText(status), json.length(), headers, json);
 
         auto buf = folly::IOBuf::copyBuffer(response);
         socket_->writeChain(this, std::move(buf));
     }
 
-    void sendErrorResponse(int status, const std::string& error) {
+    void sendErrorResponse(int status, const std::string& error,
+                           QueryStop stopped = QueryStop::NONE) {
         folly::dynamic errorJson = folly::dynamic::object;
         errorJson["error"] = error;
+        if (stopped != QueryStop::NONE) {
+            errorJson["stopped"] = toString(stopped);
+        }
         sendJsonResponse(status, folly::toJson(errorJson));
     }
 };
 
-Server::Server(uint16_t port, std::shared_ptr<KnowledgeBase> kb)
+Server::Server(uint16_t port, std::shared_ptr<KnowledgeBase> kb, QueryLimits limits)
     : port_(port)
-    , kb_(std::move(kb)) {
+    , kb_(std::move(kb))
+    , engine_(std::make_shared<QueryEngine>(kb_))
+    , limits_(limits) {
 }
 
 void Server::start() {
@@ -158,7 +230,7 @@ void Server::connectionAccepted(folly::NetworkSocket sock,
     auto socket = folly::AsyncSocket::UniquePtr(
         new folly::AsyncSocket(&evb_, sock));
         
-    auto handler = new ConnectionHandler(std::move(socket), kb_);
+    auto handler = new ConnectionHandler(std::move(socket), engine_, limits_);
     (void)handler; // Suppress unused variable warning
 }
 
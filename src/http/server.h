@@ -1,5 +1,6 @@
 #pragma once
 #include "core/knowledge_base.h"
+#include "query/query_engine.h"
 #include <folly/io/async/EventBase.h>
 #include <folly/io/async/AsyncServerSocket.h>
 #include <folly/io/async/AsyncSocket.h>
@@ -8,9 +9,18 @@
 
 namespace kbgdb {
 
+/**
+ * Server answers POST /api/query with a JSON body such as
+ * {"query": "path(?X, ?Y)", "timeout_ms": 500}. The optional fields
+ * timeout_ms, max_steps, max_results and max_memory limit the query
+ * (see QueryLimits), though never beyond the server's own limits.
+ * A query stopped by a limit returns the solutions found so far, with
+ * the header X-Query-Stopped naming the limit. With "partial": false, it
+ * fails instead, with status 504 for the deadline and 503 for the others.
+ */
 class Server : public folly::AsyncServerSocket::AcceptCallback {
 public:
-    Server(uint16_t port, std::shared_ptr<KnowledgeBase> kb);
+    Server(uint16_t port, std::shared_ptr<KnowledgeBase> kb, QueryLimits limits = {});
     
     void start();
     void stop();
@@ -18,6 +28,8 @@ public:
 private:
     uint16_t port_;
     std::shared_ptr<KnowledgeBase> kb_;
+    std::shared_ptr<QueryEngine> engine_;
+    QueryLimits limits_;    // For every query
     folly::EventBase evb_;
     std::shared_ptr<folly::AsyncServerSocket> serverSocket_;
     
@@ -0,0 +1,110 @@
+#include "query/query_cache.h"
+#include "core/aggregate.h"
+#include <functional>
+#include <unordered_set>
+
+namespace kbgdb {
+
+QueryCache::QueryCache(size_t capacity)
+    : capacity_(capacity) {
+}
+
+std::optional<std::vector<BindingSet>> QueryCache::find(const std::string& key,
+                                                        const KnowledgeSnapshot& snapshot) {
+    std::shared_ptr<const std::vector<BindingSet>> results;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = byKey_.find(key);
+        if (it != byKey_.end()) {
+            const Entry& entry = *it->second;
+            bool valid = entry.epoch <= snapshot.epoch();
+            for (size_t i = 0; i < entry.dependencies.size() && valid; ++i) {
+                const PredicateKey& p = entry.dependencies[i];
+                valid = snapshot.changedAt(p.name, p.arity) <= entry.epoch;
+            }
+            if (valid) {
+                entries_.splice(entries_.begin(), entries_, it->second);
+                results = entry.results;
+            } else if (snapshot.epoch() > entry.epoch) {
+                // Out of date for good, rather than just newer than snapshot
+                entries_.erase(it->second);
+                byKey_.erase(it);
+            }
+        }
+    }
+    if (!results) {
+        ++misses_;
+        return std::nullopt;
+    }
+    ++hits_;
+    return *results;    // Copied outside the lock
+}
+
+void QueryCache::insert(const std::string& key, const std::vector<Fact>& goals,
+                        const KnowledgeSnapshot& snapshot, std::vector<BindingSet> results) {
+    if (capacity_ == 0) {
+        return;
+    }
+    Entry entry{key, snapshot.epoch(), dependencies(goals, snapshot.rules()),
+                std::make_shared<const std::vector<BindingSet>>(std::move(results))};
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = byKey_.find(key);
+    if (it != byKey_.end()) {
+        if (it->second->epoch > entry.epoch) {
+            return;     // Already cached from a later snapshot
+        }
+        entries_.erase(it->second);
+        byKey_.erase(it);
+    }
+    entries_.push_front(std::move(entry));
+    byKey_[key] = entries_.begin();
+    if (entries_.size() > capacity_) {
+        byKey_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+}
+
+std::vector<PredicateKey> QueryCache::dependencies(const std::vector<Fact>& goals,
+                                                   const RuleSet& rules) {
+    std::unordered_set<PredicateKey> seen;
+    std::vector<PredicateKey> result;
+    std::function<void(const Fact&)> add = [&](const Fact& goal) {
+        PredicateKey key{goal.predicate(), static_cast<uint32_t>(goal.arity())};
+        if (seen.insert(key).second) {
+            result.push_back(key);
+        }
+        // An aggregate reads the predicates of the goal it aggregates
+        if (auto aggregate = parseAggregate(goal)) {
+            for (const auto& inner : aggregate->goals) {
+                add(inner);
+            }
+        }
+    };
+    for (const auto& goal : goals) {
+        add(goal);
+    }
+    // Every predicate found so far may call rules: add their bodies'
+    for (size_t i = 0; i < result.size(); ++i) {
+        const RowList* ids = rules.index.rulesFor(result[i]);
+        for (size_t j = 0; ids && j < ids->size(); ++j) {
+            for (const auto& goal : rules.rules[(*ids)[j]].body()) {
+                add(goal);
+            }
+        }
+    }
+    return result;
+}
+
+void QueryCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    byKey_.clear();
+}
+
+size_t QueryCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+} // namespace kbgdb
@@ -0,0 +1,69 @@
+#pragma once
+#include "core/knowledge_snapshot.h"
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace kbgdb {
+
+/**
+ * QueryCache keeps the results of recent queries, up to a number of
+ * entries, evicting the least recently used one first.
+ *
+ * An entry records the predicates its query depends on: those of its
+ * goals (and of the goals of aggregates among them) and, transitively,
+ * those of the bodies of their rules. It stays valid while none of them
+ * has changed since the snapshot it was evaluated on (see
+ * KnowledgeSnapshot::changedAt()), so adding facts or rules only
+ * invalidates the entries that read them.
+ *
+ * Safe to use from several threads at once.
+ */
+class QueryCache {
+public:
+    explicit QueryCache(size_t capacity);
+
+    /** The results cached under key, if they are still those in snapshot. */
+    std::optional<std::vector<BindingSet>> find(const std::string& key,
+                                                const KnowledgeSnapshot& snapshot);
+
+    /**
+     * Cache the results of goals, as evaluated on snapshot (or a later
+     * one), under key.
+     */
+    void insert(const std::string& key, const std::vector<Fact>& goals,
+                const KnowledgeSnapshot& snapshot, std::vector<BindingSet> results);
+
+    /** The predicates that goals' solutions depend on, under rules. */
+    static std::vector<PredicateKey> dependencies(const std::vector<Fact>& goals,
+                                                  const RuleSet& rules);
+
+    void clear();
+    size_t size() const;
+    size_t capacity() const { return capacity_; }
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t epoch;
+        std::vector<PredicateKey> dependencies;
+        std::shared_ptr<const std::vector<BindingSet>> results;
+    };
+
+    size_t capacity_;
+    std::list<Entry> entries_;      // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> byKey_;
+    mutable std::mutex mutex_;
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+};
+
+} // namespace kbgdb
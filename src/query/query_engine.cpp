@@ -1,17 +1,76 @@
 #include "query/query_engine.h"
+#include "query/query_parser.h"
 #include <sstream>
+#include <unordered_map>
 
 namespace kbgdb {
 
+namespace {
+
+// term with its variables renamed V0, V1, ... in order of first
+// occurrence; names maps the ones met so far to theirs
+Term normalized(const Term& term, std::unordered_map<Symbol, Symbol>& names) {
+    if (term.isVariable()) {
+        auto [it, added] = names.try_emplace(term.value);
+        if (added) {
+            it->second = Symbol("V" + std::to_string(names.size() - 1));
+        }
+        return Term::variable(it->second);
+    }
+    Term result = term;
+    for (auto& arg : result.args) {
+        arg = normalized(arg, names);
+    }
+    return result;
+}
+
+// term with the variables names maps renamed; the others (fresh
+// ones of the evaluation) are kept
+Term renamed(const Term& term, const std::unordered_map<Symbol, Symbol>& names) {
+    if (term.isVariable()) {
+        auto it = names.find(term.value);
+        return it != names.end() ? Term::variable(it->second) : term;
+    }
+    Term result = term;
+    for (auto& arg : result.args) {
+        arg = renamed(arg, names);
+    }
+    return result;
+}
+
+// bindings with their variables, and those left in their values,
+// renamed
+std::vector<BindingSet> renamed(const std::vector<BindingSet>& bindings,
+                                const std::unordered_map<Symbol, Symbol>& names) {
+    std::vector<BindingSet> result(bindings.size());
+    for (size_t i = 0; i < bindings.size(); ++i) {
+        for (const auto& [var, value] : bindings[i].bindings) {
+            auto it = names.find(var);
+            result[i].add(it != names.end() ? it->second : var, renamed(value, names));
+        }
+    }
+    return result;
+}
+
+} // namespace
+
 std::string QueryResult::toJSON() const {
     std::ostringstream oss;
     
     if (!success) {
-        oss << R"({"success": false, "error": ")" << error << R"("})";
+        oss << R"({"success": false, "error": ")" << error << R"(")";
+        if (stopped != QueryStop::NONE) {
+            oss << R"(, "stopped": ")" << toString(stopped) << R"(")";
+        }
+        oss << "}";
         return oss.str();
     }
     
-    oss << R"({"success": true, "bindings": [)";
+    oss << R"({"success": true, )";
+    if (stopped != QueryStop::NONE) {
+        oss << R"("complete": false, "stopped": ")" << toString(stopped) << R"(", )";
+    }
+    oss << R"("bindings": [)";
     
     for (size_t i = 0; i < bindings.size(); ++i) {
         if (i > 0) oss << ", ";
@@ -31,16 +90,90 @@ std::string QueryResult::toJSON() const {
     return oss.str();
 }
 
-QueryEngine::QueryEngine(std::shared_ptr<KnowledgeBase> kb)
-    : kb_(std::move(kb)) {
+QueryEngine::QueryEngine(std::shared_ptr<KnowledgeBase> kb, size_t cacheEntries)
+    : kb_(std::move(kb))
+    , cache_(cacheEntries) {
 }
 
-QueryResult QueryEngine::execute(const std::string& queryStr) {
+QueryResult QueryEngine::execute(const std::string& queryStr, size_t limit) {
+    QueryLimits limits;
+    limits.maxResults = limit;
+    return execute(queryStr, limits);
+}
+
+QueryResult QueryEngine::execute(const std::string& queryStr, const QueryLimits& limits) {
+    return execute(queryStr, std::make_shared<QueryBudget>(limits));
+}
+
+QueryResult QueryEngine::execute(const std::string& queryStr,
+                                 std::shared_ptr<QueryBudget> budget) {
     QueryResult result;
+    const QueryLimits& limits = budget->limits();
     
     try {
-        result.bindings = kb_->query(queryStr);
+        QueryParser parser;
+        parser.setRuleMode(false);  // Query mode: ?X variables
+        std::vector<Fact> goals = parser.parseConjunction(queryStr);
+        
+        // The same query however it is spaced and its variables named;
+        // cached bindings are by the normalized names
+        std::string key = std::to_string(static_cast<int>(kb_->evaluationMode())) + ":" +
+                          std::to_string(limits.maxResults) + ":";
+        std::unordered_map<Symbol, Symbol> normalizedNames;
+        for (const auto& goal : goals) {
+            std::vector<Term> terms;
+            terms.reserve(goal.terms().size());
+            for (const auto& term : goal.terms()) {
+                terms.push_back(normalized(term, normalizedNames));
+            }
+            key += Fact(goal.predicate(), std::move(terms)).toString() + ";";
+        }
+        
+        // Pinned before evaluating: changes made meanwhile leave the
+        // entry out of date, never stale
+        auto pinned = kb_->snapshot();
+        if (cache_.capacity() > 0) {
+            if (auto cached = cache_.find(key, *pinned)) {
+                std::unordered_map<Symbol, Symbol> callerNames;
+                for (const auto& [name, normal] : normalizedNames) {
+                    callerNames.emplace(normal, name);
+                }
+                result.bindings = renamed(*cached, callerNames);
+                result.success = true;
+                if (limits.maxResults > 0 && result.bindings.size() == limits.maxResults) {
+                    result.stopped = QueryStop::RESULTS;
+                }
+                return result;
+            }
+        }
+        
+        // Parallel evaluation shares the query out over the pool; it
+        // does not stream, so it is only used when there is a pool
+        if (kb_->parallelism() > 1) {
+            result.bindings = kb_->query(goals, budget);
+        } else {
+            auto solutions = kb_->openQuery(goals, budget);
+            solutions.setLimit(limits.maxResults);
+            while (auto binding = solutions.next()) {
+                result.bindings.push_back(std::move(*binding));
+            }
+        }
+        result.stopped = budget->reason();
+        if (result.stopped == QueryStop::NONE && limits.maxResults > 0 &&
+            result.bindings.size() == limits.maxResults) {
+            result.stopped = QueryStop::RESULTS;
+        }
+        
+        bool partial = result.stopped != QueryStop::NONE && result.stopped != QueryStop::RESULTS;
+        if (partial && !limits.partialResults) {
+            result.bindings.clear();
+            result.error = budget->message();
+            return result;
+        }
         result.success = true;
+        if (cache_.capacity() > 0 && !partial) {
+            cache_.insert(key, goals, *pinned, renamed(result.bindings, normalizedNames));
+        }
     } catch (const std::exception& e) {
         result.success = false;
         result.error = e.what();
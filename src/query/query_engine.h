@@ -1,5 +1,6 @@
 #pragma once
 #include "core/knowledge_base.h"
+#include "query/query_cache.h"
 #include <memory>
 #include <string>
 
@@ -7,31 +8,62 @@ namespace kbgdb {
 
 /**
  * QueryResult encapsulates the result of a query execution.
+ *
+ * A query stopped by one of its limits (see QueryLimits) has the
+ * solutions found until then, and stopped tells which limit; or, if it
+ * was not to return partial results, fails with the limit's message.
  */
 struct QueryResult {
     bool success = false;
     std::vector<BindingSet> bindings;
     std::string error;
+    QueryStop stopped = QueryStop::NONE;
+    
+    /** Whether bindings are every solution (none past a result limit). */
+    bool complete() const { return success && stopped == QueryStop::NONE; }
     
     std::string toJSON() const;
 };
 
 /**
  * QueryEngine provides a simple interface for executing queries.
- * This is a synchronous implementation.
+ * This is a synchronous implementation. Queries are evaluated in
+ * parallel when the knowledge base's parallelism() is above 1.
+ *
+ * Results are cached (see QueryCache) under the parsed query, with its
+ * variables renamed in order of first occurrence, its limit and the
+ * evaluation mode, so repeating a query whose predicates have not
+ * changed costs a lookup. Clear the cache after changing other settings
+ * of the knowledge base.
  */
 class QueryEngine {
 public:
-    explicit QueryEngine(std::shared_ptr<KnowledgeBase> kb);
+    /** cacheEntries results are kept; 0 disables the cache. */
+    explicit QueryEngine(std::shared_ptr<KnowledgeBase> kb, size_t cacheEntries = 1024);
     
     /**
      * Execute a query and return results.
      * Query format: "predicate(?Var1, constant, ?Var2)"
+     * A non-zero limit stops evaluation after that many solutions.
+     */
+    QueryResult execute(const std::string& queryStr, size_t limit = 0);
+    
+    /** Execute a query within limits: its deadline runs from now. */
+    QueryResult execute(const std::string& queryStr, const QueryLimits& limits);
+    
+    /**
+     * Execute a query within budget's limits. Another thread may cancel
+     * the budget to stop the query; it then returns as if a limit was
+     * exceeded. Results cut short by any limit but maxResults are not
+     * cached.
      */
-    QueryResult execute(const std::string& queryStr);
+    QueryResult execute(const std::string& queryStr, std::shared_ptr<QueryBudget> budget);
+    
+    QueryCache& cache() { return cache_; }
     
 private:
     std::shared_ptr<KnowledgeBase> kb_;
+    QueryCache cache_;
 };
 
 } // namespace kbgdb
@@ -9,10 +9,32 @@ Fact QueryParser::parse(const std::string& input) {
     tokens_ = tokenize(input);
     current_ = 0;
 
+    if (tokens_.empty()) {
+        throw std::runtime_error("Empty query");
+    }
+    return parseGoal();
+}
+
+std::vector<Fact> QueryParser::parseConjunction(const std::string& input) {
+    tokens_ = tokenize(input);
+    current_ = 0;
+
     if (tokens_.empty()) {
         throw std::runtime_error("Empty query");
     }
 
+    std::vector<Fact> goals;
+    goals.push_back(parseGoal());
+    while (match(Token::COMMA)) {
+        goals.push_back(parseGoal());
+    }
+    if (!isAtEnd()) {
+        throw std::runtime_error("Expected ',' between goals");
+    }
+    return goals;
+}
+
+Fact QueryParser::parseGoal() {
     // Parse predicate
     if (!match(Token::IDENTIFIER)) {
         throw std::runtime_error("Expected predicate name");
@@ -106,6 +128,10 @@ void QueryParser::addToken(std::vector<Token>& tokens, const std::string& value)
         // Query mode: variables start with '?'
         token.type = Token::VARIABLE;
         token.value = value.substr(1);  // Strip '?'
+    } else if (!ruleMode_ && value.size() > 1 && value[0] == '$') {
+        // Query mode: parameters of prepared queries keep their '$'
+        token.type = Token::VARIABLE;
+        token.value = value;
     } else if (ruleMode_ && !value.empty() && 
                (std::isupper(value[0]) || value[0] == '_')) {
         // Rule mode: variables are uppercase or start with underscore
@@ -16,6 +16,8 @@ namespace kbgdb {
  * Variable conventions:
  * - Query mode (default): Variables start with '?' (e.g., ?X, ?Name)
  * - Rule mode: Variables are uppercase or start with '_' (e.g., X, _X, _)
+ * - Query mode parameters ($who) parse as variables named with their '$',
+ *   bound to values when a prepared query runs (see PreparedQuery)
  */
 class QueryParser {
 public:
@@ -24,6 +26,12 @@ public:
      */
     Fact parse(const std::string& input);
     
+    /**
+     * Parse a conjunctive query: one or more goals separated by commas,
+     * e.g. "parent(?X, ?Y), age(?Y, ?A)".
+     */
+    std::vector<Fact> parseConjunction(const std::string& input);
+    
     /**
      * Parse a single term (for testing or standalone use)
      */
@@ -61,6 +69,7 @@ private:
     std::vector<Token> tokenize(const std::string& input);
     void addToken(std::vector<Token>& tokens, const std::string& value);
     
+    Fact parseGoal();
     Term parseTermInternal();
     Term parseList();
     Term parseCompoundOrAtom();
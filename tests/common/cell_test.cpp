@@ -0,0 +1,101 @@
+#include "common/cell.h"
+#include <gtest/gtest.h>
+
+namespace kbgdb {
+namespace {
+
+Term roundTrip(const Term& term) {
+    CellArena arena;
+    std::vector<Symbol> vars;
+    return decodeCell(encodeTerm(term, arena, vars));
+}
+
+TEST(CellTest, AtomsAreSingleWords) {
+    Cell a = Cell::atom("john");
+    EXPECT_TRUE(a.isAtom());
+    EXPECT_TRUE(a.isAtomic());
+    EXPECT_EQ(a.symbol(), "john");
+    EXPECT_EQ(a, Cell::atom("john"));
+    EXPECT_NE(a, Cell::atom("mary"));
+}
+
+TEST(CellTest, SmallIntegers) {
+    EXPECT_EQ(Cell::integer(42).intValue(), 42);
+    EXPECT_EQ(Cell::integer(-7).intValue(), -7);
+    EXPECT_EQ(Cell::integer(Cell::MAX_INT).intValue(), Cell::MAX_INT);
+    EXPECT_EQ(Cell::integer(Cell::MIN_INT).intValue(), Cell::MIN_INT);
+    EXPECT_TRUE(Cell::integer(0).isInt());
+}
+
+TEST(CellTest, RefKeepsSlotAndName) {
+    Cell r = Cell::ref(17, "Person");
+    EXPECT_TRUE(r.isRef());
+    EXPECT_EQ(r.slot(), 17u);
+    EXPECT_EQ(r.varName(), "Person");
+}
+
+TEST(CellTest, NumbersEncodeAsIntWhenCanonical) {
+    Cell cell;
+    ASSERT_TRUE(encodeAtomic(Term::number("42"), cell));
+    EXPECT_TRUE(cell.isInt());
+    ASSERT_TRUE(encodeAtomic(Term::number("3.14"), cell));
+    EXPECT_TRUE(cell.isNum());
+    ASSERT_TRUE(encodeAtomic(Term::number("007"), cell));
+    EXPECT_TRUE(cell.isNum());
+    EXPECT_FALSE(encodeAtomic(Term::variable("X"), cell));
+}
+
+TEST(CellTest, RoundTripAtomic) {
+    EXPECT_EQ(roundTrip(Term::constant("john")), Term::constant("john"));
+    EXPECT_EQ(roundTrip(Term::number("-12")), Term::number("-12"));
+    EXPECT_EQ(roundTrip(Term::number("3.14")), Term::number("3.14"));
+    EXPECT_EQ(roundTrip(Term::number("007")), Term::number("007"));
+    EXPECT_EQ(roundTrip(Term::emptyList()), Term::emptyList());
+}
+
+TEST(CellTest, RoundTripCompound) {
+    Term t = Term::compound("point", {Term::number("1"), Term::variable("Y")});
+    EXPECT_EQ(roundTrip(t), t);
+    EXPECT_EQ(roundTrip(t).toString(), "point(1, ?Y)");
+}
+
+TEST(CellTest, RoundTripLists) {
+    Term proper = Term::list({Term::constant("a"), Term::constant("b")});
+    EXPECT_EQ(roundTrip(proper).toString(), "[a, b]");
+    
+    Term partial = Term::cons(Term::constant("a"), Term::variable("T"));
+    EXPECT_EQ(roundTrip(partial).toString(), "[a | ?T]");
+}
+
+TEST(CellTest, VariablesNumberedByFirstOccurrence) {
+    CellArena arena;
+    std::vector<Symbol> vars;
+    Cell c = encodeTerm(
+        Term::compound("f", {Term::variable("X"), Term::variable("Y"), Term::variable("X")}),
+        arena, vars);
+    
+    ASSERT_EQ(vars.size(), 2u);
+    EXPECT_EQ(c.args()[0].slot(), 0u);
+    EXPECT_EQ(c.args()[1].slot(), 1u);
+    EXPECT_EQ(c.args()[2].slot(), 0u);
+}
+
+TEST(CellArenaTest, MarkAndRelease) {
+    CellArena arena(16);
+    arena.allocate(4);
+    auto mark = arena.mark();
+    size_t used = arena.bytesUsed();
+    
+    arena.allocate(10);
+    arena.allocate(40);  // Larger than a chunk
+    EXPECT_GT(arena.bytesUsed(), used);
+    
+    arena.release(mark);
+    EXPECT_EQ(arena.bytesUsed(), used);
+    
+    arena.clear();
+    EXPECT_EQ(arena.bytesUsed(), 0u);
+}
+
+} // namespace
+} // namespace kbgdb
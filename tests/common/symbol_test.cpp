@@ -0,0 +1,71 @@
+#include "common/symbol.h"
+#include "common/fact.h"
+#include <gtest/gtest.h>
+#include <unordered_set>
+
+namespace kbgdb {
+namespace {
+
+TEST(SymbolTest, InternReturnsSameId) {
+    Symbol a("john");
+    Symbol b(std::string("john"));
+    Symbol c("mary");
+    
+    EXPECT_EQ(a.id(), b.id());
+    EXPECT_EQ(a, b);
+    EXPECT_NE(a, c);
+}
+
+TEST(SymbolTest, ResolvesBackToString) {
+    Symbol s("grandparent");
+    EXPECT_EQ(s.str(), "grandparent");
+    EXPECT_EQ(Symbol::fromId(s.id()).str(), "grandparent");
+}
+
+TEST(SymbolTest, DefaultIsEmpty) {
+    Symbol s;
+    EXPECT_TRUE(s.empty());
+    EXPECT_EQ(s.id(), 0u);
+    EXPECT_EQ(s, Symbol(""));
+    EXPECT_FALSE(Symbol("x").empty());
+}
+
+TEST(SymbolTest, CompareWithStrings) {
+    Symbol s("parent");
+    EXPECT_TRUE(s == "parent");
+    EXPECT_TRUE(s == std::string("parent"));
+    EXPECT_TRUE(s != "child");
+}
+
+TEST(SymbolTest, LookupDoesNotIntern) {
+    size_t before = SymbolTable::global().size();
+    uint32_t id = 0;
+    EXPECT_FALSE(SymbolTable::global().lookup("never_interned_symbol_xyz", id));
+    EXPECT_EQ(SymbolTable::global().size(), before);
+    
+    Symbol s("interned_symbol_xyz");
+    ASSERT_TRUE(SymbolTable::global().lookup("interned_symbol_xyz", id));
+    EXPECT_EQ(id, s.id());
+}
+
+TEST(SymbolTest, Hashable) {
+    std::unordered_set<Symbol> set;
+    set.insert("a");
+    set.insert("b");
+    set.insert("a");
+    EXPECT_EQ(set.size(), 2u);
+}
+
+TEST(SymbolTest, TermsShareInternedNames) {
+    Term a = Term::constant("john");
+    Term b{TermType::CONSTANT, "john"};
+    EXPECT_EQ(a.value.id(), b.value.id());
+    EXPECT_EQ(a, b);
+    
+    Fact fact("parent", {a, Term::number("42")});
+    EXPECT_EQ(fact.predicate().id(), Symbol("parent").id());
+    EXPECT_EQ(fact.toString(), "parent(john, 42)");
+}
+
+} // namespace
+} // namespace kbgdb
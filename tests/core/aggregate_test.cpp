@@ -0,0 +1,172 @@
+#include "core/aggregate.h"
+#include "core/knowledge_base.h"
+#include "core/query_budget.h"
+#include "query/query_parser.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+namespace {
+
+class AggregateTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (const char* fact : {"parent(john, mary)", "parent(john, tom)", "parent(mary, ann)",
+                                 "parent(tom, bob)", "parent(tom, sue)", "parent(tom, joe)",
+                                 "age(mary, 40)", "age(tom, 38)", "age(ann, 12)", "age(bob, 9)",
+                                 "age(sue, 4)", "age(joe, 1)", "person(john)", "person(mary)",
+                                 "person(tom)", "person(ann)"}) {
+            kb.addFact(parse(fact));
+        }
+    }
+
+    static Fact parse(const std::string& text) {
+        QueryParser parser;
+        parser.setRuleMode(true);
+        return parser.parse(text);
+    }
+
+    static Fact goal(const std::string& text) {
+        QueryParser parser;
+        return parser.parse(text);
+    }
+
+    // Each solution as "X=a Y=b", sorted, to compare regardless of order
+    std::vector<std::string> solve(const std::string& query) {
+        std::vector<std::string> result;
+        for (const auto& solution : kb.query(query)) {
+            std::vector<std::string> bindings;
+            for (const auto& [var, value] : solution.bindings) {
+                bindings.push_back(var.str() + "=" + value.toString());
+            }
+            std::sort(bindings.begin(), bindings.end());
+            std::string line;
+            for (const auto& binding : bindings) {
+                line += (line.empty() ? "" : " ") + binding;
+            }
+            result.push_back(line);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    using Lines = std::vector<std::string>;
+
+    KnowledgeBase kb;
+};
+
+TEST_F(AggregateTest, CountSumMinMax) {
+    EXPECT_EQ(solve("count(parent(tom, ?X), ?N)"), Lines{"N=3"});
+    EXPECT_EQ(solve("sum(?A, [parent(tom, ?X), age(?X, ?A)], ?S)"), Lines{"S=14"});
+    EXPECT_EQ(solve("min(?A, [parent(tom, ?X), age(?X, ?A)], ?M)"), Lines{"M=1"});
+    EXPECT_EQ(solve("max(?A, age(?X, ?A), ?M)"), Lines{"M=40"});
+
+    // Nothing to count or sum is zero; nothing to compare fails
+    EXPECT_EQ(solve("count(parent(sue, ?X), ?N)"), Lines{"N=0"});
+    EXPECT_EQ(solve("sum(?A, [parent(sue, ?X), age(?X, ?A)], ?S)"), Lines{"S=0"});
+    EXPECT_TRUE(solve("max(?A, [parent(sue, ?X), age(?X, ?A)], ?M)").empty());
+
+    // A bound result is checked
+    EXPECT_EQ(kb.query("count(parent(john, ?X), 2), person(?P)").size(), 4u);
+    EXPECT_TRUE(kb.query("count(parent(john, ?X), 3), person(?P)").empty());
+}
+
+TEST_F(AggregateTest, GroupBy) {
+    EXPECT_EQ(solve("group_by(?P, count(parent(?P, ?C)), ?N)"),
+              (Lines{"N=1 P=mary", "N=2 P=john", "N=3 P=tom"}));
+    EXPECT_EQ(solve("group_by(?P, max(?A, [parent(?P, ?C), age(?C, ?A)]), ?M)"),
+              (Lines{"M=12 P=mary", "M=40 P=john", "M=9 P=tom"}));
+    EXPECT_EQ(solve("group_by(?P, count(parent(?P, ?C)), 3)"), Lines{"P=tom"});
+    EXPECT_EQ(solve("group_by(p(?P), sum(?A, [parent(?P, ?C), age(?C, ?A)]), ?S)"),
+              (Lines{"P=john S=78", "P=mary S=12", "P=tom S=14"}));
+
+    // Parallel parts share out the groups
+    kb.setParallelism(3);
+    EXPECT_EQ(solve("group_by(?P, count(parent(?P, ?C)), ?N)"),
+              (Lines{"N=1 P=mary", "N=2 P=john", "N=3 P=tom"}));
+}
+
+TEST_F(AggregateTest, InRuleBodies) {
+    // The count depends on P, so it is not planned before person(P)
+    kb.addRule(parse("children(P, N)"),
+               {parse("person(P)"), parse("count(parent(P, C), N)")});
+    EXPECT_EQ(solve("children(?P, ?N)"),
+              (Lines{"N=0 P=ann", "N=1 P=mary", "N=2 P=john", "N=3 P=tom"}));
+    EXPECT_EQ(solve("count(children(?P, 0), ?N)"), Lines{"N=1"});
+
+    // Left to top-down evaluation when rules are materialized
+    kb.setEvaluationMode(EvaluationMode::BOTTOM_UP);
+    EXPECT_EQ(solve("children(?P, ?N)").size(), 4u);
+    kb.setEvaluationMode(EvaluationMode::MAGIC_SETS);
+    EXPECT_EQ(solve("children(tom, ?N)"), Lines{"N=3"});
+}
+
+TEST_F(AggregateTest, NumbersAndOtherTerms) {
+    kb.addFact(parse("price(a, 1.5)"));
+    kb.addFact(parse("price(b, 2)"));
+    kb.addFact(parse("price(c, 0.25)"));
+    EXPECT_EQ(solve("sum(?V, price(?X, ?V), ?S)"), Lines{"S=3.75"});
+    EXPECT_EQ(solve("min(?V, price(?X, ?V), ?M)"), Lines{"M=0.25"});
+    EXPECT_EQ(solve("max(?X, price(?X, ?V), ?M)"), Lines{"M=c"});
+    EXPECT_THROW(kb.query("sum(?X, price(?X, ?V), ?S)"), std::invalid_argument);
+}
+
+TEST_F(AggregateTest, DefinedPredicatesTakePrecedence) {
+    kb.addFact(parse("count(apples, 7)"));
+    EXPECT_EQ(solve("count(apples, ?N)"), Lines{"N=7"});
+    EXPECT_TRUE(solve("count(parent(tom, ?X), ?N)").empty());
+}
+
+TEST_F(AggregateTest, CountingStaysWithinTheBudget) {
+    for (int i = 0; i < 5000; ++i) {
+        kb.addFact("edge", {Term::constant("n" + std::to_string(i)),
+                            Term::constant("n" + std::to_string(i + 1))});
+    }
+    auto unlimited = std::make_shared<QueryBudget>();
+    auto counted = kb.query({goal("count(edge(?X, ?Y), ?N)")}, unlimited);
+    ASSERT_EQ(counted.size(), 1u);
+    EXPECT_EQ(counted[0].bindings.size(), 1u);
+    EXPECT_EQ(unlimited->reason(), QueryStop::NONE);
+
+    QueryLimits limits;
+    limits.maxSteps = 1000;
+    auto limited = std::make_shared<QueryBudget>(limits);
+    EXPECT_TRUE(kb.query({goal("count(edge(?X, ?Y), ?N)")}, limited).empty());
+    EXPECT_EQ(limited->reason(), QueryStop::STEPS);
+}
+
+TEST(AggregateCall, TakesGoalsApart) {
+    QueryParser parser;
+    auto call = parseAggregate(parser.parse("group_by(?P, sum(?A, [parent(?P, ?C), age(?C, ?A)]), ?S)"));
+    ASSERT_TRUE(call.has_value());
+    EXPECT_EQ(call->op, AggregateOp::SUM);
+    ASSERT_EQ(call->goals.size(), 2u);
+    EXPECT_EQ(call->goals[1].predicate().str(), "age");
+    EXPECT_TRUE(call->key.has_value());
+
+    EXPECT_FALSE(parseAggregate(parser.parse("count(?G, ?N)")).has_value());
+    EXPECT_FALSE(parseAggregate(parser.parse("group_by(?K, avg(?V, p(?V)), ?R)")).has_value());
+    EXPECT_FALSE(isAggregate(Symbol("count"), 3));
+}
+
+TEST(Accumulator, SumsExactlyUntilAReal) {
+    Accumulator sum(AggregateOp::SUM);
+    sum.add(INT64_MAX - 1);
+    sum.add(1);
+    EXPECT_EQ(sum.result()->toString(), std::to_string(INT64_MAX));
+    sum.add(Term::number("0.5"));
+    EXPECT_EQ(sum.count(), 3u);
+    EXPECT_DOUBLE_EQ(std::stod(sum.result()->toString()), 9.2233720368547758e18);
+
+    Accumulator max(AggregateOp::MAX);
+    EXPECT_FALSE(max.result().has_value());
+    max.add(Term::constant("b"));
+    max.add(12);
+    EXPECT_EQ(max.result()->toString(), "b");   // Other terms after numbers
+}
+
+} // namespace
+} // namespace kbgdb
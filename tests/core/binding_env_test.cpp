@@ -0,0 +1,141 @@
+#include "core/binding_env.h"
+#include <gtest/gtest.h>
+
+namespace kbgdb {
+namespace {
+
+class BindingEnvTest : public ::testing::Test {
+protected:
+    Cell encode(const Term& term) {
+        return env.encode(term, vars);
+    }
+    
+    Cell var(const std::string& name) {
+        return encode(Term::variable(name));
+    }
+    
+    BindingEnv env;
+    std::unordered_map<Symbol, uint32_t> vars;
+};
+
+TEST_F(BindingEnvTest, BindAndDeref) {
+    Cell x = var("X");
+    EXPECT_TRUE(env.unify(x, Cell::atom("john")));
+    EXPECT_EQ(env.deref(x), Cell::atom("john"));
+    EXPECT_EQ(env.resolve(x).toString(), "john");
+}
+
+TEST_F(BindingEnvTest, UndoRestoresBindings) {
+    Cell x = var("X");
+    auto mark = env.mark();
+    
+    ASSERT_TRUE(env.unify(x, Cell::atom("john")));
+    EXPECT_TRUE(env.isBound(x.slot()));
+    
+    env.undo(mark);
+    EXPECT_FALSE(env.isBound(x.slot()));
+    EXPECT_TRUE(env.unify(x, Cell::atom("mary")));
+    EXPECT_EQ(env.resolve(x).toString(), "mary");
+}
+
+TEST_F(BindingEnvTest, UndoDropsNewVariables) {
+    var("X");
+    auto mark = env.mark();
+    env.newVars(5);
+    EXPECT_EQ(env.numVars(), 6u);
+    env.undo(mark);
+    EXPECT_EQ(env.numVars(), 1u);
+}
+
+TEST_F(BindingEnvTest, VarVarChains) {
+    Cell x = var("X");
+    Cell y = var("Y");
+    Cell z = var("Z");
+    ASSERT_TRUE(env.unify(x, y));
+    ASSERT_TRUE(env.unify(y, z));
+    ASSERT_TRUE(env.unify(z, Cell::integer(3)));
+    EXPECT_EQ(env.deref(x), Cell::integer(3));
+}
+
+TEST_F(BindingEnvTest, AtomMismatchFails) {
+    EXPECT_FALSE(env.unify(Cell::atom("a"), Cell::atom("b")));
+    EXPECT_FALSE(env.unify(Cell::atom("a"), Cell::integer(1)));
+    EXPECT_TRUE(env.unify(Cell::nil(), Cell::nil()));
+}
+
+TEST_F(BindingEnvTest, UnifyCompounds) {
+    Cell a = encode(Term::compound("point", {Term::variable("X"), Term::number("2")}));
+    Cell b = encode(Term::compound("point", {Term::number("1"), Term::variable("Y")}));
+    
+    ASSERT_TRUE(env.unify(a, b));
+    EXPECT_EQ(env.resolve(a).toString(), "point(1, 2)");
+    EXPECT_EQ(env.resolve(b).toString(), "point(1, 2)");
+    
+    Cell c = encode(Term::compound("vec", {Term::number("1"), Term::number("2")}));
+    EXPECT_FALSE(env.unify(a, c));
+}
+
+TEST_F(BindingEnvTest, UnifyLists) {
+    Cell list = encode(Term::list({Term::constant("a"), Term::constant("b"), Term::constant("c")}));
+    Cell pattern = encode(Term::cons(Term::variable("H"), Term::variable("T")));
+    
+    ASSERT_TRUE(env.unify(list, pattern));
+    EXPECT_EQ(env.resolve(var("H")).toString(), "a");
+    EXPECT_EQ(env.resolve(var("T")).toString(), "[b, c]");
+    
+    EXPECT_FALSE(env.unify(Cell::nil(), pattern));
+}
+
+TEST_F(BindingEnvTest, OccursCheck) {
+    Cell x = var("X");
+    Cell fx = encode(Term::compound("f", {Term::variable("X")}));
+    EXPECT_FALSE(env.unify(x, fx));
+}
+
+TEST_F(BindingEnvTest, InstantiateRenamesVariables) {
+    CellArena arena;
+    std::vector<Symbol> names;
+    Cell tmpl = encodeTerm(
+        Term::compound("f", {Term::variable("A"), Term::variable("A")}), arena, names);
+    
+    uint32_t base = env.newVars(static_cast<uint32_t>(names.size()));
+    Cell first = env.instantiate(tmpl, base);
+    base = env.newVars(static_cast<uint32_t>(names.size()));
+    Cell second = env.instantiate(tmpl, base);
+    
+    ASSERT_TRUE(env.unify(first, encode(Term::compound("f", {Term::constant("a"), Term::variable("Q")}))));
+    EXPECT_EQ(env.resolve(first).toString(), "f(a, a)");
+    EXPECT_EQ(env.resolve(second).toString(), "f(?A, ?A)");
+}
+
+TEST_F(BindingEnvTest, ResolveUniqueNames) {
+    Cell x = var("X");
+    EXPECT_EQ(env.resolve(x).toString(), "?X");
+    EXPECT_EQ(env.resolve(x, true).toString(), "?_G" + std::to_string(x.slot()));
+}
+
+TEST_F(BindingEnvTest, VariantHashIgnoresVariableNames) {
+    auto hash = [&](const Term& a, const Term& b) {
+        Cell* args = env.allocate(2);
+        args[0] = encode(a);
+        args[1] = encode(b);
+        return env.variantHash(Goal{"p", 2, args});
+    };
+    Term x = Term::variable("X");
+    Term y = Term::variable("Y");
+    Term z = Term::variable("Z");
+
+    EXPECT_EQ(hash(x, y), hash(y, z));
+    EXPECT_EQ(hash(Term::compound("f", {x}), x), hash(Term::compound("f", {z}), z));
+    EXPECT_NE(hash(x, x), hash(x, y));
+    EXPECT_NE(hash(x, Term::constant("a")), hash(x, Term::constant("b")));
+    EXPECT_NE(hash(Term::constant("0"), x), hash(x, y));
+
+    // Bound variables hash as their values
+    Cell w = var("W");
+    ASSERT_TRUE(env.unify(w, Cell::atom("a")));
+    EXPECT_EQ(hash(Term::variable("W"), y), hash(Term::constant("a"), z));
+}
+
+} // namespace
+} // namespace kbgdb
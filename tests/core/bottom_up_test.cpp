@@ -0,0 +1,206 @@
+#include "core/bottom_up.h"
+#include "core/knowledge_base.h"
+#include "test_util.h"
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+namespace {
+
+class BottomUpTest : public ::testing::Test {
+protected:
+    void fact(const std::string& text) {
+        QueryParser parser;
+        parser.setRuleMode(true);
+        Fact f = parser.parse(text);
+        PredicateKey key{f.predicate(), static_cast<uint32_t>(f.arity())};
+        auto it = facts.find(key);
+        if (it == facts.end()) {
+            it = facts.emplace(key, FactTable(key.name, key.arity)).first;
+        }
+        it->second.add(f);
+    }
+
+    void rule(const std::string& head, const std::vector<std::string>& body) {
+        clauses.push_back(std::make_shared<const CompiledClause>(
+            CompiledClause::compile(test::parseRule(head, body))));
+    }
+
+    static std::vector<std::string> rows(const FactTable& table) {
+        std::vector<std::string> result;
+        for (size_t i = 0; i < table.size(); ++i) {
+            if (!table.live(i)) continue;
+            result.push_back(table.fact(i).toString());
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    BottomUpEvaluator::Clauses clauses;
+    BottomUpEvaluator::Relations facts;
+};
+
+TEST_F(BottomUpTest, StrataFollowDependencies) {
+    rule("reachable(X, Y)", {"path(X, Y)"});
+    rule("path(X, Y)", {"edge(X, Y)"});
+    rule("path(X, Z)", {"edge(X, Y)", "path(Y, Z)"});
+    rule("even(X)", {"odd(Y)", "next(Y, X)"});
+    rule("odd(X)", {"even(Y)", "next(Y, X)"});
+
+    BottomUpEvaluator evaluator(clauses, facts);
+    const auto& strata = evaluator.strata();
+    ASSERT_EQ(strata.size(), 3u);
+
+    auto position = [&](const char* name, uint32_t arity) {
+        for (size_t i = 0; i < strata.size(); ++i) {
+            for (const auto& key : strata[i]) {
+                if (key == PredicateKey{name, arity}) return i;
+            }
+        }
+        return strata.size();
+    };
+    EXPECT_LT(position("path", 2), position("reachable", 2));
+    EXPECT_EQ(position("even", 1), position("odd", 1));
+}
+
+TEST_F(BottomUpTest, DerivesTransitiveClosureOfCycle) {
+    fact("edge(a, b)");
+    fact("edge(b, c)");
+    fact("edge(c, a)");
+    rule("path(X, Y)", {"edge(X, Y)"});
+    rule("path(X, Z)", {"path(X, Y)", "path(Y, Z)"});
+
+    BottomUpEvaluator evaluator(clauses, facts);
+    auto derived = evaluator.run();
+    const FactTable& path = derived.at(PredicateKey{"path", 2});
+    EXPECT_EQ(path.size(), 9u);
+    EXPECT_THAT(rows(path), ::testing::Contains("path(a, a)"));
+}
+
+TEST_F(BottomUpTest, IncludesStoredFactsOfDerivedPredicate) {
+    fact("ancestor(adam, cain)");
+    fact("parent(cain, enoch)");
+    rule("ancestor(X, Y)", {"parent(X, Y)"});
+    rule("ancestor(X, Z)", {"ancestor(X, Y)", "parent(Y, Z)"});
+
+    auto derived = BottomUpEvaluator(clauses, facts).run();
+    EXPECT_EQ(rows(derived.at(PredicateKey{"ancestor", 2})),
+              (std::vector<std::string>{"ancestor(adam, cain)", "ancestor(adam, enoch)",
+                                        "ancestor(cain, enoch)"}));
+}
+
+TEST_F(BottomUpTest, LeavesNonDatalogRulesTopDown) {
+    fact("item(a)");
+    rule("wrapped(box(X))", {"item(X)"});      // Builds a term
+    rule("any(X, Y)", {"item(X)"});            // Y is never bound
+    rule("boxed(X)", {"wrapped(X)"});          // Depends on one of them
+    rule("copy(X)", {"item(X)"});
+
+    BottomUpEvaluator evaluator(clauses, facts);
+    EXPECT_FALSE(evaluator.canMaterialize(PredicateKey{"wrapped", 1}));
+    EXPECT_FALSE(evaluator.canMaterialize(PredicateKey{"any", 2}));
+    EXPECT_FALSE(evaluator.canMaterialize(PredicateKey{"boxed", 1}));
+    EXPECT_TRUE(evaluator.canMaterialize(PredicateKey{"copy", 1}));
+
+    auto derived = evaluator.run();
+    EXPECT_EQ(derived.count(PredicateKey{"boxed", 1}), 0u);
+    EXPECT_EQ(derived.at(PredicateKey{"copy", 1}).size(), 1u);
+}
+
+TEST_F(BottomUpTest, UpdateMatchesDerivingAgain) {
+    rule("path(X, Y)", {"edge(X, Y)"});
+    rule("path(X, Z)", {"path(X, Y)", "edge(Y, Z)"});
+    rule("twohop(X, Z)", {"edge(X, Y)", "edge(Y, Z)"});
+    rule("cyclic(X)", {"path(X, X)"});
+    PredicateKey edge{"edge", 2};
+    facts.emplace(edge, FactTable("edge", 2));
+    BottomUpEvaluator evaluator(clauses, facts);
+    auto derived = evaluator.run();
+
+    // Random edges on a few nodes come and go, closing and breaking
+    // cycles that support their own facts
+    std::mt19937 random(7);
+    std::set<std::pair<int, int>> edges;
+    for (int step = 0; step < 200; ++step) {
+        int from = static_cast<int>(random() % 6);
+        int to = static_cast<int>(random() % 6);
+        Fact f("edge", {Term::number(std::to_string(from)), Term::number(std::to_string(to))});
+        FactTable& table = facts.at(edge);
+        FactTable before = table.fork();
+        BottomUpEvaluator::Changes added, removed;
+        if (edges.insert({from, to}).second) {
+            table.add(f);
+            added[edge].push_back(f);
+        } else {
+            edges.erase({from, to});
+            for (size_t r = 0; r < table.size(); ++r) {
+                if (table.live(r) && table.fact(r) == f) table.remove(r);
+            }
+            removed[edge].push_back(f);
+        }
+        evaluator.update(derived, added, removed, [&](const PredicateKey& key) {
+            return key == edge ? &before : nullptr;
+        });
+
+        auto expected = BottomUpEvaluator(clauses, facts).run();
+        for (const char* name : {"path", "twohop"}) {
+            ASSERT_EQ(rows(derived.at(PredicateKey{name, 2})),
+                      rows(expected.at(PredicateKey{name, 2}))) << name << " at step " << step;
+        }
+        ASSERT_EQ(rows(derived.at(PredicateKey{"cyclic", 1})),
+                  rows(expected.at(PredicateKey{"cyclic", 1}))) << "at step " << step;
+    }
+}
+
+TEST_F(BottomUpTest, RunDerivesOnlyWhatGoalsNeed) {
+    fact("edge(a, b)");
+    rule("path(X, Y)", {"edge(X, Y)"});
+    rule("reach(X, Y)", {"path(X, Y)"});
+    rule("other(X)", {"edge(X, Y)"});
+
+    BottomUpEvaluator evaluator(clauses, facts);
+    auto derived = evaluator.run({PredicateKey{"reach", 2}});
+    EXPECT_EQ(derived.size(), 2u);
+    EXPECT_TRUE(derived.count(PredicateKey{"path", 2}));
+    EXPECT_FALSE(derived.count(PredicateKey{"other", 1}));
+}
+
+TEST_F(BottomUpTest, KnowledgeBaseAnswersFromMaterializedRelations) {
+    KnowledgeBase kb;
+    QueryParser parser;
+    parser.setRuleMode(true);
+    kb.addFact(parser.parse("parent(r, a)"));
+    kb.addFact(parser.parse("parent(a, b)"));
+    kb.addFact(parser.parse("parent(b, c)"));
+    kb.addFact(parser.parse("parent(a, d)"));
+    kb.addRule(parser.parse("sg(X, X)"), {parser.parse("parent(Y, X)")});
+    kb.addRule(parser.parse("sg(X, Y)"), {parser.parse("parent(P, X)"),
+                                          parser.parse("sg(P, Q)"),
+                                          parser.parse("parent(Q, Y)")});
+
+    auto topDown = kb.query("sg(b, ?Y)");
+    kb.setEvaluationMode(EvaluationMode::BOTTOM_UP);
+    ASSERT_NE(kb.getMaterializedTable("sg", 2), nullptr);
+    auto bottomUp = kb.query("sg(b, ?Y)");
+
+    // Top-down returns an answer once per derivation, bottom-up once
+    std::set<std::string> expected, actual;
+    for (const auto& b : topDown) expected.insert(b.get("Y"));
+    for (const auto& b : bottomUp) actual.insert(b.get("Y"));
+    EXPECT_EQ(actual, expected);
+    EXPECT_EQ(bottomUp.size(), 2u);
+    EXPECT_THAT(actual, ::testing::UnorderedElementsAre("b", "d"));
+
+    // Changes are picked up by the next query
+    kb.addFact(parser.parse("parent(a, e)"));
+    EXPECT_EQ(kb.getMaterializedTable("sg", 2), nullptr);
+    EXPECT_EQ(kb.query("sg(b, ?Y)").size(), 3u);
+}
+
+} // namespace
+} // namespace kbgdb
@@ -0,0 +1,73 @@
+#include "core/clause.h"
+#include "query/query_parser.h"
+#include <gtest/gtest.h>
+
+namespace kbgdb {
+namespace {
+
+Rule parseRule(const std::string& head, const std::vector<std::string>& body) {
+    QueryParser parser;
+    parser.setRuleMode(true);
+    std::vector<Fact> goals;
+    for (const auto& goal : body) {
+        goals.push_back(parser.parse(goal));
+    }
+    return Rule(parser.parse(head), goals);
+}
+
+TEST(CompiledClauseTest, NumbersVariablesHeadFirst) {
+    CompiledClause clause = CompiledClause::compile(
+        parseRule("grandparent(X, Z)", {"parent(X, Y)", "parent(Y, Z)"}));
+    
+    ASSERT_EQ(clause.numVars(), 3u);
+    EXPECT_EQ(clause.varNames()[0], "X");
+    EXPECT_EQ(clause.varNames()[1], "Z");
+    EXPECT_EQ(clause.varNames()[2], "Y");
+    
+    EXPECT_EQ(clause.head().predicate, "grandparent");
+    ASSERT_EQ(clause.body().size(), 2u);
+    EXPECT_EQ(clause.body()[0].args[0].slot(), 0u);
+    EXPECT_EQ(clause.body()[0].args[1].slot(), 2u);
+    EXPECT_EQ(clause.body()[1].args[0].slot(), 2u);
+    EXPECT_EQ(clause.body()[1].args[1].slot(), 1u);
+}
+
+TEST(CompiledClauseTest, UnifiesHeadWithoutCopying) {
+    CompiledClause clause = CompiledClause::compile(
+        parseRule("wrap(X, box(X, [a|T]))", {"item(X)"}));
+    
+    BindingEnv env;
+    std::unordered_map<Symbol, uint32_t> vars;
+    QueryParser parser;
+    Fact goal = parser.parse("wrap(?A, box(b, ?L))");
+    Cell a = env.encode(goal.terms()[0], vars);
+    Cell box = env.encode(goal.terms()[1], vars);
+    
+    auto mark = env.mark();
+    uint32_t base = env.newVars(clause.numVars());
+    size_t heapBefore = env.mark().heap.used;
+    ASSERT_TRUE(env.unifyTemplate(clause.head().args[0], base, a));
+    ASSERT_TRUE(env.unifyTemplate(clause.head().args[1], base, box));
+    
+    EXPECT_EQ(env.resolve(a).toString(), "b");
+    EXPECT_EQ(env.resolve(Cell::ref(vars.at("L"))).toString(), "[a | ?T]");
+    // Only the list bound to ?L was copied onto the heap
+    EXPECT_EQ(env.mark().heap.used, heapBefore + 2);
+    
+    Goal body = env.instantiate(clause.body()[0], base);
+    EXPECT_EQ(env.resolve(body).toString(), "item(b)");
+    env.undo(mark);
+    
+    // A clashing head fails
+    Fact other = parser.parse("wrap(c, box(d, ?L))");
+    base = env.newVars(clause.numVars());
+    bool matched = true;
+    for (uint32_t i = 0; i < 2 && matched; ++i) {
+        matched = env.unifyTemplate(clause.head().args[i], base,
+                                    env.encode(other.terms()[i], vars));
+    }
+    EXPECT_FALSE(matched);
+}
+
+} // namespace
+} // namespace kbgdb
@@ -0,0 +1,283 @@
+#include "core/fact_table.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+
+namespace kbgdb {
+namespace {
+
+TEST(FactTableTest, StoresRowsOfCells) {
+    FactTable table("age", 2);
+    table.add(Fact("age", {Term::constant("john"), Term::number("30")}));
+    table.add(Fact("age", {Term::constant("mary"), Term::number("28")}));
+    
+    ASSERT_EQ(table.size(), 2u);
+    EXPECT_EQ(table.row(0)[0], Cell::atom("john"));
+    EXPECT_EQ(table.row(1)[1], Cell::integer(28));
+    EXPECT_EQ(table.numVars(0), 0u);
+}
+
+TEST(FactTableTest, DecodesFacts) {
+    FactTable table("shape", 1);
+    table.add(Fact("shape", {Term::compound("point", {Term::number("1"), Term::number("2")})}));
+    table.add(Fact("shape", {Term::list({Term::constant("a"), Term::constant("b")})}));
+    
+    EXPECT_EQ(table.fact(0).toString(), "shape(point(1, 2))");
+    EXPECT_EQ(table.fact(1).toString(), "shape([a, b])");
+}
+
+TEST(FactTableTest, TracksVariables) {
+    FactTable table("member", 2);
+    table.add(Fact("member", {Term::constant("a"), Term::list({Term::constant("a")})}));
+    table.add(Fact("member", {
+        Term::variable("X"),
+        Term::cons(Term::variable("X"), Term::variable("_"))
+    }));
+    
+    EXPECT_EQ(table.numVars(0), 0u);
+    EXPECT_EQ(table.numVars(1), 2u);
+    EXPECT_EQ(table.fact(1).toString(), "member(?X, [?X | ?_])");
+}
+
+TEST(FactTableTest, RejectsWrongArity) {
+    FactTable table("parent", 2);
+    EXPECT_THROW(table.add(Fact("parent", {Term::constant("john")})),
+                 std::invalid_argument);
+}
+
+TEST(FactTableTest, CopyIsIndependent) {
+    FactTable table("p", 1);
+    table.add(Fact("p", {Term::compound("f", {Term::constant("a")})}));
+    
+    FactTable copy(table);
+    copy.add(Fact("p", {Term::constant("b")}));
+    
+    EXPECT_EQ(table.size(), 1u);
+    ASSERT_EQ(copy.size(), 2u);
+    EXPECT_EQ(copy.fact(0).toString(), "p(f(a))");
+    EXPECT_NE(copy.row(0)[0].block(), table.row(0)[0].block());
+}
+
+std::vector<size_t> rowsOf(const RowSet& rows) {
+    std::vector<size_t> result;
+    rows.forEach([&](size_t r) {
+        result.push_back(r);
+        return true;
+    });
+    return result;
+}
+
+FactTable makeEdges(size_t n) {
+    FactTable table("edge", 2);
+    for (size_t i = 0; i < n; ++i) {
+        table.add(Fact("edge", {
+            Term::number(std::to_string(i % 10)),
+            Term::number(std::to_string(i))
+        }));
+    }
+    return table;
+}
+
+TEST(FactTableTest, FirstArgumentIsIndexed) {
+    FactTable table = makeEdges(100);
+    EXPECT_TRUE(table.hasIndex(0));
+    EXPECT_FALSE(table.hasIndex(1));
+    
+    Cell args[] = {Cell::integer(3), Cell::ref(0)};
+    RowSet rows = table.candidates(args);
+    EXPECT_FALSE(rows.isAll());
+    
+    auto found = rowsOf(rows);
+    ASSERT_EQ(found.size(), 10u);
+    for (size_t r : found) {
+        EXPECT_EQ(table.row(r)[0], Cell::integer(3));
+    }
+}
+
+TEST(FactTableTest, UnboundLookupScansEverything) {
+    FactTable table = makeEdges(20);
+    Cell args[] = {Cell::ref(0), Cell::ref(1)};
+    EXPECT_TRUE(table.candidates(args).isAll());
+    EXPECT_EQ(table.candidates(args).size(), 20u);
+}
+
+TEST(FactTableTest, OtherPositionsIndexedOnDemand) {
+    FactTable table = makeEdges(100);
+    Cell args[] = {Cell::ref(0), Cell::integer(42)};
+    
+    auto found = rowsOf(table.candidates(args));
+    EXPECT_TRUE(table.hasIndex(1));
+    ASSERT_EQ(found.size(), 1u);
+    EXPECT_EQ(found[0], 42u);
+    
+    // New facts are added to every existing index
+    table.add(Fact("edge", {Term::number("7"), Term::number("42")}));
+    EXPECT_EQ(rowsOf(table.candidates(args)).size(), 2u);
+}
+
+TEST(FactTableTest, SmallTablesAreNotIndexedOnDemand) {
+    FactTable table = makeEdges(4);
+    Cell args[] = {Cell::ref(0), Cell::integer(2)};
+    table.candidates(args);
+    EXPECT_FALSE(table.hasIndex(1));
+}
+
+TEST(FactTableTest, VariableRowsMatchEveryKey) {
+    FactTable table("likes", 2);
+    table.add(Fact("likes", {Term::constant("bob"), Term::constant("tea")}));
+    table.add(Fact("likes", {Term::variable("X"), Term::constant("cake")}));
+    table.add(Fact("likes", {Term::constant("bob"), Term::constant("jam")}));
+    table.add(Fact("likes", {Term::constant("sue"), Term::constant("pie")}));
+    
+    Cell args[] = {Cell::atom("bob"), Cell::ref(0)};
+    EXPECT_EQ(rowsOf(table.candidates(args)), (std::vector<size_t>{0, 1, 2}));
+}
+
+TEST(FactTableTest, CompoundArgumentsIndexedByFunctor) {
+    FactTable table("shape", 1);
+    table.add(Fact("shape", {Term::compound("point", {Term::number("1"), Term::number("2")})}));
+    table.add(Fact("shape", {Term::compound("circle", {Term::number("3")})}));
+    
+    CellArena arena;
+    std::vector<Symbol> vars;
+    Cell args[] = {encodeTerm(
+        Term::compound("point", {Term::variable("X"), Term::variable("Y")}), arena, vars)};
+    EXPECT_EQ(rowsOf(table.candidates(args)), (std::vector<size_t>{0}));
+}
+
+TEST(FactTableTest, ForkSharesRowsAddedBefore) {
+    FactTable table = makeEdges(100);
+    FactTable version = table.fork();
+    EXPECT_EQ(version.row(0), table.row(0));
+    
+    // Later facts are appended for the table only
+    for (size_t i = 100; i < 1000; ++i) {
+        table.add(Fact("edge", {Term::number("3"), Term::number(std::to_string(i))}));
+    }
+    ASSERT_EQ(version.size(), 100u);
+    EXPECT_EQ(version.row(42)[1], Cell::integer(42));
+    
+    Cell args[] = {Cell::integer(3), Cell::ref(0)};
+    EXPECT_EQ(rowsOf(version.candidates(args)).size(), 10u);
+    EXPECT_EQ(rowsOf(table.candidates(args)).size(), 910u);
+    
+    // Including in indexes built after the fork
+    Cell second[] = {Cell::ref(0), Cell::integer(500)};
+    EXPECT_TRUE(rowsOf(version.candidates(second)).empty());
+    EXPECT_EQ(rowsOf(table.candidates(second)), (std::vector<size_t>{500}));
+}
+
+TEST(FactTableTest, AddingToOlderVersionCopiesIt) {
+    FactTable table = makeEdges(20);
+    FactTable version = table.fork();
+    table.add(Fact("edge", {Term::number("1"), Term::number("20")}));
+    version.add(Fact("edge", {Term::number("1"), Term::number("99")}));
+    
+    ASSERT_EQ(table.size(), 21u);
+    ASSERT_EQ(version.size(), 21u);
+    EXPECT_EQ(table.row(20)[1], Cell::integer(20));
+    EXPECT_EQ(version.row(20)[1], Cell::integer(99));
+    EXPECT_NE(version.row(0), table.row(0));
+}
+
+TEST(FactTableTest, RemovedRowsStayInPlace) {
+    FactTable table = makeEdges(100);
+    table.ensureIndex(1);
+    table.remove(13);
+    table.remove(23);
+    
+    EXPECT_EQ(table.size(), 100u);
+    EXPECT_EQ(table.removed(), 2u);
+    EXPECT_FALSE(table.live(13));
+    EXPECT_TRUE(table.live(33));
+    EXPECT_EQ(table.row(33)[1], Cell::integer(33));
+    
+    // Lookups still return removed rows, for the caller to skip
+    Cell args[] = {Cell::integer(3), Cell::ref(0)};
+    EXPECT_EQ(rowsOf(table.candidates(args)).size(), 10u);
+    
+    // Rows added later are live, and a copy keeps row numbers
+    table.add(Fact("edge", {Term::number("3"), Term::number("100")}));
+    EXPECT_TRUE(table.live(100));
+    FactTable copy(table);
+    EXPECT_EQ(copy.size(), 101u);
+    EXPECT_FALSE(copy.live(13));
+    EXPECT_FALSE(copy.live(23));
+    EXPECT_TRUE(copy.live(100));
+}
+
+TEST(FactTableTest, ForkSeesRowsRemovedAfterIt) {
+    FactTable table = makeEdges(20);
+    FactTable version = table.fork();
+    table.remove(5);
+    
+    EXPECT_FALSE(table.live(5));
+    EXPECT_TRUE(version.live(5));
+    EXPECT_EQ(version.removed(), 0u);
+    
+    // Removing from the older version copies it
+    version.remove(6);
+    EXPECT_TRUE(version.live(5));
+    EXPECT_FALSE(version.live(6));
+    EXPECT_TRUE(table.live(6));
+}
+
+TEST(FactTableTest, CompactDropsRemovedRows) {
+    FactTable table = makeEdges(10);
+    for (size_t i = 0; i < 10; i += 2) {
+        table.remove(i);
+    }
+    FactTable version = table.fork();
+    table.compact();
+    
+    ASSERT_EQ(table.size(), 5u);
+    EXPECT_EQ(table.removed(), 0u);
+    for (size_t i = 0; i < 5; ++i) {
+        EXPECT_EQ(table.row(i)[1], Cell::integer(static_cast<int64_t>(2 * i + 1)));
+    }
+    Cell args[] = {Cell::integer(3), Cell::ref(0)};
+    EXPECT_EQ(rowsOf(table.candidates(args)), (std::vector<size_t>{1}));
+    
+    // Versions from before are left as they were
+    EXPECT_EQ(version.size(), 10u);
+    EXPECT_EQ(version.removed(), 5u);
+}
+
+TEST(FactTableTest, ForksReadWhileAdding) {
+    FactTable table("edge", 2);
+    std::atomic<bool> done{false};
+    std::vector<FactTable> versions;
+    std::mutex versionsMutex;
+    
+    std::thread reader([&] {
+        while (!done) {
+            FactTable version = [&] {
+                std::lock_guard<std::mutex> lock(versionsMutex);
+                return versions.empty() ? FactTable("edge", 2) : versions.back().fork();
+            }();
+            // Every row of a version is there, whatever is appended
+            Cell args[] = {Cell::integer(0), Cell::ref(0)};
+            size_t evens = rowsOf(version.candidates(args)).size();
+            EXPECT_EQ(evens, (version.size() + 1) / 2);
+            Cell last[] = {Cell::ref(0), Cell::integer(static_cast<int64_t>(version.size()) - 1)};
+            EXPECT_EQ(rowsOf(version.candidates(last)).size(), version.empty() ? 0u : 1u);
+            for (size_t i = 0; i < version.size(); ++i) {
+                EXPECT_EQ(version.row(i)[1], Cell::integer(static_cast<int64_t>(i)));
+            }
+        }
+    });
+    for (size_t i = 0; i < 2000; ++i) {
+        table.add(Fact("edge", {
+            Term::number(std::to_string(i % 2)), Term::number(std::to_string(i))
+        }));
+        if (i % 100 == 0) {
+            std::lock_guard<std::mutex> lock(versionsMutex);
+            versions.push_back(table.fork());
+        }
+    }
+    done = true;
+    reader.join();
+}
+
+} // namespace
+} // namespace kbgdb
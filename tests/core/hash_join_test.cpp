@@ -0,0 +1,100 @@
+#include "core/hash_join.h"
+#include "core/knowledge_base.h"
+#include "test_util.h"
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+namespace {
+
+class HashJoinTest : public ::testing::Test {
+protected:
+    BindingBatch batch(std::vector<uint32_t> vars, const std::vector<std::vector<int>>& rows) {
+        BindingBatch result(std::move(vars));
+        for (const auto& row : rows) {
+            std::vector<Cell> cells;
+            for (int value : row) cells.push_back(Cell::integer(value));
+            result.add(cells.data());
+        }
+        return result;
+    }
+
+    std::set<std::vector<int64_t>> rows(const BindingBatch& batch) {
+        std::set<std::vector<int64_t>> result;
+        for (size_t r = 0; r < batch.size(); ++r) {
+            std::vector<int64_t> row;
+            for (size_t c = 0; c < batch.width(); ++c) row.push_back(batch.row(r)[c].intValue());
+            result.insert(row);
+        }
+        return result;
+    }
+
+    void rule(const std::string& head, const std::vector<std::string>& body) {
+        kb.addRule(test::parseRule(head, body));
+    }
+
+    std::set<std::string> answers(const std::string& text) {
+        return test::answers(kb, text);
+    }
+
+    KnowledgeBase kb;
+};
+
+TEST_F(HashJoinTest, JoinsOnSharedVariables) {
+    auto left = batch({0, 1}, {{1, 10}, {2, 20}, {3, 30}});
+    auto right = batch({1, 2}, {{10, 100}, {10, 101}, {30, 300}, {40, 400}});
+
+    auto joined = hashJoin(left, right);
+    EXPECT_EQ(joined.variables(), (std::vector<uint32_t>{0, 1, 2}));
+    EXPECT_EQ(rows(joined), (std::set<std::vector<int64_t>>{
+        {1, 10, 100}, {1, 10, 101}, {3, 30, 300}}));
+
+    // Same result whichever side is hashed
+    EXPECT_EQ(rows(hashJoin(right, left)).size(), 3u);
+
+    EXPECT_EQ(rows(semiJoin(left, right)), (std::set<std::vector<int64_t>>{{1, 10}, {3, 30}}));
+    EXPECT_EQ(hashJoin(left, batch({5}, {{7}, {8}})).size(), 6u);   // Cross product
+}
+
+TEST_F(HashJoinTest, ProjectionDropsDuplicates) {
+    auto joined = hashJoin(batch({0, 1}, {{1, 10}, {2, 10}}), batch({1, 2}, {{10, 5}}));
+    auto projected = project(joined, {2, 1});
+    EXPECT_EQ(projected.variables(), (std::vector<uint32_t>{2, 1}));
+    EXPECT_EQ(rows(projected), (std::set<std::vector<int64_t>>{{5, 10}}));
+}
+
+TEST_F(HashJoinTest, RuleBodiesMatchTupleAtATime) {
+    for (int i = 0; i < 300; ++i) {
+        kb.addFact("employee", {Term::constant("e" + std::to_string(i)),
+                                Term::constant("d" + std::to_string(i % 70))});
+        kb.addFact("salary", {Term::constant("e" + std::to_string(i)),
+                              Term::constant(i % 2 ? "high" : "low")});
+    }
+    // Every goal matches enough rows to be joined in batches
+    for (int d = 0; d < 70; ++d) {
+        kb.addFact("dept", {Term::constant("d" + std::to_string(d)),
+                            Term::constant(d % 2 ? "sales" : "research")});
+    }
+    for (int i = 0; i < 100; ++i) {
+        kb.addFact("site", {Term::constant("d" + std::to_string(i % 70)),
+                            Term::constant("s" + std::to_string(i))});
+    }
+    rule("paid(E, S, U)", {"employee(E, D)", "dept(D, U)", "salary(E, S)"});
+    rule("colocated(E, S)", {"employee(E, D)", "site(D, S)", "salary(E, high)"});
+
+    auto paid = answers("paid(?E, ?S, ?U)");
+    auto sales = answers("paid(?E, ?S, sales)");
+    auto colocated = answers("colocated(?E, ?S)");
+    kb.setBatchJoins(false);
+    EXPECT_EQ(answers("paid(?E, ?S, ?U)"), paid);
+    EXPECT_EQ(answers("paid(?E, ?S, sales)"), sales);
+    EXPECT_EQ(answers("colocated(?E, ?S)"), colocated);
+    EXPECT_EQ(paid.size(), 300u);
+    EXPECT_EQ(sales.size(), 150u);
+    EXPECT_FALSE(colocated.empty());
+}
+
+} // namespace
+} // namespace kbgdb
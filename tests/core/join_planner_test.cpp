@@ -0,0 +1,92 @@
+#include "core/join_planner.h"
+#include "core/knowledge_base.h"
+#include "test_util.h"
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+namespace {
+
+class JoinPlannerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (int i = 0; i < 200; ++i) {
+            kb.addFact("big", {Term::constant("x" + std::to_string(i)),
+                               Term::constant("y" + std::to_string(i % 50))});
+        }
+        kb.addFact("tiny", {Term::constant("y3"), Term::constant("z")});
+        kb.addFact("tiny", {Term::constant("y7"), Term::constant("z")});
+    }
+
+    void rule(const std::string& head, const std::vector<std::string>& body) {
+        kb.addRule(test::parseRule(head, body));
+    }
+
+    // Predicate names of the last rule's body, in planned order
+    std::vector<std::string> plan(uint64_t pattern) {
+        uint32_t id = static_cast<uint32_t>(kb.getRules().size() - 1);
+        CompiledClause clause = CompiledClause::compile(kb.getRules().back());
+        std::vector<std::string> names;
+        PlanCache plans;
+        for (const Goal& goal : plans.plan(id, clause, pattern, index(), kb.planner())) {
+            names.push_back(goal.predicate.str());
+        }
+        return names;
+    }
+
+    const RuleIndex& index() {
+        rules.clear();
+        for (uint32_t id = 0; id < kb.getRules().size(); ++id) {
+            rules.add(kb.getRules()[id], id);
+        }
+        return rules;
+    }
+
+    std::set<std::string> answers(const std::string& text) {
+        return test::answers(kb, text);
+    }
+
+    RuleIndex rules;
+    KnowledgeBase kb;
+};
+
+TEST_F(JoinPlannerTest, KeepsStatistics) {
+    const PredicateStats* big = kb.planner().stats(PredicateKey{"big", 2});
+    ASSERT_NE(big, nullptr);
+    EXPECT_EQ(big->cardinality(), 200u);
+    EXPECT_EQ(big->distinct(0), 200u);
+    EXPECT_EQ(big->distinct(1), 50u);
+    EXPECT_EQ(kb.planner().stats(PredicateKey{"missing", 1}), nullptr);
+}
+
+TEST_F(JoinPlannerTest, SelectiveGoalFirst) {
+    rule("p(X, Z)", {"big(X, Y)", "tiny(Y, Z)"});
+    EXPECT_EQ(plan(0), (std::vector<std::string>{"tiny", "big"}));
+
+    // With X bound by the call, big is a single-row lookup
+    EXPECT_EQ(plan(1), (std::vector<std::string>{"big", "tiny"}));
+}
+
+TEST_F(JoinPlannerTest, RuleDefinedGoalsKeepTheirPlace) {
+    rule("q(Y)", {"tiny(Y, Z)"});
+    rule("p(X, Z)", {"big(X, Y)", "q(Y)", "tiny(Y, Z)"});
+    EXPECT_EQ(plan(0), (std::vector<std::string>{"big", "q", "tiny"}));
+}
+
+TEST_F(JoinPlannerTest, SameAnswersAsSourceOrder) {
+    rule("p(X, Z)", {"big(X, Y)", "tiny(Y, Z)"});
+    rule("r(X, W)", {"big(X, Y)", "big(W, Y)", "tiny(Y, z)"});
+
+    auto planned = answers("p(?X, ?Z)");
+    auto planned2 = answers("r(x3, ?W)");
+    kb.setJoinPlanning(false);
+    EXPECT_EQ(answers("p(?X, ?Z)"), planned);
+    EXPECT_EQ(answers("r(x3, ?W)"), planned2);
+    EXPECT_EQ(planned.size(), 8u);
+    EXPECT_EQ(planned2.size(), 4u);
+}
+
+} // namespace
+} // namespace kbgdb
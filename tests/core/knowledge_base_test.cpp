@@ -2,8 +2,11 @@
 #include "query/query_parser.h"
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
+#include <thread>
 
 namespace kbgdb {
 namespace {
@@ -113,6 +116,29 @@ TEST_F(KnowledgeBaseTest, QueryWithBoundArgument) {
     EXPECT_THAT(children, ::testing::UnorderedElementsAre("bob", "mary"));
 }
 
+TEST_F(KnowledgeBaseTest, IndexedLookupOnEitherArgument) {
+    for (int i = 0; i < 200; ++i) {
+        kb->addFact(Fact("edge", {
+            Term::number(std::to_string(i)),
+            Term::number(std::to_string(i + 1))
+        }));
+    }
+    
+    auto forward = kb->query("edge(42, ?Y)");
+    ASSERT_EQ(forward.size(), 1);
+    EXPECT_EQ(forward[0].get("Y"), "43");
+    
+    auto backward = kb->query("edge(?X, 42)");
+    ASSERT_EQ(backward.size(), 1);
+    EXPECT_EQ(backward[0].get("X"), "41");
+    
+    const FactTable* table = kb->getFactTable("edge", 2);
+    ASSERT_NE(table, nullptr);
+    EXPECT_TRUE(table->hasIndex(1));
+    
+    EXPECT_EQ(kb->query("edge(?X, ?Y)").size(), 200);
+}
+
 TEST_F(KnowledgeBaseTest, QueryNoResults) {
     kb->addFact(Fact("person", {Term{TermType::CONSTANT, "john"}}));
     
@@ -432,6 +458,513 @@ ancestor(X, Z) :- parent(X, Y), ancestor(Y, Z).
     EXPECT_THAT(ancestors, ::testing::UnorderedElementsAre("a", "b", "c"));
 }
 
+// ============================================================================
+// Conjunctive Query Tests
+// ============================================================================
+
+TEST_F(KnowledgeBaseTest, ConjunctiveQuery) {
+    writeTestFile(R"(
+parent(tom, bob).
+parent(tom, liz).
+parent(bob, ann).
+age(bob, 40).
+age(liz, 35).
+age(ann, 10).
+)");
+    
+    kb->loadFromFile(testFile.string());
+    
+    auto results = kb->query("parent(?X, ?Y), age(?Y, ?A)");
+    std::vector<std::string> rows;
+    for (const auto& binding : results) {
+        rows.push_back(binding.get("X") + " " + binding.get("Y") + " " + binding.get("A"));
+    }
+    EXPECT_THAT(rows, ::testing::UnorderedElementsAre("tom bob 40", "tom liz 35", "bob ann 10"));
+    
+    EXPECT_EQ(kb->query("parent(tom, ?Y), age(?Y, 35)").size(), 1);
+    EXPECT_EQ(kb->query("parent(?X, ann), age(?X, 35)").size(), 0);
+}
+
+TEST_F(KnowledgeBaseTest, ConjunctiveQueryMatchesEquivalentRule) {
+    QueryParser parser;
+    parser.setRuleMode(true);
+    kb->tablePredicate("ancestor", 2);
+    for (int i = 0; i < 100; ++i) {
+        std::string n = std::to_string(i);
+        kb->addFact(parser.parse("edge(n" + n + ", n" + std::to_string(i + 1) + ")"));
+        kb->addFact(parser.parse("edge(n" + n + ", n" + std::to_string(i + 2) + ")"));
+    }
+    kb->addRule(parser.parse("ancestor(X, Y)"), {parser.parse("edge(X, Y)")});
+    kb->addRule(parser.parse("ancestor(X, Y)"),
+                {parser.parse("edge(X, Z)"), parser.parse("ancestor(Z, Y)")});
+    kb->addRule(parser.parse("twoHop(X, Y)"),
+                {parser.parse("edge(X, Z)"), parser.parse("edge(Z, Y)")});
+    
+    // Large enough for a batch join
+    size_t twoHops = kb->query("twoHop(?X, ?Y)").size();
+    EXPECT_EQ(kb->query("edge(?X, ?Z), edge(?Z, ?Y)").size(), twoHops);
+    
+    // Through a rule-defined goal: n4 reaches n5, n5 does not
+    EXPECT_EQ(kb->query("edge(n3, ?Z), ancestor(?Z, n5)").size(), 1);
+    
+    kb->setEvaluationMode(EvaluationMode::MAGIC_SETS);
+    EXPECT_EQ(kb->query("edge(?X, ?Z), edge(?Z, ?Y)").size(), twoHops);
+    EXPECT_EQ(kb->query("edge(n3, ?Z), ancestor(?Z, n5)").size(), 1);
+}
+
+TEST_F(KnowledgeBaseTest, CursorOverConjunction) {
+    writeTestFile("p(a).\np(b).\nq(b).\nq(c).\n");
+    kb->loadFromFile(testFile.string());
+    
+    SolutionCursor cursor = kb->cursor("p(?X), q(?X)");
+    auto first = cursor.next();
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(first->get("X"), "b");
+    EXPECT_FALSE(cursor.next().has_value());
+    
+    EXPECT_THROW(kb->cursor(std::vector<Fact>{}), std::invalid_argument);
+}
+
+TEST_F(KnowledgeBaseTest, ParallelQueryMatchesSequential) {
+    writeTestFile(R"(
+:- table reach/2.
+edge(a, b).
+edge(b, c).
+edge(c, a).
+edge(c, d).
+reach(X, Y) :- edge(X, Y).
+reach(X, Y) :- reach(X, Z), edge(Z, Y).
+)");
+    kb->loadFromFile(testFile.string());
+    QueryParser parser;
+    parser.setRuleMode(true);
+    for (int i = 0; i < 500; ++i) {
+        kb->addFact(parser.parse("item(i" + std::to_string(i) + ", g" + std::to_string(i % 13) + ")"));
+    }
+    
+    std::vector<std::string> queries = {"reach(?X, ?Y)", "item(?I, ?G)",
+                                        "item(?I, g3), item(?J, g3)", "reach(a, d)"};
+    std::vector<std::vector<std::string>> expected;
+    for (const auto& query : queries) {
+        expected.emplace_back();
+        for (const auto& solution : kb->query(query)) {
+            expected.back().push_back(solution.toString());
+        }
+    }
+    
+    kb->setParallelism(4);
+    EXPECT_EQ(kb->parallelism(), 4u);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        std::vector<std::string> actual;
+        for (const auto& solution : kb->query(queries[i])) {
+            actual.push_back(solution.toString());
+        }
+        EXPECT_EQ(actual, expected[i]) << queries[i];
+    }
+    
+    kb->setParallelism(1);
+    EXPECT_EQ(kb->parallelism(), 1u);
+    EXPECT_THROW(kb->setParallelism(0), std::invalid_argument);
+}
+
+TEST_F(KnowledgeBaseTest, IndependentGoalsMatchNestedLoop) {
+    writeTestFile(R"(
+edge(a, b).
+edge(b, c).
+edge(c, d).
+edge(b, d).
+path(X, Y) :- edge(X, Y).
+path(X, Y) :- edge(X, Z), path(Z, Y).
+color(red).
+color(blue).
+color(red).
+report(X, Y) :- path(a, X), path(Y, d).
+tagged(X, C, Y) :- color(C), path(X, Y), edge(Y, d).
+checked(X) :- path(a, d), edge(X, Y), path(Y, c).
+none(X, Y) :- path(d, X), path(a, Y).
+)");
+    kb->loadFromFile(testFile.string());
+    
+    std::vector<std::string> queries = {"report(?X, ?Y)", "tagged(?X, ?C, ?Y)", "tagged(a, ?C, ?Y)",
+                                        "report(b, ?Y), report(?Y, c)", "checked(?X)", "none(?X, ?Y)"};
+    auto solve = [&](const std::string& query) {
+        std::vector<std::string> solutions;
+        for (const auto& solution : kb->query(query)) {
+            solutions.push_back(solution.toString());
+        }
+        std::sort(solutions.begin(), solutions.end());
+        return solutions;
+    };
+    
+    kb->setIndependentGoals(false);
+    std::vector<std::vector<std::string>> expected;
+    for (const auto& query : queries) {
+        expected.push_back(solve(query));
+    }
+    EXPECT_EQ(expected[0].size(), 20u);      // Duplicate paths are kept
+    EXPECT_TRUE(expected[5].empty());
+    
+    kb->setIndependentGoals(true);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        EXPECT_EQ(solve(queries[i]), expected[i]) << queries[i];
+    }
+    kb->setParallelism(3);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        EXPECT_EQ(solve(queries[i]), expected[i]) << queries[i];
+    }
+}
+
+// ============================================================================
+// Tabling Tests
+// ============================================================================
+
+TEST_F(KnowledgeBaseTest, TabledLeftRecursionOnCycle) {
+    writeTestFile(R"(
+:- table path/2.
+edge(a, b).
+edge(b, c).
+edge(c, a).
+edge(c, d).
+
+path(X, Y) :- path(X, Z), edge(Z, Y).
+path(X, Y) :- edge(X, Y).
+)");
+    
+    kb->loadFromFile(testFile.string());
+    EXPECT_TRUE(kb->isTabled("path", 2));
+    
+    std::vector<std::string> reached;
+    for (const auto& binding : kb->query("path(a, ?Y)")) {
+        reached.push_back(binding.get("Y"));
+    }
+    EXPECT_THAT(reached, ::testing::UnorderedElementsAre("a", "b", "c", "d"));
+    
+    // Every pair reachable in the cycle, plus each node to d
+    EXPECT_EQ(kb->query("path(?X, ?Y)").size(), 12);
+    EXPECT_EQ(kb->query("path(d, ?Y)").size(), 0);
+}
+
+TEST_F(KnowledgeBaseTest, MaterializedViewFollowsChanges) {
+    writeTestFile(R"(
+:- materialize ancestor/2, grandparent/2.
+parent(a, b).
+parent(b, c).
+parent(c, d).
+
+grandparent(X, Z) :- parent(X, Y), parent(Y, Z).
+ancestor(X, Y) :- parent(X, Y).
+ancestor(X, Z) :- parent(X, Y), ancestor(Y, Z).
+)");
+    kb->loadFromFile(testFile.string());
+    EXPECT_TRUE(kb->isMaterialized("ancestor", 2));
+    EXPECT_FALSE(kb->isMaterialized("parent", 2));
+    
+    // Answered from the view's table, in top-down mode too
+    const FactTable* view = kb->getMaterializedTable("ancestor", 2);
+    ASSERT_NE(view, nullptr);
+    EXPECT_EQ(view->size(), 6u);
+    EXPECT_EQ(kb->query("ancestor(a, ?Y)").size(), 3u);
+    
+    kb->addFact("parent", {Term::constant("d"), Term::constant("e")});
+    EXPECT_EQ(kb->getMaterializedTable("ancestor", 2)->size(), 10u);
+    EXPECT_EQ(kb->query("ancestor(a, ?Y)").size(), 4u);
+    EXPECT_EQ(kb->query("grandparent(c, ?Z)").size(), 1u);
+    
+    // Retracting cuts the chain; facts derived through it go
+    auto pinned = kb->cursor("ancestor(a, ?Y)");
+    kb->retractFact(Fact("parent", {Term::constant("b"), Term::constant("c")}));
+    std::vector<std::string> reached;
+    for (const auto& binding : kb->query("ancestor(a, ?Y)")) {
+        reached.push_back(binding.get("Y"));
+    }
+    EXPECT_THAT(reached, ::testing::UnorderedElementsAre("b"));
+    EXPECT_EQ(kb->query("ancestor(?X, ?Y)").size(), 4u);
+    EXPECT_TRUE(kb->query("grandparent(a, ?Z)").empty());
+    
+    // A cursor opened before still reads the view as it was
+    size_t count = 0;
+    while (pinned.next()) ++count;
+    EXPECT_EQ(count, 4u);
+    
+    // Facts still derivable another way stay
+    kb->addFact("parent", {Term::constant("a"), Term::constant("c")});
+    kb->addFact("parent", {Term::constant("b"), Term::constant("c")});
+    kb->retractFact(Fact("parent", {Term::constant("a"), Term::constant("c")}));
+    EXPECT_EQ(kb->query("ancestor(a, ?Y)").size(), 4u);
+    EXPECT_EQ(kb->query("ancestor(a, c)").size(), 1u);
+}
+
+TEST_F(KnowledgeBaseTest, MaterializedViewDerivedAgainAfterRuleChange) {
+    kb->addFact("edge", {Term::constant("a"), Term::constant("b")});
+    kb->addRule(Fact("link", {Term::variable("X"), Term::variable("Y")}),
+                {Fact("edge", {Term::variable("X"), Term::variable("Y")})});
+    kb->materializePredicate("link", 2);
+    ASSERT_NE(kb->getMaterializedTable("link", 2), nullptr);
+    
+    // Out of date until the next query derives it again
+    kb->addRule(Fact("link", {Term::variable("X"), Term::variable("Y")}),
+                {Fact("edge", {Term::variable("Y"), Term::variable("X")})});
+    EXPECT_EQ(kb->getMaterializedTable("link", 2), nullptr);
+    EXPECT_EQ(kb->query("link(?X, ?Y)").size(), 2u);
+    ASSERT_NE(kb->getMaterializedTable("link", 2), nullptr);
+    EXPECT_EQ(kb->getMaterializedTable("link", 2)->size(), 2u);
+    
+    // Non-ground facts cannot be materialized: the view is left top-down
+    kb->addFact("edge", {Term::constant("c"), Term::variable("Any")});
+    EXPECT_EQ(kb->getMaterializedTable("link", 2), nullptr);
+    EXPECT_EQ(kb->query("link(c, b)").size(), 1u);
+}
+
+TEST_F(KnowledgeBaseTest, TabledMutualRecursion) {
+    writeTestFile(R"(
+:- table even/1, odd/1.
+succ(0, 1).
+succ(1, 2).
+succ(2, 3).
+succ(3, 4).
+succ(4, 0).
+even(0).
+even(X) :- odd(Y), succ(Y, X).
+odd(X) :- even(Y), succ(Y, X).
+)");
+    
+    kb->loadFromFile(testFile.string());
+    
+    // The cycle has odd length, so every number ends up both even and odd
+    EXPECT_EQ(kb->query("even(?X)").size(), 5);
+    EXPECT_EQ(kb->query("odd(?X)").size(), 5);
+    EXPECT_EQ(kb->query("odd(0)").size(), 1);
+}
+
+TEST_F(KnowledgeBaseTest, TabledAnswersAreDeduplicated) {
+    kb->tablePredicate("reach", 2);
+    QueryParser parser;
+    parser.setRuleMode(true);
+    for (const char* edge : {"edge(a, b)", "edge(a, c)", "edge(b, d)", "edge(c, d)"}) {
+        kb->addFact(parser.parse(edge));
+    }
+    kb->addRule(parser.parse("reach(X, Y)"), {parser.parse("edge(X, Y)")});
+    kb->addRule(parser.parse("reach(X, Y)"),
+                {parser.parse("reach(X, Z)"), parser.parse("edge(Z, Y)")});
+    
+    // d is reached along two paths but answered once
+    EXPECT_EQ(kb->query("reach(a, ?Y)").size(), 3);
+}
+
+TEST_F(KnowledgeBaseTest, InvalidTableDirective) {
+    writeTestFile(":- table path.\n");
+    EXPECT_THROW(kb->loadFromFile(testFile.string()), std::runtime_error);
+    
+    writeTestFile(":- dynamic path/2.\n");
+    EXPECT_THROW(kb->loadFromFile(testFile.string()), std::runtime_error);
+}
+
+// ============================================================================
+// Concurrency Tests
+// ============================================================================
+
+TEST_F(KnowledgeBaseTest, CursorReadsSnapshotFromWhenOpened) {
+    kb->addFact("parent", {Term::constant("alice"), Term::constant("bob")});
+    kb->addRule(Fact("child", {Term::variable("X"), Term::variable("Y")}),
+                {Fact("parent", {Term::variable("Y"), Term::variable("X")})});
+    
+    auto parents = kb->cursor("parent(?X, ?Y)");
+    auto children = kb->cursor("child(?X, ?Y)");
+    kb->addFact("parent", {Term::constant("bob"), Term::constant("carol")});
+    kb->addRule(Fact("child", {Term::variable("X"), Term::constant("nobody")}),
+                {Fact("parent", {Term::variable("X"), Term::variable("_")})});
+    
+    size_t count = 0;
+    while (parents.next()) ++count;
+    EXPECT_EQ(count, 1u);
+    count = 0;
+    while (children.next()) ++count;
+    EXPECT_EQ(count, 1u);
+    
+    EXPECT_EQ(kb->query("parent(?X, ?Y)").size(), 2u);
+    EXPECT_EQ(kb->query("child(?X, ?Y)").size(), 4u);
+}
+
+TEST_F(KnowledgeBaseTest, SnapshotKeepsItsEpochWhileAdding) {
+    for (int i = 0; i < 10; ++i) {
+        kb->addFact("num", {Term::number(std::to_string(i))});
+    }
+    auto pinned = kb->snapshot();
+    EXPECT_EQ(pinned->epoch(), 10u);
+    
+    // Appended to the storage the snapshot shares, growing it many times
+    for (int i = 10; i < 5000; ++i) {
+        kb->addFact("num", {Term::number(std::to_string(i))});
+    }
+    const FactTable* table = pinned->facts("num", 1);
+    ASSERT_EQ(table->size(), 10u);
+    Cell args[] = {Cell::integer(7)};
+    EXPECT_EQ(table->candidates(args).size(), 1u);
+    args[0] = Cell::integer(700);
+    EXPECT_EQ(table->candidates(args).size(), 0u);
+    
+    EXPECT_EQ(kb->snapshot()->epoch(), 5000u);
+    EXPECT_EQ(kb->getFactTable("num", 1)->size(), 5000u);
+}
+
+TEST_F(KnowledgeBaseTest, CopiesSnapshotOnlyWhileHeld) {
+    kb->addFact("num", {Term::number("1")});
+    const KnowledgeSnapshot* before = kb->snapshot().get();
+    EXPECT_EQ(kb->query("num(?X)").size(), 1u);
+
+    // Changed in place once the queries have let it go
+    kb->addFact("num", {Term::number("2")});
+    EXPECT_EQ(kb->snapshot().get(), before);
+
+    auto pinned = kb->snapshot();
+    kb->addFact("num", {Term::number("3")});
+    EXPECT_NE(kb->snapshot().get(), before);
+    EXPECT_EQ(pinned->facts("num", 1)->size(), 2u);
+}
+
+TEST_F(KnowledgeBaseTest, RetractFact) {
+    kb->addFact("parent", {Term::constant("alice"), Term::constant("bob")});
+    kb->addFact("parent", {Term::constant("alice"), Term::constant("carol")});
+    kb->addFact("parent", {Term::constant("bob"), Term::constant("dave")});
+    
+    // The first match only, as retract/1
+    EXPECT_TRUE(kb->retractFact(Fact("parent", {Term::constant("alice"), Term::variable("X")})));
+    auto results = kb->query("parent(alice, ?X)");
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].get("X"), "carol");
+    
+    EXPECT_FALSE(kb->retractFact(Fact("parent", {Term::constant("bob"), Term::constant("eve")})));
+    EXPECT_FALSE(kb->retractFact(Fact("unknown", {Term::variable("X")})));
+    EXPECT_EQ(kb->getFacts("parent").size(), 2u);
+}
+
+TEST_F(KnowledgeBaseTest, RetractAllKeepsIndexesConsistent) {
+    for (int i = 0; i < 200; ++i) {
+        kb->addFact("edge", {Term::number(std::to_string(i % 10)), Term::number(std::to_string(i))});
+    }
+    kb->addRule(Fact("two", {Term::variable("X"), Term::variable("Z")}),
+                {Fact("edge", {Term::variable("X"), Term::variable("Y")}),
+                 Fact("edge", {Term::variable("Y"), Term::variable("Z")})});
+    kb->query("edge(?X, 42)");      // Indexes the second argument
+    
+    EXPECT_EQ(kb->retractAll(Fact("edge", {Term::number("3"), Term::variable("Y")})), 20u);
+    EXPECT_TRUE(kb->query("edge(3, ?Y)").empty());
+    EXPECT_TRUE(kb->query("edge(?X, 43)").empty());
+    EXPECT_EQ(kb->query("edge(?X, 42)").size(), 1u);
+    EXPECT_EQ(kb->query("edge(?X, ?Y)").size(), 180u);
+    EXPECT_TRUE(kb->query("two(?X, 3)").empty());
+    EXPECT_TRUE(kb->query("two(3, ?Z)").empty());
+    kb->setEvaluationMode(EvaluationMode::BOTTOM_UP);
+    EXPECT_TRUE(kb->query("two(?X, 3)").empty());
+    EXPECT_EQ(kb->query("two(?X, ?Z)").size(), 9u * 20u);
+    kb->setEvaluationMode(EvaluationMode::TOP_DOWN);
+    
+    // Retracting most of the facts compacts their table
+    EXPECT_EQ(kb->retractAll(Fact("edge", {Term::variable("X"), Term::variable("Y")})), 180u);
+    EXPECT_EQ(kb->getFactTable("edge", 2)->size(), 0u);
+    kb->addFact("edge", {Term::number("1"), Term::number("2")});
+    EXPECT_EQ(kb->query("edge(?X, ?Y)").size(), 1u);
+}
+
+TEST_F(KnowledgeBaseTest, UpsertFactReplacesMatches) {
+    kb->addFact("age", {Term::constant("bob"), Term::number("42")});
+    kb->addFact("age", {Term::constant("eve"), Term::number("30")});
+    
+    EXPECT_EQ(kb->upsertFact(Fact("age", {Term::constant("bob"), Term::variable("_")}),
+                             Fact("age", {Term::constant("bob"), Term::number("43")})), 1u);
+    auto results = kb->query("age(bob, ?A)");
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].get("A"), "43");
+    
+    // Inserts when nothing matches
+    EXPECT_EQ(kb->upsertFact(Fact("age", {Term::constant("amy"), Term::variable("_")}),
+                             Fact("age", {Term::constant("amy"), Term::number("7")})), 0u);
+    EXPECT_EQ(kb->query("age(?P, ?A)").size(), 3u);
+}
+
+TEST_F(KnowledgeBaseTest, OpenCursorKeepsRetractedFacts) {
+    kb->addFact("num", {Term::number("1")});
+    kb->addFact("num", {Term::number("2")});
+    auto pinned = kb->snapshot();
+    auto cursor = kb->cursor("num(?X)");
+    
+    kb->retractAll(Fact("num", {Term::variable("X")}));
+    EXPECT_TRUE(kb->query("num(?X)").empty());
+    EXPECT_GT(kb->snapshot()->epoch(), pinned->epoch());
+    
+    size_t count = 0;
+    while (cursor.next()) ++count;
+    EXPECT_EQ(count, 2u);
+}
+
+TEST_F(KnowledgeBaseTest, UpsertIsAtomicForQueries) {
+    kb->addFact("counter", {Term::number("0")});
+    std::atomic<bool> writing{true};
+    std::atomic<int> violations{0};
+    std::thread reader([&] {
+        while (writing.load()) {
+            if (kb->query("counter(?N)").size() != 1) ++violations;
+        }
+    });
+    for (int i = 1; i <= 500; ++i) {
+        kb->upsertFact(Fact("counter", {Term::variable("N")}),
+                       Fact("counter", {Term::number(std::to_string(i))}));
+    }
+    writing = false;
+    reader.join();
+    
+    EXPECT_EQ(violations.load(), 0);
+    auto results = kb->query("counter(?N)");
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].get("N"), "500");
+}
+
+TEST_F(KnowledgeBaseTest, ConcurrentQueriesWhileAdding) {
+    QueryParser parser;
+    parser.setRuleMode(true);
+    kb->addRule(parser.parse("even(X)"), {parser.parse("num(X, 0)")});
+    kb->addRule(parser.parse("pair(X, Y)"), {parser.parse("even(X)"), parser.parse("num(Y, 1)")});
+    
+    // Each query sees a prefix of the facts written so far
+    constexpr int N = 200;
+    std::atomic<bool> writing{true};
+    std::atomic<int> violations{0};
+    auto reader = [&] {
+        size_t last = 0;
+        while (writing.load()) {
+            auto nums = kb->query("num(?X, ?P)");
+            for (size_t i = 0; i < nums.size(); ++i) {
+                if (nums[i].get("X") != std::to_string(i)) ++violations;
+            }
+            if (nums.size() < last) ++violations;
+            last = nums.size();
+            kb->query("pair(?X, ?Y)");
+        }
+    };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back(reader);
+    }
+    for (int i = 0; i < N; ++i) {
+        kb->addFact("num", {Term::number(std::to_string(i)), Term::number(std::to_string(i % 2))});
+        if (i == N / 2) {
+            kb->addRule(parser.parse("odd(X)"), {parser.parse("num(X, 1)")});
+        }
+        if (i % 8 == 0) {
+            std::this_thread::yield();
+        }
+    }
+    writing = false;
+    for (auto& thread : readers) {
+        thread.join();
+    }
+    
+    EXPECT_EQ(violations.load(), 0);
+    EXPECT_EQ(kb->query("num(?X, ?P)").size(), size_t(N));
+    EXPECT_EQ(kb->query("odd(?X)").size(), size_t(N / 2));
+    EXPECT_EQ(kb->query("pair(?X, ?Y)").size(), size_t(N / 2 * N / 2));
+}
+
 // ============================================================================
 // Error Handling Tests
 // ============================================================================
@@ -0,0 +1,117 @@
+#include "core/magic_sets.h"
+#include "core/knowledge_base.h"
+#include "test_util.h"
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+namespace {
+
+class MagicSetsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        parser.setRuleMode(true);
+    }
+
+    void rule(const std::string& head, const std::vector<std::string>& body) {
+        rules.push_back(test::parseRule(head, body));
+        kb.addRule(rules.back());
+    }
+
+    Fact query(const std::string& text) {
+        QueryParser queryParser;
+        return queryParser.parse(text);
+    }
+
+    std::set<std::string> answers(const std::string& text, const std::string& var) {
+        return test::answers(kb, text, var);
+    }
+
+    QueryParser parser;
+    std::vector<Rule> rules;
+    KnowledgeBase kb;
+};
+
+TEST_F(MagicSetsTest, AdornsByBoundArguments) {
+    rule("ancestor(X, Y)", {"parent(X, Y)"});
+    rule("ancestor(X, Z)", {"parent(X, Y)", "ancestor(Y, Z)"});
+
+    auto program = rewriteMagicSets(rules, query("ancestor(john, ?W)"));
+    ASSERT_TRUE(program.has_value());
+    EXPECT_EQ(program->answer, (PredicateKey{"ancestor^bf", 2}));
+
+    std::vector<std::string> text;
+    for (const auto& r : program->rules) {
+        text.push_back(r.toString());
+    }
+    // Seed, and the recursive call passes its bound first argument on
+    EXPECT_THAT(text, ::testing::Contains(::testing::HasSubstr("magic^ancestor^bf(john)")));
+    EXPECT_THAT(text, ::testing::Contains(
+        "magic^ancestor^bf(?Y) :- magic^ancestor^bf(?X), parent(?X, ?Y)."));
+}
+
+TEST_F(MagicSetsTest, NoRewriteWithoutRules) {
+    EXPECT_FALSE(rewriteMagicSets(rules, query("parent(john, ?X)")).has_value());
+}
+
+TEST_F(MagicSetsTest, AnswersMatchTopDown) {
+    for (const char* edge : {"parent(a, b)", "parent(b, c)", "parent(c, d)",
+                             "parent(x, y)", "parent(y, z)", "parent(b, e)"}) {
+        kb.addFact(parser.parse(edge));
+    }
+    rule("ancestor(X, Y)", {"parent(X, Y)"});
+    rule("ancestor(X, Z)", {"parent(X, Y)", "ancestor(Y, Z)"});
+
+    auto expected = answers("ancestor(b, ?W)", "W");
+    kb.setEvaluationMode(EvaluationMode::MAGIC_SETS);
+    EXPECT_EQ(answers("ancestor(b, ?W)", "W"), expected);
+    EXPECT_EQ(answers("ancestor(b, ?W)", "W"), (std::set<std::string>{"c", "d", "e"}));
+    EXPECT_EQ(answers("ancestor(?V, z)", "V"), (std::set<std::string>{"x", "y"}));
+    EXPECT_EQ(kb.query("ancestor(a, d)").size(), 1u);
+    EXPECT_EQ(kb.query("ancestor(d, a)").size(), 0u);
+}
+
+TEST_F(MagicSetsTest, DerivesOnlyRelevantFacts) {
+    // Two disjoint chains: a query on one must not derive the other
+    for (int i = 0; i < 20; ++i) {
+        kb.addFact("edge", {Term::constant("a" + std::to_string(i)),
+                            Term::constant("a" + std::to_string(i + 1))});
+        kb.addFact("edge", {Term::constant("b" + std::to_string(i)),
+                            Term::constant("b" + std::to_string(i + 1))});
+    }
+    rule("path(X, Y)", {"edge(X, Y)"});
+    rule("path(X, Z)", {"path(X, Y)", "edge(Y, Z)"});
+
+    auto program = rewriteMagicSets(rules, query("path(a15, ?Y)"));
+    ASSERT_TRUE(program.has_value());
+    BottomUpEvaluator::Clauses clauses;
+    for (const auto& r : program->rules) {
+        clauses.push_back(std::make_shared<const CompiledClause>(CompiledClause::compile(r)));
+    }
+    BottomUpEvaluator::Relations facts;
+    auto edges = kb.getFactTable("edge", 2);
+    facts.emplace(PredicateKey{"edge", 2}, *edges);
+    auto derived = BottomUpEvaluator(clauses, facts).run();
+
+    // path(a15, a16) ... path(a15, a20)
+    EXPECT_EQ(derived.at(program->answer).size(), 5u);
+
+    kb.setEvaluationMode(EvaluationMode::MAGIC_SETS);
+    EXPECT_EQ(kb.query("path(a15, ?Y)").size(), 5u);
+}
+
+TEST_F(MagicSetsTest, NonDatalogQueriesFallBackToTopDown) {
+    kb.addFact(parser.parse("item(a)"));
+    rule("wrapped(box(X))", {"item(X)"});
+    kb.setEvaluationMode(EvaluationMode::MAGIC_SETS);
+
+    auto results = kb.query("wrapped(?W)");
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].getTerm("W")->toString(), "box(a)");
+}
+
+} // namespace
+} // namespace kbgdb
@@ -0,0 +1,133 @@
+#include "core/knowledge_base.h"
+#include "query/query_parser.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+namespace {
+
+class PreparedQueryTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        QueryParser parser;
+        parser.setRuleMode(true);
+        for (const char* fact : {"parent(john, mary)", "parent(john, tom)", "parent(mary, ann)",
+                                 "parent(tom, bob)", "parent(ann, sue)", "age(ann, 30)",
+                                 "age(bob, 25)", "age(sue, 4)"}) {
+            kb.addFact(parser.parse(fact));
+        }
+        kb.addRule(parser.parse("ancestor(X, Y)"), {parser.parse("parent(X, Y)")});
+        kb.addRule(parser.parse("ancestor(X, Z)"),
+                   {parser.parse("parent(X, Y)"), parser.parse("ancestor(Y, Z)")});
+    }
+
+    // Solutions as sorted strings, to compare regardless of order
+    static std::vector<std::string> sorted(const std::vector<BindingSet>& solutions) {
+        std::vector<std::string> result;
+        for (const auto& solution : solutions) {
+            std::vector<std::string> bindings;
+            for (const auto& [var, value] : solution.bindings) {
+                bindings.push_back(var.str() + "=" + value.toString());
+            }
+            std::sort(bindings.begin(), bindings.end());
+            std::string line;
+            for (const auto& binding : bindings) {
+                line += binding + " ";
+            }
+            result.push_back(line);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    KnowledgeBase kb;
+};
+
+TEST_F(PreparedQueryTest, RunsWithEachParameterValue) {
+    PreparedQuery children = kb.prepare("parent($who, ?X)");
+    EXPECT_EQ(children.parameters(), std::vector<std::string>{"who"});
+
+    for (const char* who : {"john", "mary", "sue"}) {
+        auto solutions = children.execute({Term::constant(who)});
+        EXPECT_EQ(sorted(solutions), sorted(kb.query("parent(" + std::string(who) + ", ?X)")))
+            << who;
+        for (const auto& solution : solutions) {
+            EXPECT_EQ(solution.bindings.size(), 1u);   // No parameter
+        }
+    }
+}
+
+TEST_F(PreparedQueryTest, ConjunctionsMatchQueriesWithTheValues) {
+    PreparedQuery ages = kb.prepare("ancestor($who, ?D), age(?D, ?A), parent($who, ?C)");
+    EXPECT_EQ(ages.parameters(), std::vector<std::string>{"who"});
+
+    for (const char* who : {"john", "mary", "tom", "sue"}) {
+        std::string w = who;
+        auto expected = kb.query("ancestor(" + w + ", ?D), age(?D, ?A), parent(" + w + ", ?C)");
+        EXPECT_EQ(sorted(ages.execute({Term::constant(who)})), sorted(expected)) << who;
+    }
+
+    // Likewise in parallel, and in the order written
+    kb.setParallelism(3);
+    EXPECT_EQ(sorted(ages.execute({Term::constant("john")})),
+              sorted(kb.query("ancestor(john, ?D), age(?D, ?A), parent(john, ?C)")));
+    kb.setParallelism(1);
+    kb.setJoinPlanning(false);
+    EXPECT_EQ(sorted(ages.execute({Term::constant("john")})),
+              sorted(kb.query("ancestor(john, ?D), age(?D, ?A), parent(john, ?C)")));
+}
+
+TEST_F(PreparedQueryTest, SeveralParameters) {
+    PreparedQuery related = kb.prepare("ancestor($a, ?X), ancestor(?X, $b)");
+    EXPECT_EQ(related.parameters(), (std::vector<std::string>{"a", "b"}));
+
+    auto between = related.execute({Term::constant("john"), Term::constant("sue")});
+    EXPECT_EQ(sorted(between), (std::vector<std::string>{"X=ann ", "X=mary "}));
+    EXPECT_TRUE(related.execute({Term::constant("sue"), Term::constant("john")}).empty());
+}
+
+TEST_F(PreparedQueryTest, ReadsTheCurrentStateEachTime) {
+    PreparedQuery descendants = kb.prepare("ancestor($who, ?X)");
+    EXPECT_EQ(descendants.execute({Term::constant("sue")}).size(), 0u);
+
+    kb.addFact("parent", {Term::constant("sue"), Term::constant("liz")});
+    EXPECT_EQ(descendants.execute({Term::constant("sue")}).size(), 1u);
+    EXPECT_EQ(descendants.execute({Term::constant("john")}).size(), 6u);
+
+    kb.retractFact(Fact("parent", {Term::constant("john"), Term::constant("tom")}));
+    EXPECT_EQ(descendants.execute({Term::constant("john")}).size(), 4u);
+}
+
+TEST_F(PreparedQueryTest, EvaluationModes) {
+    PreparedQuery descendants = kb.prepare("ancestor($who, ?X)");
+    auto expected = sorted(descendants.execute({Term::constant("mary")}));
+    ASSERT_EQ(expected.size(), 2u);
+
+    kb.setEvaluationMode(EvaluationMode::BOTTOM_UP);
+    EXPECT_EQ(sorted(descendants.execute({Term::constant("mary")})), expected);
+    kb.setEvaluationMode(EvaluationMode::MAGIC_SETS);
+    EXPECT_EQ(sorted(descendants.execute({Term::constant("mary")})), expected);
+
+    auto solutions = descendants.cursor({Term::constant("mary")});
+    size_t count = 0;
+    while (solutions.next()) ++count;
+    EXPECT_EQ(count, 2u);
+}
+
+TEST_F(PreparedQueryTest, RequiresOneValuePerParameter) {
+    PreparedQuery children = kb.prepare("parent($who, ?X)");
+    EXPECT_THROW(children.execute({}), std::invalid_argument);
+    EXPECT_THROW(children.cursor({Term::constant("a"), Term::constant("b")}),
+                 std::invalid_argument);
+
+    // Without parameters it is an ordinary query
+    PreparedQuery all = kb.prepare("parent(?X, ?Y)");
+    EXPECT_TRUE(all.parameters().empty());
+    EXPECT_EQ(all.execute({}).size(), 5u);
+    EXPECT_THROW(kb.prepare("parent(?X,"), std::runtime_error);
+}
+
+} // namespace
+} // namespace kbgdb
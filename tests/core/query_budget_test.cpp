@@ -0,0 +1,256 @@
+#include "core/knowledge_base.h"
+#include "core/query_budget.h"
+#include "query/query_parser.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace kbgdb {
+namespace {
+
+class QueryBudgetTest : public ::testing::Test {
+protected:
+    // edge(n0, n1), ..., edge(n<length-1>, n<length>), and path over it:
+    // path(?X, ?Y) has length * (length + 1) / 2 solutions
+    void addChain(int length) {
+        for (int i = 0; i < length; ++i) {
+            kb.addFact("edge", {Term::constant("n" + std::to_string(i)),
+                                Term::constant("n" + std::to_string(i + 1))});
+        }
+        QueryParser parser;
+        parser.setRuleMode(true);
+        kb.addRule(parser.parse("path(X, Y)"), {parser.parse("edge(X, Y)")});
+        kb.addRule(parser.parse("path(X, Z)"),
+                   {parser.parse("edge(X, Y)"), parser.parse("path(Y, Z)")});
+    }
+
+    // r(X, Z) :- a(X, Y), b(Y, Z) over a(x<i>, k) and b(k, y<i>), i < n:
+    // n * n solutions, from one batch join
+    void addProduct(int n) {
+        for (int i = 0; i < n; ++i) {
+            kb.addFact("a", {Term::constant("x" + std::to_string(i)), Term::constant("k")});
+            kb.addFact("b", {Term::constant("k"), Term::constant("y" + std::to_string(i))});
+        }
+        QueryParser parser;
+        parser.setRuleMode(true);
+        kb.addRule(parser.parse("r(X, Z)"), {parser.parse("a(X, Y)"), parser.parse("b(Y, Z)")});
+    }
+
+    // tri(X, Y, Z) over the links of a complete graph on n nodes:
+    // n * (n - 1) * (n - 2) solutions, from one multiway join
+    void addClique(int n) {
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                if (i == j) continue;
+                kb.addFact("link", {Term::constant("v" + std::to_string(i)),
+                                    Term::constant("v" + std::to_string(j))});
+            }
+        }
+        QueryParser parser;
+        parser.setRuleMode(true);
+        kb.addRule(parser.parse("tri(X, Y, Z)"), {parser.parse("link(X, Y)"),
+                                                  parser.parse("link(Y, Z)"),
+                                                  parser.parse("link(Z, X)")});
+    }
+
+    static Fact goal(const std::string& text) {
+        QueryParser parser;
+        return parser.parse(text);
+    }
+
+    static std::shared_ptr<QueryBudget> budget(const QueryLimits& limits) {
+        return std::make_shared<QueryBudget>(limits);
+    }
+
+    KnowledgeBase kb;
+};
+
+TEST_F(QueryBudgetTest, UnlimitedBudgetChangesNothing) {
+    addChain(20);
+    auto unlimited = budget({});
+    EXPECT_EQ(kb.query({goal("path(?X, ?Y)")}, unlimited).size(), 210u);
+    EXPECT_EQ(unlimited->reason(), QueryStop::NONE);
+    EXPECT_GT(unlimited->steps(), 0u);
+    EXPECT_EQ(unlimited->memory(), 0u);     // Released as the query ends
+}
+
+TEST_F(QueryBudgetTest, StepLimitStopsWithPartialResults) {
+    addChain(300);
+    QueryLimits limits;
+    limits.maxSteps = 5000;
+    auto limited = budget(limits);
+    auto solutions = kb.query({goal("path(?X, ?Y)")}, limited);
+
+    EXPECT_EQ(limited->reason(), QueryStop::STEPS);
+    EXPECT_GT(solutions.size(), 0u);
+    EXPECT_LT(solutions.size(), 300u * 301 / 2);
+    EXPECT_LE(limited->steps(), limits.maxSteps + QueryBudget::CHECK_STEPS);
+    EXPECT_NE(limited->message().find("5000 inference steps"), std::string::npos);
+}
+
+TEST_F(QueryBudgetTest, DeadlineStopsLongQuery) {
+    addChain(2000);
+    QueryLimits limits;
+    limits.timeout = std::chrono::milliseconds(20);
+    auto limited = budget(limits);
+
+    auto start = std::chrono::steady_clock::now();
+    kb.query({goal("path(?X, ?Y)")}, limited);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(limited->reason(), QueryStop::DEADLINE);
+    EXPECT_LT(elapsed, std::chrono::seconds(5));
+}
+
+TEST_F(QueryBudgetTest, MemoryLimitStopsDeepDerivation) {
+    addChain(5000);
+    QueryLimits limits;
+    limits.maxMemory = 256 * 1024;
+    auto limited = budget(limits);
+
+    // Proving the far end keeps one frame per edge on the stack
+    EXPECT_TRUE(kb.query({goal("path(n0, n5000)")}, limited).empty());
+    EXPECT_EQ(limited->reason(), QueryStop::MEMORY);
+    EXPECT_EQ(limited->memory(), 0u);
+}
+
+TEST_F(QueryBudgetTest, ResultLimit) {
+    addChain(30);
+    QueryLimits limits;
+    limits.maxResults = 7;
+    auto limited = budget(limits);
+    EXPECT_EQ(kb.query({goal("path(?X, ?Y)")}, limited).size(), 7u);
+    EXPECT_EQ(limited->reason(), QueryStop::RESULTS);
+
+    kb.setParallelism(3);
+    auto parallel = budget(limits);
+    auto solutions = kb.query({goal("path(?X, ?Y)")}, parallel);
+    EXPECT_EQ(solutions.size(), 7u);
+    EXPECT_EQ(parallel->reason(), QueryStop::RESULTS);
+}
+
+TEST_F(QueryBudgetTest, ParallelPartsShareTheBudget) {
+    addChain(300);
+    kb.setParallelism(3);
+    QueryLimits limits;
+    limits.maxSteps = 5000;
+    auto limited = budget(limits);
+    auto solutions = kb.query({goal("path(?X, ?Y)")}, limited);
+
+    EXPECT_EQ(limited->reason(), QueryStop::STEPS);
+    EXPECT_LT(solutions.size(), 300u * 301 / 2);
+    // Each of the parts charges at most one check's steps past the limit
+    EXPECT_LE(limited->steps(), limits.maxSteps + kb.parallelism() * 4 * QueryBudget::CHECK_STEPS);
+}
+
+TEST_F(QueryBudgetTest, CancelFromAnotherThread) {
+    addChain(2000);
+    auto query = budget({});
+    std::thread canceller([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        query->cancel();
+    });
+    auto cursor = kb.cursor({goal("path(?X, ?Y)")}, query);
+    size_t count = 0;
+    while (cursor.next()) ++count;
+    canceller.join();
+
+    EXPECT_EQ(query->reason(), QueryStop::CANCELLED);
+    EXPECT_LT(count, 2000u * 2001 / 2);
+    EXPECT_TRUE(cursor.done());
+}
+
+TEST_F(QueryBudgetTest, JoinsCountTheirSteps) {
+    addProduct(1000);
+    addClique(100);
+    QueryLimits limits;
+    limits.maxSteps = 5000;
+    for (const char* query : {"r(?X, ?Z)", "tri(?X, ?Y, ?Z)"}) {
+        auto limited = budget(limits);
+        EXPECT_LT(kb.query({goal(query)}, limited).size(), 5000u) << query;
+        EXPECT_EQ(limited->reason(), QueryStop::STEPS) << query;
+        EXPECT_LE(limited->steps(), limits.maxSteps + QueryBudget::CHECK_STEPS) << query;
+    }
+}
+
+TEST_F(QueryBudgetTest, MemoryLimitCoversJoinResults) {
+    addProduct(1000);
+    QueryLimits limits;
+    limits.maxMemory = 1024 * 1024;
+    auto limited = budget(limits);
+
+    // The batch of a million rows is held while its rows are returned
+    EXPECT_LT(kb.query({goal("r(?X, ?Z)")}, limited).size(), 1000u * 1000);
+    EXPECT_EQ(limited->reason(), QueryStop::MEMORY);
+    EXPECT_EQ(limited->memory(), 0u);
+}
+
+TEST_F(QueryBudgetTest, DeadlineAndCancelStopJoins) {
+    addProduct(3000);
+    addClique(300);
+    for (const char* query : {"r(?X, ?Z)", "tri(?X, ?Y, ?Z)"}) {
+        QueryLimits limits;
+        limits.timeout = std::chrono::milliseconds(20);
+        auto limited = budget(limits);
+        auto start = std::chrono::steady_clock::now();
+        kb.query({goal(query)}, limited);
+        EXPECT_EQ(limited->reason(), QueryStop::DEADLINE) << query;
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2)) << query;
+
+        auto cancelled = budget({});
+        std::thread canceller([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            cancelled->cancel();
+        });
+        start = std::chrono::steady_clock::now();
+        auto cursor = kb.cursor({goal(query)}, cancelled);
+        while (cursor.next()) {}
+        canceller.join();
+        EXPECT_EQ(cancelled->reason(), QueryStop::CANCELLED) << query;
+        EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2)) << query;
+    }
+}
+
+TEST_F(QueryBudgetTest, TabledAndMagicSetsEvaluation) {
+    addChain(400);
+    kb.tablePredicate("path", 2);
+    QueryLimits limits;
+    limits.maxSteps = 5000;
+    auto tabled = budget(limits);
+    kb.query({goal("path(?X, ?Y)")}, tabled);
+    EXPECT_EQ(tabled->reason(), QueryStop::STEPS);
+
+    // The rewritten program is derived within the budget too
+    KnowledgeBase magic;
+    QueryParser parser;
+    parser.setRuleMode(true);
+    for (int i = 0; i < 400; ++i) {
+        magic.addFact("edge", {Term::constant("n" + std::to_string(i)),
+                               Term::constant("n" + std::to_string(i + 1))});
+    }
+    magic.addRule(parser.parse("path(X, Y)"), {parser.parse("edge(X, Y)")});
+    magic.addRule(parser.parse("path(X, Z)"),
+                  {parser.parse("path(X, Y)"), parser.parse("edge(Y, Z)")});
+    magic.setEvaluationMode(EvaluationMode::MAGIC_SETS);
+    EXPECT_EQ(magic.query({goal("path(n0, ?Y)")}).size(), 400u);
+
+    auto derived = budget(limits);
+    EXPECT_LT(magic.query({goal("path(n0, ?Y)")}, derived).size(), 400u);
+    EXPECT_EQ(derived->reason(), QueryStop::STEPS);
+}
+
+TEST(QueryBudget, FirstReasonIsKept) {
+    QueryBudget budget;
+    EXPECT_TRUE(budget.charge(1000000, 1 << 30));   // No limits
+    budget.stop(QueryStop::DEADLINE);
+    budget.cancel();
+    EXPECT_TRUE(budget.stopped());
+    EXPECT_EQ(budget.reason(), QueryStop::DEADLINE);
+    EXPECT_FALSE(budget.charge(1));
+    EXPECT_STREQ(toString(budget.reason()), "deadline");
+}
+
+} // namespace
+} // namespace kbgdb
@@ -0,0 +1,76 @@
+#include "core/rule_index.h"
+#include "query/query_parser.h"
+#include <gtest/gtest.h>
+
+namespace kbgdb {
+namespace {
+
+class RuleIndexTest : public ::testing::Test {
+protected:
+    void addRule(const std::string& head, const std::string& body) {
+        QueryParser parser;
+        parser.setRuleMode(true);
+        index.add(Rule(parser.parse(head), {parser.parse(body)}), nextId++);
+    }
+    
+    std::vector<size_t> ids(const RowSet& rows) {
+        std::vector<size_t> result;
+        rows.forEach([&](size_t id) {
+            result.push_back(id);
+            return true;
+        });
+        return result;
+    }
+    
+    RuleIndex index;
+    uint32_t nextId = 0;
+};
+
+TEST_F(RuleIndexTest, SelectsByPredicateAndArity) {
+    addRule("ancestor(X, Y)", "parent(X, Y)");
+    addRule("sibling(X, Y)", "parent(Z, X)");
+    addRule("ancestor(X, Z)", "parent(X, Y)");
+    addRule("ancestor(X)", "person(X)");
+    
+    EXPECT_EQ(ids(index.candidates("ancestor", 2, Cell::ref(0))),
+              (std::vector<size_t>{0, 2}));
+    EXPECT_EQ(ids(index.candidates("ancestor", 1, Cell::ref(0))),
+              (std::vector<size_t>{3}));
+    EXPECT_TRUE(ids(index.candidates("unknown", 2, Cell::ref(0))).empty());
+}
+
+TEST_F(RuleIndexTest, SplitsByFirstHeadArgument) {
+    addRule("len([], Z)", "zero(Z)");
+    addRule("len([H|T], N)", "len(T, N)");
+    addRule("len(X, N)", "other(X, N)");
+    addRule("color(red, X)", "warm(X)");
+    addRule("color(blue, X)", "cold(X)");
+    
+    EXPECT_EQ(ids(index.candidates("len", 2, Cell::nil())),
+              (std::vector<size_t>{0, 2}));
+    
+    Cell cons[2] = {Cell::atom("a"), Cell::nil()};
+    EXPECT_EQ(ids(index.candidates("len", 2, Cell::list(cons))),
+              (std::vector<size_t>{1, 2}));
+    
+    EXPECT_EQ(ids(index.candidates("color", 2, Cell::atom("blue"))),
+              (std::vector<size_t>{4}));
+    EXPECT_TRUE(ids(index.candidates("color", 2, Cell::atom("green"))).empty());
+    EXPECT_EQ(ids(index.candidates("color", 2, Cell::ref(3))),
+              (std::vector<size_t>{3, 4}));
+}
+
+TEST_F(RuleIndexTest, RulesFor) {
+    addRule("p(X)", "q(X)");
+    addRule("p(a)", "r(a)");
+    
+    const auto* rules = index.rulesFor(PredicateKey{"p", 1});
+    ASSERT_NE(rules, nullptr);
+    ASSERT_EQ(rules->size(), 2u);
+    EXPECT_EQ((*rules)[0], 0u);
+    EXPECT_EQ((*rules)[1], 1u);
+    EXPECT_EQ(index.rulesFor(PredicateKey{"q", 1}), nullptr);
+}
+
+} // namespace
+} // namespace kbgdb
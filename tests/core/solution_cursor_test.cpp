@@ -0,0 +1,179 @@
+#include "core/knowledge_base.h"
+#include "query/query_parser.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+namespace {
+
+class SolutionCursorTest : public ::testing::Test {
+protected:
+    void addRule(const std::string& head, const std::vector<std::string>& body) {
+        QueryParser parser;
+        parser.setRuleMode(true);
+        std::vector<Fact> goals;
+        for (const auto& goal : body) {
+            goals.push_back(parser.parse(goal));
+        }
+        kb.addRule(parser.parse(head), goals);
+    }
+
+    // edge(n0, n1), ..., edge(n<length-1>, n<length>) and the usual closure
+    void addChain(int length) {
+        for (int i = 0; i < length; ++i) {
+            kb.addFact("edge", {Term::constant("n" + std::to_string(i)),
+                                Term::constant("n" + std::to_string(i + 1))});
+        }
+        addRule("path(X, Y)", {"edge(X, Y)"});
+        addRule("path(X, Z)", {"edge(X, Y)", "path(Y, Z)"});
+    }
+
+    KnowledgeBase kb;
+};
+
+TEST_F(SolutionCursorTest, YieldsSameSolutionsAsQuery) {
+    addChain(6);
+
+    auto expected = kb.query("path(?X, ?Y)");
+    ASSERT_EQ(expected.size(), 21u);
+
+    SolutionCursor cursor = kb.cursor("path(?X, ?Y)");
+    std::vector<BindingSet> actual;
+    while (auto solution = cursor.next()) {
+        actual.push_back(*solution);
+    }
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+        EXPECT_EQ(actual[i].toString(), expected[i].toString());
+    }
+    EXPECT_TRUE(cursor.done());
+    EXPECT_FALSE(cursor.next().has_value());
+}
+
+TEST_F(SolutionCursorTest, StopsAtLimit) {
+    addChain(2000);
+
+    SolutionCursor cursor = kb.cursor("path(n0, ?Y)");
+    cursor.setLimit(3);
+
+    std::vector<std::string> ys;
+    while (auto solution = cursor.next()) {
+        ys.push_back(solution->get("Y"));
+    }
+    EXPECT_EQ(ys, (std::vector<std::string>{"n1", "n2", "n3"}));
+    EXPECT_EQ(cursor.count(), 3u);
+    EXPECT_TRUE(cursor.done());
+}
+
+TEST_F(SolutionCursorTest, CancelEndsTheSearch) {
+    addChain(100);
+
+    SolutionCursor cursor = kb.cursor("path(?X, ?Y)");
+    ASSERT_TRUE(cursor.next().has_value());
+    cursor.cancel();
+    EXPECT_TRUE(cursor.done());
+    EXPECT_FALSE(cursor.next().has_value());
+}
+
+TEST_F(SolutionCursorTest, GroundQueryYieldsEmptyBinding) {
+    addChain(3);
+
+    SolutionCursor yes = kb.cursor("path(n0, n3)");
+    auto solution = yes.next();
+    ASSERT_TRUE(solution.has_value());
+    EXPECT_TRUE(solution->bindings.empty());
+
+    SolutionCursor no = kb.cursor("path(n3, n0)");
+    EXPECT_FALSE(no.next().has_value());
+}
+
+TEST_F(SolutionCursorTest, DeepRecursionDoesNotUseTheCallStack) {
+    addChain(20000);
+
+    SolutionCursor cursor = kb.cursor("path(n0, n20000)");
+    EXPECT_TRUE(cursor.next().has_value());
+}
+
+TEST_F(SolutionCursorTest, CursorsAreIndependent) {
+    addChain(4);
+
+    SolutionCursor a = kb.cursor("path(n0, ?Y)");
+    SolutionCursor b = kb.cursor("path(n2, ?Y)");
+    EXPECT_EQ(a.next()->get("Y"), "n1");
+    EXPECT_EQ(b.next()->get("Y"), "n3");
+    EXPECT_EQ(a.next()->get("Y"), "n2");
+    EXPECT_EQ(b.next()->get("Y"), "n4");
+    EXPECT_FALSE(b.next().has_value());
+    EXPECT_EQ(a.next()->get("Y"), "n3");
+
+    // Moving a cursor keeps its position
+    SolutionCursor moved = std::move(a);
+    EXPECT_EQ(moved.next()->get("Y"), "n4");
+}
+
+TEST_F(SolutionCursorTest, EmptyJoinBodyKeepsOtherChoicePoints) {
+    for (const char* item : {"i1", "i2", "i3", "i4"}) {
+        kb.addFact("item", {Term::constant(item)});
+    }
+    kb.addFact("link", {Term::constant("i2"), Term::constant("m")});
+    kb.addFact("link", {Term::constant("i4"), Term::constant("m")});
+    kb.addFact("mark", {Term::constant("m")});
+    kb.addFact("e", {Term::constant("i3"), Term::constant("a")});
+    kb.addFact("e", {Term::constant("a"), Term::constant("b")});
+    kb.addFact("e", {Term::constant("b"), Term::constant("i3")});
+    addRule("linked(X)", {"link(X, Y)", "mark(Y)"});                  // A batch join
+    addRule("closed(X)", {"e(X, Y)", "e(Y, Z)", "e(Z, X)"});          // A multiway join
+
+    // The bodies have no solutions for most items, while item(?X) still
+    // has rows to try
+    auto values = [&](const std::string& query) {
+        std::vector<std::string> xs;
+        for (const auto& solution : kb.query(query)) {
+            xs.push_back(solution.get("X"));
+        }
+        return xs;
+    };
+    EXPECT_EQ(values("item(?X), linked(?X)"), (std::vector<std::string>{"i2", "i4"}));
+    EXPECT_EQ(values("item(?X), closed(?X)"), std::vector<std::string>{"i3"});
+}
+
+TEST_F(SolutionCursorTest, PartitionsTogetherYieldEverySolutionInOrder) {
+    addChain(30);
+    for (int i = 0; i < 100; ++i) {
+        kb.addFact("big", {Term::constant("b" + std::to_string(i % 10)),
+                           Term::constant("c" + std::to_string(i))});
+        kb.addFact("big", {Term::constant("c" + std::to_string(i)),
+                           Term::constant("d" + std::to_string(i % 7))});
+    }
+    addRule("twoBig(X, Z)", {"big(X, Y)", "big(Y, Z)"});        // A batch join
+    addRule("triangle(X, Y, Z)", {"edge(X, Y)", "edge(Y, Z)", "edge(Z, X)"});
+    
+    auto drain = [](SolutionCursor cursor, std::vector<std::string>& out) {
+        while (auto solution = cursor.next()) {
+            out.push_back(solution->toString());
+        }
+    };
+    for (const char* query : {"path(?X, ?Y)", "path(n3, n9)", "twoBig(?X, ?Z)",
+                              "edge(?X, ?Y), path(?Y, n7)", "triangle(?X, ?Y, ?Z)"}) {
+        std::vector<std::string> expected;
+        drain(kb.cursor(query), expected);
+        for (size_t parts : {2, 3, 64}) {
+            std::vector<std::string> actual;
+            for (size_t part = 0; part < parts; ++part) {
+                SolutionCursor cursor = kb.cursor(query);
+                cursor.setPartition(part, parts);
+                drain(std::move(cursor), actual);
+            }
+            EXPECT_EQ(actual, expected) << query << " in " << parts << " parts";
+        }
+    }
+    
+    SolutionCursor started = kb.cursor("path(?X, ?Y)");
+    started.next();
+    EXPECT_THROW(started.setPartition(0, 2), std::runtime_error);
+    EXPECT_THROW(kb.cursor("path(?X, ?Y)").setPartition(2, 2), std::invalid_argument);
+}
+
+} // namespace
+} // namespace kbgdb
@@ -0,0 +1,40 @@
+#pragma once
+#include "core/knowledge_base.h"
+#include "core/rule.h"
+#include "query/query_parser.h"
+#include <set>
+#include <string>
+#include <vector>
+
+namespace kbgdb {
+namespace test {
+
+// Goals in rule syntax (plain capitalized variables)
+inline std::vector<Fact> parseGoals(const std::vector<std::string>& texts) {
+    QueryParser parser;
+    parser.setRuleMode(true);
+    std::vector<Fact> goals;
+    goals.reserve(texts.size());
+    for (const auto& text : texts) {
+        goals.push_back(parser.parse(text));
+    }
+    return goals;
+}
+
+inline Rule parseRule(const std::string& head, const std::vector<std::string>& body) {
+    return Rule(parseGoals({head}).front(), parseGoals(body));
+}
+
+// The query's answers as text, or only var's values when it is given;
+// a std::multiset keeps the duplicates
+template <typename Answers = std::set<std::string>>
+Answers answers(KnowledgeBase& kb, const std::string& query, const std::string& var = "") {
+    Answers result;
+    for (const auto& binding : kb.query(query)) {
+        result.insert(var.empty() ? binding.toString() : binding.get(var));
+    }
+    return result;
+}
+
+} // namespace test
+} // namespace kbgdb
@@ -0,0 +1,59 @@
+#include "core/variant_set.h"
+#include <gtest/gtest.h>
+#include <set>
+
+namespace kbgdb {
+namespace {
+
+TEST(VariantSetTest, InsertContainsErase) {
+    VariantSet set;
+    EXPECT_TRUE(set.insert(42));
+    EXPECT_FALSE(set.insert(42));
+    EXPECT_TRUE(set.contains(42));
+    EXPECT_FALSE(set.contains(7));
+    EXPECT_EQ(set.size(), 1u);
+
+    EXPECT_TRUE(set.erase(42));
+    EXPECT_FALSE(set.erase(42));
+    EXPECT_FALSE(set.contains(42));
+    EXPECT_TRUE(set.empty());
+
+    // Zero marks empty slots internally but is still a valid hash
+    EXPECT_TRUE(set.insert(0));
+    EXPECT_TRUE(set.contains(0));
+}
+
+TEST(VariantSetTest, EraseKeepsCollidingEntriesReachable) {
+    // Multiples of 1024 share a home slot and form one probe run
+    VariantSet set(8);
+    for (uint64_t i = 1; i <= 6; ++i) {
+        ASSERT_TRUE(set.insert(i * 1024));
+    }
+    ASSERT_TRUE(set.erase(2 * 1024));
+    ASSERT_TRUE(set.erase(5 * 1024));
+    for (uint64_t i = 1; i <= 6; ++i) {
+        EXPECT_EQ(set.contains(i * 1024), i != 2 && i != 5) << i;
+    }
+}
+
+TEST(VariantSetTest, MatchesStdSetUnderChurn) {
+    VariantSet set(4);
+    std::set<uint64_t> expected;
+    uint64_t x = 12345;
+    for (int i = 0; i < 20000; ++i) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t hash = (x >> 33) % 500;    // Few distinct values, many collisions
+        if (x & 1) {
+            EXPECT_EQ(set.insert(hash), expected.insert(hash).second);
+        } else {
+            EXPECT_EQ(set.erase(hash), expected.erase(hash) > 0);
+        }
+    }
+    EXPECT_EQ(set.size(), expected.size());
+    for (uint64_t hash = 0; hash < 500; ++hash) {
+        EXPECT_EQ(set.contains(hash), expected.count(hash) > 0);
+    }
+}
+
+} // namespace
+} // namespace kbgdb
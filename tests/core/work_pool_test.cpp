@@ -0,0 +1,83 @@
+#include "core/work_pool.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+
+namespace kbgdb {
+namespace {
+
+TEST(WorkPoolTest, RunsEveryTask) {
+    WorkPool pool(3);
+    EXPECT_EQ(pool.size(), 3u);
+    
+    std::vector<int> done(100, 0);
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < done.size(); ++i) {
+        tasks.push_back([&done, i] { done[i] += 1; });
+    }
+    pool.run(std::move(tasks));
+    for (int count : done) {
+        EXPECT_EQ(count, 1);
+    }
+}
+
+TEST(WorkPoolTest, IdleWorkersTakeOverQueuedTasks) {
+    // One long task holds up a worker; the tasks queued behind it are
+    // finished by the others (or the caller) meanwhile
+    WorkPool pool(2);
+    std::atomic<bool> release{false};
+    std::atomic<int> finished{0};
+    std::vector<std::function<void()>> tasks;
+    tasks.push_back([&] {
+        while (!release) std::this_thread::yield();
+    });
+    for (int i = 0; i < 20; ++i) {
+        tasks.push_back([&] {
+            if (++finished == 20) release = true;
+        });
+    }
+    pool.run(std::move(tasks));
+    EXPECT_EQ(finished, 20);
+}
+
+TEST(WorkPoolTest, RethrowsAfterTheOtherTasks) {
+    WorkPool pool(2);
+    std::atomic<int> finished{0};
+    std::vector<std::function<void()>> tasks;
+    for (int i = 0; i < 10; ++i) {
+        tasks.push_back([&, i] {
+            if (i == 3) throw std::runtime_error("task failed");
+            ++finished;
+        });
+    }
+    EXPECT_THROW(pool.run(std::move(tasks)), std::runtime_error);
+    EXPECT_EQ(finished, 9);
+}
+
+TEST(WorkPoolTest, ConcurrentCallers) {
+    WorkPool pool(2);
+    std::atomic<int> total{0};
+    auto batch = [&] {
+        std::vector<std::function<void()>> tasks;
+        for (int i = 0; i < 50; ++i) {
+            tasks.push_back([&] { ++total; });
+        }
+        pool.run(std::move(tasks));
+    };
+    std::thread a(batch);
+    std::thread b(batch);
+    a.join();
+    b.join();
+    EXPECT_EQ(total, 100);
+}
+
+TEST(WorkPoolTest, NoWorkersRunsOnTheCaller) {
+    WorkPool pool(0);
+    int count = 0;
+    pool.run({[&] { ++count; }, [&] { ++count; }});
+    EXPECT_EQ(count, 2);
+}
+
+} // namespace
+} // namespace kbgdb
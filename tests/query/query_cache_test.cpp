@@ -0,0 +1,150 @@
+#include "query/query_engine.h"
+#include "query/query_parser.h"
+#include <gtest/gtest.h>
+#include <memory>
+
+namespace kbgdb {
+namespace {
+
+class QueryCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        kb = std::make_shared<KnowledgeBase>();
+        QueryParser parser;
+        parser.setRuleMode(true);
+        kb->addFact(parser.parse("parent(john, mary)"));
+        kb->addFact(parser.parse("parent(mary, ann)"));
+        kb->addFact(parser.parse("age(ann, 3)"));
+        kb->addRule(parser.parse("grandparent(X, Z)"),
+                    {parser.parse("parent(X, Y)"), parser.parse("parent(Y, Z)")});
+        engine = std::make_unique<QueryEngine>(kb);
+    }
+
+    std::shared_ptr<KnowledgeBase> kb;
+    std::unique_ptr<QueryEngine> engine;
+};
+
+TEST_F(QueryCacheTest, RepeatedQueryIsAnsweredFromCache) {
+    auto first = engine->execute("grandparent(john, ?X)");
+    ASSERT_TRUE(first.success);
+    ASSERT_EQ(first.bindings.size(), 1u);
+    EXPECT_EQ(engine->cache().misses(), 1u);
+
+    // However it is spaced
+    auto second = engine->execute("grandparent( john,?X )");
+    EXPECT_EQ(engine->cache().hits(), 1u);
+    ASSERT_EQ(second.bindings.size(), 1u);
+    EXPECT_EQ(second.bindings[0].get("X"), "ann");
+
+    // A different limit is a different query
+    engine->execute("grandparent(john, ?X)", 1);
+    EXPECT_EQ(engine->cache().misses(), 2u);
+}
+
+TEST_F(QueryCacheTest, VariablesAreNamedByTheCaller) {
+    engine->execute("parent(?X, ?Y), parent(?Y, ann)");
+
+    // Bound to the caller's names whatever the cached query called them
+    auto renamed = engine->execute("parent(?A, ?Parent), parent(?Parent, ann)");
+    EXPECT_EQ(engine->cache().hits(), 1u);
+    ASSERT_EQ(renamed.bindings.size(), 1u);
+    EXPECT_EQ(renamed.bindings[0].get("A"), "john");
+    EXPECT_EQ(renamed.bindings[0].get("Parent"), "mary");
+    EXPECT_FALSE(renamed.bindings[0].getTerm(Symbol("X")).has_value());
+
+    // Only the same variables in the same places
+    engine->execute("parent(?X, ?Y), parent(?X, ann)");
+    EXPECT_EQ(engine->cache().hits(), 1u);
+}
+
+TEST_F(QueryCacheTest, UnboundValuesAreNamedByTheCaller) {
+    QueryParser parser;
+    parser.setRuleMode(true);
+    kb->addFact(parser.parse("same(X, X)"));
+    EXPECT_EQ(engine->execute("same(?X, ?Y)").bindings[0].getTerm(Symbol("Y")),
+              Term::variable("X"));
+
+    // Left unbound, the value is the caller's variable too
+    auto renamed = engine->execute("same(?A, ?B)");
+    EXPECT_EQ(engine->cache().hits(), 1u);
+    ASSERT_EQ(renamed.bindings.size(), 1u);
+    EXPECT_EQ(renamed.bindings[0].getTerm(Symbol("B")), Term::variable("A"));
+}
+
+TEST_F(QueryCacheTest, ChangesInvalidateOnlyDependentEntries) {
+    engine->execute("grandparent(john, ?X)");
+    engine->execute("age(?P, ?A)");
+
+    // age is not read by grandparent
+    kb->addFact("age", {Term::constant("mary"), Term::number("30")});
+    engine->execute("grandparent(john, ?X)");
+    EXPECT_EQ(engine->cache().hits(), 1u);
+    EXPECT_EQ(engine->execute("age(?P, ?A)").bindings.size(), 2u);
+    EXPECT_EQ(engine->cache().hits(), 1u);
+
+    // parent is, through grandparent's rule
+    kb->addFact("parent", {Term::constant("mary"), Term::constant("bob")});
+    EXPECT_EQ(engine->execute("grandparent(john, ?X)").bindings.size(), 2u);
+    EXPECT_EQ(engine->cache().hits(), 1u);
+
+    kb->retractFact(Fact("parent", {Term::constant("mary"), Term::constant("ann")}));
+    EXPECT_EQ(engine->execute("grandparent(john, ?X)").bindings.size(), 1u);
+    EXPECT_EQ(engine->cache().hits(), 1u);
+}
+
+TEST_F(QueryCacheTest, AddedRulesInvalidateAndExtendDependencies) {
+    QueryParser parser;
+    parser.setRuleMode(true);
+    EXPECT_EQ(engine->execute("grandparent(?X, ?Y)").bindings.size(), 1u);
+
+    // A new rule for grandparent, reading a predicate it did not before
+    kb->addRule(parser.parse("grandparent(X, Y)"), {parser.parse("adopted(X, Y)")});
+    EXPECT_EQ(engine->execute("grandparent(?X, ?Y)").bindings.size(), 1u);
+    kb->addFact(parser.parse("adopted(john, tim)"));
+    EXPECT_EQ(engine->execute("grandparent(?X, ?Y)").bindings.size(), 2u);
+    EXPECT_EQ(engine->cache().hits(), 0u);
+}
+
+TEST_F(QueryCacheTest, EvictsLeastRecentlyUsed) {
+    QueryEngine small(kb, 2);
+    small.execute("parent(john, ?X)");
+    small.execute("parent(mary, ?X)");
+    small.execute("parent(john, ?X)");      // Now most recent
+    small.execute("age(?P, ?A)");           // Evicts parent(mary, ?X)
+    EXPECT_EQ(small.cache().size(), 2u);
+    EXPECT_EQ(small.cache().hits(), 1u);
+
+    small.execute("parent(john, ?X)");
+    EXPECT_EQ(small.cache().hits(), 2u);
+    small.execute("parent(mary, ?X)");
+    EXPECT_EQ(small.cache().hits(), 2u);
+}
+
+TEST_F(QueryCacheTest, FailuresAreNotCached) {
+    EXPECT_FALSE(engine->execute("broken(").success);
+    EXPECT_EQ(engine->cache().size(), 0u);
+
+    QueryEngine uncached(kb, 0);
+    uncached.execute("parent(john, ?X)");
+    EXPECT_EQ(uncached.cache().size(), 0u);
+}
+
+TEST(QueryCacheDependencies, FollowRulesTransitively) {
+    KnowledgeBase kb;
+    QueryParser parser;
+    parser.setRuleMode(true);
+    kb.addRule(parser.parse("a(X)"), {parser.parse("b(X)"), parser.parse("c(X)")});
+    kb.addRule(parser.parse("b(X)"), {parser.parse("d(X)")});
+    kb.addRule(parser.parse("b(X)"), {parser.parse("a(X)")});
+    kb.addRule(parser.parse("e(X)"), {parser.parse("f(X)")});
+
+    auto dependencies = QueryCache::dependencies({parser.parse("a(X)")}, kb.snapshot()->rules());
+    std::vector<std::string> names;
+    for (const auto& key : dependencies) {
+        names.push_back(key.name.str());
+    }
+    EXPECT_EQ(names, (std::vector<std::string>{"a", "b", "c", "d"}));
+}
+
+} // namespace
+} // namespace kbgdb
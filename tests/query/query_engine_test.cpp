@@ -0,0 +1,141 @@
+#include "query/query_engine.h"
+#include "query/query_parser.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+namespace kbgdb {
+namespace {
+
+class QueryEngineTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        kb = std::make_shared<KnowledgeBase>();
+        for (int i = 0; i < 300; ++i) {
+            kb->addFact("edge", {Term::constant("n" + std::to_string(i)),
+                                 Term::constant("n" + std::to_string(i + 1))});
+        }
+        QueryParser parser;
+        parser.setRuleMode(true);
+        kb->addRule(parser.parse("path(X, Y)"), {parser.parse("edge(X, Y)")});
+        kb->addRule(parser.parse("path(X, Z)"),
+                    {parser.parse("edge(X, Y)"), parser.parse("path(Y, Z)")});
+        engine = std::make_unique<QueryEngine>(kb);
+    }
+
+    std::shared_ptr<KnowledgeBase> kb;
+    std::unique_ptr<QueryEngine> engine;
+};
+
+TEST_F(QueryEngineTest, LimitedQueryReturnsPartialResults) {
+    QueryLimits limits;
+    limits.maxSteps = 5000;
+    auto result = engine->execute("path(?X, ?Y)", limits);
+
+    ASSERT_TRUE(result.success);
+    EXPECT_FALSE(result.complete());
+    EXPECT_EQ(result.stopped, QueryStop::STEPS);
+    EXPECT_GT(result.bindings.size(), 0u);
+    EXPECT_LT(result.bindings.size(), 300u * 301 / 2);
+    EXPECT_NE(result.toJSON().find(R"("complete": false, "stopped": "steps")"), std::string::npos);
+
+    // Not cached: the same query without limits is evaluated in full
+    auto full = engine->execute("path(?X, ?Y)");
+    EXPECT_TRUE(full.complete());
+    EXPECT_EQ(full.bindings.size(), 300u * 301 / 2);
+    EXPECT_EQ(engine->cache().hits(), 0u);
+}
+
+TEST_F(QueryEngineTest, LimitIsAnErrorWithoutPartialResults) {
+    QueryLimits limits;
+    limits.timeout = std::chrono::milliseconds(10);
+    limits.partialResults = false;
+    auto result = engine->execute("path(?X, ?Y), path(?Y, ?Z)", limits);
+
+    EXPECT_FALSE(result.success);
+    EXPECT_TRUE(result.bindings.empty());
+    EXPECT_EQ(result.stopped, QueryStop::DEADLINE);
+    EXPECT_EQ(result.error, "Query exceeded its deadline of 10 ms");
+    EXPECT_NE(result.toJSON().find(R"("stopped": "deadline")"), std::string::npos);
+}
+
+TEST_F(QueryEngineTest, ResultLimitIsNotAnError) {
+    QueryLimits limits;
+    limits.maxResults = 3;
+    limits.partialResults = false;
+    auto result = engine->execute("path(n0, ?Y)", limits);
+    ASSERT_TRUE(result.success);
+    EXPECT_EQ(result.bindings.size(), 3u);
+    EXPECT_EQ(result.stopped, QueryStop::RESULTS);
+
+    // Cached like any limited query
+    EXPECT_EQ(engine->execute("path(n0, ?Y)", 3).stopped, QueryStop::RESULTS);
+    EXPECT_EQ(engine->cache().hits(), 1u);
+    EXPECT_TRUE(engine->execute("edge(n0, ?Y)").complete());
+}
+
+TEST_F(QueryEngineTest, CancelledBudget) {
+    auto budget = std::make_shared<QueryBudget>();
+    budget->cancel();
+    auto result = engine->execute("path(?X, ?Y)", budget);
+    EXPECT_TRUE(result.success);
+    EXPECT_TRUE(result.bindings.empty());
+    EXPECT_EQ(result.stopped, QueryStop::CANCELLED);
+}
+
+TEST_F(QueryEngineTest, EvaluatesInParallel) {
+    auto sequential = engine->execute("path(?X, ?Y), edge(?Y, ?Z)");
+    ASSERT_TRUE(sequential.success);
+
+    kb->setParallelism(3);
+    QueryEngine parallel(kb);
+    auto result = parallel.execute("path(?X, ?Y), edge(?Y, ?Z)");
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(result.bindings.size(), sequential.bindings.size());
+    for (size_t i = 0; i < result.bindings.size(); ++i) {
+        EXPECT_EQ(result.bindings[i].toString(), sequential.bindings[i].toString());
+    }
+
+    auto limited = parallel.execute("path(?X, ?Y)", 10);
+    EXPECT_EQ(limited.bindings.size(), 10u);
+    EXPECT_EQ(limited.stopped, QueryStop::RESULTS);
+}
+
+TEST(QueryEngine, PreparesViewsAndMaterialization) {
+    auto kb = std::make_shared<KnowledgeBase>();
+    QueryParser parser;
+    parser.setRuleMode(true);
+    for (const char* fact : {"edge(a, b)", "edge(b, c)", "edge(c, d)"}) {
+        kb->addFact(parser.parse(fact));
+    }
+    kb->addRule(parser.parse("path(X, Y)"), {parser.parse("edge(X, Y)")});
+    kb->addRule(parser.parse("path(X, Z)"),
+                {parser.parse("edge(X, Y)"), parser.parse("path(Y, Z)")});
+    QueryEngine engine(kb);
+
+    kb->materializePredicate(Symbol("path"), 2);
+    kb->addRule(parser.parse("hop(X, Y)"), {parser.parse("edge(X, Y)")});
+    EXPECT_EQ(kb->getMaterializedTable(Symbol("path"), 2), nullptr);   // Out of date
+    EXPECT_EQ(engine.execute("path(a, ?Y)").bindings.size(), 3u);
+    EXPECT_NE(kb->getMaterializedTable(Symbol("path"), 2), nullptr);
+
+    kb->setEvaluationMode(EvaluationMode::BOTTOM_UP);
+    kb->addFact(parser.parse("edge(d, e)"));
+    EXPECT_EQ(kb->getMaterializedTable(Symbol("hop"), 2), nullptr);
+    EXPECT_EQ(engine.execute("hop(?X, ?Y)").bindings.size(), 4u);
+    EXPECT_NE(kb->getMaterializedTable(Symbol("hop"), 2), nullptr);
+}
+
+TEST_F(QueryEngineTest, AggregateDependsOnItsGoal) {
+    auto count = engine->execute("count(edge(n0, ?Y), ?N)");
+    ASSERT_EQ(count.bindings.size(), 1u);
+    EXPECT_EQ(count.bindings[0].bindings.begin()->second.toString(), "1");
+
+    kb->addFact("edge", {Term::constant("n0"), Term::constant("n2")});
+    count = engine->execute("count(edge(n0, ?Y), ?N)");
+    EXPECT_EQ(count.bindings[0].bindings.begin()->second.toString(), "2");
+    EXPECT_EQ(engine->cache().hits(), 0u);
+}
+
+} // namespace
+} // namespace kbgdb
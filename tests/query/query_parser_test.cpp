@@ -34,6 +34,17 @@ TEST_F(QueryParserTest, QueryWithVariables) {
     EXPECT_EQ(terms[1].value, "mary");
 }
 
+TEST_F(QueryParserTest, QueryWithParameters) {
+    parser.setRuleMode(false);
+    Fact fact = parser.parse("parent($who, ?X)");
+
+    const auto& terms = fact.terms();
+    ASSERT_EQ(terms.size(), 2);
+    EXPECT_EQ(terms[0].type, TermType::VARIABLE);
+    EXPECT_EQ(terms[0].value, "$who");  // Kept apart from ?who
+    EXPECT_EQ(parser.parse("price($)").terms()[0].type, TermType::CONSTANT);
+}
+
 TEST_F(QueryParserTest, RuleWithUppercaseVariables) {
     parser.setRuleMode(true);  // Rule mode: X
     Fact fact = parser.parse("parent(X, mary)");
@@ -99,5 +110,21 @@ TEST_F(QueryParserTest, MultipleVariables) {
     EXPECT_TRUE(terms[2].isVariable());
 }
 
+TEST_F(QueryParserTest, Conjunction) {
+    parser.setRuleMode(false);
+    std::vector<Fact> goals = parser.parseConjunction("parent(?X, ?Y), age(?Y, f(?A, b))");
+    
+    ASSERT_EQ(goals.size(), 2);
+    EXPECT_EQ(goals[0].predicate(), "parent");
+    EXPECT_EQ(goals[1].predicate(), "age");
+    ASSERT_EQ(goals[1].terms().size(), 2);
+    EXPECT_TRUE(goals[1].terms()[1].isCompound());
+    
+    EXPECT_EQ(parser.parseConjunction("parent(?X, ?Y)").size(), 1);
+    EXPECT_THROW(parser.parseConjunction("parent(?X, ?Y),"), std::runtime_error);
+    EXPECT_THROW(parser.parseConjunction("parent(?X, ?Y) age(?Y, ?A)"), std::runtime_error);
+    EXPECT_THROW(parser.parseConjunction(""), std::runtime_error);
+}
+
 } // namespace
 } // namespace kbgdb